@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "utils/Mnist.h"
 #include "utils/OpenCL.h"
@@ -15,43 +19,81 @@ int main()
     std::cout << "!! Running in DEBUG mode !!" << std::endl;
 #endif
 
-    // Initialze OpenCL device and load the kernels.
-    Check(InitOpenCL(), "Failed to initialize OpenCL context");
+    // Training can be spread across multiple devices, see nn/DataParallel.h.
+    const char* num_devices_env = getenv("DEEPLEARN_NUM_DEVICES");
+    size_t num_devices = num_devices_env ? std::max(atoi(num_devices_env), 1) : 1;
 
-    // Load MNIST dataset.
-    CPUTensor train_data, train_labels, test_data, test_labels;
-    bool mnist_loaded_successfully = utils::LoadMNIST("../mnist", &train_data, &train_labels, &test_data, &test_labels);
+    // Initialze OpenCL devices and load the kernels.
+    std::vector<GPUContext*> contexts;
+    Check(InitOpenCL(num_devices, &contexts), "Failed to initialize OpenCL context");
+
+    // Map the MNIST dataset into memory. Samples are only converted to floats once they are needed.
+    utils::MNISTDataset train_set, test_set;
+    bool mnist_loaded_successfully = utils::OpenMNIST("../mnist", true, &train_set) && utils::OpenMNIST("../mnist", false, &test_set);
     Check(mnist_loaded_successfully, "Failed to load MNIST datasets. See fetch_mnist.sh");
 
-    // Move data to the GPU.
-    GPUTensor train_data_gpu = train_data.ToGPU(),
-              train_labels_gpu = train_labels.ToGPU(),
-              test_data_gpu = test_data.ToGPU(),
-              test_labels_gpu = test_labels.ToGPU();
+    CPUTensor test_data, test_labels;
+    nn::LoadDataset(*test_set.images, &test_data);
+    nn::LoadDataset(*test_set.labels, &test_labels);
 
     // Build network.
-    Network network(new CrossEntropy({10}));
-    network << new ReshapeLayer({28, 28}, {1, 28, 28})
+    auto build_network = []() {
+        Network* network = new Network(new CrossEntropy({10}));
+        *network << new ReshapeLayer({28, 28}, {1, 28, 28})
 
-            << new ConvolutionLayer({1, 28, 28}, 32, 5, 5)
-            << new ReLUActivation({32, 28, 28})
-            << new MaxPool2DLayer({32, 28, 28}, 2, 2)
+                 << new ConvolutionLayer({1, 28, 28}, 32, 5, 5)
+                 << new ReLUActivation({32, 28, 28})
+                 << new MaxPool2DLayer({32, 28, 28}, 2, 2)
 
-            << new ConvolutionLayer({32, 14, 14}, 32, 5, 5)
-            << new ReLUActivation({32, 14, 14})
-            << new MaxPool2DLayer({32, 14, 14}, 2, 2)
+                 << new ConvolutionLayer({32, 14, 14}, 32, 5, 5)
+                 << new ReLUActivation({32, 14, 14})
+                 << new MaxPool2DLayer({32, 14, 14}, 2, 2)
 
-            << new ReshapeLayer({32, 7, 7}, {32*7*7})
-            << new DenseLayer(32*7*7, 1024)
-            << new BiasLayer({1024})
-            << new ReLUActivation({1024})
+                 << new ReshapeLayer({32, 7, 7}, {32*7*7})
+                 << new DenseLayer(32*7*7, 1024)
+                 << new BiasLayer({1024})
+                 << new ReLUActivation({1024})
 
-            << new DenseLayer(1024, 10)
-            << new SoftmaxActivation({10});
+                 << new DenseLayer(1024, 10)
+                 << new SoftmaxActivation({10});
+        return network;
+    };
 
-    // Train network.
     // Learning rate of 0.001 seems good for convolutinal networks. MLPs can use higher values though.
-    network.Train(train_data_gpu, train_labels_gpu, test_data_gpu, test_labels_gpu, 10, 16, 0.001f);
+    if (contexts.size() > 1) {
+        CPUTensor train_data, train_labels;
+        nn::LoadDataset(*train_set.images, &train_data);
+        nn::LoadDataset(*train_set.labels, &train_labels);
+
+        DataParallelNetwork network(contexts, build_network);
+
+        // Compile all kernels needed by the network up front.
+        network.WarmUp();
+
+        // Train network. Each mini-batch is split across all devices.
+        network.Train(train_data, train_labels, test_data, test_labels, 10, 16 * contexts.size(), 0.001f);
+    } else {
+        // Keep the training set on the GPU in its original 8 bit form. Batches are gathered and converted there.
+        Check(train_set.images->type() == utils::IdxFile::kUInt8, "Expected 8 bit MNIST images");
+        const std::vector<size_t>& dimensions = train_set.images->dimensions();
+        DeviceDataset train_data_gpu(train_set.images->sample(0), {dimensions[0], dimensions[1], dimensions[2]}, 1.f / 255);
+        DeviceDataset train_labels_gpu(train_set.label_indices->sample(0), train_set.label_indices->num_samples(), 10);
+
+        // Move test data to the GPU.
+        GPUTensor test_data_gpu = test_data.ToGPU(),
+                  test_labels_gpu = test_labels.ToGPU();
+
+        std::unique_ptr<Network> network(build_network());
+
+        // Compile all kernels needed by the network up front.
+        network->WarmUp();
+
+        // Write a checkpoint after every epoch. This happens in the background while training continues.
+        network->set_checkpoint_path("mnist.ckpt");
+
+        // Train network.
+        network->Train(train_data_gpu, train_labels_gpu, test_data_gpu, test_labels_gpu, 10, 16, 0.001f);
+    }
 
     return 0;
 }
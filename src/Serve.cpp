@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "utils/InferenceServer.h"
+#include "utils/OpenCL.h"
+#include "nn/NN.h"
+
+// Inference runs on a GPU.
+using namespace nn::gpu;
+
+// The server to stop on SIGINT or SIGTERM.
+static utils::InferenceServer* server = nullptr;
+
+static void HandleSignal(int)
+{
+    if (server)
+        server->Stop();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " checkpoint socket [max_batch_size [max_wait_us]]" << std::endl;
+        return 1;
+    }
+
+    size_t max_batch_size = argc > 3 ? std::max(atoi(argv[3]), 1) : 32;
+    std::chrono::microseconds max_wait(argc > 4 ? std::max(atoi(argv[4]), 0) : 2000);
+
+    Check(InitOpenCL(), "Failed to initialize OpenCL context");
+
+    // Rebuild the network from a checkpoint written during training, see Network::Save().
+    std::unique_ptr<Checkpoint> checkpoint = Checkpoint::Open(argv[1]);
+    Check(checkpoint && checkpoint->num_layers() > 0, "Failed to open checkpoint");
+    nn::Shape output_shape = nn::DecodeShape(checkpoint->layer(checkpoint->num_layers() - 1).output_shape);
+
+    // The objective is only needed for training.
+    std::unique_ptr<Network> network = Network::Load(*checkpoint, new CrossEntropy(output_shape));
+    Check(network, "Failed to load network");
+    checkpoint.reset();
+
+    network->WarmUp();
+
+    // Every batch is uploaded and downloaded with a single transfer each.
+    auto evaluate = [&network](const CPUTensor& inputs) {
+        return network->EvaluateBatch(inputs.ToGPU()).ToHost();
+    };
+
+    utils::InferenceServer inference_server(network->InputTensorShape(), network->OutputTensorShape(), evaluate, max_batch_size, max_wait);
+    Check(inference_server.Listen(argv[2]), "Failed to listen on socket");
+
+    server = &inference_server;
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+
+    std::cout << "Serving " << argv[1] << " on " << argv[2] << " (max batch size " << max_batch_size << ", max wait " << max_wait.count() << "us)" << std::endl;
+    inference_server.Run();
+    server = nullptr;
+
+    std::cout << inference_server.statistics().ToString();
+
+    return 0;
+}
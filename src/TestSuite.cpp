@@ -3,9 +3,14 @@
 #include <vector>
 #include <memory>
 #include <ctime>
+#include <chrono>
+#include <thread>
+#include <cstdio>
 
 #include "ocl/Device.h"
 #include "ocl/Utils.h"
+#include "utils/Idx.h"
+#include "utils/InferenceServer.h"
 #include "utils/Mnist.h"
 #include "nn/NN.h"
 #include "utils/OpenCL.h"
@@ -27,7 +32,7 @@ using namespace nn;
     for (int i = 0; i < NUM_REPETITIONS; i++) {                             \
         do_gpu;                                                             \
     }                                                                       \
-    nn::GPUContext::device->AwaitJobCompletion();                           \
+    nn::GPUContext::Current()->device()->AwaitJobCompletion();              \
     gpu_time = (clock() - start) / (double)CLOCKS_PER_SEC;                  \
     printf("%50s      CPU: %.6fs      GPU: %.6fs %10.2fx Speedup\n",        \
             name, cpu_time / NUM_REPETITIONS, gpu_time / NUM_REPETITIONS,   \
@@ -97,6 +102,225 @@ void RunBasicTensorTests()
 
     Assert(h_tensor[0][4] == h_row);
     Assert(h_tensor == g_tensor.ToHost());
+
+
+    // Ownership hand-off tests. These are zero-copy on devices with unified memory.
+    CPUTensor h_moved(h_tensor);
+    GPUTensor g_moved = h_moved.MoveToGPU();
+    Check(h_moved.size() == 0 && g_moved.shape() == h_tensor.shape(), "Tensor move test failed");
+    g_moved += g_tensor;
+    CPUTensor h_moved_back = g_moved.MoveToHost();
+    Check(g_moved.size() == 0 && h_moved_back == h_tensor + h_tensor, "Tensor move test failed");
+    GPUTensor g_moved_again = h_moved_back.MoveToGPU();
+    Check(g_moved_again.ToHost() == h_tensor + h_tensor, "Tensor move test failed");
+
+    // Device memory of released tensors should be reused for later tensors of similar size.
+    const ocl::MemoryStatistics& stats = GPUContext::Current()->device()->memory_statistics();
+    size_t live_bytes = stats.live_bytes, cache_hits = stats.cache_hits;
+    {
+        GPUTensor g_temp({small_1, small_2});
+        Check(stats.live_bytes >= live_bytes + g_temp.size() * sizeof(float), "Device allocator test failed");
+    }
+    Check(stats.live_bytes == live_bytes, "Device allocator test failed");
+    GPUTensor g_reused({small_2, small_1}, ocl::kScratchBuffer);
+    GPUTensor g_reused_again({small_1, small_2});
+    Check(stats.cache_hits > cache_hits, "Device allocator test failed");
+    Check(stats.peak_bytes >= stats.live_bytes, "Device allocator test failed");
+
+    // Temporaries that kernels are still working on are cached as well, later commands can't overtake the kernels.
+    size_t cached_bytes = stats.cached_bytes;
+    {
+        GPUTensor g_sum = g_reused_again + g_reused_again;
+    }
+    Check(stats.cached_bytes > cached_bytes, "Device allocator test failed");
+    cache_hits = stats.cache_hits;
+    GPUTensor g_sum_reused({small_1, small_2});
+    Check(stats.cache_hits == cache_hits + 1, "Device allocator test failed");
+
+    // Local work size candidates for the tuner must be valid for the kernel.
+    ocl::Kernel* kernel = GPUContext::Current()->kernel_manager().kernel(kTransposedVecMulKernel);
+    auto candidates = GPUContext::Current()->tuner().LocalWorkSizeCandidates(*kernel, ocl::Kernel::WorkSize(small_1, small_2));
+    for (const auto& candidate : candidates) {
+        Check(candidate.size() == 2 && candidate[0] * candidate[1] <= kernel->MaxWorkGroupSize(), "Tuner test failed");
+    }
+}
+
+void RunIdxTests()
+{
+    // A 2x2x3 array of big endian 16 bit integers.
+    const uint8_t header[] = { 0, 0, utils::IdxFile::kInt16, 3, 0, 0, 0, 2, 0, 0, 0, 2, 0, 0, 0, 3 };
+    const int16_t values[] = { 0, 1, -1, 255, 256, -32768, 32767, 2, 3, 4, 5, 6 };
+    string path = "/tmp/deeplearn-test.idx";
+    FILE* file = fopen(path.c_str(), "wb");
+    Check(file, "Failed to create IDX test file");
+    fwrite(header, 1, sizeof(header), file);
+    for (int16_t value : values) {
+        uint8_t bytes[] = { uint8_t((uint16_t)value >> 8), uint8_t(value & 0xff) };
+        fwrite(bytes, 1, 2, file);
+    }
+    fclose(file);
+
+    unique_ptr<utils::IdxFile> idx = utils::IdxFile::Open(path);
+    Check(idx && idx->type() == utils::IdxFile::kInt16 && idx->num_samples() == 2, "IDX reader test failed");
+    Check(idx->sample_shape() == Shape({2, 3}) && idx->sample_size() == 6, "IDX reader test failed");
+
+    // Raw samples point into the mapped file.
+    Check(idx->sample(1)[1] == 0x80 && idx->sample(1)[2] == 0x7f, "IDX reader test failed");
+
+    float sample[6];
+    idx->set_scale(0.5f);
+    idx->Load(0, sample);
+    for (size_t i = 0; i < 6; i++)
+        Check(sample[i] == values[i] * 0.5f, "IDX reader test failed");
+
+    idx.reset();
+    remove(path.c_str());
+}
+
+void RunDataLoaderTests()
+{
+    // Every sample consists of its index, so the batches show which samples they contain.
+    const size_t num_samples = 100, batch_size = 7, num_epochs = 3;
+    CPUTensor data({num_samples, 3}), labels({num_samples, 1});
+    for (size_t i = 0; i < num_samples; i++) {
+        data(i, 0) = data(i, 1) = data(i, 2) = i;
+        labels(i, 0) = i;
+    }
+
+    DataLoader loader(data, labels, batch_size, 3, 1.f, 2.f);
+    Check(loader.batches_per_epoch() == num_samples / batch_size, "Data loader test failed");
+    loader.Start(num_epochs);
+
+    for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+        vector<bool> seen(num_samples, false);
+        for (size_t batch = 0; batch < loader.batches_per_epoch(); batch++) {
+            const DataLoader::Batch& next = loader.NextBatch();
+            Check(next.epoch == epoch && next.data.shape() == Shape({batch_size, 3}), "Data loader test failed");
+            for (size_t i = 0; i < batch_size; i++) {
+                size_t sample = next.labels(i, 0);
+                Check(sample < num_samples && !seen[sample], "Data loader test failed: not a permutation");
+                Check(floatEq(next.data(i, 2), (sample - 1.f) / 2.f), "Data loader test failed: wrong normalization");
+                seen[sample] = true;
+            }
+        }
+    }
+
+    loader.Stop();
+}
+
+// Returns the bandwidth in GB/s achieved by running |transfer| NUM_REPETITIONS times, each transferring |nbytes| bytes.
+template <typename Transfer>
+double MeasureBandwidth(size_t nbytes, Transfer transfer)
+{
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < NUM_REPETITIONS; i++)
+        transfer();
+    nn::GPUContext::Current()->device()->AwaitJobCompletion();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    return (double)nbytes * NUM_REPETITIONS / elapsed.count() / 1e9;
+}
+
+void RunProfilerTests()
+{
+    // A separate device with profiling enabled, so that only the commands below are recorded.
+    ocl::Device device(GPUContext::Current()->device()->id());
+    Check(device.Init(true) && device.profiler(), "Failed to create profiling device");
+
+    const size_t num_reads = 5;
+    vector<float> data(1024, 1.0f);
+    {
+        unique_ptr<ocl::Buffer> buffer = device.AllocateBuffer(data.size() * sizeof(float));
+        Check(buffer && buffer->Write(data.data()), "Profiler test failed");
+        for (size_t i = 0; i < num_reads; i++)
+            Check(buffer->ReadInto(data.data()), "Profiler test failed");
+    }
+
+    vector<ocl::Profiler::Entry> report = device.profiler()->Report();
+    Check(report.size() == 2, "Profiler test failed");
+    for (const auto& entry : report) {
+        Check(entry.name == ocl::kHostToDevice || entry.name == ocl::kDeviceToHost, "Profiler test failed");
+        Check(entry.count == (entry.name == ocl::kHostToDevice ? 1 : num_reads), "Profiler test failed");
+        Check(entry.execution.total >= 0 && floatEq(entry.execution.mean, entry.execution.total / entry.count), "Profiler test failed");
+    }
+
+    // With a single command, the 99th percentile is the upper bound of its histogram bucket,
+    // which lies within one bucket width (a factor of 10^(1/20)) above the command's duration.
+    const ocl::Profiler::Entry& upload = report[0].name == ocl::kHostToDevice ? report[0] : report[1];
+    Check(upload.execution.p99 >= upload.execution.total && upload.execution.p99 <= upload.execution.total * 1.13 + 1e-5, "Profiler test failed");
+    Check(upload.wait.p99 >= upload.wait.total && upload.wait.p99 <= upload.wait.total * 1.13 + 1e-5, "Profiler test failed");
+
+    // Reset discards everything recorded so far.
+    device.profiler()->Reset();
+    Check(device.profiler()->Report().empty(), "Profiler test failed");
+}
+
+void RunTransferTests()
+{
+    // Use a fixed, reasonably large size so the numbers are comparable between runs.
+    const size_t num_elements = 16 * 1024 * 1024;
+    const size_t nbytes = num_elements * sizeof(float);
+
+    CPUTensor h_pageable({num_elements}, RandomInitializer());
+    CPUTensor h_pinned({num_elements}, HostMemory::kPinned);
+    copy(h_pageable.begin(), h_pageable.end(), h_pinned.begin());
+    GPUTensor g_tensor({num_elements});
+
+    // Transfers through the plain driver path, as done before the staging buffers were introduced.
+    double direct_upload = MeasureBandwidth(nbytes, [&]() { g_tensor.gpu_buffer()->Write(h_pageable.begin(), num_elements); });
+    double direct_download = MeasureBandwidth(nbytes, [&]() { g_tensor.gpu_buffer()->ReadInto(h_pageable.begin(), num_elements); });
+
+    // Transfers from pageable memory through the pinned staging buffers.
+    double staged_upload = MeasureBandwidth(nbytes, [&]() { GPUContext::Current()->device()->Upload(g_tensor.gpu_buffer(), (uint8_t*)h_pageable.begin(), nbytes, 0); });
+    double staged_download = MeasureBandwidth(nbytes, [&]() { GPUContext::Current()->device()->Download(g_tensor.gpu_buffer(), (uint8_t*)h_pageable.begin(), nbytes, 0); });
+
+    // Transfers from and to a pinned tensor.
+    double pinned_upload = MeasureBandwidth(nbytes, [&]() { g_tensor.gpu_buffer()->Write(h_pinned.begin(), num_elements); });
+    double pinned_download = MeasureBandwidth(nbytes, [&]() { g_tensor.gpu_buffer()->ReadInto(h_pinned.begin(), num_elements); });
+
+    printf("%50s      Direct: %6.2f GB/s      Staged: %6.2f GB/s      Pinned: %6.2f GB/s\n", "Host to device transfer", direct_upload, staged_upload, pinned_upload);
+    printf("%50s      Direct: %6.2f GB/s      Staged: %6.2f GB/s      Pinned: %6.2f GB/s\n", "Device to host transfer", direct_download, staged_download, pinned_download);
+
+    // Round trips through all paths must preserve the data.
+    Check(h_pinned.ToGPU().ToHost() == h_pageable, "Pinned tensor transfer test failed");
+    Check(h_pageable.ToGPU().ToHost(HostMemory::kPinned) == h_pageable, "Pinned tensor transfer test failed");
+    GPUTensor g_copy(g_tensor);
+    Check(g_copy.ToHost() == h_pageable, "Device buffer copy test failed");
+}
+
+void RunDeviceDatasetTests()
+{
+    const size_t num_samples = 50, batch_size = 8, num_classes = 10;
+    vector<uint8_t> pixels(num_samples * 4 * 3), classes(num_samples);
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = rand() % 256;
+    for (size_t i = 0; i < num_samples; i++)
+        classes[i] = rand() % num_classes;
+
+    DeviceDataset data(pixels.data(), {num_samples, 4, 3}, 1.f / 255);
+    DeviceDataset labels(classes.data(), num_samples, num_classes);
+    Check(data.sample_shape() == Shape({4, 3}) && labels.sample_shape() == Shape({num_classes}), "Device dataset test failed");
+
+    vector<uint32_t> order(num_samples);
+    for (size_t i = 0; i < num_samples; i++)
+        order[i] = rand() % num_samples;
+    ocl::Device* device = GPUContext::Current()->device();
+    unique_ptr<ocl::Buffer> indices = device->AllocateBuffer(num_samples * sizeof(uint32_t), ocl::kReadOnlyBuffer);
+    device->Upload(indices.get(), (uint8_t*)order.data(), num_samples * sizeof(uint32_t), 0);
+
+    // Gather the second batch of the order and compare it against a conversion on the host.
+    GPUTensor batch_data, batch_labels;
+    data.Gather(indices.get(), batch_size, batch_size, &batch_data);
+    labels.Gather(indices.get(), batch_size, batch_size, &batch_labels);
+    CPUTensor h_data = batch_data.ToHost(), h_labels = batch_labels.ToHost();
+    Check(h_data.shape() == Shape({batch_size, 4, 3}) && h_labels.shape() == Shape({batch_size, num_classes}), "Device dataset test failed");
+
+    for (size_t i = 0; i < batch_size; i++) {
+        size_t sample = order[batch_size + i];
+        for (size_t j = 0; j < 12; j++)
+            Check(floatEq(h_data.begin()[i * 12 + j], pixels[sample * 12 + j] / 255.f), "Device dataset test failed: wrong sample data");
+        for (size_t j = 0; j < num_classes; j++)
+            Check(h_labels(i, j) == (j == classes[sample] ? 1.f : 0.f), "Device dataset test failed: wrong one-hot label");
+    }
 }
 
 void RunTensorArithmeticTests()
@@ -138,6 +362,28 @@ void RunTensorArithmeticTests()
     g_x = h_x.ToGPU();
     RunTest("Elementwise log()", log(h_x, h_output), log(g_x, g_output));
     Check(h_output == g_output.ToHost(), "Elementwise log() test failed");
+
+    // Elementwise operations are bandwidth bound, so compare the achieved bandwidth of the scalar and vectorized kernels. Each addition
+    // reads two tensors and writes one. The size isn't a multiple of the vector width, so the scalar tail of the vectorized kernels is tested as well.
+    const size_t num_elements = 16 * 1024 * 1024 + 3;
+    CPUTensor h_a({num_elements}, RandomInitializer()), h_b({num_elements}, RandomInitializer());
+    GPUTensor g_a = h_a.ToGPU(), g_b = h_b.ToGPU(), g_sum({num_elements});
+    CPUTensor h_sum = h_a + h_b;
+
+    KernelManager& kernel_manager = GPUContext::Current()->kernel_manager();
+    size_t configured_width = kernel_manager.elementwise_vector_width();
+    const size_t widths[] = { 1, 4, 8 };
+    double bandwidths[3];
+    for (size_t i = 0; i < 3; i++) {
+        kernel_manager.set_elementwise_vector_width(widths[i]);
+        // Compile the kernel before measuring.
+        add(g_a, g_b, g_sum);
+        bandwidths[i] = MeasureBandwidth(3 * num_elements * sizeof(float), [&]() { add(g_a, g_b, g_sum); });
+        Check(h_sum == g_sum.ToHost(), "Vectorized tensor addition test failed");
+    }
+    kernel_manager.set_elementwise_vector_width(configured_width);
+
+    printf("%50s      Scalar: %6.2f GB/s      float4: %6.2f GB/s      float8: %6.2f GB/s\n", "Tensor addition bandwidth", bandwidths[0], bandwidths[1], bandwidths[2]);
 }
 
 void RunLinearAlgebraTests()
@@ -170,6 +416,22 @@ void RunLinearAlgebraTests()
     RunTest("Transposed vector-vector multiplication", transposed_vecmul(h_vector1, h_vector2, h_output3), transposed_vecmul(g_vector1, g_vector2, g_output3));
     Check(h_output3 == g_output3.ToHost(), "Transposed vector-vector multiplication test failed");
 
+    // Accumulating rank-1 update, as used for the weight gradients.
+    CPUTensor h_expected = h_output3 + h_output3;
+    accumulate_transposed_vecmul(h_vector1, h_vector2, h_output3);
+    accumulate_transposed_vecmul(g_vector1, g_vector2, g_output3);
+    Check(h_output3 == h_expected && h_output3 == g_output3.ToHost(), "Accumulating transposed vector-vector multiplication test failed");
+
+    // Accumulating transposed matrix multiplication, i.e. the sum of the above for every (used) row of both matrices.
+    const size_t batch_size = 32, num_rows = 29;
+    CPUTensor h_rows1({batch_size, small_1}, RandomInitializer()), h_rows2({batch_size, small_2}, RandomInitializer());
+    GPUTensor g_rows1 = h_rows1.ToGPU(), g_rows2 = h_rows2.ToGPU();
+    for (size_t i = 0; i < num_rows; i++)
+        accumulate_transposed_vecmul(h_rows1[i], h_rows2[i], h_expected);
+    accumulate_transposed_matmul(h_rows1, h_rows2, num_rows, h_output3);
+    accumulate_transposed_matmul(g_rows1, g_rows2, num_rows, g_output3);
+    Check(h_output3 == h_expected && h_output3 == g_output3.ToHost(), "Accumulating transposed matrix multiplication test failed");
+
 }
 
 void RunConvolutionTests()
@@ -190,6 +452,10 @@ void RunConvolutionTests()
     CPUTensor h_image2({num_features, height, width});
     GPUTensor g_image2({num_features, height, width});
 
+    // Don't measure the kernel compilation.
+    prepare_convolution(g_kernel);
+    GPUContext::Current()->kernel_manager().AwaitPrograms();
+
     // Convolution
     RunTest("Convolution", convolution(h_image, h_kernel, h_image2), convolution(g_image, g_kernel, g_image2));
     Check(h_image2 == g_image2.ToHost(), "Convolution test failed");
@@ -206,6 +472,42 @@ void RunConvolutionTests()
     // Convolution gradients
     RunTest("Convolution gradients", convolution_kernel_gradients(h_image, h_image2, h_kernel), convolution_kernel_gradients(g_image, g_image2, g_kernel));
     Check(h_kernel == g_kernel.ToHost(), "Convolution kernel gradient test failed");
+
+    CPUTensor h_expected = h_kernel + h_kernel;
+    accumulate_convolution_kernel_gradients(h_image, h_image2, ConvolutionParameters(), h_kernel);
+    accumulate_convolution_kernel_gradients(g_image, g_image2, ConvolutionParameters(), g_kernel);
+    Check(h_kernel == h_expected && h_kernel == g_kernel.ToHost(), "Accumulating convolution kernel gradient test failed");
+
+    // Strided, unpadded and dilated convolutions use separate kernels, see ConvolutionGeneral.cl.
+    ConvolutionParameters parameters(2, Padding::kValid, 2);
+    Shape output_shape = parameters.OutputShape(h_image.shape(), h_kernel.shape());
+    h_image2 = CPUTensor(output_shape, RandomInitializer(0, 0.1));
+    g_image2 = h_image2.ToGPU();
+    CPUTensor h_output(output_shape);
+    GPUTensor g_output(output_shape);
+
+    RunTest("Strided convolution", convolution(h_image, h_kernel, parameters, h_output), convolution(g_image, g_kernel, parameters, g_output));
+    Check(h_output == g_output.ToHost(), "Strided convolution test failed");
+
+    RunTest("Strided cross-correlation", cross_correlation(h_image2, h_kernel, parameters, h_image), cross_correlation(g_image2, g_kernel, parameters, g_image));
+    Check(h_image == g_image.ToHost(), "Strided cross-correlation test failed");
+
+    RunTest("Strided convolution gradients", convolution_kernel_gradients(h_image, h_image2, parameters, h_kernel), convolution_kernel_gradients(g_image, g_image2, parameters, g_kernel));
+    Check(h_kernel == g_kernel.ToHost(), "Strided convolution kernel gradient test failed");
+
+    h_expected = h_kernel + h_kernel;
+    accumulate_convolution_kernel_gradients(h_image, h_image2, parameters, h_kernel);
+    accumulate_convolution_kernel_gradients(g_image, g_image2, parameters, g_kernel);
+    Check(h_kernel == h_expected && h_kernel == g_kernel.ToHost(), "Accumulating strided convolution kernel gradient test failed");
+
+    // Unpadded convolutions with stride 1 still use the tiled kernels.
+    parameters = ConvolutionParameters(1, Padding::kValid, 1);
+    output_shape = parameters.OutputShape(h_image.shape(), h_kernel.shape());
+    h_output = CPUTensor(output_shape);
+    g_output = GPUTensor(output_shape);
+
+    RunTest("Unpadded convolution", convolution(h_image, h_kernel, parameters, h_output), convolution(g_image, g_kernel, parameters, g_output));
+    Check(h_output == g_output.ToHost(), "Unpadded convolution test failed");
 }
 
 void RunActivationTests()
@@ -220,6 +522,16 @@ void RunActivationTests()
     // ReLU
     RunTest("ReLU activation", relu(h_input, h_output), relu(g_input, g_output));
     Check(h_output == g_output.ToHost(), "Sigmoid test failed");
+
+    // Fused elementwise operations
+    CPUTensor h_input2({large}, RandomInitializer());
+    GPUTensor g_input2 = h_input2.ToGPU();
+    vector<const CPUTensor*> h_arguments = { &h_input, &h_input2 };
+    vector<const GPUTensor*> g_arguments = { &g_input, &g_input2 };
+    elementwise::Expression expression = elementwise::relu_derivative(elementwise::Argument(0)) * elementwise::Argument(1) +
+                                         0.5f * elementwise::sigmoid(elementwise::Argument(1) - 1.f);
+    RunTest("Fused elementwise operations", fused(expression, h_arguments, h_output), fused(expression, g_arguments, g_output));
+    Check(h_output == g_output.ToHost(), "Fused elementwise operations test failed");
 }
 
 void RunLossFunctionTests()
@@ -231,6 +543,24 @@ void RunLossFunctionTests()
     // Mean squared error
     RunTest("Mean squared error calculation", cpu_result = mse(h_input1, h_input2), gpu_result = mse(g_input1, g_input2));
     Check(floatEq(cpu_result, gpu_result), "MSE test failed");
+
+    // Softmax and cross-entropy. Use a one-hot label and inputs large enough that a naive exp() would overflow.
+    size_t num_classes = RandBetween(2, 1000);
+    CPUTensor h_logits({num_classes}, RandomInitializer()), h_label({num_classes}, ZeroInitializer);
+    for (auto& f : h_logits)
+        f = f * 100 + 100;
+    *(h_label.begin() + rand() % num_classes) = 1;
+    GPUTensor g_logits = h_logits.ToGPU(), g_label = h_label.ToGPU();
+    CPUTensor h_probabilities({num_classes}), h_gradients({num_classes});
+    GPUTensor g_probabilities({num_classes}), g_gradients({num_classes});
+
+    RunTest("Softmax", softmax(h_logits, h_probabilities), softmax(g_logits, g_probabilities));
+    Check(floatEq(sum(h_probabilities), 1) && h_probabilities == g_probabilities.ToHost(), "Softmax test failed");
+
+    RunTest("Softmax cross-entropy", cpu_result = softmax_cross_entropy(h_logits, h_probabilities, h_label, h_gradients),
+                                     gpu_result = softmax_cross_entropy(g_logits, g_probabilities, g_label, g_gradients));
+    Check(std::isfinite(cpu_result) && floatEq(cpu_result, gpu_result), "Softmax cross-entropy test failed");
+    Check(h_gradients == g_gradients.ToHost() && h_gradients == h_probabilities - h_label, "Softmax cross-entropy test failed");
 }
 
 void RunLayerTests()
@@ -281,6 +611,10 @@ void RunLayerTests()
     ConvolutionLayer<CPUTensor> h_convolution({num_channels, height, width}, h_convolution_layer_weights);
     ConvolutionLayer<GPUTensor> g_convolution({num_channels, height, width}, g_convolution_layer_weights);
 
+    CPUTensor h_depthwise_kernels({num_channels, 5, 5}, RandomInitializer()), h_pointwise_weights({num_features, num_channels}, RandomInitializer());
+    DepthwiseSeparableConvolutionLayer<CPUTensor> h_separable({num_channels, height, width}, h_depthwise_kernels, h_pointwise_weights);
+    DepthwiseSeparableConvolutionLayer<GPUTensor> g_separable({num_channels, height, width}, h_depthwise_kernels.ToGPU(), h_pointwise_weights.ToGPU());
+
     MaxPool2DLayer<CPUTensor> h_maxpool({num_features, height, width}, 2, 2);
     MaxPool2DLayer<GPUTensor> g_maxpool({num_features, height, width}, 2, 2);
 
@@ -294,6 +628,19 @@ void RunLayerTests()
     Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "Dense layer test failed");
     Check(h_dense.CurrentGradients() == g_dense.CurrentGradients().ToHost(), "Dense layer test failed");
 
+    // With deferred weight gradients, the stashed samples must yield the same gradients once finalized.
+    DenseLayer<CPUTensor> h_deferred_dense(h_dense_layer_weights);
+    DenseLayer<GPUTensor> g_deferred_dense(g_dense_layer_weights);
+    h_deferred_dense.DeferWeightGradients(NUM_REPETITIONS);
+    g_deferred_dense.DeferWeightGradients(NUM_REPETITIONS);
+    h_deferred_dense.Forward(h_dense_layer_input);
+    g_deferred_dense.Forward(g_dense_layer_input);
+    RunTest("Fully connected layer (Deferred Backward)", h_deferred_dense.Backward(h_dense_layer_gradients), g_deferred_dense.Backward(g_dense_layer_gradiensts));
+    h_deferred_dense.FinalizeGradients();
+    g_deferred_dense.FinalizeGradients();
+    Check(h_deferred_dense.CurrentGradients() == h_dense.CurrentGradients(), "Deferred dense layer test failed");
+    Check(h_deferred_dense.CurrentGradients() == g_deferred_dense.CurrentGradients().ToHost(), "Deferred dense layer test failed");
+
 
     RunTest("Bias layer (Forward)", cpu_result_tensor = &h_bias.Forward(h_bias_layer_input), gpu_result_tensor = &g_bias.Forward(g_bias_layer_input));
     Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "Bias layer test failed");
@@ -310,6 +657,18 @@ void RunLayerTests()
     Check(h_convolution.CurrentGradients() == g_convolution.CurrentGradients().ToHost(), "Convolution layer test failed");
 
 
+    g_separable.WarmUp();
+    GPUContext::Current()->kernel_manager().AwaitPrograms();
+
+    RunTest("Depthwise separable convolution layer (Forward)", cpu_result_tensor = &h_separable.Forward(h_image1), gpu_result_tensor = &g_separable.Forward(g_image1));
+    Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "Depthwise separable convolution layer test failed");
+
+    RunTest("Depthwise separable convolution layer (Backward)", cpu_result_tensor = &h_separable.Backward(h_image2), gpu_result_tensor = &g_separable.Backward(g_image2));
+    Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "Depthwise separable convolution layer test failed");
+    for (size_t i = 0; i < h_separable.Gradients().size(); i++)
+        Check(*h_separable.Gradients()[i] == g_separable.Gradients()[i]->ToHost(), "Depthwise separable convolution layer test failed");
+
+
     RunTest("2D Max-pooling layer (Forward)", cpu_result_tensor = &h_maxpool.Forward(h_image2), gpu_result_tensor = &g_maxpool.Forward(g_image2));
     Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "2D Max-pooling layer test failed");
 
@@ -317,6 +676,204 @@ void RunLayerTests()
     Check((*cpu_result_tensor) == gpu_result_tensor->ToHost(), "2D Max-pooling layer test failed");
 }
 
+// Runs two steps of the given optimizers on the same parameters and gradients and checks that both backends agree.
+void TestOptimizer(const char* name, Optimizer<CPUTensor>* h_optimizer, Optimizer<GPUTensor>* g_optimizer)
+{
+    CPUTensor h_parameters({large}, RandomInitializer()), h_gradients({large}, RandomInitializer());
+    GPUTensor g_parameters = h_parameters.ToGPU(), g_gradients = h_gradients.ToGPU();
+    vector<CPUTensor*> h_parameter_list = { &h_parameters }, h_gradient_list = { &h_gradients };
+    vector<GPUTensor*> g_parameter_list = { &g_parameters }, g_gradient_list = { &g_gradients };
+
+    RunTest(name, h_optimizer->Step(h_parameter_list, h_gradient_list, 10, 0.1f), g_optimizer->Step(g_parameter_list, g_gradient_list, 10, 0.1f));
+    Check(h_parameters == g_parameters.ToHost(), std::string(name) + " test failed");
+    Check(h_gradients == CPUTensor({large}, ZeroInitializer) && g_gradients.ToHost() == h_gradients, std::string(name) + " test failed");
+
+    // The second step also depends on the optimizer state.
+    CPUTensor h_new_gradients({large}, RandomInitializer());
+    h_gradients = h_new_gradients;
+    g_gradients = h_new_gradients.ToGPU();
+    h_optimizer->Step(h_parameter_list, h_gradient_list, 10, 0.1f);
+    g_optimizer->Step(g_parameter_list, g_gradient_list, 10, 0.1f);
+    Check(h_parameters == g_parameters.ToHost(), std::string(name) + " test failed");
+
+    delete h_optimizer;
+    delete g_optimizer;
+}
+
+void RunOptimizerTests()
+{
+    TestOptimizer("SGD step", new SGD<CPUTensor>(), new SGD<GPUTensor>());
+    TestOptimizer("SGD with momentum step", new SGD<CPUTensor>(0.9f), new SGD<GPUTensor>(0.9f));
+    TestOptimizer("RMSProp step", new RMSProp<CPUTensor>(), new RMSProp<GPUTensor>());
+    TestOptimizer("Adam step", new Adam<CPUTensor>(), new Adam<GPUTensor>());
+}
+
+void RunDataParallelTests()
+{
+    // A second context on the same device behaves like a separate device.
+    GPUContext* default_context = GPUContext::Current();
+    unique_ptr<GPUContext> second_context(CreateGPUContext(default_context->device()->id()));
+    Check(second_context, "Failed to create second GPU context");
+    second_context->kernel_manager().AwaitPrograms();
+
+    const size_t input_dim = 100, output_dim = 10, batch_size = 16;
+    CPUTensor h_weights({output_dim, input_dim}, RandomInitializer(0, 0.1));
+    CPUTensor h_data({batch_size, input_dim}, RandomInitializer()), h_labels({batch_size, output_dim}, RandomInitializer());
+
+    Network<CPUTensor> h_network(new MSE<CPUTensor>({output_dim}));
+    h_network << new DenseLayer<CPUTensor>(h_weights);
+
+    DataParallelNetwork g_network({ default_context, second_context.get() }, [&]() {
+        // The weights of the second replica are overwritten with those of the first one.
+        Network<GPUTensor>* network = new Network<GPUTensor>(new MSE<GPUTensor>({output_dim}));
+        *network << new DenseLayer<GPUTensor>(GPUTensor({output_dim, input_dim}, RandomInitializer()));
+        return network;
+    });
+    g_network.SetTrainingData(h_data, h_labels);
+
+    // Start from the same weights as the CPU network.
+    GPUTensor g_weights = h_weights.ToGPU();
+    *g_network.replica(0).Parameters()[0] = g_weights;
+    Check(g_network.BroadcastParameters(), "Data-parallel training test failed");
+
+    vector<size_t> indices;
+    for (size_t i = 0; i < batch_size; i++)
+        indices.push_back(i);
+
+    bool hit;
+    size_t hits;
+    RunTest("Data-parallel training (2 replicas)",
+            for (size_t j : indices) h_network.Backpropagate(h_data[j], h_labels[j], &hit); h_network.GradientDescent(batch_size, 0.1f),
+            g_network.TrainMiniBatch(indices, 0.1f, &hits));
+    Check(*h_network.Parameters()[0] == g_network.replica(0).Parameters()[0]->ToHost(), "Data-parallel training test failed");
+
+    // Tensors can only be accessed while their context is current.
+    second_context->MakeCurrent();
+    Check(*h_network.Parameters()[0] == g_network.replica(1).Parameters()[0]->ToHost(), "Data-parallel training test failed");
+    default_context->MakeCurrent();
+}
+
+void RunExecutionPlanTests()
+{
+    const size_t input_dim = 100, hidden_dim = 50, output_dim = 10, batch_size = 16;
+    CPUTensor h_weights1({hidden_dim, input_dim}, RandomInitializer(0, 0.1)), h_weights2({output_dim, hidden_dim}, RandomInitializer(0, 0.1));
+    CPUTensor h_data({batch_size, input_dim}, RandomInitializer()), h_labels({batch_size, output_dim}, RandomInitializer());
+    GPUTensor g_data = h_data.ToGPU(), g_labels = h_labels.ToGPU();
+
+    Network<CPUTensor> h_network(new MSE<CPUTensor>({output_dim}));
+    h_network << new DenseLayer<CPUTensor>(h_weights1) << new DenseLayer<CPUTensor>(h_weights2);
+    Network<GPUTensor> g_network(new MSE<GPUTensor>({output_dim}));
+    g_network << new DenseLayer<GPUTensor>(h_weights1.ToGPU()) << new DenseLayer<GPUTensor>(h_weights2.ToGPU());
+
+    h_network.Capture(h_data, h_labels, 0.1f);
+    g_network.Capture(g_data, g_labels, 0.1f);
+    Check(*h_network.Parameters()[0] == g_network.Parameters()[0]->ToHost(), "Execution plan test failed");
+
+    // Replays must pick up new data written into the captured input tensors.
+    CPUTensor h_new_data({batch_size, input_dim}, RandomInitializer());
+    h_data = h_new_data;
+    g_data = h_new_data.ToGPU();
+
+    RunTest("Replayed training step", h_network.Replay(), g_network.Replay());
+    for (size_t i = 0; i < h_network.Parameters().size(); i++)
+        Check(*h_network.Parameters()[i] == g_network.Parameters()[i]->ToHost(), "Execution plan test failed");
+}
+
+void RunCheckpointTests()
+{
+    // A network that uses every kind of layer with parameters or attributes.
+    const Shape input_shape({2, 8, 8});
+    Network<CPUTensor> h_network(new MSE<CPUTensor>({10}));
+    h_network << new ConvolutionLayer<CPUTensor>(input_shape, 4, 3, 3, ConvolutionParameters(1, Padding::kValid, 1))
+              << new ReLUActivation<CPUTensor>({4, 6, 6})
+              << new DepthwiseSeparableConvolutionLayer<CPUTensor>({4, 6, 6}, 3, 3, 3)
+              << new MaxPool2DLayer<CPUTensor>({3, 6, 6}, 2, 2)
+              << new ReshapeLayer<CPUTensor>({3, 3, 3}, {27})
+              << new DenseLayer<CPUTensor>(27, 10)
+              << new BiasLayer<CPUTensor>({10})
+              << new SoftmaxActivation<CPUTensor>({10});
+
+    string path = "/tmp/deeplearn-test.ckpt";
+    Check(h_network.Save(path), "Checkpoint test failed: failed to save");
+
+    unique_ptr<Checkpoint> checkpoint = Checkpoint::Open(path);
+    Check(checkpoint && checkpoint->num_layers() == 8 && checkpoint->num_tensors() == 5, "Checkpoint test failed");
+    for (size_t i = 0; i < checkpoint->num_tensors(); i++)
+        Check((uintptr_t)checkpoint->tensor_data(i) % kCheckpointAlignment == 0, "Checkpoint test failed: misaligned tensor");
+
+    // Networks loaded on either device must compute the same output as the original network.
+    CPUTensor input(input_shape, RandomInitializer());
+    unique_ptr<Network<CPUTensor>> h_loaded = Network<CPUTensor>::Load(*checkpoint, new MSE<CPUTensor>({10}));
+    unique_ptr<Network<GPUTensor>> g_loaded = Network<GPUTensor>::Load(*checkpoint, new MSE<GPUTensor>({10}));
+    Check(h_loaded && g_loaded, "Checkpoint test failed: failed to load");
+    Check(h_loaded->Evaluate(input) == h_network.Evaluate(input), "Checkpoint test failed: wrong output after loading");
+    Check(g_loaded->Evaluate(input.ToGPU()).ToHost() == h_network.Evaluate(input), "Checkpoint test failed: wrong output after loading");
+
+    // Restoring into a network with a different topology must fail.
+    Network<CPUTensor> other(new MSE<CPUTensor>({10}));
+    other << new DenseLayer<CPUTensor>(27, 10);
+    Check(!other.Restore(*checkpoint), "Checkpoint test failed: restored into mismatching network");
+
+    checkpoint.reset();
+    remove(path.c_str());
+}
+
+void RunInferenceServerTests()
+{
+    const size_t input_dim = 20, output_dim = 5, num_clients = 8, num_requests = 50;
+    CPUTensor h_weights({output_dim, input_dim}, RandomInitializer());
+    Network<CPUTensor> h_network(new MSE<CPUTensor>({output_dim}));
+    h_network << new DenseLayer<CPUTensor>(h_weights) << new SigmoidActivation<CPUTensor>({output_dim});
+    Network<GPUTensor> g_network(new MSE<GPUTensor>({output_dim}));
+    g_network << new DenseLayer<GPUTensor>(h_weights.ToGPU()) << new SigmoidActivation<GPUTensor>({output_dim});
+
+    // Batched evaluation must match evaluating every sample on its own.
+    CPUTensor h_inputs({num_clients, input_dim}, RandomInitializer());
+    CPUTensor g_outputs = g_network.EvaluateBatch(h_inputs.ToGPU()).ToHost();
+    for (size_t i = 0; i < num_clients; i++)
+        Check(g_outputs[i] == h_network.Evaluate(h_inputs[i]), "Batched evaluation test failed");
+
+    auto evaluate = [&g_network](const CPUTensor& inputs) { return g_network.EvaluateBatch(inputs.ToGPU()).ToHost(); };
+    utils::InferenceServer server({input_dim}, {output_dim}, evaluate, 4, chrono::milliseconds(5));
+    string path = "/tmp/deeplearn-test.sock";
+    Check(server.Listen(path), "Inference server test failed: failed to listen");
+    thread server_thread([&server]() { server.Run(); });
+
+    // Concurrent clients, whose requests end up in the same batches. Tensors are not thread safe, so every client gets its own copies.
+    vector<CPUTensor> inputs, expected_outputs;
+    inputs.reserve(num_clients);
+    expected_outputs.reserve(num_clients);
+    for (size_t c = 0; c < num_clients; c++) {
+        inputs.push_back(h_inputs[c]);
+        expected_outputs.push_back(h_network.Evaluate(h_inputs[c]));
+    }
+
+    vector<thread> clients;
+    vector<int> success(num_clients, true);
+    for (size_t c = 0; c < num_clients; c++) {
+        clients.emplace_back([&, c]() {
+            unique_ptr<utils::InferenceClient> client = utils::InferenceClient::Connect(path);
+            if (!client || client->input_size() != input_dim || client->output_size() != output_dim) {
+                success[c] = false;
+                return;
+            }
+
+            CPUTensor output({output_dim});
+            for (size_t r = 0; r < num_requests; r++) {
+                success[c] = success[c] && client->Evaluate(inputs[c].begin(), output.begin()) && output == expected_outputs[c];
+            }
+        });
+    }
+    for (thread& client : clients)
+        client.join();
+
+    server.Stop();
+    server_thread.join();
+
+    for (size_t c = 0; c < num_clients; c++)
+        Check(success[c], "Inference server test failed: wrong result");
+    Check(server.statistics().num_requests() == num_clients * num_requests, "Inference server test failed: wrong statistics");
+}
 
 int main(int argc, char** argv)
 {
@@ -338,9 +895,16 @@ int main(int argc, char** argv)
 
     // Basic tensor tests don't run any benchmarks.
     RunBasicTensorTests();
+    RunIdxTests();
+    RunDataLoaderTests();
 
     cout << "   RESULTS" << endl << endl;
 
+    RunProfilerTests();
+    RunTransferTests();
+    RunDeviceDatasetTests();
+    cout << endl;
+
     RunTensorArithmeticTests();
     cout << endl;
 
@@ -359,6 +923,18 @@ int main(int argc, char** argv)
     RunLayerTests();
     cout << endl;
 
+    RunOptimizerTests();
+    cout << endl;
+
+    RunDataParallelTests();
+    cout << endl;
+
+    RunExecutionPlanTests();
+    cout << endl;
+
+    RunCheckpointTests();
+    RunInferenceServerTests();
+
     cout << "\n   ALL TESTS PASSED" << endl;
 
     return 0;
@@ -0,0 +1,81 @@
+//
+// Lock-free bounded queue.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __BOUNDED_QUEUE_H__
+#define __BOUNDED_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "common/Common.h"
+
+// A fixed size ring buffer for exactly one producer and one consumer thread, which never block each other.
+//
+// Elements are constructed once and then reused: the producer fills the slot returned by Reserve() in place and
+// publishes it with Push(), the consumer works on Front() in place and hands the slot back with Pop(). This way large
+// elements, e.g. tensors, are neither copied nor reallocated while passing through the queue.
+template <typename T>
+class BoundedQueue {
+  public:
+    // Creates a queue with |capacity| slots, each of which is allocated through |create|, which must return a new T*.
+    template <typename Factory>
+    BoundedQueue(size_t capacity, Factory create) : capacity_(capacity), slots_(new std::unique_ptr<T>[capacity]), head_(0), tail_(0)
+    {
+        Assert(capacity > 0);
+        for (size_t i = 0; i < capacity; i++)
+            slots_[i].reset(create());
+    }
+
+    // Producer side: returns the next free slot, or nullptr if the queue is full.
+    T* Reserve()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == capacity_)
+            return nullptr;
+        return slots_[head % capacity_].get();
+    }
+
+    // Producer side: makes the slot returned by the last call to Reserve() available to the consumer.
+    void Push()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side: returns the oldest published slot, or nullptr if the queue is empty.
+    T* Front()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+            return nullptr;
+        return slots_[tail % capacity_].get();
+    }
+
+    // Consumer side: returns the slot returned by Front() to the producer.
+    void Pop()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+  private:
+    static const size_t kCacheLineSize = 64;
+
+    const size_t capacity_;
+
+    std::unique_ptr<std::unique_ptr<T>[]> slots_;
+
+    // Number of slots pushed and popped so far. Kept on separate cache lines since they are written by different threads.
+    // The counters are padded instead of over-aligned, so the queue can still be allocated with plain new.
+    char padding0_[kCacheLineSize];
+    std::atomic<size_t> head_;
+    char padding1_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;
+    char padding2_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+
+    DISALLOW_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "KernelCommon.h"
 
+#ifndef VECTOR_WIDTH
+
 kernel void ScaledAdd(uint size, global const float* x, global const float* y, float v, global float* out)
 {
     uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;
@@ -12,6 +14,28 @@ kernel void ScaledAdd(uint size, global const float* x, global const float* y, f
     }
 }
 
+#else
+
+kernel void ScaledAddVec(uint size, global const float* x, global const float* y, float v, global float* out)
+{
+    uint num_vectors = size / VECTOR_WIDTH;
+    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;
+
+    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {
+        uint index = base + i * get_local_size(0);
+        if (index < num_vectors) {
+            vstoreN(vloadN(index, x) + v * vloadN(index, y), index, out);
+        }
+    }
+
+    uint tail = num_vectors * VECTOR_WIDTH + get_global_id(0);
+    if (tail < size) {
+        out[tail] = x[tail] + v * y[tail];
+    }
+}
+
+#endif
+
 #define add(x, y) (x)+(y)
 BINARY_OPERATION(Add, add);
 TENSOR_SCALAR_OPERATION(ScalarAdd, add);
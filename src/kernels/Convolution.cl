@@ -4,224 +4,382 @@
 #if 0
 #define KERNEL_WIDTH 3
 #define KERNEL_HEIGHT 3
-#define LOOKUP_TABLE_X { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 17, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17 }
-#define LOOKUP_TABLE_Y { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17 }
 #endif
 
+// The kernels in this file handle convolutions with stride 1 and without dilation, but any padding.
+// The host passes the padding as (pad_x, pad_y): output element (x, y) is computed from the input
+// elements at (x - pad_x + kx, y - pad_y + ky). See ConvolutionGeneral.cl for the other cases.
+
 #define TILE_WIDTH 16
 #define TILE_HEIGHT 16
-#define KERNEL_HALFWIDTH (KERNEL_WIDTH / 2)
-#define KERNEL_HALFHEIGHT (KERNEL_HEIGHT / 2)
 #define KERNEL_SIZE ((KERNEL_WIDTH) * (KERNEL_HEIGHT))
-#define LOOKUP_TABLE_SIZE (sizeof(halo_lookup_table_x) / sizeof(halo_lookup_table_x[0]))
-
-#define CACHE_WIDTH (KERNEL_WIDTH * 5)
-#define CACHE_HEIGHT (KERNEL_HEIGHT * 5)
-
-// TODO get rid of this requirement by loading halo values in a loop.
-#if (TILE_WIDTH + KERNEL_HALFWIDTH * 2) * (TILE_HEIGHT + KERNEL_HALFHEIGHT * 2) - (TILE_WIDTH * TILE_HEIGHT) > TILE_WIDTH * TILE_HEIGHT
-  #error "Convolution kernel too large: There are more halo elements than threads!"
-#endif
 
-// Lookup tables to map a thread ID to a halo coordinate.
-constant int halo_lookup_table_x[] = LOOKUP_TABLE_X;
-constant int halo_lookup_table_y[] = LOOKUP_TABLE_Y;
+// Size of the input area (tile plus halo) needed to compute a TILE_WIDTH x TILE_HEIGHT block of outputs.
+#define CACHE_TILE_WIDTH (TILE_WIDTH + KERNEL_WIDTH - 1)
+#define CACHE_TILE_HEIGHT (TILE_HEIGHT + KERNEL_HEIGHT - 1)
+
+// Loads the input area of the given channel that starts at |origin| (in image coordinates) into the local |tile|.
+// Elements outside the image are zero. Every thread loads several elements, so this works for any kernel size.
+#define LOAD_TILE(tile, input, channel, origin, width, height)                                              \
+    for (uint i = id; i < CACHE_TILE_WIDTH * CACHE_TILE_HEIGHT; i += num_threads) {                         \
+        pos2 c = (pos2)(i % CACHE_TILE_WIDTH, i / CACHE_TILE_WIDTH);                                        \
+        pos2 gc = (origin) + c;                                                                             \
+        if (gc.x >= 0 && (uint)gc.x < (width) && gc.y >= 0 && (uint)gc.y < (height))                        \
+            tile[c.y][c.x] = input[(channel) * ((width) * (height)) + gc.y * (width) + gc.x];               \
+        else                                                                                                \
+            tile[c.y][c.x] = 0.f;                                                                           \
+    }
 
 kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
-kernel void Convolution2D(uint width, uint height, uint channel, uint num_channels, global const float* input, global const float* conv_kernel, global float* output)
+kernel void Convolution2D(uint in_width, uint in_height, uint out_width, uint out_height, int pad_x, int pad_y, uint num_channels,
+                          global const float* input, global const float* conv_kernel, global float* output)
 {
     // Local caches for fast memory access.
-    local float tile[TILE_HEIGHT + KERNEL_HALFHEIGHT * 2][TILE_WIDTH + KERNEL_HALFWIDTH * 2];
+    local float tile[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
     local float kern[KERNEL_HEIGHT][KERNEL_WIDTH];
 
-    // Position of this thread's element in the input/output image.
+    // Position of this thread's element in the output image.
     pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
     uint feature_map = get_global_id(Z);
 
-    // Local ID of this thread.
-    int2 l = (int2)(get_local_id(X), get_local_id(Y));
-
-    // Position of this thread's element in the cached tile.
-    pos2 t = l + (int2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
+    // Local ID of this thread, which is also its position in the tile.
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
 
     // Image coordinate of the upper-left element in the tile cache.
-    pos2 ul = g - l - (pos2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
 
-    // Load main area from input buffer.
-    if ((uint)g.x < width && (uint)g.y < height)
-        tile[t.y][t.x] = input[channel * (width * height) + g.y * width + g.x];
-    else
-        tile[t.y][t.x] = 0.f;
+    // The results for all input channels are summed up in a register and only written back once.
+    float value = 0.f;
+    for (uint channel = 0; channel < num_channels; channel++) {
+        // Wait until all threads are done with the previous channel.
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-    // Load halo region from input buffer.
-    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
-    if (id < LOOKUP_TABLE_SIZE) {
-        pos2 lh = (pos2)(halo_lookup_table_x[id], halo_lookup_table_y[id]);
-        pos2 gh = ul + lh;
-        if (gh.x >= 0 && (uint)gh.x < width && gh.y >= 0 && (uint)gh.y < height)
-            tile[lh.y][lh.x] = input[channel * (width * height) + gh.y * width + gh.x];
-        else
-            tile[lh.y][lh.x] = 0.f;
-    }
+        LOAD_TILE(tile, input, channel, origin, in_width, in_height);
 
-    // Load kernel into local memory and mirror it at the center.
-    // TODO might want to assert that work group size > kernel size
-    uint kernel_base_index = feature_map * (num_channels * KERNEL_WIDTH * KERNEL_HEIGHT) + channel * (KERNEL_WIDTH * KERNEL_HEIGHT);
-    if (l.x < KERNEL_WIDTH && l.y < KERNEL_HEIGHT)
-        kern[l.y][l.x] = conv_kernel[kernel_base_index + (KERNEL_HEIGHT - 1 - l.y) * KERNEL_WIDTH + (KERNEL_WIDTH - 1 - l.x)];
+        // Load kernel into local memory and mirror it at the center.
+        uint kernel_base_index = feature_map * (num_channels * KERNEL_SIZE) + channel * KERNEL_SIZE;
+        for (uint i = id; i < KERNEL_SIZE; i += num_threads)
+            kern[i / KERNEL_WIDTH][i % KERNEL_WIDTH] = conv_kernel[kernel_base_index + KERNEL_SIZE - 1 - i];
 
-    // Sync threads.
-    barrier(CLK_LOCAL_MEM_FENCE);
+        // Sync threads.
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-    // Perform the convolution.
-    float value = 0.f;
-    for (int ky = -KERNEL_HALFHEIGHT; ky <= KERNEL_HALFHEIGHT; ky++) {
-        for (int kx = -KERNEL_HALFWIDTH; kx <= KERNEL_HALFWIDTH; kx++) {
-            value += tile[t.y + ky][t.x + kx] * kern[ky + KERNEL_HALFHEIGHT][kx + KERNEL_HALFWIDTH];
+        // Perform the convolution.
+        for (uint ky = 0; ky < KERNEL_HEIGHT; ky++) {
+            for (uint kx = 0; kx < KERNEL_WIDTH; kx++) {
+                value += tile[l.y + ky][l.x + kx] * kern[ky][kx];
+            }
         }
     }
 
-    // Write back result. This kernel is called multiple times (once per input channel)
-    // and the results are added up into the final images.
-    if ((uint)g.x < width && (uint)g.y < height) {
-        if (channel == 0)
-            output[feature_map * (width * height) + g.y * width + g.x] = value;
-        else
-            output[feature_map * (width * height) + g.y * width + g.x] += value;
-    }
+    // Write back result.
+    if ((uint)g.x < out_width && (uint)g.y < out_height)
+        output[feature_map * (out_width * out_height) + g.y * out_width + g.x] = value;
 }
 
 // Same as the convolution, except that the kernel is not mirrored.
+//
+// The host passes the padding of the equivalent correlation here, i.e. kernel size - 1 - padding of the convolution.
 // TODO this is pretty much excactly the same code except for the part that loads the kernel from global memory.
 // For some reason the compiler doesn't like us putting the common code into a separate function though: "SC failed. No reason given."...
 kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
-kernel void CrossCorrelation2D(uint width, uint height, uint channel, uint num_feature_maps, global const float* input, global const float* conv_kernel, global float* output)
+kernel void CrossCorrelation2D(uint in_width, uint in_height, uint out_width, uint out_height, int pad_x, int pad_y, uint num_channels, uint num_feature_maps,
+                               global const float* input, global const float* conv_kernel, global float* output)
 {
     // Local caches for fast memory access.
-    local float tile[TILE_HEIGHT + KERNEL_HALFHEIGHT * 2][TILE_WIDTH + KERNEL_HALFWIDTH * 2];
+    local float tile[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
     local float kern[KERNEL_HEIGHT][KERNEL_WIDTH];
 
-    // Position of this thread's element in the input/output image.
+    // Position of this thread's element in the output image.
     pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
     uint feature_map = get_global_id(Z);
 
+    // Local ID of this thread, which is also its position in the tile.
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
+
+    // Image coordinate of the upper-left element in the tile cache.
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
+
+    // The results for all input channels are summed up in a register and only written back once.
+    float value = 0.f;
+    for (uint channel = 0; channel < num_channels; channel++) {
+        // Wait until all threads are done with the previous channel.
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        LOAD_TILE(tile, input, channel, origin, in_width, in_height);
+
+        // Load kernel into local memory.
+        // Kernel has different shape here than in the Convolution2D kernel. See TensorOps.h and/or CpuTensorOps.h.
+        uint kernel_base_index = channel * (num_feature_maps * KERNEL_SIZE) + feature_map * KERNEL_SIZE;
+        for (uint i = id; i < KERNEL_SIZE; i += num_threads)
+            kern[i / KERNEL_WIDTH][i % KERNEL_WIDTH] = conv_kernel[kernel_base_index + i];
+
+        // Sync threads.
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Perform the cross-correlation.
+        for (uint ky = 0; ky < KERNEL_HEIGHT; ky++) {
+            for (uint kx = 0; kx < KERNEL_WIDTH; kx++) {
+                value += tile[l.y + ky][l.x + kx] * kern[ky][kx];
+            }
+        }
+    }
+
+    // Write back result.
+    if ((uint)g.x < out_width && (uint)g.y < out_height)
+        output[feature_map * (out_width * out_height) + g.y * out_width + g.x] = value;
+}
+
+
+// Register blocking of the Convolution2DBlocked kernel. Usually defined by the host code, see KernelManager.
+#ifndef FEATURE_MAPS_PER_THREAD
+#define FEATURE_MAPS_PER_THREAD 4
+#endif
+#ifndef PIXELS_PER_THREAD
+#define PIXELS_PER_THREAD 2
+#endif
+
+#if TILE_WIDTH % PIXELS_PER_THREAD != 0
+  #error "The tile width must be a multiple of the number of pixels per thread"
+#endif
+
+// Same as Convolution2D, but every thread computes PIXELS_PER_THREAD horizontally adjacent output pixels of
+// FEATURE_MAPS_PER_THREAD consecutive feature maps. Every value read from the cached tile is thus reused for
+// several feature maps and every kernel weight for several pixels, with the partial sums kept in registers.
+//
+// A work group computes a TILE_WIDTH x TILE_HEIGHT block of FEATURE_MAPS_PER_THREAD feature maps, global Z is the
+// number of feature maps divided by FEATURE_MAPS_PER_THREAD.
+kernel __attribute__((reqd_work_group_size(TILE_WIDTH / PIXELS_PER_THREAD, TILE_HEIGHT, 1)))
+kernel void Convolution2DBlocked(uint in_width, uint in_height, uint out_width, uint out_height, int pad_x, int pad_y, uint num_channels,
+                                 global const float* input, global const float* conv_kernel, global float* output)
+{
+    // Local caches for fast memory access.
+    local float tile[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
+    local float kern[FEATURE_MAPS_PER_THREAD][KERNEL_HEIGHT][KERNEL_WIDTH];
+
     // Local ID of this thread.
-    int2 l = (int2)(get_local_id(X), get_local_id(Y));
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
 
-    // Position of this thread's element in the cached tile.
-    pos2 t = l + (int2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
+    // Position of this thread's first element in the tile and in the output image.
+    pos2 t = (pos2)(get_local_id(X) * PIXELS_PER_THREAD, get_local_id(Y));
+    pos2 g = (pos2)(get_group_id(X) * TILE_WIDTH, get_group_id(Y) * TILE_HEIGHT) + t;
 
     // Image coordinate of the upper-left element in the tile cache.
-    pos2 ul = g - l - (pos2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
+    pos2 origin = g - t - (pos2)(pad_x, pad_y);
 
-    // Load main area from input buffer.
-    if ((uint)g.x < width && (uint)g.y < height)
-        tile[t.y][t.x] = input[channel * (width * height) + g.y * width + g.x];
-    else
-        tile[t.y][t.x] = 0.f;
+    uint first_feature_map = get_global_id(Z) * FEATURE_MAPS_PER_THREAD;
 
-    // Load halo region from input buffer.
-    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
-    if (id < LOOKUP_TABLE_SIZE) {
-        pos2 lh = (pos2)(halo_lookup_table_x[id], halo_lookup_table_y[id]);
-        pos2 gh = ul + lh;
-        if (gh.x >= 0 && (uint)gh.x < width && gh.y >= 0 && (uint)gh.y < height)
-            tile[lh.y][lh.x] = input[channel * (width * height) + gh.y * width + gh.x];
-        else
-            tile[lh.y][lh.x] = 0.f;
+    float values[FEATURE_MAPS_PER_THREAD][PIXELS_PER_THREAD];
+    for (uint f = 0; f < FEATURE_MAPS_PER_THREAD; f++) {
+        for (uint p = 0; p < PIXELS_PER_THREAD; p++)
+            values[f][p] = 0.f;
     }
 
-    // Load kernel into local memory and mirror it at the center.
-    // Kernel has different shape here than in the Convolution2D kernel. See TensorOps.h and/or CpuTensorOps.h.
-    uint kernel_base_index = channel * (num_feature_maps * KERNEL_WIDTH * KERNEL_HEIGHT) + feature_map * (KERNEL_WIDTH * KERNEL_HEIGHT);
-    if (l.x < KERNEL_WIDTH && l.y < KERNEL_HEIGHT)
-        kern[l.y][l.x] = conv_kernel[kernel_base_index + l.y * KERNEL_WIDTH + l.x];
+    for (uint channel = 0; channel < num_channels; channel++) {
+        // Wait until all threads are done with the previous channel.
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-    // Sync threads.
-    barrier(CLK_LOCAL_MEM_FENCE);
+        LOAD_TILE(tile, input, channel, origin, in_width, in_height);
 
-    // Perform the convolution.
-    float value = 0.f;
-    for (int ky = -KERNEL_HALFHEIGHT; ky <= KERNEL_HALFHEIGHT; ky++) {
-        for (int kx = -KERNEL_HALFWIDTH; kx <= KERNEL_HALFWIDTH; kx++) {
-            value += tile[t.y + ky][t.x + kx] * kern[ky + KERNEL_HALFHEIGHT][kx + KERNEL_HALFWIDTH];
+        // Load the kernels of all feature maps computed by this work group and mirror them at the center.
+        for (uint i = id; i < FEATURE_MAPS_PER_THREAD * KERNEL_SIZE; i += num_threads) {
+            uint f = i / KERNEL_SIZE, k = i % KERNEL_SIZE;
+            uint kernel_base_index = (first_feature_map + f) * (num_channels * KERNEL_SIZE) + channel * KERNEL_SIZE;
+            kern[f][k / KERNEL_WIDTH][k % KERNEL_WIDTH] = conv_kernel[kernel_base_index + KERNEL_SIZE - 1 - k];
+        }
+
+        // Sync threads.
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Perform the convolution.
+        for (uint ky = 0; ky < KERNEL_HEIGHT; ky++) {
+            for (uint kx = 0; kx < KERNEL_WIDTH; kx++) {
+                float pixels[PIXELS_PER_THREAD];
+                for (uint p = 0; p < PIXELS_PER_THREAD; p++)
+                    pixels[p] = tile[t.y + ky][t.x + p + kx];
+
+                for (uint f = 0; f < FEATURE_MAPS_PER_THREAD; f++) {
+                    float weight = kern[f][ky][kx];
+                    for (uint p = 0; p < PIXELS_PER_THREAD; p++)
+                        values[f][p] += pixels[p] * weight;
+                }
+            }
         }
     }
 
-    // Write back result. This kernel is called multiple times (once per input channel)
-    // and the results are added up into the final images.
-    if ((uint)g.x < width && (uint)g.y < height) {
-        if (channel == 0)
-            output[feature_map * (width * height) + g.y * width + g.x] = value;
-        else
-            output[feature_map * (width * height) + g.y * width + g.x] += value;
+    // Write back results.
+    for (uint f = 0; f < FEATURE_MAPS_PER_THREAD; f++) {
+        for (uint p = 0; p < PIXELS_PER_THREAD; p++) {
+            if ((uint)g.x + p < out_width && (uint)g.y < out_height)
+                output[(first_feature_map + f) * (out_width * out_height) + g.y * out_width + g.x + p] = values[f][p];
+        }
     }
 }
 
 
-#if TILE_WIDTH < KERNEL_WIDTH || TILE_HEIGHT < KERNEL_HEIGHT
-  #error "Convolution kernel too large. Gradient computation will fail."
-#endif
+// Sums up the contributions of all work items of a TILE_WIDTH x TILE_HEIGHT work group to the gradient of every kernel
+// weight: the product of the work item's output |gradient| and the input element in |tile| that the weight was applied
+// to at its pixel |l|. Every weight is reduced with a tree reduction in the local |sums|, which holds one float per work
+// item, in log2(work group size) steps. The sum for weight k is written to partial_sums[(kernel_index * KERNEL_SIZE +
+// KERNEL_SIZE - 1 - k) * num_blocks + block], the kernel being mirrored during the convolution.
+#define REDUCE_KERNEL_GRADIENTS(sums, tile, gradient, l, kernel_index, block, num_blocks, partial_sums)     \
+    for (uint k = 0; k < KERNEL_SIZE; k++) {                                                                \
+        sums[id] = (gradient) * tile[(l).y + k / KERNEL_WIDTH][(l).x + k % KERNEL_WIDTH];                   \
+        for (uint stride = num_threads / 2; stride > 0; stride /= 2) {                                      \
+            barrier(CLK_LOCAL_MEM_FENCE);                                                                   \
+            if (id < stride)                                                                                \
+                sums[id] += sums[id + stride];                                                              \
+        }                                                                                                   \
+        if (id == 0) {                                                                                      \
+            uint weight = (kernel_index) * KERNEL_SIZE + KERNEL_SIZE - 1 - k;                               \
+            partial_sums[weight * (num_blocks) + (block)] = sums[0];                                        \
+        }                                                                                                   \
+        /* Wait until the sum has been read before the next weight reuses the local memory. */              \
+        barrier(CLK_LOCAL_MEM_FENCE);                                                                       \
+    }
 
-kernel __attribute__((reqd_work_group_size(KERNEL_WIDTH * KERNEL_HEIGHT, 1, 1)))
-kernel void Convolution2DGradients(uint width, uint height, uint num_channels, global const float* input, global const float* gradients, global float* kernels)
+// First pass of the kernel weight gradients. Every work group handles one TILE_WIDTH x TILE_HEIGHT block of the output
+// of one (feature map, channel) pair, global Z being feature_map * num_channels + channel. Every work item computes the
+// products for its output pixel, which are then summed up over the block by a tree reduction, see
+// REDUCE_KERNEL_GRADIENTS. The partial sums of all blocks are reduced by the ReduceRows kernel afterwards.
+//
+// |partial_sums| is a (num_feature_maps, num_channels, KERNEL_SIZE, num_blocks) tensor.
+kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
+kernel void Convolution2DGradients(uint in_width, uint in_height, uint out_width, uint out_height, int pad_x, int pad_y, uint num_channels,
+                                   global const float* input, global const float* gradients, global float* partial_sums)
 {
-    uint feature_map_index = get_global_id(Z);
-    uint channel_index = get_global_id(Y);
-    uint kernel_weight_index = get_local_id(X);
-
-    local float local_input[TILE_HEIGHT][TILE_WIDTH];
-    local float local_gradients[TILE_HEIGHT + 2 * KERNEL_HALFHEIGHT][TILE_WIDTH + 2 * KERNEL_HALFWIDTH];
+    local float local_input[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
+    local float sums[TILE_WIDTH * TILE_HEIGHT];
 
-    // Index delta to obtain the output element from an input element for our kernel weight.
-    pos2 k = (pos2)(kernel_weight_index % KERNEL_WIDTH, kernel_weight_index / KERNEL_WIDTH);
-    // Obtain the relativ delta to the center of the kernel. Also mirrors the kernel at the same time.
-    k -= (pos2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
+    pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint kernel_index = get_global_id(Z);
+    uint feature_map = kernel_index / num_channels, channel = kernel_index % num_channels;
 
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
 
+    // Work items outside of the output don't contribute.
     float gradient = 0.f;
+    if ((uint)g.x < out_width && (uint)g.y < out_height)
+        gradient = gradients[feature_map * (out_width * out_height) + g.y * out_width + g.x];
 
-    // Iterate over all elements of the input image.
-    uint x = 0, y = 0;
-    while (y < height) {
-        while (x < width) {
-            //
-            // Load next block into local memory.
-            barrier(CLK_LOCAL_MEM_FENCE);
-            for (uint i = kernel_weight_index; i < TILE_WIDTH * TILE_HEIGHT; i += get_local_size(X)) {
-                pos2 l = (pos2)(i % TILE_WIDTH, i / TILE_WIDTH);
-                pos2 g = l + (pos2)(x, y);
-                if (g.x < (int)width && g.y < (int)height)
-                    local_input[l.y][l.x] = input[channel_index * (width * height) + g.y * width + g.x];
-                else
-                    local_input[l.y][l.x] = 0.f;
-            }
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
+    LOAD_TILE(local_input, input, channel, origin, in_width, in_height);
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-            for (uint i = kernel_weight_index; i < (TILE_WIDTH + 2 * KERNEL_HALFWIDTH) * (TILE_HEIGHT + 2 * KERNEL_HALFHEIGHT); i += get_local_size(X)) {
-                pos2 l = (pos2)(i % (TILE_WIDTH + 2 * KERNEL_HALFWIDTH), i / (TILE_WIDTH + 2 * KERNEL_HALFWIDTH));
-                pos2 g = l + (pos2)(x, y) - (pos2)(KERNEL_HALFWIDTH, KERNEL_HALFHEIGHT);
-                if (g.x >= 0 && g.x < (int)width && g.y >= 0 && g.y < (int)height)
-                    local_gradients[l.y][l.x] = gradients[feature_map_index * (width * height) + g.y * width + g.x];
-                else
-                    local_gradients[l.y][l.x] = 0.f;
-            }
-            barrier(CLK_LOCAL_MEM_FENCE);
+    uint num_blocks = get_num_groups(X) * get_num_groups(Y);
+    uint block = get_group_id(Y) * get_num_groups(X) + get_group_id(X);
+
+    REDUCE_KERNEL_GRADIENTS(sums, local_input, gradient, l, kernel_index, block, num_blocks, partial_sums);
+}
 
-            //
-            // Do the "convolution".
-            for (uint ly = KERNEL_HALFHEIGHT; ly < TILE_HEIGHT + KERNEL_HALFHEIGHT; ly++) {
-                for (uint lx = KERNEL_HALFWIDTH; lx < TILE_WIDTH + KERNEL_HALFWIDTH; lx++) {
-                    gradient += local_input[ly - KERNEL_HALFHEIGHT][lx - KERNEL_HALFWIDTH] * local_gradients[ly + k.y][lx + k.x];
-                }
-            }
 
-            x += TILE_WIDTH;
+// Depthwise convolution: every channel is convolved with its own kernel, so global Z is the channel.
+// Input and output have the same size, the host passes the padding as for Convolution2D.
+kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
+kernel void DepthwiseConvolution2D(uint width, uint height, int pad_x, int pad_y,
+                                   global const float* input, global const float* conv_kernel, global float* output)
+{
+    local float tile[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
+    local float kern[KERNEL_HEIGHT][KERNEL_WIDTH];
+
+    pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
+    uint channel = get_global_id(Z);
+
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
+
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
+
+    LOAD_TILE(tile, input, channel, origin, width, height);
+
+    // Load the kernel of this channel into local memory and mirror it at the center.
+    for (uint i = id; i < KERNEL_SIZE; i += num_threads)
+        kern[i / KERNEL_WIDTH][i % KERNEL_WIDTH] = conv_kernel[channel * KERNEL_SIZE + KERNEL_SIZE - 1 - i];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float value = 0.f;
+    for (uint ky = 0; ky < KERNEL_HEIGHT; ky++) {
+        for (uint kx = 0; kx < KERNEL_WIDTH; kx++) {
+            value += tile[l.y + ky][l.x + kx] * kern[ky][kx];
         }
+    }
+
+    if ((uint)g.x < width && (uint)g.y < height)
+        output[channel * (width * height) + g.y * width + g.x] = value;
+}
 
-        x = 0;
-        y += TILE_HEIGHT;
+// Same as the depthwise convolution, except that the kernel is not mirrored.
+kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
+kernel void DepthwiseCrossCorrelation2D(uint width, uint height, int pad_x, int pad_y,
+                                        global const float* input, global const float* conv_kernel, global float* output)
+{
+    local float tile[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
+    local float kern[KERNEL_HEIGHT][KERNEL_WIDTH];
+
+    pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
+    uint channel = get_global_id(Z);
+
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
+
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
+
+    LOAD_TILE(tile, input, channel, origin, width, height);
+
+    for (uint i = id; i < KERNEL_SIZE; i += num_threads)
+        kern[i / KERNEL_WIDTH][i % KERNEL_WIDTH] = conv_kernel[channel * KERNEL_SIZE + i];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float value = 0.f;
+    for (uint ky = 0; ky < KERNEL_HEIGHT; ky++) {
+        for (uint kx = 0; kx < KERNEL_WIDTH; kx++) {
+            value += tile[l.y + ky][l.x + kx] * kern[ky][kx];
+        }
     }
 
-    // Write back
-    kernels[feature_map_index * (num_channels * KERNEL_WIDTH * KERNEL_HEIGHT) + channel_index * (KERNEL_WIDTH * KERNEL_HEIGHT) + kernel_weight_index] = gradient;
+    if ((uint)g.x < width && (uint)g.y < height)
+        output[channel * (width * height) + g.y * width + g.x] = value;
+}
+
+// Gradients of the depthwise convolution wrt its kernel weights. Works like Convolution2DGradients, except that every
+// channel only contributes to its own kernel, so global Z is the channel.
+//
+// |partial_sums| is a (num_channels, KERNEL_SIZE, num_blocks) tensor.
+kernel __attribute__((reqd_work_group_size(TILE_WIDTH, TILE_HEIGHT, 1)))
+kernel void DepthwiseConvolution2DGradients(uint width, uint height, int pad_x, int pad_y,
+                                            global const float* input, global const float* gradients, global float* partial_sums)
+{
+    local float local_input[CACHE_TILE_HEIGHT][CACHE_TILE_WIDTH];
+    local float sums[TILE_WIDTH * TILE_HEIGHT];
+
+    pos2 g = (pos2)(get_global_id(X), get_global_id(Y));
+    pos2 l = (pos2)(get_local_id(X), get_local_id(Y));
+    uint channel = get_global_id(Z);
+
+    uint id = get_local_id(Y) * get_local_size(X) + get_local_id(X);
+    uint num_threads = get_local_size(X) * get_local_size(Y);
+
+    float gradient = 0.f;
+    if ((uint)g.x < width && (uint)g.y < height)
+        gradient = gradients[channel * (width * height) + g.y * width + g.x];
+
+    pos2 origin = g - l - (pos2)(pad_x, pad_y);
+    LOAD_TILE(local_input, input, channel, origin, width, height);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    uint num_blocks = get_num_groups(X) * get_num_groups(Y);
+    uint block = get_group_id(Y) * get_num_groups(X) + get_group_id(X);
+
+    REDUCE_KERNEL_GRADIENTS(sums, local_input, gradient, l, channel, block, num_blocks, partial_sums);
 }
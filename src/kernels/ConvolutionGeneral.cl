@@ -0,0 +1,104 @@
+#include "KernelCommon.h"
+
+// Convolutions with arbitrary stride, padding and dilation. The kernel size is a runtime parameter here,
+// so these are compiled only once. Convolutions with stride 1 and without dilation use the tiled kernels
+// in Convolution.cl instead.
+//
+// Output element (x, y) of a convolution is computed from the input elements at
+// (x * stride - pad_x + kx * dilation, y * stride - pad_y + ky * dilation), see ConvolutionParameters.h.
+
+kernel void Convolution2DGeneral(uint in_width, uint in_height, uint out_width, uint out_height, uint kernel_width, uint kernel_height,
+                                 uint stride, uint dilation, int pad_x, int pad_y, uint num_channels, uint num_feature_maps,
+                                 global const float* input, global const float* kernels, global float* output)
+{
+    uint x = get_global_id(X), y = get_global_id(Y), feature_map = get_global_id(Z);
+    if (x >= out_width || y >= out_height || feature_map >= num_feature_maps)
+        return;
+
+    uint kernel_size = kernel_width * kernel_height;
+    int sx0 = (int)(x * stride) - pad_x, sy0 = (int)(y * stride) - pad_y;
+
+    float value = 0.f;
+    for (uint channel = 0; channel < num_channels; channel++) {
+        global const float* channel_input = input + channel * (in_width * in_height);
+        // The kernel is mirrored during a convolution, so walk it backwards.
+        global const float* kern = kernels + feature_map * (num_channels * kernel_size) + channel * kernel_size + kernel_size - 1;
+        for (uint ky = 0; ky < kernel_height; ky++) {
+            int sy = sy0 + (int)(ky * dilation);
+            for (uint kx = 0; kx < kernel_width; kx++) {
+                int sx = sx0 + (int)(kx * dilation);
+                if (sx >= 0 && sx < (int)in_width && sy >= 0 && sy < (int)in_height)
+                    value += kern[-(int)(ky * kernel_width + kx)] * channel_input[sy * in_width + sx];
+            }
+        }
+    }
+
+    output[feature_map * (out_width * out_height) + y * out_width + x] = value;
+}
+
+// Gradients of a convolution wrt its input. Here, |input| holds the gradients wrt the output of the convolution (num_feature_maps
+// images of size out_width x out_height) and |output| receives the gradients wrt its input (num_channels images of size in_width x in_height).
+kernel void CrossCorrelation2DGeneral(uint in_width, uint in_height, uint out_width, uint out_height, uint kernel_width, uint kernel_height,
+                                      uint stride, uint dilation, int pad_x, int pad_y, uint num_channels, uint num_feature_maps,
+                                      global const float* input, global const float* kernels, global float* output)
+{
+    uint x = get_global_id(X), y = get_global_id(Y), channel = get_global_id(Z);
+    if (x >= in_width || y >= in_height || channel >= num_channels)
+        return;
+
+    uint kernel_size = kernel_width * kernel_height;
+
+    // Sum up the contributions of all output elements that were computed from input element (x, y).
+    float value = 0.f;
+    for (uint ky = 0; ky < kernel_height; ky++) {
+        int ny = (int)y + pad_y - (int)(ky * dilation);
+        if (ny < 0 || ny % stride != 0 || ny / stride >= out_height)
+            continue;
+        uint oy = ny / stride;
+
+        for (uint kx = 0; kx < kernel_width; kx++) {
+            int nx = (int)x + pad_x - (int)(kx * dilation);
+            if (nx < 0 || nx % stride != 0 || nx / stride >= out_width)
+                continue;
+            uint ox = nx / stride;
+
+            uint kernel_index = channel * kernel_size + (kernel_height - 1 - ky) * kernel_width + (kernel_width - 1 - kx);
+            for (uint feature_map = 0; feature_map < num_feature_maps; feature_map++)
+                value += kernels[feature_map * (num_channels * kernel_size) + kernel_index] * input[feature_map * (out_width * out_height) + oy * out_width + ox];
+        }
+    }
+
+    output[channel * (in_width * in_height) + y * in_width + x] = value;
+}
+
+// Gradients of a convolution wrt its kernel weights, one weight per thread. Global X is the index of the weight within its kernel.
+// If |accumulate| is set, the gradients are added to |kernels|.
+kernel void Convolution2DGradientsGeneral(uint in_width, uint in_height, uint out_width, uint out_height, uint kernel_width, uint kernel_height,
+                                          uint stride, uint dilation, int pad_x, int pad_y, uint num_channels, uint num_feature_maps, uint accumulate,
+                                          global const float* input, global const float* gradients, global float* kernels)
+{
+    uint k = get_global_id(X), channel = get_global_id(Y), feature_map = get_global_id(Z);
+    uint kernel_size = kernel_width * kernel_height;
+    if (k >= kernel_size || channel >= num_channels || feature_map >= num_feature_maps)
+        return;
+
+    uint kx = k % kernel_width, ky = k / kernel_width;
+    global const float* channel_input = input + channel * (in_width * in_height);
+    global const float* feature_map_gradients = gradients + feature_map * (out_width * out_height);
+
+    float gradient = 0.f;
+    for (uint y = 0; y < out_height; y++) {
+        int sy = (int)(y * stride + ky * dilation) - pad_y;
+        if (sy < 0 || sy >= (int)in_height)
+            continue;
+        for (uint x = 0; x < out_width; x++) {
+            int sx = (int)(x * stride + kx * dilation) - pad_x;
+            if (sx >= 0 && sx < (int)in_width)
+                gradient += feature_map_gradients[y * out_width + x] * channel_input[sy * in_width + sx];
+        }
+    }
+
+    // The kernel is mirrored during the convolution.
+    uint index = feature_map * (num_channels * kernel_size) + channel * kernel_size + kernel_size - 1 - k;
+    kernels[index] = accumulate ? kernels[index] + gradient : gradient;
+}
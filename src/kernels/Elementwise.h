@@ -0,0 +1,16 @@
+#ifndef __ELEMENTWISE_H__
+#define __ELEMENTWISE_H__
+
+// Elementwise functions, shared between Activations.cl and the fused kernels generated by the host (see nn/tensor/Elementwise.h).
+//
+// These are macros so they work on scalars as well as on the vector types used by the vectorized kernels (see KernelCommon.h).
+
+#define sigmoid(f) (1.0f / (1.0f + exp(-(f))))
+
+#define sigmoid_derivative(f) (sigmoid(f) * (1.0f - sigmoid(f)))
+
+#define relu(f) max((f), 0.f)
+
+#define relu_derivative(f) step(0.f, (f))
+
+#endif
@@ -0,0 +1,26 @@
+#include "KernelCommon.h"
+
+// Assembly of mini batches from datasets that are kept on the device as bytes, see nn/DeviceDataset.h.
+//
+// Row r of the batch is the sample with index indices[first + r]. Global Y is the row within the batch.
+
+// Converts the bytes of the selected samples to floats, multiplied by |scale|. Global X is the element within the sample.
+kernel void GatherBytes(uint batch_size, uint sample_size, uint first, float scale, global const uint* indices, global const uchar* data, global float* output)
+{
+    uint i = get_global_id(X), row = get_global_id(Y);
+    if (i >= sample_size || row >= batch_size)
+        return;
+
+    uint sample = indices[first + row];
+    output[row * sample_size + i] = data[sample * sample_size + i] * scale;
+}
+
+// Expands the class indices of the selected samples into "one-hot" vectors. Global X is the class.
+kernel void GatherOneHot(uint batch_size, uint num_classes, uint first, global const uint* indices, global const uchar* labels, global float* output)
+{
+    uint c = get_global_id(X), row = get_global_id(Y);
+    if (c >= num_classes || row >= batch_size)
+        return;
+
+    output[row * num_classes + c] = labels[indices[first + row]] == c ? 1.f : 0.f;
+}
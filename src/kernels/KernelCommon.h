@@ -2,7 +2,10 @@
 #define __KERNEL_COMMON_H__
 
 // For binary and unary kernels, each thread processes this many elements of the input tensor.
+// The host may override this at compile time, see KernelManager::LoadKernels().
+#ifndef ITEMS_PER_THREAD
 #define ITEMS_PER_THREAD 10
+#endif
 
 
 // The following block is only processes when included from an OpenCL kernel.
@@ -19,6 +22,8 @@
 // These can be negative, e.g. during halo calculations.
 typedef int2 pos2;
 
+#ifndef VECTOR_WIDTH
+
 #define UNARY_OPERATION(name, op) kernel void name(uint size, global const float* input, global float* output)      \
 {                                                                                                                   \
     uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;                          \
@@ -57,6 +62,75 @@ typedef int2 pos2;
     }                                                                                                               \
 }
 
+#else
+
+// Helpers for the vectorized variants below. VECTOR_WIDTH is set by the host, see KernelManager::vector_kernel().
+#define VECTOR_CONCAT_(a, b) a##b
+#define VECTOR_CONCAT(a, b) VECTOR_CONCAT_(a, b)
+#define floatN VECTOR_CONCAT(float, VECTOR_WIDTH)
+#define vloadN VECTOR_CONCAT(vload, VECTOR_WIDTH)
+#define vstoreN VECTOR_CONCAT(vstore, VECTOR_WIDTH)
+
+// Vectorized variants of the kernels above. Each thread processes ITEMS_PER_THREAD vectors of VECTOR_WIDTH elements.
+// The remaining (size % VECTOR_WIDTH) elements at the end of the tensor are processed by the first threads of the grid.
+#define UNARY_OPERATION(name, op) kernel void name##Vec(uint size, global const float* input, global float* output) \
+{                                                                                                                   \
+    uint num_vectors = size / VECTOR_WIDTH;                                                                         \
+    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;                          \
+                                                                                                                    \
+    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {                                                                   \
+        uint index = base + i * get_local_size(0);                                                                  \
+        if (index < num_vectors) {                                                                                  \
+            vstoreN(op(vloadN(index, input)), index, output);                                                       \
+        }                                                                                                           \
+    }                                                                                                               \
+                                                                                                                    \
+    uint tail = num_vectors * VECTOR_WIDTH + get_global_id(0);                                                      \
+    if (tail < size) {                                                                                              \
+        output[tail] = op(input[tail]);                                                                             \
+    }                                                                                                               \
+}
+
+#define BINARY_OPERATION(name, op) kernel void name##Vec(uint size, global const float* x,                          \
+        global const float* y, global float* output)                                                                \
+{                                                                                                                   \
+    uint num_vectors = size / VECTOR_WIDTH;                                                                         \
+    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;                          \
+                                                                                                                    \
+    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {                                                                   \
+        uint index = base + i * get_local_size(0);                                                                  \
+        if (index < num_vectors) {                                                                                  \
+            vstoreN(op(vloadN(index, x), vloadN(index, y)), index, output);                                         \
+        }                                                                                                           \
+    }                                                                                                               \
+                                                                                                                    \
+    uint tail = num_vectors * VECTOR_WIDTH + get_global_id(0);                                                      \
+    if (tail < size) {                                                                                              \
+        output[tail] = op(x[tail], y[tail]);                                                                        \
+    }                                                                                                               \
+}
+
+#define TENSOR_SCALAR_OPERATION(name, op) kernel void name##Vec(uint size, global const float* x,                   \
+        float v, global float* out)                                                                                 \
+{                                                                                                                   \
+    uint num_vectors = size / VECTOR_WIDTH;                                                                         \
+    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;                          \
+                                                                                                                    \
+    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {                                                                   \
+        uint index = base + i * get_local_size(0);                                                                  \
+        if (index < num_vectors) {                                                                                  \
+            vstoreN(op(vloadN(index, x), v), index, out);                                                           \
+        }                                                                                                           \
+    }                                                                                                               \
+                                                                                                                    \
+    uint tail = num_vectors * VECTOR_WIDTH + get_global_id(0);                                                      \
+    if (tail < size) {                                                                                              \
+        out[tail] = op(x[tail], v);                                                                                 \
+    }                                                                                                               \
+}
+
+#endif       // VECTOR_WIDTH
+
 #endif
 
 #endif
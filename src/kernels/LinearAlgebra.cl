@@ -45,6 +45,30 @@ kernel void MatVecMulReduce(uint size, uint num_entries, global const float* in,
     }
 }
 
+// Sums up chunks of the rows of a (num_rows, row_length) matrix. Work group (chunk, row) adds up one element per thread
+// with a tree reduction in local memory and writes the sum to out[row * num_chunks + chunk]. The work group size must
+// be a power of two and |cache| must hold one float per thread. If |accumulate| is set, the sums are added to |out|.
+kernel void ReduceRows(uint row_length, uint accumulate, global const float* in, local float* cache, global float* out)
+{
+    uint chunk = get_group_id(0), num_chunks = get_num_groups(0);
+    uint row = get_group_id(1);
+    uint id = get_local_id(0), num_threads = get_local_size(0);
+
+    uint i = chunk * num_threads + id;
+    cache[id] = i < row_length ? in[row * row_length + i] : 0.f;
+
+    for (uint stride = num_threads / 2; stride > 0; stride /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < stride)
+            cache[id] += cache[id + stride];
+    }
+
+    if (id == 0) {
+        uint index = row * num_chunks + chunk;
+        out[index] = accumulate ? out[index] + cache[0] : cache[0];
+    }
+}
+
 kernel __attribute__((reqd_work_group_size(256, 1, 1)))
 kernel void TransposedMatVecMul(uint num_rows, uint num_cols, uint num_elements_per_thread, global const float* m, global const float* v, local float* cache, global float* out)
 {
@@ -76,12 +100,48 @@ kernel void TransposedMatVecMul(uint num_rows, uint num_cols, uint num_elements_
         out[col * get_global_size(ROW) + get_global_id(ROW)] = sum;
 }
 
-kernel void TransposedVecMul(uint num_rows, uint num_cols, global const float* v1, global const float* v2, global float* out)
+// Outer product of v1 and v2. If |accumulate| is set, the product is added to |out| (a rank-1 update, GER in BLAS terms).
+kernel void TransposedVecMul(uint num_rows, uint num_cols, uint accumulate, global const float* v1, global const float* v2, global float* out)
 {
     uint row = get_global_id(0);
     uint col = get_global_id(1);
 
     if (row < num_rows && col < num_cols) {
-        out[row * num_cols + col] = v1[row] * v2[col];
+        float value = v1[row] * v2[col];
+        out[row * num_cols + col] = accumulate ? out[row * num_cols + col] + value : value;
     }
 }
+
+// Size of the square tiles processed by one work group of the TransposedMatMul kernel. Must be in sync with kMatMulTileSize in GpuTensorOps.cpp.
+#define MATMUL_TILE_SIZE 16
+
+// Computes out = a^T * b (or out += a^T * b if |accumulate| is set) for matrices a of shape (num_rows, a_cols) and b of shape
+// (num_rows, b_cols), i.e. out[i][j] = sum_k a[k][i] * b[k][j]. Global X indexes the columns of b, global Y the columns of a.
+//
+// Every work group computes one tile of the output. The corresponding rows of a and b are staged through local memory
+// one tile at a time, so each element is loaded from global memory by only one thread of the work group.
+kernel __attribute__((reqd_work_group_size(MATMUL_TILE_SIZE, MATMUL_TILE_SIZE, 1)))
+void TransposedMatMul(uint num_rows, uint a_cols, uint b_cols, uint accumulate, global const float* a, global const float* b, global float* out)
+{
+    local float a_tile[MATMUL_TILE_SIZE][MATMUL_TILE_SIZE];
+    local float b_tile[MATMUL_TILE_SIZE][MATMUL_TILE_SIZE];
+
+    uint lx = get_local_id(X), ly = get_local_id(Y);
+    uint col = get_global_id(X), row = get_global_id(Y);
+    // Column of a loaded by this thread. Neighbouring threads load neighbouring elements.
+    uint a_col = get_group_id(Y) * MATMUL_TILE_SIZE + lx;
+
+    float sum = 0.f;
+    for (uint k = 0; k < num_rows; k += MATMUL_TILE_SIZE) {
+        a_tile[ly][lx] = (k + ly < num_rows && a_col < a_cols) ? a[(k + ly) * a_cols + a_col] : 0.f;
+        b_tile[ly][lx] = (k + ly < num_rows && col < b_cols) ? b[(k + ly) * b_cols + col] : 0.f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (uint i = 0; i < MATMUL_TILE_SIZE; i++)
+            sum += a_tile[i][ly] * b_tile[i][lx];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (row < a_cols && col < b_cols)
+        out[row * b_cols + col] = accumulate ? out[row * b_cols + col] + sum : sum;
+}
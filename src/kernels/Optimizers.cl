@@ -0,0 +1,58 @@
+#include "KernelCommon.h"
+
+// Parameter updates of the optimizers in nn/optimizers/.
+//
+// Each kernel performs a complete optimization step for one parameter tensor: it reads the accumulated gradients,
+// scales them by |gradient_scale| (usually 1 / batch_size), updates the optimizer state and the parameters and
+// zeroes the gradients for the next mini-batch. Every element is thus read and written exactly once per step.
+
+#define UPDATE_LOOP(body)                                                                                           \
+    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;                          \
+    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {                                                                   \
+        uint index = base + i * get_local_size(0);                                                                  \
+        if (index < size) {                                                                                         \
+            float g = gradients[index] * gradient_scale;                                                            \
+            gradients[index] = 0.f;                                                                                 \
+            body                                                                                                    \
+        }                                                                                                           \
+    }
+
+kernel void SGDUpdate(uint size, float gradient_scale, float learning_rate, global float* gradients, global float* parameters)
+{
+    UPDATE_LOOP(
+        parameters[index] -= learning_rate * g;
+    )
+}
+
+kernel void MomentumUpdate(uint size, float gradient_scale, float learning_rate, float momentum, global float* gradients,
+                           global float* velocity, global float* parameters)
+{
+    UPDATE_LOOP(
+        float v = momentum * velocity[index] - learning_rate * g;
+        velocity[index] = v;
+        parameters[index] += v;
+    )
+}
+
+kernel void RMSPropUpdate(uint size, float gradient_scale, float learning_rate, float decay, float epsilon, global float* gradients,
+                          global float* mean_square, global float* parameters)
+{
+    UPDATE_LOOP(
+        float ms = decay * mean_square[index] + (1.f - decay) * g * g;
+        mean_square[index] = ms;
+        parameters[index] -= learning_rate * g / (sqrt(ms) + epsilon);
+    )
+}
+
+// |step_size| is the learning rate with the bias correction of the current step already applied, see nn/optimizers/Adam.h.
+kernel void AdamUpdate(uint size, float gradient_scale, float step_size, float beta1, float beta2, float epsilon, global float* gradients,
+                       global float* first_moment, global float* second_moment, global float* parameters)
+{
+    UPDATE_LOOP(
+        float m = beta1 * first_moment[index] + (1.f - beta1) * g;
+        float v = beta2 * second_moment[index] + (1.f - beta2) * g * g;
+        first_moment[index] = m;
+        second_moment[index] = v;
+        parameters[index] -= step_size * m / (sqrt(v) + epsilon);
+    )
+}
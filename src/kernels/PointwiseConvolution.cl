@@ -0,0 +1,51 @@
+#include "KernelCommon.h"
+
+// Pointwise (1x1) convolutions. These are matrix products between the (num_feature_maps, num_channels) weight
+// matrix and the images, stored as (num_channels, num_pixels) matrices. Consecutive threads process consecutive
+// pixels, so the accesses to the images are coalesced.
+
+kernel void PointwiseConvolution(uint num_pixels, uint num_channels, uint num_feature_maps,
+                                 global const float* input, global const float* weights, global float* output)
+{
+    uint pixel = get_global_id(X), feature_map = get_global_id(Y);
+    if (pixel >= num_pixels || feature_map >= num_feature_maps)
+        return;
+
+    float value = 0.f;
+    for (uint channel = 0; channel < num_channels; channel++)
+        value += weights[feature_map * num_channels + channel] * input[channel * num_pixels + pixel];
+
+    output[feature_map * num_pixels + pixel] = value;
+}
+
+// Gradients wrt the input of a pointwise convolution. Here, |input| holds the gradients wrt its output.
+kernel void PointwiseCrossCorrelation(uint num_pixels, uint num_channels, uint num_feature_maps,
+                                      global const float* input, global const float* weights, global float* output)
+{
+    uint pixel = get_global_id(X), channel = get_global_id(Y);
+    if (pixel >= num_pixels || channel >= num_channels)
+        return;
+
+    float value = 0.f;
+    for (uint feature_map = 0; feature_map < num_feature_maps; feature_map++)
+        value += weights[feature_map * num_channels + channel] * input[feature_map * num_pixels + pixel];
+
+    output[channel * num_pixels + pixel] = value;
+}
+
+// Gradients of a pointwise convolution wrt its weights, one weight per thread.
+// If |accumulate| is set, the gradients are added to |weights|.
+kernel void PointwiseConvolutionGradients(uint num_pixels, uint num_channels, uint num_feature_maps, uint accumulate,
+                                          global const float* input, global const float* gradients, global float* weights)
+{
+    uint channel = get_global_id(X), feature_map = get_global_id(Y);
+    if (channel >= num_channels || feature_map >= num_feature_maps)
+        return;
+
+    float gradient = 0.f;
+    for (uint pixel = 0; pixel < num_pixels; pixel++)
+        gradient += gradients[feature_map * num_pixels + pixel] * input[channel * num_pixels + pixel];
+
+    uint index = feature_map * num_channels + channel;
+    weights[index] = accumulate ? weights[index] + gradient : gradient;
+}
@@ -0,0 +1,101 @@
+#include "KernelCommon.h"
+
+// Softmax and cross-entropy for a single vector. These run as a single work group whose size must be a power of two,
+// |maxima| and |sums| must hold one float per thread.
+//
+// The softmax is computed as exp(x - log(sum(exp(input)))), with the log-sum-exp computed relative to the maximum
+// of the input. This way exp() never overflows, unlike the naive exp(x) / sum(exp(input)).
+
+// Returns log(sum(exp(input))), reading every element only once. Every thread keeps a running maximum of its elements
+// and rescales its partial sum of exp(x - maximum) whenever the maximum grows. The partial results of all threads are
+// then merged in local memory in the same way.
+float log_sum_exp(uint size, global const float* input, local float* maxima, local float* sums)
+{
+    uint id = get_local_id(0), num_threads = get_local_size(0);
+
+    float maximum = -INFINITY, sum = 0.f;
+    for (uint i = id; i < size; i += num_threads) {
+        float x = input[i];
+        if (x > maximum) {
+            sum = sum * exp(maximum - x) + 1.f;
+            maximum = x;
+        } else {
+            sum += exp(x - maximum);
+        }
+    }
+    maxima[id] = maximum;
+    sums[id] = sum;
+
+    for (uint stride = num_threads / 2; stride > 0; stride /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < stride) {
+            // Threads without any elements have a maximum of -INFINITY and a sum of zero.
+            float m1 = maxima[id], m2 = maxima[id + stride];
+            float m = max(m1, m2);
+            if (m != -INFINITY) {
+                sums[id] = sums[id] * exp(m1 - m) + sums[id + stride] * exp(m2 - m);
+                maxima[id] = m;
+            }
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    return maxima[0] + log(sums[0]);
+}
+
+kernel void Softmax(uint size, global const float* input, local float* maxima, local float* sums, global float* output)
+{
+    float lse = log_sum_exp(size, input, maxima, sums);
+
+    for (uint i = get_local_id(0); i < size; i += get_local_size(0))
+        output[i] = exp(input[i] - lse);
+}
+
+// Computes the gradients of the cross-entropy of softmax(input) wrt |input| into |gradients| and the cross-entropy
+// itself, -sum(label * log(softmax(input))) = sum(label * (lse - input)), into |loss|. |probabilities| is the output of
+// the Softmax kernel for |input|, so no exp() is needed here: lse = x - log(p) for every element. It is taken from the
+// largest input, whose probability is at least 1 / size and thus never rounded to zero.
+kernel void SoftmaxCrossEntropy(uint size, global const float* input, global const float* probabilities, global const float* label,
+                                local float* maxima, local float* sums, global float* gradients, global float* loss)
+{
+    uint id = get_local_id(0), num_threads = get_local_size(0);
+
+    float maximum = -INFINITY, label_sum = 0.f, weighted_sum = 0.f;
+    uint largest = 0;
+    for (uint i = id; i < size; i += num_threads) {
+        float x = input[i], l = label[i];
+        if (x > maximum) {
+            maximum = x;
+            largest = i;
+        }
+        // For labels that sum up to one, the derivative of the loss wrt x is simply p - l.
+        gradients[i] = probabilities[i] - l;
+        label_sum += l;
+        weighted_sum += l * x;
+    }
+
+    // Find the lse of the largest input. Threads without any elements have a maximum of -INFINITY.
+    maxima[id] = maximum;
+    sums[id] = maximum == -INFINITY ? 0.f : maximum - log(probabilities[largest]);
+    for (uint stride = num_threads / 2; stride > 0; stride /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < stride && maxima[id + stride] > maxima[id]) {
+            maxima[id] = maxima[id + stride];
+            sums[id] = sums[id + stride];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    float lse = sums[0];
+
+    // All threads have read the lse at this point, so |sums| can be reused.
+    barrier(CLK_LOCAL_MEM_FENCE);
+    sums[id] = lse * label_sum - weighted_sum;
+    for (uint stride = num_threads / 2; stride > 0; stride /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < stride)
+            sums[id] += sums[id + stride];
+    }
+
+    if (id == 0)
+        loss[0] = sums[0];
+}
@@ -30,11 +30,8 @@ class Activation : public Layer<Tensor> {
     virtual Shape InputTensorShape() const = 0;
     virtual Shape OutputTensorShape() const { return InputTensorShape(); }
 
-    // Activations don't have weights or biases.
-    virtual void GradientDescent(size_t batch_size, float epsilon) { }
-
-    // See the comment in Objective.h for LossGradientWrtActivationInput.
-    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data) = 0;
+    // See the comment in Objective.h for LossAndGradientWrtActivationInput.
+    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data, float* loss) = 0;
 };
 
 }       // namespace nn
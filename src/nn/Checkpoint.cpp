@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nn/Checkpoint.h"
+#include "nn/Gpu.h"
+#include "ocl/Utils.h"
+
+using namespace std;
+
+namespace nn {
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+CheckpointShape EncodeShape(const Shape& shape)
+{
+    Check(shape.rank() <= kCheckpointMaxRank, "Shape " << shape.ToString() << " has too many dimensions for a checkpoint");
+
+    CheckpointShape result;
+    memset(&result, 0, sizeof(result));
+    result.rank = shape.rank();
+    for (size_t i = 0; i < shape.rank(); i++)
+        result.dimensions[i] = shape[i];
+    return result;
+}
+
+Shape DecodeShape(const CheckpointShape& shape)
+{
+    return Shape(vector<size_t>(shape.dimensions, shape.dimensions + shape.rank));
+}
+
+unique_ptr<Checkpoint> Checkpoint::Open(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    FAIL_IF(fd < 0, "Failed to open file '" << path << "'.", nullptr);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        close(fd);
+        FAIL_IF(true, "Invalid checkpoint '" << path << "'.", nullptr);
+    }
+    size_t size = st.st_size;
+
+    // The mapping stays valid after the file has been closed.
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    FAIL_IF(mapping == MAP_FAILED, "Failed to map file '" << path << "'.", nullptr);
+
+    unique_ptr<Checkpoint> checkpoint(new Checkpoint(mapping, size));
+    const CheckpointHeader& header = *checkpoint->header_;
+
+    FAIL_IF(memcmp(header.magic, kCheckpointMagic, sizeof(kCheckpointMagic)) != 0, "'" << path << "' is not a checkpoint.", nullptr);
+    FAIL_IF(header.byte_order_mark != kCheckpointByteOrderMark, "Checkpoint '" << path << "' was written on a machine with a different byte order.", nullptr);
+    FAIL_IF(header.version != kCheckpointVersion, "Unsupported checkpoint version " << header.version << " in '" << path << "'.", nullptr);
+
+    // Validate the tables so the accessors can be used without further checks.
+    size_t tables_end = sizeof(CheckpointHeader) + header.num_layers * sizeof(CheckpointLayer) + header.num_tensors * sizeof(CheckpointTensor);
+    bool valid = header.file_size == size && tables_end <= size;
+
+    for (size_t i = 0; valid && i < header.num_layers; i++) {
+        const CheckpointLayer& layer = checkpoint->layers_[i];
+        valid = layer.num_attributes <= kCheckpointMaxAttributes &&
+                layer.input_shape.rank <= kCheckpointMaxRank && layer.output_shape.rank <= kCheckpointMaxRank &&
+                layer.first_tensor <= header.num_tensors && layer.num_tensors <= header.num_tensors - layer.first_tensor;
+    }
+
+    for (size_t i = 0; valid && i < header.num_tensors; i++) {
+        const CheckpointTensor& tensor = checkpoint->tensors_[i];
+        valid = tensor.shape.rank <= kCheckpointMaxRank && tensor.offset % kCheckpointAlignment == 0 && tensor.offset >= tables_end;
+        if (valid) {
+            size_t num_elements = DecodeShape(tensor.shape).TotalElementCount();
+            valid = tensor.offset <= size && num_elements <= (size - tensor.offset) / sizeof(float);
+        }
+    }
+
+    FAIL_IF(!valid, "Invalid or corrupted checkpoint '" << path << "'.", nullptr);
+
+    return checkpoint;
+}
+
+Checkpoint::Checkpoint(void* mapping, size_t mapping_size) :
+    mapping_(mapping),
+    mapping_size_(mapping_size),
+    data_(static_cast<const uint8_t*>(mapping)),
+    header_(reinterpret_cast<const CheckpointHeader*>(data_)),
+    layers_(reinterpret_cast<const CheckpointLayer*>(data_ + sizeof(CheckpointHeader))),
+    tensors_(reinterpret_cast<const CheckpointTensor*>(data_ + sizeof(CheckpointHeader) + header_->num_layers * sizeof(CheckpointLayer))) { }
+
+Checkpoint::~Checkpoint()
+{
+    munmap(mapping_, mapping_size_);
+}
+
+Shape Checkpoint::tensor_shape(size_t i) const
+{
+    Assert(i < num_tensors());
+    return DecodeShape(tensors_[i].shape);
+}
+
+CheckpointWriter::CheckpointWriter() : success_(true) { }
+
+CheckpointWriter::~CheckpointWriter()
+{
+    Wait();
+}
+
+void CheckpointWriter::Write(const string& path, const vector<CheckpointLayer>& layers, vector<CPUTensor>* tensors)
+{
+    Wait();
+
+    path_ = path;
+    layers_ = layers;
+    tensors_.clear();
+    tensors_.swap(*tensors);
+    thread_ = thread(&CheckpointWriter::WriteFile, this);
+}
+
+bool CheckpointWriter::Wait()
+{
+    if (thread_.joinable())
+        thread_.join();
+    return success_;
+}
+
+void CheckpointWriter::WriteFile()
+{
+    // Lay out the tensor data behind the tables.
+    vector<CheckpointTensor> tensors(tensors_.size());
+    size_t offset = sizeof(CheckpointHeader) + layers_.size() * sizeof(CheckpointLayer) + tensors.size() * sizeof(CheckpointTensor);
+    for (size_t i = 0; i < tensors.size(); i++) {
+        memset(&tensors[i], 0, sizeof(CheckpointTensor));
+        tensors[i].shape = EncodeShape(tensors_[i].shape());
+        tensors[i].offset = offset = AlignUp(offset, kCheckpointAlignment);
+        offset += tensors_[i].size() * sizeof(float);
+    }
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+    header.version = kCheckpointVersion;
+    header.byte_order_mark = kCheckpointByteOrderMark;
+    header.num_layers = layers_.size();
+    header.num_tensors = tensors.size();
+    header.file_size = offset;
+
+    string temporary_path = ocl::util::TemporaryPath(path_);
+    FILE* file = fopen(temporary_path.c_str(), "wb");
+    success_ = file != nullptr;
+    WARN_IF(!success_, "Failed to create checkpoint '" << temporary_path << "'.");
+    if (!success_)
+        return;
+
+    static const uint8_t kPadding[kCheckpointAlignment] = { 0 };
+    success_ = fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(layers_.data(), sizeof(CheckpointLayer), layers_.size(), file) == layers_.size() &&
+               fwrite(tensors.data(), sizeof(CheckpointTensor), tensors.size(), file) == tensors.size();
+    for (size_t i = 0; success_ && i < tensors.size(); i++) {
+        size_t padding = tensors[i].offset - ftell(file);
+        success_ = fwrite(kPadding, 1, padding, file) == padding &&
+                   fwrite(tensors_[i].begin(), sizeof(float), tensors_[i].size(), file) == tensors_[i].size();
+    }
+    success_ = fclose(file) == 0 && success_;
+
+    // Only replace the previous checkpoint once the new one is complete.
+    success_ = success_ && rename(temporary_path.c_str(), path_.c_str()) == 0;
+    WARN_IF(!success_, "Failed to write checkpoint '" << path_ << "'.");
+    if (!success_)
+        remove(temporary_path.c_str());
+
+    // Release the snapshot.
+    tensors_.clear();
+}
+
+CPUTensor SnapshotTensor(const CPUTensor& tensor)
+{
+    return tensor;
+}
+
+CPUTensor SnapshotTensor(const GPUTensor& tensor)
+{
+    return tensor.ToHost();
+}
+
+void RestoreTensor(const Checkpoint& checkpoint, size_t index, CPUTensor* tensor)
+{
+    Assert(checkpoint.tensor_shape(index) == tensor->shape());
+    const float* data = checkpoint.tensor_data(index);
+    copy(data, data + tensor->size(), tensor->begin());
+}
+
+void RestoreTensor(const Checkpoint& checkpoint, size_t index, GPUTensor* tensor)
+{
+    Assert(checkpoint.tensor_shape(index) == tensor->shape());
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(checkpoint.tensor_data(index));
+    Check(GPUContext::Current()->device()->Upload(tensor->gpu_buffer(), data, tensor->size() * sizeof(float), 0), "Failed to transfer checkpoint to the device");
+}
+
+}       // namespace nn
@@ -0,0 +1,181 @@
+//
+// Binary checkpoints of trained networks.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nn/Layer.h"
+#include "nn/Tensor.h"
+#include "common/Common.h"
+
+namespace nn {
+
+//
+// Checkpoint file format
+//
+// A checkpoint is laid out so that it can be mapped into memory and used in place, without any parsing step:
+//
+//      CheckpointHeader                    64 bytes
+//      CheckpointLayer[num_layers]         describes the topology of the network
+//      CheckpointTensor[num_tensors]       shape and file offset of every parameter tensor
+//      tensor data                         raw floats, every tensor starts at a multiple of kCheckpointAlignment
+//
+// The parameters of layer i are the tensors [first_tensor, first_tensor + num_tensors), in the order of
+// Layer::Parameters(). All values are stored in the byte order of the machine that wrote the checkpoint, which
+// is recorded in the header. Checkpoints from machines with a different byte order are rejected.
+//
+
+static const char kCheckpointMagic[8] = { 'D', 'L', 'C', 'K', 'P', 'T', 0, 0 };
+static const uint32_t kCheckpointVersion = 1;
+static const uint32_t kCheckpointByteOrderMark = 0x01020304;
+
+// Alignment of the tensor data in the file, suitable for any vector load.
+static const size_t kCheckpointAlignment = 64;
+
+// Maximum rank of the shapes stored in a checkpoint.
+static const size_t kCheckpointMaxRank = 6;
+
+// Maximum number of attributes per layer, see Layer::Attributes().
+static const size_t kCheckpointMaxAttributes = 4;
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t num_layers;
+    uint32_t num_tensors;
+    uint64_t file_size;
+    uint8_t reserved[32];
+};
+
+struct CheckpointShape {
+    uint32_t rank;
+    uint32_t dimensions[kCheckpointMaxRank];
+};
+
+struct CheckpointLayer {
+    uint32_t kind;                  // A LayerKind.
+    uint32_t first_tensor;
+    uint32_t num_tensors;
+    uint32_t num_attributes;
+    uint32_t attributes[kCheckpointMaxAttributes];
+    CheckpointShape input_shape;
+    CheckpointShape output_shape;
+};
+
+struct CheckpointTensor {
+    CheckpointShape shape;
+    uint32_t reserved;
+    uint64_t offset;                // From the start of the file, a multiple of kCheckpointAlignment.
+};
+
+static_assert(sizeof(CheckpointHeader) == 64, "Checkpoint header must be 64 bytes");
+static_assert(sizeof(CheckpointLayer) == 88, "Unexpected padding in CheckpointLayer");
+static_assert(sizeof(CheckpointTensor) == 40, "Unexpected padding in CheckpointTensor");
+
+// A checkpoint file, mapped into memory.
+//
+// Opening a checkpoint only validates the header and the tables. The tensor data is paged in on demand
+// when it is copied into the parameters of a network, see Network::Restore() and Network::Load().
+class Checkpoint {
+  public:
+    // Maps the checkpoint at the given path into memory and validates it. Returns nullptr on failure.
+    static std::unique_ptr<Checkpoint> Open(const std::string& path);
+
+    ~Checkpoint();
+
+    size_t num_layers() const { return header_->num_layers; }
+    size_t num_tensors() const { return header_->num_tensors; }
+
+    const CheckpointLayer& layer(size_t i) const
+    {
+        Assert(i < num_layers());
+        return layers_[i];
+    }
+
+    Shape tensor_shape(size_t i) const;
+
+    // Returns the elements of the given tensor, pointing directly into the mapped file.
+    const float* tensor_data(size_t i) const
+    {
+        Assert(i < num_tensors());
+        return reinterpret_cast<const float*>(data_ + tensors_[i].offset);
+    }
+
+  private:
+    Checkpoint(void* mapping, size_t mapping_size);
+
+    // The whole file, as returned by mmap.
+    void* mapping_;
+    size_t mapping_size_;
+
+    // Pointers into the mapping.
+    const uint8_t* data_;
+    const CheckpointHeader* header_;
+    const CheckpointLayer* layers_;
+    const CheckpointTensor* tensors_;
+
+    DISALLOW_COPY_AND_ASSIGN(Checkpoint);
+};
+
+// Writes checkpoints on a background thread.
+//
+// The caller snapshots the parameters into host tensors, which are handed over to the writer together with
+// the layer table. Only one checkpoint is written at a time: Write() waits for the previous one to finish.
+// Every checkpoint is first written to a temporary file which then replaces the target, so an interrupted
+// write never destroys the last complete checkpoint.
+class CheckpointWriter {
+  public:
+    CheckpointWriter();
+
+    // Waits for the pending write, if any.
+    ~CheckpointWriter();
+
+    // Starts writing a checkpoint with the given layers and parameter tensors to |path|. The first_tensor and
+    // num_tensors fields of the layers must refer to |tensors|. Takes over the tensors, leaving |tensors| empty.
+    void Write(const std::string& path, const std::vector<CheckpointLayer>& layers, std::vector<CPUTensor>* tensors);
+
+    // Waits until the pending write, if any, has finished. Returns false if it failed.
+    bool Wait();
+
+  private:
+    // Runs on the background thread.
+    void WriteFile();
+
+    std::string path_;
+    std::vector<CheckpointLayer> layers_;
+    std::vector<CPUTensor> tensors_;
+
+    std::thread thread_;
+
+    // Result of the last write, only accessed while no write is in progress.
+    bool success_;
+
+    DISALLOW_COPY_AND_ASSIGN(CheckpointWriter);
+};
+
+// Conversions between shapes and their representation in checkpoints.
+CheckpointShape EncodeShape(const Shape& shape);
+Shape DecodeShape(const CheckpointShape& shape);
+
+// Copies a parameter tensor into a new host tensor for a checkpoint. For device tensors, this waits for the download.
+CPUTensor SnapshotTensor(const CPUTensor& tensor);
+CPUTensor SnapshotTensor(const GPUTensor& tensor);
+
+// Copies the given tensor of a checkpoint into a parameter tensor of the same shape.
+void RestoreTensor(const Checkpoint& checkpoint, size_t index, CPUTensor* tensor);
+void RestoreTensor(const Checkpoint& checkpoint, size_t index, GPUTensor* tensor);
+
+}       // namespace nn
+
+#endif
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+
+#include "nn/DataLoader.h"
+#include "nn/Gpu.h"
+
+using namespace std;
+
+namespace nn {
+
+// How long a worker sleeps before checking again whether its queue has room for another batch.
+static const chrono::microseconds kWorkerBackoff(100);
+
+DataLoader::DataLoader(const Dataset& data, const Dataset& labels, size_t batch_size, size_t num_workers) :
+    DataLoader(data, labels, batch_size, num_workers, 0.f, 1.f) { }
+
+DataLoader::DataLoader(const Dataset& data, const Dataset& labels, size_t batch_size, size_t num_workers, float mean, float stddev) :
+    data_(&data),
+    labels_(&labels),
+    batch_size_(batch_size),
+    mean_(mean),
+    scale_(1.f / stddev),
+    seed_(rand()),
+    num_batches_(0),
+    next_batch_(0),
+    holding_batch_(false),
+    stop_(false)
+{
+    Init(num_workers);
+}
+
+DataLoader::DataLoader(const CPUTensor& data, const CPUTensor& labels, size_t batch_size, size_t num_workers) :
+    DataLoader(data, labels, batch_size, num_workers, 0.f, 1.f) { }
+
+DataLoader::DataLoader(const CPUTensor& data, const CPUTensor& labels, size_t batch_size, size_t num_workers, float mean, float stddev) :
+    owned_data_(new TensorDataset(data)),
+    owned_labels_(new TensorDataset(labels)),
+    data_(owned_data_.get()),
+    labels_(owned_labels_.get()),
+    batch_size_(batch_size),
+    mean_(mean),
+    scale_(1.f / stddev),
+    seed_(rand()),
+    num_batches_(0),
+    next_batch_(0),
+    holding_batch_(false),
+    stop_(false)
+{
+    Init(num_workers);
+}
+
+void DataLoader::Init(size_t num_workers)
+{
+    Assert(data_->num_samples() == labels_->num_samples());
+    Check(batch_size_ > 0 && batch_size_ <= data_->num_samples(), "Invalid batch size");
+    Check(num_workers > 0, "At least one worker is required");
+
+    // Batches have the shape of a sample, with an additional first dimension.
+    Shape sample_shape = data_->sample_shape(), label_shape = labels_->sample_shape();
+    vector<size_t> data_dimensions = { batch_size_ }, labels_dimensions = { batch_size_ };
+    for (size_t i = 0; i < sample_shape.rank(); i++)
+        data_dimensions.push_back(sample_shape[i]);
+    for (size_t i = 0; i < label_shape.rank(); i++)
+        labels_dimensions.push_back(label_shape[i]);
+    Shape data_shape(data_dimensions), labels_shape(labels_dimensions);
+    HostMemory memory = GPUContext::Current() ? HostMemory::kPinned : HostMemory::kPageable;
+
+    for (size_t i = 0; i < num_workers; i++) {
+        queues_.emplace_back(new BoundedQueue<Batch>(kBatchesPerWorker, [&]() {
+            return new Batch(data_shape, labels_shape, memory);
+        }));
+    }
+}
+
+DataLoader::~DataLoader()
+{
+    Stop();
+}
+
+void DataLoader::Start(size_t num_epochs)
+{
+    Stop();
+
+    num_batches_ = num_epochs * batches_per_epoch();
+    next_batch_ = 0;
+    stop_ = false;
+    for (size_t i = 0; i < queues_.size(); i++)
+        workers_.emplace_back(&DataLoader::Work, this, i);
+}
+
+void DataLoader::Stop()
+{
+    stop_ = true;
+    for (thread& worker : workers_)
+        worker.join();
+    workers_.clear();
+
+    for (auto& queue : queues_) {
+        while (queue->Front())
+            queue->Pop();
+    }
+    holding_batch_ = false;
+}
+
+const DataLoader::Batch& DataLoader::NextBatch()
+{
+    Check(next_batch_ < num_batches_, "No more batches");
+
+    if (holding_batch_)
+        queues_[(next_batch_ - 1) % queues_.size()]->Pop();
+
+    // The batch is usually ready, so don't bother sleeping.
+    BoundedQueue<Batch>* queue = queues_[next_batch_ % queues_.size()].get();
+    Batch* batch;
+    while (!(batch = queue->Front()))
+        this_thread::yield();
+
+    next_batch_++;
+    holding_batch_ = true;
+    return *batch;
+}
+
+void DataLoader::Work(size_t index)
+{
+    BoundedQueue<Batch>* queue = queues_[index].get();
+
+    vector<size_t> permutation(data_->num_samples());
+    size_t permutation_epoch = SIZE_MAX;
+
+    for (size_t b = index; b < num_batches_; b += queues_.size()) {
+        size_t epoch = b / batches_per_epoch();
+        if (epoch != permutation_epoch) {
+            iota(permutation.begin(), permutation.end(), 0);
+            shuffle(permutation.begin(), permutation.end(), mt19937(seed_ + epoch));
+            permutation_epoch = epoch;
+        }
+
+        Batch* batch;
+        while (!(batch = queue->Reserve())) {
+            if (stop_)
+                return;
+            this_thread::sleep_for(kWorkerBackoff);
+        }
+
+        Gather(permutation, (b % batches_per_epoch()) * batch_size_, batch);
+        batch->epoch = epoch;
+        queue->Push();
+
+        if (stop_)
+            return;
+    }
+}
+
+void DataLoader::Gather(const vector<size_t>& permutation, size_t first, Batch* batch)
+{
+    size_t sample_size = batch->data.size() / batch_size_;
+    size_t label_size = batch->labels.size() / batch_size_;
+    bool normalize = mean_ != 0.f || scale_ != 1.f;
+
+    for (size_t i = 0; i < batch_size_; i++) {
+        size_t sample = permutation[first + i];
+
+        float* data = batch->data.begin() + i * sample_size;
+        data_->Load(sample, data);
+        if (normalize) {
+            for (size_t j = 0; j < sample_size; j++)
+                data[j] = (data[j] - mean_) * scale_;
+        }
+
+        labels_->Load(sample, batch->labels.begin() + i * label_size);
+    }
+}
+
+void CopyBatch(const CPUTensor& batch, CPUTensor* tensor)
+{
+    *tensor = batch;
+}
+
+void CopyBatch(const CPUTensor& batch, GPUTensor* tensor)
+{
+    if (tensor->shape() != batch.shape())
+        *tensor = GPUTensor(batch.shape());
+
+    // Batches are usually pinned, so they can be transferred without staging.
+    bool success;
+    if (batch.is_pinned())
+        success = tensor->gpu_buffer()->Write(batch.begin(), batch.size());
+    else
+        success = GPUContext::Current()->device()->Upload(tensor->gpu_buffer(), reinterpret_cast<const uint8_t*>(batch.begin()), batch.size() * sizeof(float), 0);
+    Check(success, "Failed to transfer batch to the device");
+}
+
+}       // namespace nn
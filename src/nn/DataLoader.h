@@ -0,0 +1,126 @@
+//
+// Asynchronous loading of training batches.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __DATA_LOADER_H__
+#define __DATA_LOADER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "nn/Dataset.h"
+#include "nn/Tensor.h"
+#include "common/BoundedQueue.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// Number of batches that every worker of a DataLoader prepares ahead of time.
+constexpr size_t kBatchesPerWorker = 4;
+
+// Prepares mini batches for training on a set of background threads.
+//
+// Every epoch visits the training samples in the order of a new random permutation. The workers gather the samples
+// of each batch into contiguous tensors, converting them to floats if the dataset stores them in another format
+// (see Dataset.h), normalize the inputs and pass the batches to the training thread through
+// one lock-free queue per worker. Worker i prepares batches i, i + num_workers, ..., so the batches are consumed in
+// a fixed order. Samples at the end of an epoch that don't fill a whole batch are skipped.
+//
+// If a GPU context exists, the batches are allocated in pinned memory so they can be transferred to the device quickly.
+class DataLoader {
+  public:
+    struct Batch {
+        Batch(const Shape& data_shape, const Shape& labels_shape, HostMemory memory) : data(data_shape, memory), labels(labels_shape, memory), epoch(0) { }
+
+        // Tensors of shape (batch_size, ...) holding the normalized inputs and the labels.
+        CPUTensor data;
+        CPUTensor labels;
+
+        // Epoch that this batch belongs to, starting at zero.
+        size_t epoch;
+    };
+
+    // Creates a loader for the given datasets, which must outlive the loader. No batches are prepared until Start().
+    DataLoader(const Dataset& data, const Dataset& labels, size_t batch_size, size_t num_workers);
+
+    // Same as above, but inputs x are normalized to (x - mean) / stddev.
+    DataLoader(const Dataset& data, const Dataset& labels, size_t batch_size, size_t num_workers, float mean, float stddev);
+
+    // Creates a loader for data and labels stored in tensors, with one sample per row.
+    DataLoader(const CPUTensor& data, const CPUTensor& labels, size_t batch_size, size_t num_workers);
+    DataLoader(const CPUTensor& data, const CPUTensor& labels, size_t batch_size, size_t num_workers, float mean, float stddev);
+
+    // Stops the workers.
+    ~DataLoader();
+
+    // Starts preparing the batches of |num_epochs| epochs in the background.
+    void Start(size_t num_epochs);
+
+    // Stops the workers and discards all batches that have not been consumed yet.
+    void Stop();
+
+    // Returns the next batch, waiting for it if necessary. The batch remains valid until the next call.
+    // Must only be called from a single thread and no more than num_epochs * batches_per_epoch() times after Start().
+    const Batch& NextBatch();
+
+    // Returns the number of batches per epoch.
+    size_t batches_per_epoch() const { return data_->num_samples() / batch_size_; }
+
+    size_t batch_size() const { return batch_size_; }
+
+  private:
+    // Allocates the batches. Called by all constructors.
+    void Init(size_t num_workers);
+
+    // Main loop of worker |index|.
+    void Work(size_t index);
+
+    // Fills |batch| with the samples at positions [first, first + batch_size) of |permutation|.
+    void Gather(const std::vector<size_t>& permutation, size_t first, Batch* batch);
+
+    // Datasets created for tensors passed to the constructor.
+    std::unique_ptr<Dataset> owned_data_;
+    std::unique_ptr<Dataset> owned_labels_;
+
+    // Training data and labels. Not owned by this instance, unless they are the ones above.
+    const Dataset* data_;
+    const Dataset* labels_;
+
+    size_t batch_size_;
+
+    // Normalization parameters, see the constructor.
+    float mean_, scale_;
+
+    // Seed of the per-epoch permutations. The workers compute the same permutations independently.
+    unsigned int seed_;
+
+    // Total number of batches to prepare, set by Start().
+    size_t num_batches_;
+
+    // Index of the next batch returned by NextBatch().
+    size_t next_batch_;
+
+    // Whether the batch returned by the last call to NextBatch() still has to be handed back to its queue.
+    bool holding_batch_;
+
+    std::vector<std::unique_ptr<BoundedQueue<Batch>>> queues_;
+
+    std::vector<std::thread> workers_;
+
+    std::atomic<bool> stop_;
+
+    DISALLOW_COPY_AND_ASSIGN(DataLoader);
+};
+
+// Copies a batch into a tensor on the host or on the device, which is (re)allocated if its shape doesn't match.
+void CopyBatch(const CPUTensor& batch, CPUTensor* tensor);
+void CopyBatch(const CPUTensor& batch, GPUTensor* tensor);
+
+}       // namespace nn
+
+#endif
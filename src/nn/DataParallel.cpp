@@ -0,0 +1,236 @@
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#include "nn/DataParallel.h"
+#include "nn/tensor/CpuTensor.h"
+
+using namespace std;
+
+namespace nn {
+
+DataParallelNetwork::DataParallelNetwork(const vector<GPUContext*>& contexts, Builder build) :
+    contexts_(contexts),
+    replicas_(contexts.size()),
+    data_(contexts.size()),
+    labels_(contexts.size()),
+    gradient_buffers_(contexts.size())
+{
+    Check(!contexts_.empty(), "At least one device is required");
+
+    ForEachReplica([&](size_t replica) {
+        replicas_[replica].reset(build());
+    });
+
+    // All replicas need to start out with the same parameters.
+    Check(BroadcastParameters(), "Failed to synchronize network parameters between devices");
+
+    for (size_t replica = 0; replica < num_replicas(); replica++) {
+        for (GPUTensor* gradient : replicas_[replica]->Gradients())
+            gradient_buffers_[replica].emplace_back(gradient->size());
+    }
+}
+
+void DataParallelNetwork::ForEachReplica(function<void(size_t)> function)
+{
+    vector<thread> threads;
+    for (size_t replica = 0; replica < num_replicas(); replica++) {
+        threads.emplace_back([this, &function, replica]() {
+            contexts_[replica]->MakeCurrent();
+            function(replica);
+        });
+    }
+
+    for (thread& t : threads)
+        t.join();
+}
+
+void DataParallelNetwork::WarmUp()
+{
+    ForEachReplica([&](size_t replica) {
+        replicas_[replica]->WarmUp();
+    });
+}
+
+bool DataParallelNetwork::BroadcastParameters()
+{
+    vector<GPUTensor*> source = replicas_[0]->Parameters();
+
+    // Devices in different OpenCL contexts can't access each other's buffers, so the data goes through the host.
+    vector<vector<float>> parameters;
+    for (GPUTensor* parameter : source) {
+        parameters.emplace_back(parameter->size());
+        FAIL_IF(!contexts_[0]->device()->Download(parameter->gpu_buffer(), reinterpret_cast<uint8_t*>(parameters.back().data()), parameter->size() * sizeof(float), 0),
+                "Failed to download parameters", false);
+    }
+
+    vector<char> success(num_replicas(), true);
+    ForEachReplica([&](size_t replica) {
+        if (replica == 0)
+            return;
+        vector<GPUTensor*> destination = replicas_[replica]->Parameters();
+        Check(destination.size() == source.size(), "Network replicas differ in their topology");
+        for (size_t i = 0; i < destination.size(); i++) {
+            Check(destination[i]->shape() == source[i]->shape(), "Network replicas differ in their topology");
+            success[replica] &= GPUContext::Current()->device()->Upload(destination[i]->gpu_buffer(), reinterpret_cast<uint8_t*>(parameters[i].data()),
+                                                                        parameters[i].size() * sizeof(float), 0);
+        }
+    });
+
+    for (char s : success)
+        FAIL_IF(!s, "Failed to upload parameters", false);
+    return true;
+}
+
+void DataParallelNetwork::SetTrainingData(const CPUTensor& data, const CPUTensor& labels)
+{
+    Assert(data.shape(0) == labels.shape(0));
+
+    ForEachReplica([&](size_t replica) {
+        data_[replica].reset(new GPUTensor(data.ToGPU()));
+        labels_[replica].reset(new GPUTensor(labels.ToGPU()));
+    });
+}
+
+bool DataParallelNetwork::DownloadGradients(size_t replica)
+{
+    vector<GPUTensor*> gradients = replicas_[replica]->Gradients();
+    for (size_t i = 0; i < gradients.size(); i++) {
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(gradient_buffers_[replica][i].data());
+        if (!contexts_[replica]->device()->Download(gradients[i]->gpu_buffer(), buffer, gradients[i]->size() * sizeof(float), 0))
+            return false;
+    }
+    return true;
+}
+
+bool DataParallelNetwork::UploadGradientSums(size_t replica)
+{
+    vector<GPUTensor*> gradients = replicas_[replica]->Gradients();
+    for (size_t i = 0; i < gradients.size(); i++) {
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(gradient_buffers_[0][i].data());
+        if (!contexts_[replica]->device()->Upload(gradients[i]->gpu_buffer(), buffer, gradients[i]->size() * sizeof(float), 0))
+            return false;
+    }
+    return true;
+}
+
+double DataParallelNetwork::TrainMiniBatch(const vector<size_t>& indices, float epsilon, size_t* hits)
+{
+    Assert(data_[0] && labels_[0]);
+
+    size_t n = indices.size();
+    vector<double> losses(num_replicas(), 0);
+    vector<size_t> replica_hits(num_replicas(), 0);
+    vector<char> success(num_replicas(), true);
+
+    // Each replica accumulates the gradients for its share of the mini-batch.
+    ForEachReplica([&](size_t replica) {
+        size_t begin = replica * n / num_replicas(), end = (replica + 1) * n / num_replicas();
+        for (size_t i = begin; i < end; i++) {
+            bool hit;
+            losses[replica] += replicas_[replica]->Backpropagate((*data_[replica])[indices[i]], (*labels_[replica])[indices[i]], &hit);
+            replica_hits[replica] += hit ? 1 : 0;
+        }
+
+        if (num_replicas() > 1)
+            success[replica] = DownloadGradients(replica);
+    });
+
+    // All-reduce: sum up the gradients of all replicas on the host...
+    if (num_replicas() > 1) {
+        for (char s : success)
+            Check(s, "Failed to download gradients");
+
+        vector<vector<float>>& sums = gradient_buffers_[0];
+        for (size_t replica = 1; replica < num_replicas(); replica++) {
+            for (size_t i = 0; i < sums.size(); i++) {
+                const vector<float>& gradients = gradient_buffers_[replica][i];
+                for (size_t j = 0; j < gradients.size(); j++)
+                    sums[i][j] += gradients[j];
+            }
+        }
+    }
+
+    // ... and distribute the sums, so that every replica performs the same update.
+    ForEachReplica([&](size_t replica) {
+        if (num_replicas() > 1)
+            success[replica] = UploadGradientSums(replica);
+        if (success[replica])
+            replicas_[replica]->GradientDescent(n, epsilon);
+    });
+
+    for (char s : success)
+        Check(s, "Failed to upload gradients");
+
+    double loss = 0;
+    *hits = 0;
+    for (size_t replica = 0; replica < num_replicas(); replica++) {
+        loss += losses[replica];
+        *hits += replica_hits[replica];
+    }
+    return loss;
+}
+
+void DataParallelNetwork::Train(const CPUTensor& data, const CPUTensor& labels, const CPUTensor& test_data, const CPUTensor& test_labels, size_t num_epochs, size_t batch_size, float epsilon)
+{
+    Assert(test_data.shape(0) == test_labels.shape(0));
+
+    SetTrainingData(data, labels);
+
+    vector<unique_ptr<GPUTensor>> test_data_gpu(num_replicas()), test_labels_gpu(num_replicas());
+    ForEachReplica([&](size_t replica) {
+        test_data_gpu[replica].reset(new GPUTensor(test_data.ToGPU()));
+        test_labels_gpu[replica].reset(new GPUTensor(test_labels.ToGPU()));
+    });
+
+    size_t n = data.shape(0);
+    vector<size_t> indices(batch_size);
+
+    for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+        double loss = 0, hits = 0;
+        size_t current_iteration = 0;
+
+        // We might miss a couple of inputs at the end, but that's ok since the input is shuffled.
+        for (size_t batch = 0; batch < n / batch_size; batch++) {
+            for (size_t i = 0; i < batch_size; i++)
+                indices[i] = rand() % n;
+
+            size_t batch_hits;
+            loss += TrainMiniBatch(indices, epsilon, &batch_hits);
+            hits += batch_hits;
+            current_iteration += batch_size;
+
+            printf("%zu/%zu  loss: %.2f  acc: %.2f\n", current_iteration, n, loss / current_iteration, hits / current_iteration);
+        }
+
+        // Epoch done, evaluate performance on test data. The replicas are identical, so they can share the work.
+        size_t num_tests = test_data.shape(0);
+        vector<size_t> correct(num_replicas(), 0);
+        ForEachReplica([&](size_t replica) {
+            for (size_t test = replica * num_tests / num_replicas(); test < (replica + 1) * num_tests / num_replicas(); test++) {
+                const GPUTensor& output = replicas_[replica]->Evaluate((*test_data_gpu[replica])[test]);
+                if (argmax(output) == argmax((*test_labels_gpu[replica])[test]))
+                    correct[replica]++;
+            }
+        });
+
+        double correct_count = 0;
+        for (size_t c : correct)
+            correct_count += c;
+
+        std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
+        std::cout << "EPOCH " << epoch + 1 << " FINISHED. ACCURACY: " << correct_count << "/" << num_tests << " (" << correct_count / num_tests << ")" << std::endl;
+        std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
+    }
+
+    // Show where the device time went if profiling is enabled, see ocl::Device::Init().
+    for (size_t replica = 0; replica < num_replicas(); replica++) {
+        ocl::Profiler* profiler = contexts_[replica]->device()->profiler();
+        if (profiler) {
+            std::cout << std::endl << "Device " << replica << ":" << std::endl;
+            profiler->Print(std::cout);
+        }
+    }
+}
+
+}       // namespace nn
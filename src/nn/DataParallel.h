@@ -0,0 +1,88 @@
+//
+// Data-parallel training on multiple devices.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __DATA_PARALLEL_H__
+#define __DATA_PARALLEL_H__
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "nn/Gpu.h"
+#include "nn/Network.h"
+#include "nn/Tensor.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// Trains a network on several OpenCL devices at once.
+//
+// Every device holds a replica of the network and its own copy of the training data. Each mini-batch is split
+// evenly across the replicas, which process their share concurrently. Afterwards the gradients of all replicas
+// are summed up (all-reduce) and every replica performs the same gradient descent step, so the replicas stay in sync.
+class DataParallelNetwork {
+  public:
+    // Builds a network. Called once per device, with the context of that device being current.
+    typedef std::function<Network<GPUTensor>*()> Builder;
+
+    // Creates one replica of the network per context. The parameters of the first replica are copied to all others.
+    //
+    // The contexts are not owned by this instance and must outlive it.
+    DataParallelNetwork(const std::vector<GPUContext*>& contexts, Builder build);
+
+    // Returns the number of replicas, i.e. devices, used for training.
+    size_t num_replicas() const { return replicas_.size(); }
+
+    // Returns the replica on the device of the given context. The context must be current when using the replica.
+    Network<GPUTensor>& replica(size_t index) { return *replicas_[index]; }
+
+    // Compiles the device code required by the network on all devices, see Network::WarmUp().
+    void WarmUp();
+
+    // Copies the parameters of the first replica to all other replicas.
+    bool BroadcastParameters();
+
+    // Copies the training data to every device. Must be called before TrainMiniBatch().
+    void SetTrainingData(const CPUTensor& data, const CPUTensor& labels);
+
+    // Processes the training samples with the given indices, split across all replicas, then performs
+    // a gradient descent step on every replica with the summed gradients.
+    //
+    // Returns the total loss of the mini-batch and stores the number of correct predictions in |hits|.
+    double TrainMiniBatch(const std::vector<size_t>& indices, float epsilon, size_t* hits);
+
+    // Train the network on the supplied data. Same as Network::Train(), but the data is located on the host.
+    void Train(const CPUTensor& data, const CPUTensor& labels, const CPUTensor& test_data, const CPUTensor& test_labels, size_t num_epochs, size_t batch_size, float epsilon);
+
+  private:
+    // Runs |function| for every replica concurrently, each on its own thread with the context of the replica being current.
+    void ForEachReplica(std::function<void(size_t)> function);
+
+    // Transfers the gradients of the given replica into gradient_buffers_[replica].
+    bool DownloadGradients(size_t replica);
+
+    // Overwrites the gradients of the given replica with the sums in gradient_buffers_[0].
+    bool UploadGradientSums(size_t replica);
+
+    // Contexts of the devices used for training. Not owned by this instance.
+    std::vector<GPUContext*> contexts_;
+
+    // One replica of the network per context.
+    std::vector<std::unique_ptr<Network<GPUTensor>>> replicas_;
+
+    // One copy of the training data and labels per context.
+    std::vector<std::unique_ptr<GPUTensor>> data_, labels_;
+
+    // Host memory for the all-reduce: one buffer per replica and gradient tensor.
+    // The sums are accumulated in the buffers of the first replica.
+    std::vector<std::vector<std::vector<float>>> gradient_buffers_;
+
+    DISALLOW_COPY_AND_ASSIGN(DataParallelNetwork);
+};
+
+}       // namespace nn
+
+#endif
@@ -0,0 +1,20 @@
+#include "nn/Dataset.h"
+
+using namespace std;
+
+namespace nn {
+
+void LoadDataset(const Dataset& dataset, CPUTensor* out)
+{
+    Shape sample_shape = dataset.sample_shape();
+    vector<size_t> dimensions = { dataset.num_samples() };
+    for (size_t i = 0; i < sample_shape.rank(); i++)
+        dimensions.push_back(sample_shape[i]);
+
+    *out = CPUTensor(Shape(dimensions));
+    size_t sample_size = out->size() / dataset.num_samples();
+    for (size_t i = 0; i < dataset.num_samples(); i++)
+        dataset.Load(i, out->begin() + i * sample_size);
+}
+
+}       // namespace nn
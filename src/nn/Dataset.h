@@ -0,0 +1,96 @@
+//
+// Sources of training samples.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __DATASET_H__
+#define __DATASET_H__
+
+#include <algorithm>
+#include <cstddef>
+
+#include "nn/Tensor.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// A collection of samples of the same shape that are converted to floats on demand, e.g. by the workers of a DataLoader.
+class Dataset {
+  public:
+    virtual ~Dataset() { }
+
+    // Returns the number of samples in this dataset.
+    virtual size_t num_samples() const = 0;
+
+    // Returns the shape of a single sample.
+    virtual Shape sample_shape() const = 0;
+
+    // Writes the elements of the sample with the given index to |output|, which must have room for
+    // sample_shape().TotalElementCount() floats. Can be called from multiple threads concurrently.
+    virtual void Load(size_t index, float* output) const = 0;
+};
+
+// A dataset whose samples are the rows of a tensor. The tensor must outlive the dataset.
+class TensorDataset : public Dataset {
+  public:
+    explicit TensorDataset(const CPUTensor& tensor) : tensor_(tensor), sample_size_(tensor.size() / tensor.shape(0)) { }
+
+    virtual size_t num_samples() const override { return tensor_.shape(0); }
+
+    virtual Shape sample_shape() const override { return tensor_.shape().ElementShape(); }
+
+    virtual void Load(size_t index, float* output) const override
+    {
+        Assert(index < num_samples());
+        const float* sample = tensor_.begin() + index * sample_size_;
+        std::copy(sample, sample + sample_size_, output);
+    }
+
+  private:
+    const CPUTensor& tensor_;
+
+    size_t sample_size_;
+
+    DISALLOW_COPY_AND_ASSIGN(TensorDataset);
+};
+
+// Converts class indices, the single element of every sample of the underlying dataset, into "one-hot" vectors of
+// size |num_classes|, with all entries 0 except for the entry of the class, which is 1.
+// The underlying dataset must outlive this instance.
+class OneHotDataset : public Dataset {
+  public:
+    OneHotDataset(const Dataset& indices, size_t num_classes) : indices_(indices), num_classes_(num_classes)
+    {
+        Assert(indices.sample_shape().TotalElementCount() == 1);
+    }
+
+    virtual size_t num_samples() const override { return indices_.num_samples(); }
+
+    virtual Shape sample_shape() const override { return Shape({num_classes_}); }
+
+    virtual void Load(size_t index, float* output) const override
+    {
+        float value;
+        indices_.Load(index, &value);
+        size_t label = value;
+        Assert(label < num_classes_);
+
+        std::fill(output, output + num_classes_, 0.f);
+        output[label] = 1.f;
+    }
+
+  private:
+    const Dataset& indices_;
+
+    size_t num_classes_;
+
+    DISALLOW_COPY_AND_ASSIGN(OneHotDataset);
+};
+
+// Loads all samples of the given dataset into a tensor of shape [num_samples, sample shape...].
+void LoadDataset(const Dataset& dataset, CPUTensor* out);
+
+}       // namespace nn
+
+#endif
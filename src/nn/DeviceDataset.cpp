@@ -0,0 +1,78 @@
+#include "nn/DeviceDataset.h"
+#include "nn/Gpu.h"
+
+using namespace std;
+
+typedef ocl::Kernel::WorkSize WorkSize;
+
+namespace nn {
+
+// Uploads |size| bytes into a new device buffer.
+static unique_ptr<ocl::Buffer> Upload(const uint8_t* data, size_t size)
+{
+    ocl::Device* device = GPUContext::Current()->device();
+    unique_ptr<ocl::Buffer> buffer = device->AllocateBuffer(size, ocl::kReadOnlyBuffer);
+    Check(buffer, "Out of device memory");
+    Check(device->Upload(buffer.get(), data, size, 0), "Failed to transfer dataset to the device");
+    return buffer;
+}
+
+DeviceDataset::DeviceDataset(const uint8_t* data, const Shape& shape, float scale) :
+    num_samples_(shape[0]),
+    sample_shape_(shape.ElementShape()),
+    sample_size_(shape.TotalElementCount() / shape[0]),
+    scale_(scale),
+    one_hot_(false),
+    data_(Upload(data, shape.TotalElementCount()))
+{
+    Assert(shape.rank() > 1);
+}
+
+DeviceDataset::DeviceDataset(const uint8_t* class_indices, size_t num_samples, size_t num_classes) :
+    num_samples_(num_samples),
+    sample_shape_({num_classes}),
+    sample_size_(1),
+    scale_(1.f),
+    one_hot_(true),
+    data_(Upload(class_indices, num_samples))
+{
+}
+
+void DeviceDataset::Gather(ocl::Buffer* indices, size_t first, size_t batch_size, GPUTensor* batch) const
+{
+    Assert((first + batch_size) * sizeof(uint32_t) <= indices->size());
+
+    vector<size_t> dimensions = { batch_size };
+    for (size_t i = 0; i < sample_shape_.rank(); i++)
+        dimensions.push_back(sample_shape_[i]);
+    Shape batch_shape(dimensions);
+    if (batch->shape() != batch_shape)
+        *batch = GPUTensor(batch_shape);
+
+    bool success;
+    KernelManager& kernel_manager = GPUContext::Current()->kernel_manager();
+    if (one_hot_) {
+        size_t num_classes = sample_shape_[0];
+        success = kernel_manager.kernel(kGatherOneHotKernel)->Run(
+                WorkSize(num_classes, batch_size),
+                batch_size,
+                num_classes,
+                first,
+                indices,
+                data_.get(),
+                batch->gpu_buffer());
+    } else {
+        success = kernel_manager.kernel(kGatherBytesKernel)->Run(
+                WorkSize(sample_size_, batch_size),
+                batch_size,
+                sample_size_,
+                first,
+                scale_,
+                indices,
+                data_.get(),
+                batch->gpu_buffer());
+    }
+    Check(success, "Failed to gather batch");
+}
+
+}       // namespace nn
@@ -0,0 +1,81 @@
+//
+// Recorded sequences of tensor operations.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __EXECUTION_PLAN_H__
+#define __EXECUTION_PLAN_H__
+
+#include <functional>
+#include <memory>
+
+#include "nn/Tensor.h"
+#include "nn/Gpu.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// A sequence of tensor operations, e.g. a complete training step of a network, that is executed once when the plan
+// is created and can then be repeated through Replay().
+//
+// The operations must always work on the same tensors, which must outlive the plan. To process new data, update
+// the contents of the input tensors in place before replaying the plan. Host side logic (shape checks, loss and
+// accuracy computations, ...) only runs during the first execution.
+template <typename Tensor>
+class ExecutionPlan;
+
+// On the host there is no launch overhead to save, so the operations are simply executed again.
+template <>
+class ExecutionPlan<CPUTensor> {
+  public:
+    explicit ExecutionPlan(const std::function<void()>& operations) : operations_(operations)
+    {
+        operations_();
+    }
+
+    void Replay()
+    {
+        operations_();
+    }
+
+  private:
+    std::function<void()> operations_;
+
+    DISALLOW_COPY_AND_ASSIGN(ExecutionPlan);
+};
+
+// On the device, the kernel launches (with all their arguments), copies and clears issued by the operations are captured
+// into an ocl::CommandGraph, which is enqueued again as a whole. Scalar arguments keep the values they had during
+// the first execution.
+template <>
+class ExecutionPlan<GPUTensor> {
+  public:
+    explicit ExecutionPlan(const std::function<void()>& operations)
+    {
+        ocl::Device* device = GPUContext::Current()->device();
+        device->BeginCapture();
+        operations();
+        graph_ = device->EndCapture();
+    }
+
+    void Replay()
+    {
+        Check(graph_->Replay(), "Failed to replay execution plan");
+    }
+
+    // Returns the number of device commands that are enqueued by every replay.
+    size_t num_commands() const
+    {
+        return graph_->num_commands();
+    }
+
+  private:
+    std::unique_ptr<ocl::CommandGraph> graph_;
+
+    DISALLOW_COPY_AND_ASSIGN(ExecutionPlan);
+};
+
+}       // namespace nn
+
+#endif
@@ -1,8 +1,14 @@
+#include <algorithm>
 #include <sstream>
+#include <thread>
 
 #include "nn/Gpu.h"
 #include "common/Common.h"
 
+#define INCLUDED_BY_HOST
+#include "kernels/KernelCommon.h"
+#undef INCLUDED_BY_HOST
+
 using namespace std;
 
 namespace nn {
@@ -19,11 +25,47 @@ static string name_for_kernel[] = {
 };
 #undef C
 
+// Maximum number of programs compiled at the same time.
+constexpr size_t kMaxCompilerThreads = 8;
+
+KernelManager::KernelManager(GPUContext* context) :
+    context_(context),
+    kernels_(),
+    items_per_thread_(ITEMS_PER_THREAD),
+    elementwise_vector_width_(kElementwiseVectorWidth),
+    vector_kernels_(),
+    convolution_feature_maps_per_thread_(kConvolutionFeatureMapsPerThread),
+    convolution_pixels_per_thread_(kConvolutionPixelsPerThread),
+    convolution_kernels_(),
+    cross_correlation_kernels_(),
+    convolution_gradient_kernels_(),
+    convolution_blocked_kernels_(),
+    depthwise_convolution_kernels_(),
+    depthwise_cross_correlation_kernels_(),
+    depthwise_convolution_gradient_kernels_() { }
+
 KernelManager::~KernelManager()
 {
+    // Abort or finish all background compilations first.
+    builder_.reset();
+    pending_programs_.clear();
+
     // Free all kernels
     for (size_t i = 0; i < kNumKernels; i++) {
         delete kernels_[i];
+        delete vector_kernels_[i][0];
+        delete vector_kernels_[i][1];
+    }
+    for (size_t x = 0; x < kMaxConvolutionKernelHalfSize; x++) {
+        for (size_t y = 0; y < kMaxConvolutionKernelHalfSize; y++) {
+            delete convolution_kernels_[x][y];
+            delete cross_correlation_kernels_[x][y];
+            delete convolution_gradient_kernels_[x][y];
+            delete convolution_blocked_kernels_[x][y];
+            delete depthwise_convolution_kernels_[x][y];
+            delete depthwise_cross_correlation_kernels_[x][y];
+            delete depthwise_convolution_gradient_kernels_[x][y];
+        }
     }
 
     // Free all programs
@@ -34,60 +76,255 @@ KernelManager::~KernelManager()
 
 bool KernelManager::LoadKernels(const string& kernel_directory)
 {
-    Assert(GPUContext::device);
+    return LoadKernels(kernel_directory, true);
+}
+
+bool KernelManager::LoadKernels(const string& kernel_directory, bool precompile)
+{
+    Assert(context_->device());
+    Assert(!builder_);
 
-    string compile_options = "-I " + kernel_directory;
     kernel_directory_ = kernel_directory;
 
-    for (size_t i = 0; i < kNumKernels; i++) {
-        string program_name = program_name_for_kernel[i];
-        if (programs_.count(program_name) == 0) {
-            programs_[program_name] = GPUContext::device->CreateProgramFromFile(kernel_directory + program_name + ".cl", compile_options).release();
-            if (!programs_[program_name])
-                return false;
+    size_t num_threads = min<size_t>(max<size_t>(thread::hardware_concurrency(), 1), kMaxCompilerThreads);
+    builder_.reset(new ocl::ProgramBuilder(context_->device(), num_threads));
+
+    items_per_thread_ = TuneItemsPerThread();
+
+    stringstream compile_options;
+    compile_options << "-I " << kernel_directory_ << " -D ITEMS_PER_THREAD=" << items_per_thread_;
+    compile_options_ = compile_options.str();
+
+    // The tuning file may specify a different register blocking for the convolution, as "CONVOLUTION_BLOCKING <feature maps> <pixels>".
+    ocl::Tuner::Parameters blocking;
+    if (context_->tuner().Lookup("CONVOLUTION_BLOCKING", &blocking)) {
+        bool valid = blocking.size() == 2 && blocking[0] > 0 && blocking[1] > 0 && kConvolutionTileWidth % blocking[1] == 0;
+        WARN_IF(!valid, "Ignoring invalid convolution blocking in the tuning file");
+        if (valid) {
+            convolution_feature_maps_per_thread_ = blocking[0];
+            convolution_pixels_per_thread_ = blocking[1];
+        }
+    }
+
+    elementwise_vector_width_ = TuneElementwiseVectorWidth();
+
+    if (precompile) {
+        for (size_t i = 0; i < kNumKernels; i++) {
+            const string& program_name = program_name_for_kernel[i];
+            ScheduleProgram(program_name, program_name + ".cl", compile_options_);
         }
-        kernels_[i] = programs_[program_name]->CreateKernel(name_for_kernel[i]).release();
-        if (!kernels_[i])
-            return false;
     }
 
     return true;
 }
 
-ocl::Kernel* KernelManager::convolution_kernel(size_t kernel_width, size_t kernel_height)
+ocl::Kernel* KernelManager::LoadKernel(KernelIDs id)
+{
+    const string& program_name = program_name_for_kernel[id];
+    ScheduleProgram(program_name, program_name + ".cl", compile_options_);
+
+    kernels_[id] = program(program_name)->CreateKernel(name_for_kernel[id]).release();
+    Check(kernels_[id], "Failed to create kernel '" << name_for_kernel[id] << "'");
+
+    return kernels_[id];
+}
+
+size_t KernelManager::TuneItemsPerThread()
+{
+    const string kKey = "ITEMS_PER_THREAD";
+    const size_t kCandidates[] = { 1, 2, 4, 8, 10, 16, 32 };
+
+    ocl::Tuner& tuner = context_->tuner();
+    ocl::Tuner::Parameters result;
+    if (tuner.Lookup(kKey, &result)) {
+        bool valid = result.size() == 1 && find(begin(kCandidates), end(kCandidates), result[0]) != end(kCandidates);
+        WARN_IF(!valid, "Ignoring invalid number of items per thread in the tuning file");
+        if (valid)
+            return result[0];
+    }
+    if (!tuner.enabled())
+        return ITEMS_PER_THREAD;
+
+    // Compile the Add kernel for all candidates at once.
+    vector<ocl::Tuner::Parameters> candidates;
+    for (size_t n : kCandidates) {
+        candidates.push_back({ n });
+        ScheduleProgram(kKey + "=" + to_string(n), "Arithmetic.cl", "-I " + kernel_directory_ + " -D ITEMS_PER_THREAD=" + to_string(n));
+    }
+
+    // Large enough to saturate the device.
+    constexpr size_t kProblemSize = 4 * 1024 * 1024;
+    auto x = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    auto y = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    auto out = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    FAIL_IF(!x || !y || !out, "Failed to allocate buffers for tuning", ITEMS_PER_THREAD);
+
+    map<size_t, unique_ptr<ocl::Kernel>> add_kernels;
+    result = tuner.Tune(kKey, candidates, { ITEMS_PER_THREAD }, [&](const ocl::Tuner::Parameters& candidate) {
+        size_t n = candidate[0];
+        if (!add_kernels[n])
+            add_kernels[n] = program(kKey + "=" + to_string(n))->CreateKernel("Add");
+        if (!add_kernels[n])
+            return false;
+
+        ocl::Kernel::WorkSize gws((kProblemSize + n - 1) / n);
+        return add_kernels[n]->Run(gws, ocl::Kernel::CalculateLocalWorkSize(gws), kProblemSize, x.get(), y.get(), out.get());
+    });
+
+    // The programs are not needed anymore.
+    add_kernels.clear();
+    for (size_t n : kCandidates) {
+        delete program(kKey + "=" + to_string(n));
+        programs_.erase(kKey + "=" + to_string(n));
+    }
+
+    return result[0];
+}
+
+ocl::Kernel* KernelManager::vector_kernel(KernelIDs id, size_t width)
+{
+    Assert(width == 4 || width == 8);
+
+    ocl::Kernel*& kernel = vector_kernels_[id][width / 8];
+    if (!kernel) {
+        const string& program_name = program_name_for_kernel[id];
+        ScheduleProgram(program_name + "Vec" + to_string(width), program_name + ".cl", compile_options_ + " -D VECTOR_WIDTH=" + to_string(width));
+
+        kernel = program(program_name + "Vec" + to_string(width))->CreateKernel(name_for_kernel[id] + "Vec").release();
+        Check(kernel, "Failed to create kernel '" << name_for_kernel[id] << "Vec' for vector width " << width);
+    }
+
+    return kernel;
+}
+
+void KernelManager::set_elementwise_vector_width(size_t width)
+{
+    Assert(width == 1 || width == 4 || width == 8);
+    elementwise_vector_width_ = width;
+}
+
+size_t KernelManager::TuneElementwiseVectorWidth()
+{
+    const string kKey = "ELEMENTWISE_VECTOR_WIDTH";
+
+    ocl::Tuner& tuner = context_->tuner();
+    ocl::Tuner::Parameters result;
+    if (tuner.Lookup(kKey, &result)) {
+        bool valid = result.size() == 1 && (result[0] == 1 || result[0] == 4 || result[0] == 8);
+        WARN_IF(!valid, "Ignoring invalid elementwise vector width in the tuning file");
+        if (valid)
+            return result[0];
+    }
+    if (!tuner.enabled())
+        return kElementwiseVectorWidth;
+
+    // Same problem as in TuneItemsPerThread().
+    constexpr size_t kProblemSize = 4 * 1024 * 1024;
+    auto x = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    auto y = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    auto out = context_->device()->AllocateBuffer(kProblemSize * sizeof(float), ocl::kScratchBuffer);
+    FAIL_IF(!x || !y || !out, "Failed to allocate buffers for tuning", kElementwiseVectorWidth);
+
+    result = tuner.Tune(kKey, { { 1 }, { 4 }, { 8 } }, { kElementwiseVectorWidth }, [&](const ocl::Tuner::Parameters& candidate) {
+        size_t width = candidate[0];
+        ocl::Kernel* add = width == 1 ? kernel(kAddKernel) : vector_kernel(kAddKernel, width);
+
+        ocl::Kernel::WorkSize gws((kProblemSize / width + items_per_thread_ - 1) / items_per_thread_);
+        return add->Run(gws, ocl::Kernel::CalculateLocalWorkSize(gws), kProblemSize, x.get(), y.get(), out.get());
+    });
+
+    return result[0];
+}
+
+void KernelManager::ScheduleProgram(const string& name, const string& filename, const string& compile_options)
+{
+    Assert(builder_);
+
+    if (programs_.count(name) == 0 && pending_programs_.count(name) == 0)
+        pending_programs_[name] = builder_->BuildFromFile(kernel_directory_ + filename, compile_options);
+}
+
+ocl::Program* KernelManager::program(const string& name)
+{
+    if (programs_.count(name) == 0) {
+        Assert(pending_programs_.count(name) == 1);
+        programs_[name] = builder_->Await(pending_programs_[name]).release();
+        pending_programs_.erase(name);
+        Check(programs_[name], "Failed to build program '" << name << "'");
+    }
+
+    return programs_[name];
+}
+
+void KernelManager::AwaitPrograms()
+{
+    while (!pending_programs_.empty())
+        program(pending_programs_.begin()->first);
+}
+
+ocl::Kernel* KernelManager::generated_kernel(const string& key, const function<string()>& generate_source, const string& kernel_name)
+{
+    Assert(context_->device());
+
+    GeneratedKernel& generated = generated_kernels_[key];
+    if (!generated.kernel) {
+        string source = generate_source();
+        generated.program = context_->device()->CreateProgram(source, compile_options_);
+        Check(generated.program, "Failed to build generated program:\n" << source);
+        generated.kernel = generated.program->CreateKernel(kernel_name);
+        Check(generated.kernel, "Failed to create kernel '" << kernel_name << "'");
+    }
+
+    return generated.kernel.get();
+}
+
+void KernelManager::PrepareConvolutionKernels(size_t kernel_width, size_t kernel_height)
 {
-    Assert(GPUContext::device);
+    Assert(context_->device());
+    Assert(kernel_width < kMaxConvolutionKernelSize && kernel_height < kMaxConvolutionKernelSize);
+
+    stringstream compile_options;
+    compile_options << "-I " + kernel_directory_;
+    compile_options << " -D KERNEL_WIDTH=" << kernel_width;
+    compile_options << " -D KERNEL_HEIGHT=" << kernel_height;
+    compile_options << " -D FEATURE_MAPS_PER_THREAD=" << convolution_feature_maps_per_thread_;
+    compile_options << " -D PIXELS_PER_THREAD=" << convolution_pixels_per_thread_;
+
+    stringstream program_name;
+    program_name << "Convolution" << kernel_width << "x" << kernel_height;
+
+    ScheduleProgram(program_name.str(), "Convolution.cl", compile_options.str());
+}
+
+void KernelManager::LoadConvolutionKernels(size_t kernel_width, size_t kernel_height)
+{
+    PrepareConvolutionKernels(kernel_width, kernel_height);
+
+    stringstream program_name;
+    program_name << "Convolution" << kernel_width << "x" << kernel_height;
+    ocl::Program* program = this->program(program_name.str());
 
     size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
-    if (!convolution_kernels_[halfwidth][halfheight]) {
-        // These must be in sync with the .cl source.
-        constexpr size_t kTileWidth = 16, kTileHeight = 16;
-
-        stringstream compile_options;
-        compile_options << "-I " + kernel_directory_;
-        compile_options << " -D KERNEL_WIDTH=" << kernel_width;
-        compile_options << " -D KERNEL_HEIGHT=" << kernel_height;
-
-        // Compute the halo lookup table. The lookup table assigns each thread a set of halo pixels to load. See kernels/Convolution.cl
-        stringstream lookup_table_x, lookup_table_y;
-        string separator = "";
-        for (size_t y = 0; y < kTileHeight + 2 * halfheight; y++) {
-            for (size_t x = 0; x < kTileWidth + 2 * halfwidth; x++) {
-                if (x < halfwidth || x >= kTileWidth + halfwidth || y < halfheight || y >= kTileHeight + halfheight) {
-                    lookup_table_x << separator << x;
-                    lookup_table_y << separator << y;
-                    separator = ",";
-                }
-            }
-        }
+    convolution_kernels_[halfwidth][halfheight] = program->CreateKernel("Convolution2D").release();
+    cross_correlation_kernels_[halfwidth][halfheight] = program->CreateKernel("CrossCorrelation2D").release();
+    convolution_gradient_kernels_[halfwidth][halfheight] = program->CreateKernel("Convolution2DGradients").release();
+    convolution_blocked_kernels_[halfwidth][halfheight] = program->CreateKernel("Convolution2DBlocked").release();
+    depthwise_convolution_kernels_[halfwidth][halfheight] = program->CreateKernel("DepthwiseConvolution2D").release();
+    depthwise_cross_correlation_kernels_[halfwidth][halfheight] = program->CreateKernel("DepthwiseCrossCorrelation2D").release();
+    depthwise_convolution_gradient_kernels_[halfwidth][halfheight] = program->CreateKernel("DepthwiseConvolution2DGradients").release();
+    Check(convolution_kernels_[halfwidth][halfheight] && cross_correlation_kernels_[halfwidth][halfheight] && convolution_gradient_kernels_[halfwidth][halfheight] &&
+          convolution_blocked_kernels_[halfwidth][halfheight] && depthwise_convolution_kernels_[halfwidth][halfheight] &&
+          depthwise_cross_correlation_kernels_[halfwidth][halfheight] && depthwise_convolution_gradient_kernels_[halfwidth][halfheight],
+          "Failed to create convolution kernels");
+}
 
-        compile_options << " -D LOOKUP_TABLE_X={" << lookup_table_x.str() << "}";
-        compile_options << " -D LOOKUP_TABLE_Y={" << lookup_table_y.str() << "}";
+ocl::Kernel* KernelManager::convolution_kernel(size_t kernel_width, size_t kernel_height)
+{
+    Assert(context_->device());
 
-        auto program = GPUContext::device->CreateProgramFromFile(kernel_directory_ + "Convolution.cl", compile_options.str()).release();
-        convolution_kernels_[halfwidth][halfheight] = program->CreateKernel("Convolution2D").release();
-        cross_correlation_kernels_[halfwidth][halfheight] = program->CreateKernel("CrossCorrelation2D").release();
-        convolution_gradient_kernels_[halfwidth][halfheight] = program->CreateKernel("Convolution2DGradients").release();
+    size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
+    if (!convolution_kernels_[halfwidth][halfheight]) {
+        LoadConvolutionKernels(kernel_width, kernel_height);
     }
 
     return convolution_kernels_[halfwidth][halfheight];
@@ -95,12 +332,11 @@ ocl::Kernel* KernelManager::convolution_kernel(size_t kernel_width, size_t kerne
 
 ocl::Kernel* KernelManager::cross_correlation_kernel(size_t kernel_width, size_t kernel_height)
 {
-    Assert(GPUContext::device);
+    Assert(context_->device());
 
     size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
     if (!cross_correlation_kernels_[halfwidth][halfheight]) {
-        // Load convoltion and cross-correlation kernels
-        convolution_kernel(kernel_width, kernel_height);
+        LoadConvolutionKernels(kernel_width, kernel_height);
     }
 
     return cross_correlation_kernels_[halfwidth][halfheight];
@@ -108,25 +344,86 @@ ocl::Kernel* KernelManager::cross_correlation_kernel(size_t kernel_width, size_t
 
 ocl::Kernel* KernelManager::convolution_gradient_kernel(size_t kernel_width, size_t kernel_height)
 {
-    Assert(GPUContext::device);
+    Assert(context_->device());
 
     size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
     if (!convolution_gradient_kernels_[halfwidth][halfheight]) {
-        // Load convoltion and cross-correlation kernels
-        convolution_kernel(kernel_width, kernel_height);
+        LoadConvolutionKernels(kernel_width, kernel_height);
     }
 
     return convolution_gradient_kernels_[halfwidth][halfheight];
 }
 
-ocl::Device* GPUContext::device = nullptr;;
-KernelManager GPUContext::kernel_manager;
+ocl::Kernel* KernelManager::convolution_blocked_kernel(size_t kernel_width, size_t kernel_height)
+{
+    Assert(context_->device());
+
+    size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
+    if (!convolution_blocked_kernels_[halfwidth][halfheight]) {
+        LoadConvolutionKernels(kernel_width, kernel_height);
+    }
+
+    return convolution_blocked_kernels_[halfwidth][halfheight];
+}
+
+ocl::Kernel* KernelManager::depthwise_convolution_kernel(size_t kernel_width, size_t kernel_height)
+{
+    Assert(context_->device());
+
+    size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
+    if (!depthwise_convolution_kernels_[halfwidth][halfheight]) {
+        LoadConvolutionKernels(kernel_width, kernel_height);
+    }
+
+    return depthwise_convolution_kernels_[halfwidth][halfheight];
+}
+
+ocl::Kernel* KernelManager::depthwise_cross_correlation_kernel(size_t kernel_width, size_t kernel_height)
+{
+    Assert(context_->device());
+
+    size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
+    if (!depthwise_cross_correlation_kernels_[halfwidth][halfheight]) {
+        LoadConvolutionKernels(kernel_width, kernel_height);
+    }
+
+    return depthwise_cross_correlation_kernels_[halfwidth][halfheight];
+}
+
+ocl::Kernel* KernelManager::depthwise_convolution_gradient_kernel(size_t kernel_width, size_t kernel_height)
+{
+    Assert(context_->device());
+
+    size_t halfwidth = kernel_width/2, halfheight = kernel_height/2;
+    if (!depthwise_convolution_gradient_kernels_[halfwidth][halfheight]) {
+        LoadConvolutionKernels(kernel_width, kernel_height);
+    }
+
+    return depthwise_convolution_gradient_kernels_[halfwidth][halfheight];
+}
+
+GPUContext* GPUContext::default_context_ = nullptr;
+thread_local GPUContext* GPUContext::current_ = nullptr;
+
+GPUContext::GPUContext(ocl::Device* device) : device_(device), kernel_manager_(this) { }
+
+GPUContext::~GPUContext()
+{
+    Assert(default_context_ != this);
+    if (current_ == this)
+        current_ = nullptr;
+}
+
+bool GPUContext::Init(const string& kernel_directory)
+{
+    WARN_IF(!tuner_.Init(device(), ocl::Tuner::DefaultPath(device())), "Ignoring previous tuning results");
+    return kernel_manager_.LoadKernels(kernel_directory);
+}
 
-bool GPUContext::Init(ocl::Device* device, const string& kernel_directory)
+void GPUContext::SetDefault(GPUContext* context)
 {
-    Assert(!GPUContext::device);
-    GPUContext::device = device;
-    return kernel_manager.LoadKernels(kernel_directory);
+    Assert(!default_context_);
+    default_context_ = context;
 }
 
 }       // namespace nn
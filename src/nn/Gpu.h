@@ -7,10 +7,15 @@
 #ifndef __GPU_H__
 #define __GPU_H__
 
+#include <functional>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 #include "ocl/Device.h"
 #include "ocl/Kernel.h"
+#include "ocl/ProgramBuilder.h"
+#include "ocl/Tuner.h"
 
 namespace nn {
 
@@ -22,21 +27,44 @@ enum KernelIDs {
 };
 #undef C
 
-constexpr size_t kMaxConvolutionKernelSize = 11;
+// Kernel sizes must be smaller than this. The tiled kernels keep the input area of a whole tile, including the halo, in local memory.
+constexpr size_t kMaxConvolutionKernelSize = 15;
 constexpr size_t kMaxConvolutionKernelHalfSize = kMaxConvolutionKernelSize / 2 + 1;
 
+// Size of the output blocks computed by one work group of the convolution kernels. Must be in sync with kernels/Convolution.cl.
+constexpr size_t kConvolutionTileWidth = 16;
+constexpr size_t kConvolutionTileHeight = 16;
+
+// Default register blocking of the Convolution2DBlocked kernel: the number of feature maps and (horizontally
+// adjacent) output pixels computed by each thread. Can be overridden through the tuning file, see KernelManager.
+constexpr size_t kConvolutionFeatureMapsPerThread = 4;
+constexpr size_t kConvolutionPixelsPerThread = 2;
+
+// Default vector width of the elementwise kernels, see KernelCommon.h. Either 1 (scalar kernels), 4 or 8.
+// Determined by benchmarking in tuning mode or set through the tuning file, see KernelManager.
+constexpr size_t kElementwiseVectorWidth = 4;
+
 // Class to manage OpenCL kernels for the neural networking code.
+//
+// Programs are compiled on a set of background threads. A kernel only becomes available
+// once the program containing it has been compiled, requesting it before that blocks.
+class GPUContext;
+
 class KernelManager {
   public:
-    KernelManager() { }
+    // Creates a kernel manager for the device of the given context.
+    explicit KernelManager(GPUContext* context);
 
     ~KernelManager();
 
-    // Loads all registered kernels (see KernelList.h).
+    // Starts compiling all registered programs (see KernelList.h) in the background.
     bool LoadKernels(const std::string& kernel_directory);
 
+    // Same as above. If |precompile| is false, programs will only be compiled once one of their kernels is first requested.
+    bool LoadKernels(const std::string& kernel_directory, bool precompile);
+
     // Returns the kernel with the given ID.
-    ocl::Kernel* kernel(KernelIDs id) { return kernels_[id]; }
+    ocl::Kernel* kernel(KernelIDs id) { return kernels_[id] ? kernels_[id] : LoadKernel(id); }
 
     // Returns the 2D convolution/cross-correlation kernel for the given kernel size.
     //
@@ -46,37 +74,156 @@ class KernelManager {
     ocl::Kernel* cross_correlation_kernel(size_t kernel_width, size_t kernel_height);
     ocl::Kernel* convolution_gradient_kernel(size_t kernel_width, size_t kernel_height);
 
+    // Returns the register blocked variant of the convolution kernel for the given kernel size. It computes
+    // convolution_feature_maps_per_thread() feature maps and convolution_pixels_per_thread() pixels per thread.
+    ocl::Kernel* convolution_blocked_kernel(size_t kernel_width, size_t kernel_height);
+
+    // Returns the depthwise convolution kernels for the given kernel size. These are part of the same program as the above.
+    ocl::Kernel* depthwise_convolution_kernel(size_t kernel_width, size_t kernel_height);
+    ocl::Kernel* depthwise_cross_correlation_kernel(size_t kernel_width, size_t kernel_height);
+    ocl::Kernel* depthwise_convolution_gradient_kernel(size_t kernel_width, size_t kernel_height);
+
+    // Register blocking of the blocked convolution kernel. Passed to the kernel as compile-time defines.
+    size_t convolution_feature_maps_per_thread() const { return convolution_feature_maps_per_thread_; }
+    size_t convolution_pixels_per_thread() const { return convolution_pixels_per_thread_; }
+
+    // Returns the kernel with the given name from a program generated at runtime and identified by |key|. On first use
+    // of the key, |generate_source| is called to produce the program source, which is then compiled with the same
+    // options as the programs in KernelList.h. Later requests for the same key only cost a hash table lookup.
+    ocl::Kernel* generated_kernel(const std::string& key, const std::function<std::string()>& generate_source, const std::string& kernel_name);
+
+    // Returns the vectorized variant of the elementwise kernel with the given ID, which uses vector loads and stores of
+    // |width| (4 or 8) elements, see KernelCommon.h. Only valid for the kernels in Arithmetic.cl and Activations.cl.
+    //
+    // The vectorized kernels are compiled on first use.
+    ocl::Kernel* vector_kernel(KernelIDs id, size_t width);
+
+    // Returns the number of elements (for the vectorized kernels: vectors) that each thread of the elementwise kernels processes.
+    size_t items_per_thread() const { return items_per_thread_; }
+
+    // Vector width to use for elementwise operations on suitably aligned tensors. 1 selects the scalar kernels.
+    size_t elementwise_vector_width() const { return elementwise_vector_width_; }
+    void set_elementwise_vector_width(size_t width);
+
+    // Starts compiling the convolution kernels for the given kernel size in the background.
+    void PrepareConvolutionKernels(size_t kernel_width, size_t kernel_height);
+
+    // Waits until all programs that have been scheduled for compilation are available.
+    void AwaitPrograms();
+
   private:
+    // Creates the kernel with the given ID, waiting for its program if necessary.
+    ocl::Kernel* LoadKernel(KernelIDs id);
+
+    // Schedules the compilation of the given program file unless that already happened.
+    // The name identifies the program, it must be unique for every combination of file and compile options.
+    void ScheduleProgram(const std::string& name, const std::string& filename, const std::string& compile_options);
+
+    // Returns the program with the given name, waiting for its compilation to finish if necessary.
+    ocl::Program* program(const std::string& name);
+
+    // Creates all kernels of the convolution program for the given kernel size.
+    void LoadConvolutionKernels(size_t kernel_width, size_t kernel_height);
+
+    // Determines the number of items per thread for the elementwise kernels, benchmarking candidates in tuning mode.
+    size_t TuneItemsPerThread();
+
+    // Determines the vector width of the elementwise kernels, benchmarking candidates in tuning mode.
+    size_t TuneElementwiseVectorWidth();
+
+    // Context whose device the kernels are compiled for. Not owned by this instance.
+    GPUContext* context_;
+
     ocl::Kernel* kernels_[kNumKernels];
     std::map<std::string, ocl::Program*> programs_;
 
+    // Compiles programs in the background.
+    std::unique_ptr<ocl::ProgramBuilder> builder_;
+
+    // Programs that have been scheduled for compilation but have not yet been moved into programs_.
+    std::map<std::string, std::shared_ptr<ocl::PendingProgram>> pending_programs_;
+
     // Path to the OpenCL kernel files.
     std::string kernel_directory_;
 
+    // Compile options for the programs in KernelList.h.
+    std::string compile_options_;
+
+    size_t items_per_thread_;
+    size_t elementwise_vector_width_;
+
+    // Vectorized elementwise kernels for a vector width of 4 and 8.
+    ocl::Kernel* vector_kernels_[kNumKernels][2];
+
+    // Kernels from programs generated at runtime, keyed by the key passed to generated_kernel(). The kernel must be destroyed before its program.
+    struct GeneratedKernel {
+        std::unique_ptr<ocl::Program> program;
+        std::unique_ptr<ocl::Kernel> kernel;
+    };
+    std::unordered_map<std::string, GeneratedKernel> generated_kernels_;
+
+    size_t convolution_feature_maps_per_thread_;
+    size_t convolution_pixels_per_thread_;
+
     // Convolution/cross-correlation kernels.
     // Since widht and height of the convolution kernel must always be odd, we index
     // them by the halfwidth and halfheight of the kernel.
     ocl::Kernel* convolution_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
     ocl::Kernel* cross_correlation_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
     ocl::Kernel* convolution_gradient_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
+    ocl::Kernel* convolution_blocked_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
+    ocl::Kernel* depthwise_convolution_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
+    ocl::Kernel* depthwise_cross_correlation_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
+    ocl::Kernel* depthwise_convolution_gradient_kernels_[kMaxConvolutionKernelHalfSize][kMaxConvolutionKernelHalfSize];
 };
 
 
 // Class to hold GPU related context for the neural networking code.
 //
-// Currently, only one OpenCL device is supported, thus all methods of this class are static.
+// Every context owns one OpenCL device together with the kernels compiled for it. All tensor operations
+// and layers use the current context of the calling thread (see Current()), so tensors created while one
+// context was current must only be used while that context is current.
 class GPUContext {
   public:
-    // Initializes the global GPUContext with the given device.
-    // Also loads all registered (see KernelList.h) kernels.
+    // Creates a context for the given device. Takes ownership of the device pointer.
+    explicit GPUContext(ocl::Device* device);
+
+    ~GPUContext();
+
+    // Loads previous tuning results for the device and starts compiling all registered (see KernelList.h) kernels in the background.
+    // Tuning mode must be enabled before this is called, see tuner().
+    bool Init(const std::string& kernel_directory);
+
+    // Returns the context used by the calling thread. This is the context most recently passed to MakeCurrent()
+    // on this thread or, if there is none, the default context. Returns nullptr if OpenCL hasn't been initialized.
+    static GPUContext* Current() { return current_ ? current_ : default_context_; }
+
+    // Sets the default context, used by all threads that haven't made another context current.
     //
-    // Can only be called once per session.
-    // Takes ownership of the device pointer.
-    static bool Init(ocl::Device* device, const std::string& kernel_directory);
+    // Can only be called once per session. Takes ownership of the context, it lives until the end of the process.
+    static void SetDefault(GPUContext* context);
+
+    // Makes this context the current context for the calling thread.
+    void MakeCurrent() { current_ = this; }
+
+    // OpenCL device and kernel manager of this context.
+    ocl::Device* device() { return device_.get(); }
+    KernelManager& kernel_manager() { return kernel_manager_; }
+
+    // Launch parameter tuning for the device of this context.
+    ocl::Tuner& tuner() { return tuner_; }
+
+  private:
+    static GPUContext* default_context_;
+    static thread_local GPUContext* current_;
+
+    std::unique_ptr<ocl::Device> device_;
+    ocl::Tuner tuner_;
+
+    // Destroyed first as the kernels must not outlive the device.
+    KernelManager kernel_manager_;
 
-    // Global OpenCL device and kernel manager.
-    static ocl::Device* device;
-    static KernelManager kernel_manager;
+    DISALLOW_COPY_AND_ASSIGN(GPUContext);
 };
 
 }       // namespace nn
@@ -26,10 +26,31 @@ C(kSigmoidDerivativeKernel,             "Activations",      "SigmoidDerivative")
 C(kReLUKernel,                          "Activations",      "ReLU"),
 C(kReLUDerivativeKernel,                "Activations",      "ReLUDerivative"),
 
+C(kSoftmaxKernel,                       "Softmax",          "Softmax"),
+C(kSoftmaxCrossEntropyKernel,           "Softmax",          "SoftmaxCrossEntropy"),
+
+C(kSGDUpdateKernel,                     "Optimizers",       "SGDUpdate"),
+C(kMomentumUpdateKernel,                "Optimizers",       "MomentumUpdate"),
+C(kRMSPropUpdateKernel,                 "Optimizers",       "RMSPropUpdate"),
+C(kAdamUpdateKernel,                    "Optimizers",       "AdamUpdate"),
+
 C(kMatVecMulKernel,                     "LinearAlgebra",    "MatVecMul"),
 C(kMatVecMulReduceKernel,               "LinearAlgebra",    "MatVecMulReduce"),
 C(kTransposedMatVecMulKernel,           "LinearAlgebra",    "TransposedMatVecMul"),
 C(kTransposedVecMulKernel,              "LinearAlgebra",    "TransposedVecMul"),
+C(kReduceRowsKernel,                    "LinearAlgebra",    "ReduceRows"),
+C(kTransposedMatMulKernel,              "LinearAlgebra",    "TransposedMatMul"),
 
 C(kMaxPool2DKernel,                     "Pooling",          "MaxPool2D"),
 C(kMaxPool2DGradientsKernel,            "Pooling",          "MaxPool2DGradients"),
+
+C(kConvolution2DGeneralKernel,          "ConvolutionGeneral", "Convolution2DGeneral"),
+C(kCrossCorrelation2DGeneralKernel,     "ConvolutionGeneral", "CrossCorrelation2DGeneral"),
+C(kConvolution2DGradientsGeneralKernel, "ConvolutionGeneral", "Convolution2DGradientsGeneral"),
+
+C(kPointwiseConvolutionKernel,          "PointwiseConvolution", "PointwiseConvolution"),
+C(kPointwiseCrossCorrelationKernel,     "PointwiseConvolution", "PointwiseCrossCorrelation"),
+C(kPointwiseConvolutionGradientsKernel, "PointwiseConvolution", "PointwiseConvolutionGradients"),
+
+C(kGatherBytesKernel,                   "Gather",           "GatherBytes"),
+C(kGatherOneHotKernel,                  "Gather",           "GatherOneHot"),
@@ -7,11 +7,28 @@
 #ifndef __LAYER_H__
 #define __LAYER_H__
 
+#include <cstdint>
+#include <vector>
+
 #include "nn/Tensor.h"
 #include "nn/Initializer.h"
 
 namespace nn {
 
+// Identifies the type of a layer in checkpoints, see Checkpoint.h. The values are part of the file format.
+enum class LayerKind : uint32_t {
+    kUnknown                        = 0,
+    kDense                          = 1,
+    kBias                           = 2,
+    kConvolution                    = 3,
+    kDepthwiseSeparableConvolution  = 4,
+    kMaxPool2D                      = 5,
+    kReshape                        = 6,
+    kReLU                           = 7,
+    kSigmoid                        = 8,
+    kSoftmax                        = 9,
+};
+
 template <typename Tensor>
 class Layer {
   public:
@@ -40,8 +57,27 @@ class Layer {
     // Returns the output tensor shape of this layer.
     virtual Shape OutputTensorShape() const = 0;
 
-    // Perform a gradient descent step on the previously processed mini batch.
-    virtual void GradientDescent(size_t batch_size, float epsilon) = 0;
+    // Starts preparing this layer for execution, e.g. by compiling device code that it needs.
+    // This may return before the preparation has finished, see Network::WarmUp().
+    virtual void WarmUp() { }
+
+    // Returns the learnable parameters (weights, biases) of this layer. These are updated by the optimizer of the network.
+    virtual std::vector<Tensor*> Parameters() { return {}; }
+
+    // Returns the tensors in which the gradients for the parameters are accumulated during the backward pass,
+    // in the same order as Parameters(). The gradients are reset by the optimizer, see Optimizer.h.
+    virtual std::vector<Tensor*> Gradients() { return {}; }
+
+    // Completes the gradients of any samples whose contribution was deferred during the backward pass, so that
+    // the tensors returned by Gradients() hold the sum over the whole mini batch. See DenseLayer::DeferWeightGradients().
+    virtual void FinalizeGradients() { }
+
+    // Returns the type of this layer. Layers of unknown type can't be stored in checkpoints.
+    virtual LayerKind kind() const { return LayerKind::kUnknown; }
+
+    // Returns the hyperparameters that are needed to reconstruct this layer from a checkpoint, in addition
+    // to its input and output shapes and the shapes of its parameters (e.g. the stride of a convolution).
+    virtual std::vector<uint32_t> Attributes() const { return {}; }
 
     // Returns a tensor holding the current weight gradients.
     // This is mostly useful for testing purposes.
@@ -8,6 +8,11 @@
 #include "nn/Gpu.h"
 #include "nn/Initializer.h"
 #include "nn/Network.h"
+#include "nn/Checkpoint.h"
+#include "nn/DataLoader.h"
+#include "nn/Dataset.h"
+#include "nn/DeviceDataset.h"
+#include "nn/DataParallel.h"
 
 // Tensors
 #include "nn/Tensor.h"
@@ -16,6 +21,7 @@
 #include "nn/layers/Bias.h"
 #include "nn/layers/Convolution.h"
 #include "nn/layers/Dense.h"
+#include "nn/layers/DepthwiseSeparableConvolution.h"
 #include "nn/layers/MaxPool.h"
 #include "nn/layers/Reshape.h"
 
@@ -28,6 +34,11 @@
 #include "nn/objectives/CrossEntropy.h"
 #include "nn/objectives/MSE.h"
 
+// Optimizers
+#include "nn/optimizers/Adam.h"
+#include "nn/optimizers/RMSProp.h"
+#include "nn/optimizers/SGD.h"
+
 namespace nn {
 
 // Namespaces to export all template classes for either CPU or GPU tensor instances.
@@ -35,10 +46,19 @@ namespace gpu {
 
 using nn::GPUTensor;
 using nn::CPUTensor;
+using nn::GPUContext;
+using nn::Checkpoint;
+using nn::DataLoader;
+using nn::Dataset;
+using nn::DeviceDataset;
+using nn::DataParallelNetwork;
+using nn::ConvolutionParameters;
+using nn::Padding;
 
 typedef Network<GPUTensor> Network;
 
 typedef ConvolutionLayer<GPUTensor> ConvolutionLayer;
+typedef DepthwiseSeparableConvolutionLayer<GPUTensor> DepthwiseSeparableConvolutionLayer;
 typedef DenseLayer<GPUTensor> DenseLayer;
 typedef MaxPool2DLayer<GPUTensor> MaxPool2DLayer;
 typedef BiasLayer<GPUTensor> BiasLayer;
@@ -51,16 +71,24 @@ typedef SoftmaxActivation<GPUTensor> SoftmaxActivation;
 typedef MSE<GPUTensor> MSE;
 typedef CrossEntropy<GPUTensor> CrossEntropy;
 
+typedef SGD<GPUTensor> SGD;
+typedef RMSProp<GPUTensor> RMSProp;
+typedef Adam<GPUTensor> Adam;
+
 }       // namespace gpu
 
 namespace cpu {
 
 using nn::GPUTensor;
 using nn::CPUTensor;
+using nn::Checkpoint;
+using nn::ConvolutionParameters;
+using nn::Padding;
 
 typedef Network<CPUTensor> Network;
 
 typedef ConvolutionLayer<CPUTensor> ConvolutionLayer;
+typedef DepthwiseSeparableConvolutionLayer<CPUTensor> DepthwiseSeparableConvolutionLayer;
 typedef DenseLayer<CPUTensor> DenseLayer;
 typedef MaxPool2DLayer<CPUTensor> MaxPool2DLayer;
 typedef BiasLayer<CPUTensor> BiasLayer;
@@ -73,6 +101,10 @@ typedef SoftmaxActivation<CPUTensor> SoftmaxActivation;
 typedef MSE<CPUTensor> MSE;
 typedef CrossEntropy<CPUTensor> CrossEntropy;
 
+typedef SGD<CPUTensor> SGD;
+typedef RMSProp<CPUTensor> RMSProp;
+typedef Adam<CPUTensor> Adam;
+
 }       // namespace gpu
 
 }       // namespace nn
@@ -7,12 +7,33 @@
 #ifndef __NETWORK_H__
 #define __NETWORK_H__
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
 #include <vector>
 
 #include "nn/Tensor.h"
+#include "nn/Checkpoint.h"
+#include "nn/DataLoader.h"
+#include "nn/DeviceDataset.h"
+#include "nn/ExecutionPlan.h"
 #include "nn/Layer.h"
 #include "nn/Activation.h"
 #include "nn/Objective.h"
+#include "nn/Optimizer.h"
+#include "nn/optimizers/SGD.h"
+#include "nn/layers/Bias.h"
+#include "nn/layers/Convolution.h"
+#include "nn/layers/Dense.h"
+#include "nn/layers/DepthwiseSeparableConvolution.h"
+#include "nn/layers/MaxPool.h"
+#include "nn/layers/Reshape.h"
+#include "nn/activations/ReLU.h"
+#include "nn/activations/Sigmoid.h"
+#include "nn/activations/Softmax.h"
 #include "common/Common.h"
 
 namespace nn {
@@ -22,18 +43,89 @@ class Network {
     typedef Objective<Tensor> Objective;
     typedef Layer<Tensor> Layer;
     typedef Activation<Tensor> Activation;
+    typedef Optimizer<Tensor> Optimizer;
 
   public:
-    Network(Objective* objective) : objective_(objective), final_activation_(nullptr) { }
+    // Creates a network that is trained with plain stochastic gradient descent.
+    Network(Objective* objective) : Network(objective, new SGD<Tensor>()) { }
+
+    // Creates a network that is trained with the given optimizer. Takes ownership of both pointers.
+    Network(Objective* objective, Optimizer* optimizer) : objective_(objective), optimizer_(optimizer), final_activation_(nullptr) { }
+
+    // Reconstructs a network, including its parameters, from a checkpoint written by Save().
+    // Takes ownership of the objective. Returns nullptr if the checkpoint contains unknown layers.
+    static std::unique_ptr<Network> Load(const Checkpoint& checkpoint, Objective* objective)
+    {
+        std::unique_ptr<Network> network(new Network(objective));
+
+        for (size_t i = 0; i < checkpoint.num_layers(); i++) {
+            const CheckpointLayer& layer = checkpoint.layer(i);
+            Shape input_shape = DecodeShape(layer.input_shape), output_shape = DecodeShape(layer.output_shape);
+            Shape first_parameter_shape = layer.num_tensors > 0 ? checkpoint.tensor_shape(layer.first_tensor) : Shape(std::vector<size_t>());
+
+            // The parameters are overwritten by Restore() below.
+            switch (static_cast<LayerKind>(layer.kind)) {
+                case LayerKind::kDense:
+                    FAIL_IF(input_shape.rank() != 1 || output_shape.rank() != 1, "Invalid dense layer in checkpoint.", nullptr);
+                    network->Append(new DenseLayer<Tensor>(input_shape[0], output_shape[0]));
+                    break;
+                case LayerKind::kBias:
+                    network->Append(new BiasLayer<Tensor>(input_shape));
+                    break;
+                case LayerKind::kConvolution: {
+                    FAIL_IF(first_parameter_shape.rank() != 4 || layer.num_attributes != 3 || output_shape.rank() != 3, "Invalid convolution layer in checkpoint.", nullptr);
+                    ConvolutionParameters parameters(layer.attributes[0], static_cast<Padding>(layer.attributes[1]), layer.attributes[2]);
+                    network->Append(new ConvolutionLayer<Tensor>(input_shape, output_shape[0], first_parameter_shape[3], first_parameter_shape[2], parameters));
+                    break;
+                }
+                case LayerKind::kDepthwiseSeparableConvolution:
+                    FAIL_IF(first_parameter_shape.rank() != 3 || output_shape.rank() != 3, "Invalid depthwise separable convolution layer in checkpoint.", nullptr);
+                    network->Append(new DepthwiseSeparableConvolutionLayer<Tensor>(input_shape, output_shape[0], first_parameter_shape[2], first_parameter_shape[1]));
+                    break;
+                case LayerKind::kMaxPool2D:
+                    FAIL_IF(layer.num_attributes != 2 || layer.attributes[0] == 0 || layer.attributes[1] == 0 || input_shape.rank() != 3,
+                            "Invalid max pooling layer in checkpoint.", nullptr);
+                    network->Append(new MaxPool2DLayer<Tensor>(input_shape, layer.attributes[0], layer.attributes[1]));
+                    break;
+                case LayerKind::kReshape:
+                    network->Append(new ReshapeLayer<Tensor>(input_shape, output_shape));
+                    break;
+                case LayerKind::kReLU:
+                    network->Append(new ReLUActivation<Tensor>(input_shape));
+                    break;
+                case LayerKind::kSigmoid:
+                    network->Append(new SigmoidActivation<Tensor>(input_shape));
+                    break;
+                case LayerKind::kSoftmax:
+                    network->Append(new SoftmaxActivation<Tensor>(input_shape));
+                    break;
+                default:
+                    FAIL_IF(true, "Unknown layer kind " << layer.kind << " in checkpoint.", nullptr);
+            }
+        }
+
+        if (!network->Restore(checkpoint))
+            return nullptr;
+
+        return network;
+    }
 
     ~Network()
     {
+        // The plan refers to the tensors of the layers.
+        plan_.reset();
+
+        // Finish writing the last checkpoint, its tensors are independent of the layers.
+        checkpoint_writer_.reset();
+
         for (Layer* layer : layers_) {
             delete layer;
         }
 
         if (objective_)
             delete objective_;
+        if (optimizer_)
+            delete optimizer_;
     }
 
     // Train the network on the supplied data.
@@ -62,18 +154,99 @@ class Network {
                 printf("%zu/%zu  loss: %.2f  acc: %.2f\n", current_iteration_, n, loss_avg, acc_avg);
             }
 
-            // Epoch done, evaluate performance on test data.
-            double correct_count = 0;
-            for (size_t test = 0; test < test_data.shape(0); test++) {
-                const Tensor& output = Evaluate(test_data[test]);
-                if (argmax(output) == argmax(test_labels[test]))
-                    correct_count++;
+            FinishEpoch(epoch, test_data, test_labels);
+        }
+
+        PrintProfile();
+    }
+
+    // Train the network on the batches prepared by the given loader, see DataLoader.h.
+    //
+    // The loader takes care of shuffling and normalizing the training data, so the test data must have been normalized in the same way.
+    void Train(DataLoader& loader, Tensor& test_data, Tensor& test_labels, size_t num_epochs, float epsilon)
+    {
+        Assert(test_data.shape(0) == test_labels.shape(0));
+
+        size_t n = loader.batches_per_epoch() * loader.batch_size();
+        loader.Start(num_epochs);
+
+        Tensor data, labels;
+        for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+            loss_ = 0, hits_ = 0, current_iteration_ = 0;
+
+            for (size_t batch = 0; batch < loader.batches_per_epoch(); batch++) {
+                const DataLoader::Batch& next = loader.NextBatch();
+                Assert(next.epoch == epoch);
+
+                CopyBatch(next.data, &data);
+                CopyBatch(next.labels, &labels);
+                ProcessBatch(data, labels, epsilon);
+
+                double loss_avg = loss_ / current_iteration_;
+                double acc_avg  = hits_ / current_iteration_;
+                printf("%zu/%zu  loss: %.2f  acc: %.2f\n", current_iteration_, n, loss_avg, acc_avg);
+            }
+
+            FinishEpoch(epoch, test_data, test_labels);
+        }
+
+        loader.Stop();
+        PrintProfile();
+    }
+
+    // Train the network on datasets that are kept on the device, see DeviceDataset.h. Only available for GPU networks.
+    //
+    // Every epoch visits the samples in the order of a new random permutation, which is uploaded once per epoch.
+    // The batches are then gathered and converted on the device, so the host only has to enqueue kernels.
+    void Train(const DeviceDataset& data, const DeviceDataset& labels, Tensor& test_data, Tensor& test_labels, size_t num_epochs, size_t batch_size, float epsilon)
+    {
+        Assert(data.num_samples() == labels.num_samples());
+        Assert(test_data.shape(0) == test_labels.shape(0));
+
+        size_t n = data.num_samples();
+        ocl::Device* device = GPUContext::Current()->device();
+        std::unique_ptr<ocl::Buffer> order = device->AllocateBuffer(n * sizeof(uint32_t), ocl::kReadOnlyBuffer);
+        Check(order, "Out of device memory");
+
+        std::vector<uint32_t> permutation(n);
+        std::mt19937 generator(rand());
+        Tensor batch_data, batch_labels;
+
+        for (size_t epoch = 0; epoch < num_epochs; epoch++) {
+            loss_ = 0, hits_ = 0, current_iteration_ = 0;
+
+            std::iota(permutation.begin(), permutation.end(), 0);
+            std::shuffle(permutation.begin(), permutation.end(), generator);
+            Check(device->Upload(order.get(), reinterpret_cast<const uint8_t*>(permutation.data()), n * sizeof(uint32_t), 0), "Failed to transfer sample order to the device");
+
+            for (size_t batch = 0; batch < n / batch_size; batch++) {
+                data.Gather(order.get(), batch * batch_size, batch_size, &batch_data);
+                labels.Gather(order.get(), batch * batch_size, batch_size, &batch_labels);
+                ProcessBatch(batch_data, batch_labels, epsilon);
+
+                double loss_avg = loss_ / current_iteration_;
+                double acc_avg  = hits_ / current_iteration_;
+                printf("%zu/%zu  loss: %.2f  acc: %.2f\n", current_iteration_, n, loss_avg, acc_avg);
             }
 
-            std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
-            std::cout << "EPOCH " << epoch + 1 << " FINISHED. ACCURACY: " << correct_count << "/" << test_data.shape(0) << " (" << correct_count / test_data.shape(0) << ")" << std::endl;
-            std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
+            FinishEpoch(epoch, test_data, test_labels);
         }
+
+        PrintProfile();
+    }
+
+    // Prepares all layers for execution and waits until that has finished.
+    //
+    // Compiles the device code required by the layers (e.g. the convolution kernels for each kernel size
+    // used in the network) concurrently, so that this doesn't happen during the first mini-batch.
+    void WarmUp()
+    {
+        for (Layer* layer : layers_) {
+            layer->WarmUp();
+        }
+
+        if (GPUContext::Current())
+            GPUContext::Current()->kernel_manager().AwaitPrograms();
     }
 
     // Evaluate the network's output for the given input.
@@ -91,6 +264,26 @@ class Network {
         return *current;
     }
 
+    // Evaluates the network for every row of |inputs| and returns the outputs as the rows of a new tensor.
+    //
+    // The layers still process one sample at a time, but on the GPU the forward passes of all samples are
+    // enqueued back to back without waiting for any of them, so a whole batch only needs one transfer in
+    // each direction.
+    Tensor EvaluateBatch(const Tensor& inputs)
+    {
+        Shape output_shape = OutputTensorShape();
+        std::vector<size_t> dimensions = { inputs.shape(0) };
+        for (size_t i = 0; i < output_shape.rank(); i++)
+            dimensions.push_back(output_shape[i]);
+        Shape batch_shape(dimensions);
+
+        Tensor outputs(batch_shape);
+        for (size_t i = 0; i < inputs.shape(0); i++)
+            outputs[i] = Evaluate(inputs[i]);
+
+        return outputs;
+    }
+
     // Returns the number of layers in this network.
     size_t num_layers() const
     {
@@ -147,7 +340,218 @@ class Network {
         return *this;
     }
 
+    // Runs the forward and the backward pass for a single training sample.
+    //
+    // The gradients are accumulated in the layers until the next call to GradientDescent().
+    // Returns the loss for the sample and sets |hit| if the network's prediction was correct.
+    double Backpropagate(const Tensor& input, const Tensor& label, bool* hit)
+    {
+        const Tensor& output = Evaluate(input);
+
+        *hit = argmax(output) == argmax(label);
+
+        // We might be able to directly compute the loss and its gradients wrt the
+        // input of the final activation. See Objective.h for details.
+        float loss = 0;
+        const Tensor* gradients = nullptr;
+        bool skip_final_activation = false;
+        if (final_activation_)
+            gradients = objective_->LossAndGradientWrtActivationInput(final_activation_, label, &loss);
+        if (!gradients) {
+            loss = objective_->Loss(output, label);
+            gradients = &objective_->LossGradientWrtNetworkOutput(output, label);
+        } else {
+            skip_final_activation = true;
+        }
+
+        auto start_layer = skip_final_activation ? layers_.rbegin() + 1 : layers_.rbegin();
+        for (auto it = start_layer; it != layers_.rend(); ++it) {
+            Layer* layer = *it;
+            gradients = &layer->Backward(*gradients);
+        }
+
+        return loss;
+    }
+
+    // Lets the optimizer update the parameters of all layers using the gradients accumulated for the last |batch_size| samples.
+    void GradientDescent(size_t batch_size, float epsilon)
+    {
+        optimizer_->Step(Parameters(), Gradients(), batch_size, epsilon);
+    }
+
+    // Runs one training step on the given mini batch, i.e. backpropagates every sample and updates the parameters,
+    // and records it so that the same step can be repeated through Replay().
+    //
+    // Replay() then processes whatever |inputs| and |labels| contain at that time, so these tensors must be kept alive
+    // and updated in place. On the GPU, replaying skips all host side work and only enqueues the recorded kernels,
+    // whose arguments were bound during the capture. The learning rate is fixed at capture time, as is the step size of
+    // optimizers that adapt it over time (Adam's bias correction), so capture after the first few steps if that matters.
+    // Capture a step that has been run before, e.g. through Train(), so no kernels are compiled or tuned while capturing.
+    void Capture(const Tensor& inputs, const Tensor& labels, float epsilon)
+    {
+        Assert(inputs.shape(0) == labels.shape(0));
+
+        plan_.reset();
+        plan_.reset(new ExecutionPlan<Tensor>([this, &inputs, &labels, epsilon]() {
+            for (size_t i = 0; i < inputs.shape(0); i++) {
+                bool hit;
+                Backpropagate(inputs[i], labels[i], &hit);
+            }
+            GradientDescent(inputs.shape(0), epsilon);
+        }));
+    }
+
+    // Repeats the training step recorded by Capture(). On the GPU, this doesn't wait for the step to finish.
+    // Neither the loss nor the accuracy are computed.
+    void Replay()
+    {
+        Check(plan_, "No training step captured");
+        plan_->Replay();
+    }
+
+    // Writes the topology and the parameters of this network to a checkpoint file, see Checkpoint.h.
+    // Returns false on failure.
+    bool Save(const std::string& path)
+    {
+        SaveAsync(path);
+        return checkpoint_writer_->Wait();
+    }
+
+    // Starts writing a checkpoint in the background and returns once the parameters have been copied.
+    //
+    // Training can continue right away. If another checkpoint is still being written, this waits for it first.
+    void SaveAsync(const std::string& path)
+    {
+        std::vector<CheckpointLayer> layers;
+        std::vector<CPUTensor> tensors;
+        tensors.reserve(Parameters().size());
+        for (Layer* layer : layers_) {
+            Check(layer->kind() != LayerKind::kUnknown, "Layer can't be stored in a checkpoint");
+
+            std::vector<uint32_t> attributes = layer->Attributes();
+            Check(attributes.size() <= kCheckpointMaxAttributes, "Too many layer attributes");
+
+            CheckpointLayer record;
+            memset(&record, 0, sizeof(record));
+            record.kind = static_cast<uint32_t>(layer->kind());
+            record.first_tensor = tensors.size();
+            record.num_attributes = attributes.size();
+            std::copy(attributes.begin(), attributes.end(), record.attributes);
+            record.input_shape = EncodeShape(layer->InputTensorShape());
+            record.output_shape = EncodeShape(layer->OutputTensorShape());
+
+            for (Tensor* parameter : layer->Parameters()) {
+                tensors.push_back(SnapshotTensor(*parameter));
+                record.num_tensors++;
+            }
+
+            layers.push_back(record);
+        }
+
+        if (!checkpoint_writer_)
+            checkpoint_writer_.reset(new CheckpointWriter());
+        checkpoint_writer_->Write(path, layers, &tensors);
+    }
+
+    // Writes a checkpoint to |path| in the background after every epoch of training. Pass an empty path to disable this.
+    void set_checkpoint_path(const std::string& path)
+    {
+        checkpoint_path_ = path;
+    }
+
+    // Copies the parameters stored in a checkpoint into this network, which must have the same topology.
+    // Returns false if the topology doesn't match.
+    bool Restore(const Checkpoint& checkpoint)
+    {
+        FAIL_IF(checkpoint.num_layers() != layers_.size(), "Checkpoint has " << checkpoint.num_layers() << " layers, network has " << layers_.size() << ".", false);
+
+        for (size_t i = 0; i < layers_.size(); i++) {
+            const CheckpointLayer& record = checkpoint.layer(i);
+            std::vector<Tensor*> parameters = layers_[i]->Parameters();
+            bool matches = record.kind == static_cast<uint32_t>(layers_[i]->kind()) &&
+                           DecodeShape(record.input_shape) == layers_[i]->InputTensorShape() &&
+                           DecodeShape(record.output_shape) == layers_[i]->OutputTensorShape() &&
+                           record.num_tensors == parameters.size();
+            for (size_t j = 0; matches && j < parameters.size(); j++)
+                matches = checkpoint.tensor_shape(record.first_tensor + j) == parameters[j]->shape();
+            FAIL_IF(!matches, "Layer " << i << " doesn't match the checkpoint.", false);
+        }
+
+        for (size_t i = 0; i < layers_.size(); i++) {
+            std::vector<Tensor*> parameters = layers_[i]->Parameters();
+            for (size_t j = 0; j < parameters.size(); j++)
+                RestoreTensor(checkpoint, checkpoint.layer(i).first_tensor + j, parameters[j]);
+        }
+
+        return true;
+    }
+
+    // Returns the learnable parameters of all layers, in a fixed order.
+    std::vector<Tensor*> Parameters()
+    {
+        std::vector<Tensor*> parameters;
+        for (Layer* layer : layers_) {
+            for (Tensor* parameter : layer->Parameters())
+                parameters.push_back(parameter);
+        }
+        return parameters;
+    }
+
+    // Returns the accumulated gradients of all layers, in the same order as Parameters().
+    // Gradients that the layers deferred during the backward passes are computed first.
+    std::vector<Tensor*> Gradients()
+    {
+        std::vector<Tensor*> gradients;
+        for (Layer* layer : layers_) {
+            layer->FinalizeGradients();
+            for (Tensor* gradient : layer->Gradients())
+                gradients.push_back(gradient);
+        }
+        return gradients;
+    }
+
   private:
+    // Evaluates the performance on the test data after an epoch.
+    void FinishEpoch(size_t epoch, Tensor& test_data, Tensor& test_labels)
+    {
+        double correct_count = 0;
+        for (size_t test = 0; test < test_data.shape(0); test++) {
+            const Tensor& output = Evaluate(test_data[test]);
+            if (argmax(output) == argmax(test_labels[test]))
+                correct_count++;
+        }
+
+        std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
+        std::cout << "EPOCH " << epoch + 1 << " FINISHED. ACCURACY: " << correct_count << "/" << test_data.shape(0) << " (" << correct_count / test_data.shape(0) << ")" << std::endl;
+        std::cout << "----------------------------------------------------------------------------------------------------" << std::endl;
+
+        if (!checkpoint_path_.empty())
+            SaveAsync(checkpoint_path_);
+    }
+
+    // Shows where the device time went if profiling is enabled, see ocl::Device::Init().
+    void PrintProfile()
+    {
+        if (GPUContext::Current() && GPUContext::Current()->device()->profiler()) {
+            std::cout << std::endl;
+            GPUContext::Current()->device()->profiler()->Print(std::cout);
+        }
+    }
+
+    // Trains on the samples of a contiguous batch, as prepared by a DataLoader.
+    void ProcessBatch(Tensor& data, Tensor& labels, float epsilon)
+    {
+        for (size_t i = 0; i < data.shape(0); i++) {
+            current_iteration_++;
+
+            bool hit;
+            loss_ += Backpropagate(data[i], labels[i], &hit);
+            hits_ += hit ? 1 : 0;
+        }
+
+        GradientDescent(data.shape(0), epsilon);
+    }
+
     void ProcessMiniBatch(Tensor& train_data, Tensor& train_labels, size_t batch_size, float epsilon)
     {
         for (size_t i = 0; i < batch_size; i++) {
@@ -155,35 +559,12 @@ class Network {
 
             size_t r = rand() % train_data.shape(0);
 
-            Tensor& input = train_data[r];
-            Tensor& label = train_labels[r];
-
-            const Tensor& output = Evaluate(input);
-
-            loss_ += objective_->Loss(output, label);
-            hits_ += argmax(output) == argmax(label) ? 1 : 0;
-
-            // We might be able to directly compute the gradients of the loss function wrt the
-            // input of the final activation. See Objective.h for details.
-            const Tensor* gradients = nullptr;
-            bool skip_final_activation = false;
-            if (final_activation_)
-                gradients = objective_->LossGradientWrtActivationInput(final_activation_, label);
-            if (!gradients)
-                gradients = &objective_->LossGradientWrtNetworkOutput(output, label);
-            else
-                skip_final_activation = true;
-
-            auto start_layer = skip_final_activation ? layers_.rbegin() + 1 : layers_.rbegin();
-            for (auto it = start_layer; it != layers_.rend(); ++it) {
-                Layer* layer = *it;
-                gradients = &layer->Backward(*gradients);
-            }
+            bool hit;
+            loss_ += Backpropagate(train_data[r], train_labels[r], &hit);
+            hits_ += hit ? 1 : 0;
         }
 
-        for (Layer* layer : layers_) {
-            layer->GradientDescent(batch_size, epsilon);
-        }
+        GradientDescent(batch_size, epsilon);
     }
 
     // Statistics for the current training epoch.
@@ -194,12 +575,24 @@ class Network {
     // The pointers are owned by this instance.
     std::vector<Layer*> layers_;
 
-    // Optimizer to use for training. Pointer is owned by this instance.
+    // Objective to minimize during training. Pointer is owned by this instance.
     Objective* objective_;
 
+    // Optimizer to use for training. Pointer is owned by this instance.
+    Optimizer* optimizer_;
+
     // The final activation layer, if any.
     Activation* final_activation_;
 
+    // Training step recorded by Capture(), if any.
+    std::unique_ptr<ExecutionPlan<Tensor>> plan_;
+
+    // Where to write a checkpoint after every epoch, empty if disabled.
+    std::string checkpoint_path_;
+
+    // Writes the checkpoints in the background, created on first use.
+    std::unique_ptr<CheckpointWriter> checkpoint_writer_;
+
     DISALLOW_COPY_AND_ASSIGN(Network);
 };
 
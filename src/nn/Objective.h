@@ -39,22 +39,24 @@ class Objective {
 
     // If the last layer is an activation (or more generally if the last layer does not have any trainable weights)
     // then it is possible and might be desirable to calculate the gradient of the loss wrt the input of the final layer
-    // as opposed to the output of the final layer.
+    // as opposed to the output of the final layer. The loss can then often be computed in the same pass, which is
+    // also numerically more stable since it doesn't have to go through the output of the activation.
     //
     // This mechanism triggers a double dispatch on the provided activation object so that each Objective can
     // implement the corresponding methods only for the activations that it knows how to deal with.
     //
     // This method either return a valid pointer to a tensor which contains the gradients of the loss function
-    // wrt to the input of the final activation, or nullptr if the gradient calculation for that activation not available.
-    const Tensor* LossGradientWrtActivationInput(Activation<Tensor>* activation, const Tensor& label)
+    // wrt to the input of the final activation and stores the loss in |loss|, or nullptr if the gradient calculation
+    // for that activation not available.
+    const Tensor* LossAndGradientWrtActivationInput(Activation<Tensor>* activation, const Tensor& label, float* loss)
     {
-        return activation->Dispatch(this, label);
+        return activation->Dispatch(this, label, loss);
     }
 
-    // One method per Activation class. These perform the actual math for LossGradientWrtActivationInput.
-    virtual const Tensor* Accept(ReLUActivation<Tensor>* relu, const Tensor& label) { return nullptr; }
-    virtual const Tensor* Accept(SigmoidActivation<Tensor>* sigmoid, const Tensor& label) { return nullptr; }
-    virtual const Tensor* Accept(SoftmaxActivation<Tensor>* softmax, const Tensor& label) { return nullptr; }
+    // One method per Activation class. These perform the actual math for LossAndGradientWrtActivationInput.
+    virtual const Tensor* Accept(ReLUActivation<Tensor>* relu, const Tensor& label, float* loss) { return nullptr; }
+    virtual const Tensor* Accept(SigmoidActivation<Tensor>* sigmoid, const Tensor& label, float* loss) { return nullptr; }
+    virtual const Tensor* Accept(SoftmaxActivation<Tensor>* softmax, const Tensor& label, float* loss) { return nullptr; }
 };
 
 }       // namespace nn
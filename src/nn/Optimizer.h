@@ -0,0 +1,35 @@
+//
+// Base optimizer class
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <vector>
+
+#include "nn/Tensor.h"
+
+namespace nn {
+
+// Base class for optimizers.
+//
+// The optimizer determines how the parameters of a network are updated from the gradients accumulated during
+// a mini-batch. Each update runs as a single fused operation per parameter tensor, see the *_update functions in TensorOps.h.
+template <typename Tensor>
+class Optimizer {
+  public:
+    // Default destructor.
+    virtual ~Optimizer() { };
+
+    // Updates all |parameters| from the corresponding |gradients|, which have been accumulated over |batch_size| samples,
+    // then resets the gradients to zero.
+    //
+    // Optimizers may keep state for every parameter tensor, so the same tensors must be passed in the same order every time.
+    virtual void Step(const std::vector<Tensor*>& parameters, const std::vector<Tensor*>& gradients, size_t batch_size, float learning_rate) = 0;
+};
+
+}       // namespace nn
+
+#endif
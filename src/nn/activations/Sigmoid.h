@@ -34,17 +34,19 @@ class SigmoidActivation : public Activation<Tensor> {
     {
         Assert(loss.shape() == shape_);
 
-        sigmoid_derivative(*last_input_, output_);
-        output_ *= loss;
+        // Computed in a single pass, see Elementwise.h.
+        fused(elementwise::sigmoid_derivative(elementwise::Argument(0)) * elementwise::Argument(1), { last_input_, &loss }, output_);
 
         return output_;
     }
 
     virtual Shape InputTensorShape() const override { return shape_; }
 
-    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data) override
+    virtual LayerKind kind() const override { return LayerKind::kSigmoid; }
+
+    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data, float* loss) override
     {
-        return objective->Accept(this, data);
+        return objective->Accept(this, data, loss);
     }
 
   private:
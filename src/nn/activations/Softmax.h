@@ -26,10 +26,7 @@ class SoftmaxActivation : public Activation<Tensor> {
 
         last_input_ = &input;
 
-        exp(input, output_);
-        float s = sum(output_);
-        output_ /= s;
-
+        softmax(input, output_);
 
         return output_;
     }
@@ -45,11 +42,14 @@ class SoftmaxActivation : public Activation<Tensor> {
 
     virtual Shape InputTensorShape() const override { return shape_; }
 
-    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data) override
+    virtual LayerKind kind() const override { return LayerKind::kSoftmax; }
+
+    virtual const Tensor* Dispatch(Objective<Tensor>* objective, const Tensor& data, float* loss) override
     {
-        return objective->Accept(this, data);
+        return objective->Accept(this, data, loss);
     }
 
+    const Tensor* last_input() const { return last_input_; }
     const Tensor* last_output() const { return &output_; }
 
   private:
@@ -60,10 +60,19 @@ class BiasLayer : public Layer<Tensor> {
         return shape_;
     }
 
-    virtual void GradientDescent(size_t batch_size, float epsilon) override
+    virtual LayerKind kind() const override
     {
-        add(weights_, gradients_, -1 * (epsilon / batch_size), weights_);
-        gradients_.Clear();
+        return LayerKind::kBias;
+    }
+
+    virtual std::vector<Tensor*> Parameters() override
+    {
+        return { &weights_ };
+    }
+
+    virtual std::vector<Tensor*> Gradients() override
+    {
+        return { &gradients_ };
     }
 
   private:
@@ -19,23 +19,29 @@ template <typename Tensor>
 class ConvolutionLayer : public Layer<Tensor> {
   public:
     ConvolutionLayer(const Shape& input_shape, size_t num_features, size_t kernel_width, size_t kernel_height) :
+        ConvolutionLayer(input_shape, num_features, kernel_width, kernel_height, ConvolutionParameters()) { }
+
+    ConvolutionLayer(const Shape& input_shape, size_t num_features, size_t kernel_width, size_t kernel_height, const ConvolutionParameters& parameters) :
         input_shape_(input_shape),
-        output_shape_({num_features, input_shape[1], input_shape[2]}),
+        parameters_(parameters),
+        output_shape_(parameters.OutputShape(input_shape, {num_features, input_shape[0], kernel_height, kernel_width})),
         // TODO GlorotInitializer doesn't seem to do well here... ?
         //kernels_({num_features, input_shape[0], kernel_height, kernel_width}, GlorotInitializer(input_shape[0] * kernel_width * kernel_height)),
         kernels_({num_features, input_shape[0], kernel_height, kernel_width}, RandomInitializer()),
         kernel_gradients_({num_features, input_shape[0], kernel_height, kernel_width}, ZeroInitializer),
-        tmp_kernel_gradients_({num_features, input_shape[0], kernel_height, kernel_width}, ZeroInitializer),
         output_(output_shape_, ZeroInitializer),
         output_gradients_(input_shape_, ZeroInitializer),
         last_input_(nullptr) { }
 
     ConvolutionLayer(const Shape& input_shape, const Tensor& kernels) :
+        ConvolutionLayer(input_shape, kernels, ConvolutionParameters()) { }
+
+    ConvolutionLayer(const Shape& input_shape, const Tensor& kernels, const ConvolutionParameters& parameters) :
         input_shape_(input_shape),
-        output_shape_({kernels.shape(0), input_shape[1], input_shape[2]}),
+        parameters_(parameters),
+        output_shape_(parameters.OutputShape(input_shape, kernels.shape())),
         kernels_(kernels),
         kernel_gradients_(kernels.shape(), ZeroInitializer),
-        tmp_kernel_gradients_(kernels.shape(), ZeroInitializer),
         output_(output_shape_, ZeroInitializer),
         output_gradients_(input_shape_, ZeroInitializer),
         last_input_(nullptr)
@@ -55,7 +61,7 @@ class ConvolutionLayer : public Layer<Tensor> {
         // We'll need our input later on during the backward pass.
         last_input_ = &input;
 
-        convolution(input, kernels_, output_);
+        convolution(input, kernels_, parameters_, output_);
 
         return output_;
     }
@@ -64,14 +70,11 @@ class ConvolutionLayer : public Layer<Tensor> {
     {
         Assert(gradients.shape() == output_shape_);
 
-        // Calculate gradients for the kernel weights.
+        // Calculate gradients for the kernel weights and add them to the sum for the current mini-batch.
         // See the implementation for details. Basically this sums up
         // all the (input_pixel, output_pixel) pairs that each weight
         // of the kernel influenced.
-        convolution_kernel_gradients(*last_input_, gradients, tmp_kernel_gradients_);
-
-        // Sum of the kernel weight gradients for the current mini-batch.
-        kernel_gradients_ += tmp_kernel_gradients_;
+        accumulate_convolution_kernel_gradients(*last_input_, gradients, parameters_, kernel_gradients_);
 
         // We get the derivatives of the loss function wrt to our inputs simply by
         // doing a cross convolution on it.
@@ -80,11 +83,17 @@ class ConvolutionLayer : public Layer<Tensor> {
         // output values through a simple multiplication (which becomes a constant factor
         // when computing the derivative). We need to use the same kernel weight during the
         // backward pass, so we need to use a mirrored kernel ==> a cross-correlation.
-        cross_correlation(gradients, kernels_, output_gradients_);
+        cross_correlation(gradients, kernels_, parameters_, output_gradients_);
 
         return output_gradients_;
     }
 
+    virtual void WarmUp() override
+    {
+        // The device kernels depend on the kernel size and are thus compiled on demand.
+        prepare_convolution(kernels_);
+    }
+
     virtual Shape InputTensorShape() const override
     {
         return input_shape_;
@@ -95,10 +104,24 @@ class ConvolutionLayer : public Layer<Tensor> {
         return output_shape_;
     }
 
-    virtual void GradientDescent(size_t batch_size, float epsilon) override
+    virtual LayerKind kind() const override
+    {
+        return LayerKind::kConvolution;
+    }
+
+    virtual std::vector<uint32_t> Attributes() const override
     {
-        add(kernels_, kernel_gradients_, -1 * (epsilon / batch_size), kernels_);
-        kernel_gradients_.Clear();
+        return { uint32_t(parameters_.stride), uint32_t(parameters_.padding), uint32_t(parameters_.dilation) };
+    }
+
+    virtual std::vector<Tensor*> Parameters() override
+    {
+        return { &kernels_ };
+    }
+
+    virtual std::vector<Tensor*> Gradients() override
+    {
+        return { &kernel_gradients_ };
     }
 
     virtual Tensor CurrentGradients() const override
@@ -110,18 +133,18 @@ class ConvolutionLayer : public Layer<Tensor> {
     // 3D dimension of the input tensor: (channels, image_height, image_width).
     Shape input_shape_;
 
-    // 3D dimension of the output tensor: (num_features, image_height, image_width).
+    // Stride, padding and dilation of the convolution.
+    ConvolutionParameters parameters_;
+
+    // 3D dimension of the output tensor: (num_features, output_height, output_width), see ConvolutionParameters::OutputShape().
     Shape output_shape_;
 
-    // Convolution kernels. This is a tensor of shape (num_features, kernel_dim_y, kernel_dim_x);
+    // Convolution kernels. This is a tensor of shape (num_features, channels, kernel_dim_y, kernel_dim_x);
     Tensor kernels_;
 
     // Gradients of the kernels during backpropagation.
     Tensor kernel_gradients_;
 
-    // Hold the kernel gradients during one backward pass. Added up into kernel_gradients_ for a mini batch.
-    Tensor tmp_kernel_gradients_;
-
     // Output tensor, populated during the forward pass.
     // This contains the output of this layer before the activation function is executed.
     Tensor output_;
@@ -22,9 +22,9 @@ class DenseLayer : public Layer<Tensor> {
         weights_({output_dim, input_dim}, GlorotInitializer(input_dim)),
         output_({output_dim}),
         output_gradients_({input_dim}),
-        tmp_weight_gradients_({output_dim, input_dim}, ZeroInitializer),
         weight_gradients_({output_dim, input_dim}, ZeroInitializer),
         last_input_(nullptr),
+        num_stashed_(0),
         input_dim_(input_dim),
         output_dim_(output_dim) { }
 
@@ -32,9 +32,9 @@ class DenseLayer : public Layer<Tensor> {
         weights_(weights),
         output_({weights.shape(0)}),
         output_gradients_({weights.shape(1)}),
-        tmp_weight_gradients_(weights.shape(), ZeroInitializer),
         weight_gradients_(weights.shape(), ZeroInitializer),
         last_input_(nullptr),
+        num_stashed_(0),
         input_dim_(weights.shape(1)),
         output_dim_(weights.shape(0)) { }
 
@@ -42,6 +42,20 @@ class DenseLayer : public Layer<Tensor> {
     {
     }
 
+    // Defers the computation of the weight gradients until FinalizeGradients() is called.
+    //
+    // Instead of adding the outer product of the output gradients and the input to the weight gradients after
+    // every sample, the backward pass then only copies both vectors into a (max_batch_size, dim) matrix. The
+    // weight gradients for all stashed samples are later computed as a single matrix multiplication G^T * X,
+    // which makes much better use of the caches (or local memory) than max_batch_size separate outer products.
+    // If more than max_batch_size samples are backpropagated, the stashed ones are processed early.
+    void DeferWeightGradients(size_t max_batch_size)
+    {
+        Assert(max_batch_size > 0 && num_stashed_ == 0);
+        stashed_inputs_ = Tensor({max_batch_size, input_dim_});
+        stashed_gradients_ = Tensor({max_batch_size, output_dim_});
+    }
+
     virtual const Tensor& Forward(const Tensor& input) override
     {
         Assert(input.shape() == Shape({input_dim_}));
@@ -59,8 +73,16 @@ class DenseLayer : public Layer<Tensor> {
     {
         Assert(gradients.shape() == Shape({output_dim_}));
 
-        // Update weight derivatives.
-        weight_gradients_ += transposed_vecmul(gradients, *last_input_, tmp_weight_gradients_);
+        // Update weight derivatives. These are accumulated in place over a mini-batch.
+        if (deferring_weight_gradients()) {
+            if (num_stashed_ == stashed_inputs_.shape(0))
+                FinalizeGradients();
+            stashed_inputs_[num_stashed_] = *last_input_;
+            stashed_gradients_[num_stashed_] = gradients;
+            num_stashed_++;
+        } else {
+            accumulate_transposed_vecmul(gradients, *last_input_, weight_gradients_);
+        }
 
         // "Reverse" the matrix-vector multiplication.
         transposed_matvecmul(weights_, gradients, output_gradients_);
@@ -78,10 +100,28 @@ class DenseLayer : public Layer<Tensor> {
         return Shape({output_dim_});
     }
 
-    virtual void GradientDescent(size_t batch_size, float epsilon) override
+    virtual LayerKind kind() const override
+    {
+        return LayerKind::kDense;
+    }
+
+    virtual std::vector<Tensor*> Parameters() override
+    {
+        return { &weights_ };
+    }
+
+    virtual std::vector<Tensor*> Gradients() override
     {
-        add(weights_, weight_gradients_, -1 * (epsilon / batch_size), weights_);
-        weight_gradients_.Clear();
+        return { &weight_gradients_ };
+    }
+
+    virtual void FinalizeGradients() override
+    {
+        if (num_stashed_ == 0)
+            return;
+
+        accumulate_transposed_matmul(stashed_gradients_, stashed_inputs_, num_stashed_, weight_gradients_);
+        num_stashed_ = 0;
     }
 
     virtual Tensor CurrentGradients() const override
@@ -90,6 +130,11 @@ class DenseLayer : public Layer<Tensor> {
     }
 
   private:
+    bool deferring_weight_gradients() const
+    {
+        return stashed_inputs_.rank() != 0;
+    }
+
     // Weights and bias variables. These are learned during training.
     Tensor weights_;
 
@@ -99,14 +144,21 @@ class DenseLayer : public Layer<Tensor> {
     // Error output tensor, populated during the backward pass.
     Tensor output_gradients_;
 
-    // Tensors to sum up the partial derivatives for each minibatch during training.
-    Tensor tmp_weight_gradients_;               // Used to store the outcome of the transposed vector-vector multiplication in.
+    // Sum of the partial derivatives of the weights for each minibatch during training.
     Tensor weight_gradients_;
 
     // Input during the forward pass, needed to calculate the gradients.
     // Pointer not owned by this instance.
     const Tensor* last_input_;
 
+    // Inputs and output gradients of the samples whose weight gradients have not been computed yet, one per row.
+    // Only allocated if DeferWeightGradients() was called.
+    Tensor stashed_inputs_;
+    Tensor stashed_gradients_;
+
+    // Number of valid rows in the above.
+    size_t num_stashed_;
+
     // 1D dimension of the input tensor.
     size_t input_dim_;
 
@@ -0,0 +1,164 @@
+//
+// Depthwise separable 2D convolution layer.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __DEPTHWISE_SEPARABLE_CONVOLUTION_LAYER_H__
+#define __DEPTHWISE_SEPARABLE_CONVOLUTION_LAYER_H__
+
+#include <cstddef>
+
+#include "nn/Layer.h"
+#include "nn/Tensor.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// A convolution that is factored into a depthwise convolution, which filters every input channel with
+// its own kernel, followed by a pointwise (1x1) convolution, which combines the channels into features.
+//
+// Compared to a ConvolutionLayer, this needs num_channels * (kernel_size + num_features) instead of
+// num_channels * kernel_size * num_features weights and multiplications per pixel.
+template <typename Tensor>
+class DepthwiseSeparableConvolutionLayer : public Layer<Tensor> {
+  public:
+    DepthwiseSeparableConvolutionLayer(const Shape& input_shape, size_t num_features, size_t kernel_width, size_t kernel_height) :
+        input_shape_(input_shape),
+        output_shape_({num_features, input_shape[1], input_shape[2]}),
+        depthwise_kernels_({input_shape[0], kernel_height, kernel_width}, RandomInitializer()),
+        pointwise_weights_({num_features, input_shape[0]}, RandomInitializer()),
+        depthwise_kernel_gradients_({input_shape[0], kernel_height, kernel_width}, ZeroInitializer),
+        pointwise_weight_gradients_({num_features, input_shape[0]}, ZeroInitializer),
+        depthwise_output_(input_shape_, ZeroInitializer),
+        output_(output_shape_, ZeroInitializer),
+        depthwise_output_gradients_(input_shape_, ZeroInitializer),
+        output_gradients_(input_shape_, ZeroInitializer),
+        last_input_(nullptr) { }
+
+    DepthwiseSeparableConvolutionLayer(const Shape& input_shape, const Tensor& depthwise_kernels, const Tensor& pointwise_weights) :
+        input_shape_(input_shape),
+        output_shape_({pointwise_weights.shape(0), input_shape[1], input_shape[2]}),
+        depthwise_kernels_(depthwise_kernels),
+        pointwise_weights_(pointwise_weights),
+        depthwise_kernel_gradients_(depthwise_kernels.shape(), ZeroInitializer),
+        pointwise_weight_gradients_(pointwise_weights.shape(), ZeroInitializer),
+        depthwise_output_(input_shape_, ZeroInitializer),
+        output_(output_shape_, ZeroInitializer),
+        depthwise_output_gradients_(input_shape_, ZeroInitializer),
+        output_gradients_(input_shape_, ZeroInitializer),
+        last_input_(nullptr)
+    {
+        Assert(depthwise_kernels.rank() == 3 && pointwise_weights.rank() == 2);
+        Assert(input_shape[0] == depthwise_kernels.shape(0) && input_shape[0] == pointwise_weights.shape(1));
+    }
+
+    virtual ~DepthwiseSeparableConvolutionLayer()
+    {
+    }
+
+    virtual const Tensor& Forward(const Tensor& input) override
+    {
+        Assert(input.shape() == input_shape_);
+
+        // We'll need our input later on during the backward pass.
+        last_input_ = &input;
+
+        depthwise_convolution(input, depthwise_kernels_, depthwise_output_);
+        pointwise_convolution(depthwise_output_, pointwise_weights_, output_);
+
+        return output_;
+    }
+
+    virtual const Tensor& Backward(const Tensor& gradients) override
+    {
+        Assert(gradients.shape() == output_shape_);
+
+        // Backpropagate through the pointwise convolution first...
+        accumulate_pointwise_convolution_weight_gradients(depthwise_output_, gradients, pointwise_weight_gradients_);
+        pointwise_cross_correlation(gradients, pointwise_weights_, depthwise_output_gradients_);
+
+        // ... then through the depthwise convolution, see ConvolutionLayer::Backward().
+        accumulate_depthwise_convolution_kernel_gradients(*last_input_, depthwise_output_gradients_, depthwise_kernel_gradients_);
+        depthwise_cross_correlation(depthwise_output_gradients_, depthwise_kernels_, output_gradients_);
+
+        return output_gradients_;
+    }
+
+    virtual void WarmUp() override
+    {
+        // The device kernels depend on the kernel size and are thus compiled on demand.
+        prepare_depthwise_convolution(depthwise_kernels_);
+    }
+
+    virtual Shape InputTensorShape() const override
+    {
+        return input_shape_;
+    }
+
+    virtual Shape OutputTensorShape() const override
+    {
+        return output_shape_;
+    }
+
+    virtual LayerKind kind() const override
+    {
+        return LayerKind::kDepthwiseSeparableConvolution;
+    }
+
+    virtual std::vector<Tensor*> Parameters() override
+    {
+        return { &depthwise_kernels_, &pointwise_weights_ };
+    }
+
+    virtual std::vector<Tensor*> Gradients() override
+    {
+        return { &depthwise_kernel_gradients_, &pointwise_weight_gradients_ };
+    }
+
+    // Returns the gradients of the depthwise kernels.
+    virtual Tensor CurrentGradients() const override
+    {
+        return depthwise_kernel_gradients_;
+    }
+
+  private:
+    // 3D dimension of the input tensor: (channels, image_height, image_width).
+    Shape input_shape_;
+
+    // 3D dimension of the output tensor: (num_features, image_height, image_width).
+    Shape output_shape_;
+
+    // Depthwise convolution kernels, a tensor of shape (channels, kernel_dim_y, kernel_dim_x).
+    Tensor depthwise_kernels_;
+
+    // Weights of the pointwise convolution, a tensor of shape (num_features, channels).
+    Tensor pointwise_weights_;
+
+    // Gradients of the weights during backpropagation.
+    Tensor depthwise_kernel_gradients_;
+    Tensor pointwise_weight_gradients_;
+
+    // Output of the depthwise convolution, input to the pointwise convolution.
+    Tensor depthwise_output_;
+
+    // Output tensor, populated during the forward pass.
+    Tensor output_;
+
+    // Gradients wrt the output of the depthwise convolution, populated during the backward pass.
+    Tensor depthwise_output_gradients_;
+
+    // Error output tensor, populated during the backward pass.
+    Tensor output_gradients_;
+
+    // Input during the forward pass, needed to calculate the gradients.
+    // Pointer not owned by this instance.
+    const Tensor* last_input_;
+
+
+    DISALLOW_COPY_AND_ASSIGN(DepthwiseSeparableConvolutionLayer);
+};
+
+}       // namespace nn
+
+#endif
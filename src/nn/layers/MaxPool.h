@@ -68,9 +68,14 @@ class MaxPool2DLayer : public Layer<Tensor> {
         return output_shape_;
     }
 
-    virtual void GradientDescent(size_t batch_size, float epsilon) override
+    virtual LayerKind kind() const override
     {
-        // Nothing to do here.
+        return LayerKind::kMaxPool2D;
+    }
+
+    virtual std::vector<uint32_t> Attributes() const override
+    {
+        return { uint32_t(pooling_size_x_), uint32_t(pooling_size_y_) };
     }
 
   private:
@@ -64,9 +64,9 @@ class ReshapeLayer : public Layer<Tensor> {
         return output_shape_;
     }
 
-    virtual void GradientDescent(size_t batch_size, float epsilon) override
+    virtual LayerKind kind() const override
     {
-        // nothing to do here
+        return LayerKind::kReshape;
     }
 
   private:
@@ -14,7 +14,7 @@ namespace nn {
 template <typename Tensor>
 class CrossEntropy : public Objective<Tensor> {
   public:
-    CrossEntropy(const Shape& network_output_shape) : gradients_(network_output_shape), network_output_logarithms_(network_output_shape)
+    CrossEntropy(const Shape& network_output_shape) : gradients_(network_output_shape)
     {
         // For now we only support vectors as the output of our networks.
         Assert(network_output_shape.rank() == 1);
@@ -25,35 +25,34 @@ class CrossEntropy : public Objective<Tensor> {
         Assert(network_output.shape() == label.shape());
         Assert(network_output.shape() == gradients_.shape());
 
-        log(network_output, network_output_logarithms_);
-        mul(network_output_logarithms_, label, network_output_logarithms_);
-        return -sum(network_output_logarithms_);
+        // -sum(log(network_output) * label), computed in a single pass.
+        return -fused_sum(elementwise::log(elementwise::Argument(0)) * elementwise::Argument(1),
+                          std::vector<const Tensor*>{ &network_output, &label });
     }
 
     virtual const Tensor& LossGradientWrtNetworkOutput(const Tensor& network_output, const Tensor& label) override
     {
         // For now cross-entropy is only supported if the last layer is a Softmax activation, in which
-        // case LossGradientWrtActivationInput will calculate the correct gradients.
+        // case LossAndGradientWrtActivationInput will calculate the correct gradients.
         Check(false, "Cross-entropy is only supported in combination with a Softmax as final layer.");
         return gradients_;
     }
 
-    virtual const Tensor* Accept(SoftmaxActivation<Tensor>* softmax, const Tensor& label) override
+    virtual const Tensor* Accept(SoftmaxActivation<Tensor>* softmax, const Tensor& label, float* loss) override
     {
-        Assert(softmax->last_output()->shape() == label.shape());
-        Assert(softmax->last_output()->shape() == gradients_.shape());
+        Assert(softmax->last_input()->shape() == label.shape());
+        Assert(softmax->last_input()->shape() == gradients_.shape());
 
-        // See Math.md for an explanation.
-        sub(*softmax->last_output(), label, gradients_);
+        // Computes the loss and the gradients (softmax output - label) in a single pass, reusing the output of the
+        // softmax from the forward pass. Unlike Loss(), this stays finite even if some of the outputs of the softmax
+        // are rounded to zero.
+        *loss = softmax_cross_entropy(*softmax->last_input(), *softmax->last_output(), label, gradients_);
         return &gradients_;
     }
 
   private:
     // Storage for the gradients to avoid memory allocations.
     Tensor gradients_;
-
-    // Storage for the network output logarithms, needed during the loss calculation.
-    Tensor network_output_logarithms_;
 };
 
 }       // namespace nn
@@ -0,0 +1,67 @@
+//
+// Adam optimizer.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __ADAM_OPTIMIZER_H__
+#define __ADAM_OPTIMIZER_H__
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "nn/Optimizer.h"
+#include "nn/Initializer.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// Adaptive moment estimation: keeps running averages of the gradients (first moment) and of the squared gradients
+// (second moment) of every parameter and updates the parameters by their ratio.
+template <typename Tensor>
+class Adam : public Optimizer<Tensor> {
+  public:
+    Adam() : Adam(0.9f, 0.999f, 1e-8f) { }
+
+    Adam(float beta1, float beta2, float epsilon) : beta1_(beta1), beta2_(beta2), epsilon_(epsilon), step_(0) { }
+
+    virtual void Step(const std::vector<Tensor*>& parameters, const std::vector<Tensor*>& gradients, size_t batch_size, float learning_rate) override
+    {
+        Assert(parameters.size() == gradients.size());
+
+        if (first_moments_.empty()) {
+            for (Tensor* parameter : parameters) {
+                first_moments_.emplace_back(new Tensor(parameter->shape(), ZeroInitializer));
+                second_moments_.emplace_back(new Tensor(parameter->shape(), ZeroInitializer));
+            }
+        }
+        Assert(first_moments_.size() == parameters.size());
+
+        // The moments start out at zero and are thus biased towards zero during the first steps. Instead of correcting
+        // every element of the moments, the correction is folded into the step size, which is the same for all elements.
+        step_++;
+        float step_size = learning_rate * std::sqrt(1.f - std::pow(beta2_, step_)) / (1.f - std::pow(beta1_, step_));
+
+        for (size_t i = 0; i < parameters.size(); i++)
+            adam_update(*parameters[i], *gradients[i], *first_moments_[i], *second_moments_[i], 1.f / batch_size, step_size, beta1_, beta2_, epsilon_);
+    }
+
+  private:
+    float beta1_;
+    float beta2_;
+    float epsilon_;
+
+    // Number of steps performed so far.
+    size_t step_;
+
+    // Running averages of the gradients and the squared gradients of every parameter tensor.
+    std::vector<std::unique_ptr<Tensor>> first_moments_;
+    std::vector<std::unique_ptr<Tensor>> second_moments_;
+
+    DISALLOW_COPY_AND_ASSIGN(Adam);
+};
+
+}       // namespace nn
+
+#endif
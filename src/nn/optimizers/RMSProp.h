@@ -0,0 +1,56 @@
+//
+// RMSProp optimizer.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __RMSPROP_OPTIMIZER_H__
+#define __RMSPROP_OPTIMIZER_H__
+
+#include <memory>
+#include <vector>
+
+#include "nn/Optimizer.h"
+#include "nn/Initializer.h"
+#include "common/Common.h"
+
+namespace nn {
+
+// Divides the gradients of every parameter by a running average of their magnitude,
+// so that all parameters are updated at roughly the same rate.
+template <typename Tensor>
+class RMSProp : public Optimizer<Tensor> {
+  public:
+    RMSProp() : RMSProp(0.9f, 1e-8f) { }
+
+    // |decay| determines how quickly the running average of the squared gradients forgets old values, |epsilon|
+    // avoids divisions by zero.
+    RMSProp(float decay, float epsilon) : decay_(decay), epsilon_(epsilon) { }
+
+    virtual void Step(const std::vector<Tensor*>& parameters, const std::vector<Tensor*>& gradients, size_t batch_size, float learning_rate) override
+    {
+        Assert(parameters.size() == gradients.size());
+
+        if (mean_squares_.empty()) {
+            for (Tensor* parameter : parameters)
+                mean_squares_.emplace_back(new Tensor(parameter->shape(), ZeroInitializer));
+        }
+        Assert(mean_squares_.size() == parameters.size());
+
+        for (size_t i = 0; i < parameters.size(); i++)
+            rmsprop_update(*parameters[i], *gradients[i], *mean_squares_[i], 1.f / batch_size, learning_rate, decay_, epsilon_);
+    }
+
+  private:
+    float decay_;
+    float epsilon_;
+
+    // Running average of the squared gradients of every parameter tensor.
+    std::vector<std::unique_ptr<Tensor>> mean_squares_;
+
+    DISALLOW_COPY_AND_ASSIGN(RMSProp);
+};
+
+}       // namespace nn
+
+#endif
@@ -0,0 +1,60 @@
+//
+// Stochastic gradient descent, optionally with momentum.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __SGD_OPTIMIZER_H__
+#define __SGD_OPTIMIZER_H__
+
+#include <memory>
+#include <vector>
+
+#include "nn/Optimizer.h"
+#include "nn/Initializer.h"
+#include "common/Common.h"
+
+namespace nn {
+
+template <typename Tensor>
+class SGD : public Optimizer<Tensor> {
+  public:
+    // Plain stochastic gradient descent: parameters -= learning_rate * gradients / batch_size.
+    SGD() : momentum_(0) { }
+
+    // Gradient descent with (classical) momentum. The update of the previous step, scaled by |momentum|,
+    // is added to the current update.
+    explicit SGD(float momentum) : momentum_(momentum) { }
+
+    virtual void Step(const std::vector<Tensor*>& parameters, const std::vector<Tensor*>& gradients, size_t batch_size, float learning_rate) override
+    {
+        Assert(parameters.size() == gradients.size());
+
+        if (momentum_ == 0) {
+            for (size_t i = 0; i < parameters.size(); i++)
+                sgd_update(*parameters[i], *gradients[i], 1.f / batch_size, learning_rate);
+            return;
+        }
+
+        if (velocities_.empty()) {
+            for (Tensor* parameter : parameters)
+                velocities_.emplace_back(new Tensor(parameter->shape(), ZeroInitializer));
+        }
+        Assert(velocities_.size() == parameters.size());
+
+        for (size_t i = 0; i < parameters.size(); i++)
+            sgd_update(*parameters[i], *gradients[i], *velocities_[i], 1.f / batch_size, learning_rate, momentum_);
+    }
+
+  private:
+    float momentum_;
+
+    // Last update of every parameter tensor. Only used with momentum.
+    std::vector<std::unique_ptr<Tensor>> velocities_;
+
+    DISALLOW_COPY_AND_ASSIGN(SGD);
+};
+
+}       // namespace nn
+
+#endif
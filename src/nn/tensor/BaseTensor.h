@@ -13,6 +13,8 @@
 
 #include "common/Common.h"
 #include "nn/tensor/Shape.h"
+#include "nn/tensor/ConvolutionParameters.h"
+#include "nn/tensor/Elementwise.h"
 
 namespace nn {
 
@@ -67,6 +69,16 @@ namespace nn {
 constexpr size_t ROW = 0, COL = 1;
 constexpr size_t X = 1, Y = 0;
 
+// Kind of host memory that backs a CPUTensor.
+enum class HostMemory {
+    // Regular (pageable) memory. Transfers to and from the GPU are staged through pinned buffers of the device.
+    kPageable,
+
+    // Pinned (page-locked) memory allocated through the OpenCL device. Transfers to and from
+    // the GPU are done via DMA directly from and into the tensor. Requires an initialized GPUContext.
+    kPinned,
+};
+
 
 //
 // The BaseTensor class makes use of the CRTP (https://en.wikipedia.org/wiki/Curiously_recurring_template_pattern)
@@ -0,0 +1,28 @@
+#include "nn/tensor/ConvolutionParameters.h"
+
+using namespace std;
+
+namespace nn {
+
+size_t ConvolutionParameters::PaddingFor(size_t kernel_size) const
+{
+    Assert(kernel_size % 2 == 1);
+    return padding == Padding::kSame ? dilation * (kernel_size / 2) : 0;
+}
+
+size_t ConvolutionParameters::OutputSize(size_t input_size, size_t kernel_size) const
+{
+    size_t extent = dilation * (kernel_size - 1) + 1;
+    size_t padded_size = input_size + 2 * PaddingFor(kernel_size);
+    Check(padded_size >= extent, "Convolution kernel is larger than its input");
+    return (padded_size - extent) / stride + 1;
+}
+
+Shape ConvolutionParameters::OutputShape(const Shape& input_shape, const Shape& kernel_shape) const
+{
+    Assert(input_shape.rank() == 3 && kernel_shape.rank() == 4);
+    Assert(input_shape[0] == kernel_shape[1]);
+    return Shape({kernel_shape[0], OutputSize(input_shape[1], kernel_shape[2]), OutputSize(input_shape[2], kernel_shape[3])});
+}
+
+}       // namespace nn
@@ -0,0 +1,63 @@
+//
+// Hyperparameters of 2D convolutions.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __CONVOLUTION_PARAMETERS_H__
+#define __CONVOLUTION_PARAMETERS_H__
+
+#include <cstddef>
+
+#include "nn/tensor/Shape.h"
+
+namespace nn {
+
+// How the borders of the input are handled by a convolution.
+enum class Padding {
+    // The input is padded with zeros so that, at stride 1, the output has the same size as the input.
+    kSame,
+
+    // No padding, the kernel is only applied where it lies completely within the input.
+    kValid,
+};
+
+// Stride, padding and dilation of a 2D convolution, see convolution() in TensorOps.h.
+//
+// Output element (y, x) of a convolution is computed from the input elements at
+// (y * stride - padding + ky * dilation, x * stride - padding + kx * dilation) for every kernel position (ky, kx).
+struct ConvolutionParameters {
+    // Plain convolution: stride 1, same padding and no dilation.
+    ConvolutionParameters() : stride(1), padding(Padding::kSame), dilation(1) { }
+
+    ConvolutionParameters(size_t stride, Padding padding, size_t dilation) : stride(stride), padding(padding), dilation(dilation) { }
+
+    // Returns the number of zeros added in front of the input along an axis for the given kernel size.
+    size_t PaddingFor(size_t kernel_size) const;
+
+    // Returns the size of the output along an axis for the given input and kernel size.
+    size_t OutputSize(size_t input_size, size_t kernel_size) const;
+
+    // Returns the output shape (num_features, height, width) for the given input shape
+    // (num_channels, height, width) and kernel shape (num_features, num_channels, kernel_height, kernel_width).
+    Shape OutputShape(const Shape& input_shape, const Shape& kernel_shape) const;
+
+    // Returns true if neighbouring output and kernel elements map to neighbouring input elements.
+    // The optimized convolution kernels are restricted to this case.
+    bool is_contiguous() const { return stride == 1 && dilation == 1; }
+
+    bool operator==(const ConvolutionParameters& other) const { return stride == other.stride && padding == other.padding && dilation == other.dilation; }
+    bool operator!=(const ConvolutionParameters& other) const { return !(*this == other); }
+
+    // Distance between the input positions of neighbouring output elements.
+    size_t stride;
+
+    Padding padding;
+
+    // Distance between the input elements that neighbouring kernel weights are applied to.
+    size_t dilation;
+};
+
+}       // namespace nn
+
+#endif
@@ -2,6 +2,7 @@
 #include <iomanip>
 #include <cmath>
 #include <cfloat>
+#include <cstring>
 #include <sstream>
 
 #include "nn/tensor/CpuTensor.h"
@@ -11,27 +12,64 @@ using namespace std;
 
 namespace nn {
 
-CPUTensor::CPUTensor() : BaseTensor({}), buffer_(nullptr) { }
+CPUTensor::CPUTensor() : BaseTensor({}), buffer_(nullptr), mapped_memory_(nullptr) { }
 
-CPUTensor::CPUTensor(const Shape& shape) : BaseTensor(shape)
+CPUTensor::CPUTensor(const Shape& shape) : BaseTensor(shape), mapped_memory_(nullptr)
 {
-    buffer_ = new float[size()];
-    Check(buffer_, "Out of memory");
+    AllocateBuffer(size(), HostMemory::kPageable);
+}
+
+CPUTensor::CPUTensor(const Shape& shape, HostMemory memory) : BaseTensor(shape), mapped_memory_(nullptr)
+{
+    AllocateBuffer(size(), memory);
 }
 
 CPUTensor::~CPUTensor()
 {
-    if (buffer_ && !is_view())
+    if (!is_view())
+        FreeBuffer();
+}
+
+// Whether pageable memory for this many elements is allocated through ocl::AllocateHostMemory().
+static bool IsHandOffSize(size_t num_elements)
+{
+    return num_elements * sizeof(float) >= ocl::kMinHostHandOffSize;
+}
+
+void CPUTensor::AllocateBuffer(size_t num_elements, HostMemory memory)
+{
+    if (memory == HostMemory::kPinned) {
+        Assert(GPUContext::Current());
+        mapped_memory_ = GPUContext::Current()->device()->AllocatePinnedMemory(num_elements * sizeof(float)).release();
+        Check(mapped_memory_, "Out of pinned memory");
+        buffer_ = reinterpret_cast<float*>(mapped_memory_->data());
+    } else if (IsHandOffSize(num_elements)) {
+        // Allocated so that the memory can be handed over to the device in MoveToGPU().
+        buffer_ = static_cast<float*>(ocl::AllocateHostMemory(num_elements * sizeof(float)));
+        Check(buffer_, "Out of memory");
+    } else {
+        buffer_ = new float[num_elements];
+    }
+}
+
+void CPUTensor::FreeBuffer()
+{
+    if (mapped_memory_)
+        delete mapped_memory_;
+    else if (buffer_ && IsHandOffSize(size()))
+        ocl::FreeHostMemory(buffer_);
+    else
         delete [] buffer_;
+    mapped_memory_ = nullptr;
+    buffer_ = nullptr;
 }
 
-CPUTensor::CPUTensor(const CPUTensor& other) : BaseTensor(other)
+CPUTensor::CPUTensor(const CPUTensor& other) : BaseTensor(other), mapped_memory_(nullptr)
 {
 #if COPYGUARD
     std::cout << "Notice: CPUTensor copy constructor called." << std::endl;
 #endif
-    buffer_ = new float[size()];
-    Check(buffer_, "Out of memory");
+    AllocateBuffer(size(), HostMemory::kPageable);
     copy(other.buffer_, other.buffer_ + size(), buffer_);
 }
 
@@ -44,8 +82,9 @@ CPUTensor& CPUTensor::operator=(const CPUTensor& other)
 
     // This optimization is required so tensor views work as expected.
     if (size() != other.size()) {
-        delete [] buffer_;
-        buffer_ = new float[other.size()];
+        HostMemory memory = is_pinned() ? HostMemory::kPinned : HostMemory::kPageable;
+        FreeBuffer();
+        AllocateBuffer(other.size(), memory);
     }
 
     // Assign base class properties.
@@ -103,20 +142,61 @@ GPUTensor CPUTensor::ToGPU() const
     return GPUTensor(*this);
 }
 
-CPUTensor::CPUTensor(const GPUTensor& other) : BaseTensor(other.shape())
+GPUTensor CPUTensor::MoveToGPU()
+{
+    Check(!is_view(), "Cannot move tensor views.");
+    Assert(GPUContext::Current());
+
+    ocl::Device* device = GPUContext::Current()->device();
+
+    // Hand the memory over to the device if it can use it directly. Pinned memory already
+    // is a device buffer which just needs to be unmapped, large pageable allocations are wrapped into a new one.
+    ocl::Buffer* buffer = nullptr;
+    if (device->has_unified_memory() && (mapped_memory_ || IsHandOffSize(size()))) {
+        if (mapped_memory_) {
+            buffer = device->UnmapBuffer(std::unique_ptr<ocl::MappedBuffer>(mapped_memory_)).release();
+        } else {
+            buffer = device->WrapHostMemory(buffer_, size() * sizeof(float)).release();
+            if (!buffer)
+                ocl::FreeHostMemory(buffer_);
+        }
+        Check(buffer, "Failed to hand over tensor memory to the device");
+        mapped_memory_ = nullptr;
+        buffer_ = nullptr;
+    }
+
+    // Only a single named return value here, so the result is never copied.
+    GPUTensor result = buffer ? GPUTensor(shape(), buffer) : GPUTensor(*this);
+    FreeBuffer();
+    BaseTensor::operator=(CPUTensor());
+    return result;
+}
+
+CPUTensor::CPUTensor(const Shape& shape, ocl::MappedBuffer* mapping) : BaseTensor(shape), mapped_memory_(mapping)
+{
+    Assert(mapping->size() == size() * sizeof(float));
+    buffer_ = reinterpret_cast<float*>(mapping->data());
+}
+
+CPUTensor::CPUTensor(const GPUTensor& other, HostMemory memory) : BaseTensor(other.shape()), mapped_memory_(nullptr)
 {
-    buffer_ = new float[size()];
-    Check(buffer_, "Out of memory");
-    other.gpu_buffer()->ReadInto(buffer_, size());
+    AllocateBuffer(size(), memory);
+
+    bool success;
+    if (is_pinned())
+        success = other.gpu_buffer()->ReadInto(buffer_, size());
+    else
+        success = GPUContext::Current()->device()->Download(other.gpu_buffer(), reinterpret_cast<uint8_t*>(buffer_), size() * sizeof(float), 0);
+    Check(success, "Failed to transfer tensor to the host");
 }
 
-CPUTensor::CPUTensor(const CPUTensor& base, const Shape& new_shape) : BaseTensor(new_shape), buffer_(base.buffer_)
+CPUTensor::CPUTensor(const CPUTensor& base, const Shape& new_shape) : BaseTensor(new_shape), buffer_(base.buffer_), mapped_memory_(nullptr)
 {
     Assert(size() == base.size());
     is_view_ = true;
 }
 
-CPUTensor::CPUTensor(const CPUTensor& base, size_t index) : BaseTensor(base.shape().ElementShape())
+CPUTensor::CPUTensor(const CPUTensor& base, size_t index) : BaseTensor(base.shape().ElementShape()), mapped_memory_(nullptr)
 {
     buffer_ = base.buffer_ + index * (base.shape().ElementShape().TotalElementCount());
     is_view_ = true;
@@ -36,13 +36,17 @@ class CPUTensor : public BaseTensor<CPUTensor> {
     // Default constructor for a CPUTensor. Does not initialize its data.
     explicit CPUTensor(const Shape& shape);
 
+    // Allocates a CPUTensor in the given kind of host memory. Does not initialize its data.
+    //
+    // Pinned tensors are mostly useful as source or destination of frequent transfers, e.g. for input batches.
+    CPUTensor(const Shape& shape, HostMemory memory);
+
     // Initialization constructor.
     // Initializes all values using the provided initializer.
     template <class Initializer>
-    CPUTensor(const Shape& shape, Initializer initializer) : BaseTensor(shape)
+    CPUTensor(const Shape& shape, Initializer initializer) : BaseTensor(shape), mapped_memory_(nullptr)
     {
-        buffer_ = new float[size()];
-        Check(buffer_, "Out of memory");
+        AllocateBuffer(size(), HostMemory::kPageable);
 
         for (size_t i = 0; i < size(); i++)
             buffer_[i] = initializer();
@@ -107,6 +111,17 @@ class CPUTensor : public BaseTensor<CPUTensor> {
     // Transfer the data of this tensor to a new tensor located on the GPU.
     GPUTensor ToGPU() const;
 
+    // Moves the data of this tensor to a new tensor located on the GPU, leaving this tensor empty.
+    //
+    // On devices with unified memory (see ocl::Device::has_unified_memory) the returned tensor
+    // takes over the memory of this tensor and no data is copied. On other devices this is
+    // equivalent to ToGPU() followed by freeing the host memory.
+    // This tensor must not be a view, and any existing views onto it become invalid.
+    GPUTensor MoveToGPU();
+
+    // Returns true if the data of this tensor lives in pinned host memory.
+    bool is_pinned() const { return mapped_memory_ != nullptr; }
+
   private:
     // Tensor view constructors.
     CPUTensor(const CPUTensor& base, const Shape& new_shape);
@@ -132,12 +147,24 @@ class CPUTensor : public BaseTensor<CPUTensor> {
     }
 
     // Transfer constructor.
-    // Creates a CPU tensor with the data and shape of the provided GPU tensor.
-    explicit CPUTensor(const GPUTensor& tensor);
+    // Creates a CPU tensor in the given kind of host memory with the data and shape of the provided GPU tensor.
+    CPUTensor(const GPUTensor& tensor, HostMemory memory);
+
+    // Creates a CPU tensor backed by the given mapping of a device buffer. Takes ownership of the mapping.
+    CPUTensor(const Shape& shape, ocl::MappedBuffer* mapping);
+
+    // (De)allocates the underlying buffer in the requested kind of host memory.
+    void AllocateBuffer(size_t num_elements, HostMemory memory);
+    void FreeBuffer();
 
     // Underlying (host) buffer. Pointer is owned by this instance if !is_view().
     float* buffer_;
 
+    // Mapping of a device buffer that buffer_ points into, nullptr for pageable memory or views.
+    // This is the case for pinned tensors and for tensors obtained through GPUTensor::MoveToHost().
+    // Pointer is owned by this instance.
+    ocl::MappedBuffer* mapped_memory_;
+
     friend class GPUTensor;
     friend class BaseTensor;
 };
@@ -1,6 +1,12 @@
+#include <algorithm>
 #include <cfloat>
 #include <memory>
 #include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "nn/tensor/CpuTensor.h"
 
@@ -89,7 +95,8 @@ float vecmul(const CPUTensor& x, const CPUTensor& y)
     return res;
 }
 
-CPUTensor& transposed_vecmul(const CPUTensor& x, const CPUTensor& y, CPUTensor& output)
+// Computes x * y^T into |output|, or adds it to |output| if |accumulate| is set.
+static CPUTensor& transposed_vecmul(const CPUTensor& x, const CPUTensor& y, bool accumulate, CPUTensor& output)
 {
     Assert(x.rank() == 1 && y.rank() == 1 && output.rank() == 2);
     Assert(output.shape(0) == x.shape(0));
@@ -97,7 +104,39 @@ CPUTensor& transposed_vecmul(const CPUTensor& x, const CPUTensor& y, CPUTensor&
 
     for (size_t row = 0; row < x.shape(0); row++) {
         for (size_t col = 0; col < y.shape(0); col++) {
-            output(row, col) = x(row) * y(col);
+            float value = x(row) * y(col);
+            output(row, col) = accumulate ? output(row, col) + value : value;
+        }
+    }
+
+    return output;
+}
+
+CPUTensor& transposed_vecmul(const CPUTensor& x, const CPUTensor& y, CPUTensor& output)
+{
+    return transposed_vecmul(x, y, false, output);
+}
+
+CPUTensor& accumulate_transposed_vecmul(const CPUTensor& x, const CPUTensor& y, CPUTensor& output)
+{
+    return transposed_vecmul(x, y, true, output);
+}
+
+CPUTensor& accumulate_transposed_matmul(const CPUTensor& a, const CPUTensor& b, size_t num_rows, CPUTensor& output)
+{
+    Assert(a.rank() == 2 && b.rank() == 2 && output.rank() == 2);
+    Assert(num_rows <= a.shape(0) && num_rows <= b.shape(0));
+    Assert(output.shape(0) == a.shape(1) && output.shape(1) == b.shape(1));
+
+    // Rank-1 updates, one per row. The innermost loop walks along the rows of b and |output|.
+    size_t a_cols = a.shape(1), b_cols = b.shape(1);
+    for (size_t k = 0; k < num_rows; k++) {
+        const float* a_row = a.begin() + k * a_cols;
+        const float* b_row = b.begin() + k * b_cols;
+        for (size_t i = 0; i < a_cols; i++) {
+            float* out = output.begin() + i * b_cols;
+            for (size_t j = 0; j < b_cols; j++)
+                out[j] += a_row[i] * b_row[j];
         }
     }
 
@@ -173,6 +212,124 @@ TENSOR_SCALAR_OPERATION(div, scalar_div);
 UNARY_OPERATION(exp, std::exp);
 UNARY_OPERATION(log, std::log);
 
+CPUTensor& sgd_update(CPUTensor& parameters, CPUTensor& gradients, float gradient_scale, float learning_rate)
+{
+    Assert(parameters.shape() == gradients.shape());
+
+    float* p = parameters.begin();
+    float* g = gradients.begin();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        p[i] -= learning_rate * g[i] * gradient_scale;
+        g[i] = 0.f;
+    }
+
+    return parameters;
+}
+
+CPUTensor& sgd_update(CPUTensor& parameters, CPUTensor& gradients, CPUTensor& velocity, float gradient_scale, float learning_rate, float momentum)
+{
+    Assert(parameters.shape() == gradients.shape() && parameters.shape() == velocity.shape());
+
+    float* p = parameters.begin();
+    float* g = gradients.begin();
+    float* v = velocity.begin();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        v[i] = momentum * v[i] - learning_rate * g[i] * gradient_scale;
+        p[i] += v[i];
+        g[i] = 0.f;
+    }
+
+    return parameters;
+}
+
+CPUTensor& rmsprop_update(CPUTensor& parameters, CPUTensor& gradients, CPUTensor& mean_square, float gradient_scale, float learning_rate, float decay, float epsilon)
+{
+    Assert(parameters.shape() == gradients.shape() && parameters.shape() == mean_square.shape());
+
+    float* p = parameters.begin();
+    float* g = gradients.begin();
+    float* ms = mean_square.begin();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        float gradient = g[i] * gradient_scale;
+        ms[i] = decay * ms[i] + (1.f - decay) * gradient * gradient;
+        p[i] -= learning_rate * gradient / (std::sqrt(ms[i]) + epsilon);
+        g[i] = 0.f;
+    }
+
+    return parameters;
+}
+
+CPUTensor& adam_update(CPUTensor& parameters, CPUTensor& gradients, CPUTensor& first_moment, CPUTensor& second_moment, float gradient_scale, float step_size,
+                       float beta1, float beta2, float epsilon)
+{
+    Assert(parameters.shape() == gradients.shape());
+    Assert(parameters.shape() == first_moment.shape() && parameters.shape() == second_moment.shape());
+
+    float* p = parameters.begin();
+    float* g = gradients.begin();
+    float* m = first_moment.begin();
+    float* v = second_moment.begin();
+    for (size_t i = 0; i < parameters.size(); i++) {
+        float gradient = g[i] * gradient_scale;
+        m[i] = beta1 * m[i] + (1.f - beta1) * gradient;
+        v[i] = beta2 * v[i] + (1.f - beta2) * gradient * gradient;
+        p[i] -= step_size * m[i] / (std::sqrt(v[i]) + epsilon);
+        g[i] = 0.f;
+    }
+
+    return parameters;
+}
+
+// Pointers to the data of the given tensors, which must all have the given shape.
+static std::vector<const float*> argument_data(const std::vector<const CPUTensor*>& arguments, const Shape& shape)
+{
+    std::vector<const float*> data;
+    for (const CPUTensor* argument : arguments) {
+        Assert(argument->shape() == shape);
+        data.push_back(argument->begin());
+    }
+    return data;
+}
+
+CPUTensor& fused(const elementwise::Expression& expression, const std::vector<const CPUTensor*>& arguments, CPUTensor& output)
+{
+    Assert(expression.num_arguments() <= arguments.size());
+
+    // The expression is evaluated block by block. The results go through a separate buffer, as |output| may be one
+    // of the arguments.
+    constexpr size_t kBlockSize = elementwise::Expression::kEvaluationBlockSize;
+    float buffer[kBlockSize];
+
+    std::vector<const float*> data = argument_data(arguments, output.shape());
+    float* o = output.begin();
+    for (size_t i = 0; i < output.size(); i += kBlockSize) {
+        size_t count = std::min(kBlockSize, output.size() - i);
+        const float* values = expression.Evaluate(data.data(), i, count, buffer);
+        std::copy(values, values + count, o + i);
+    }
+
+    return output;
+}
+
+float fused_sum(const elementwise::Expression& expression, const std::vector<const CPUTensor*>& arguments)
+{
+    Assert(!arguments.empty() && expression.num_arguments() <= arguments.size());
+
+    constexpr size_t kBlockSize = elementwise::Expression::kEvaluationBlockSize;
+    float buffer[kBlockSize];
+
+    std::vector<const float*> data = argument_data(arguments, arguments[0]->shape());
+    float sum = 0.f;
+    for (size_t i = 0; i < arguments[0]->size(); i += kBlockSize) {
+        size_t count = std::min(kBlockSize, arguments[0]->size() - i);
+        const float* values = expression.Evaluate(data.data(), i, count, buffer);
+        for (size_t j = 0; j < count; j++)
+            sum += values[j];
+    }
+
+    return sum;
+}
+
 
 CPUTensor& maxpool(const CPUTensor& input, size_t pooling_width, size_t pooling_height, CPUTensor& output)
 {
@@ -233,29 +390,34 @@ CPUTensor& maxpool_gradients(const CPUTensor& input, const CPUTensor& gradients,
 }
 
 CPUTensor& convolution(const CPUTensor& input, const CPUTensor& kernels, CPUTensor& output)
+{
+    return convolution(input, kernels, ConvolutionParameters(), output);
+}
+
+CPUTensor& convolution(const CPUTensor& input, const CPUTensor& kernels, const ConvolutionParameters& parameters, CPUTensor& output)
 {
     Assert(kernels.rank() == 4);
     Assert(input.rank() == 3 && output.rank() == 3);
     Assert(kernels.shape(2) % 2 == 1 && kernels.shape(3) % 2 == 1);
-    Assert(kernels.shape(0) == output.shape(0) && kernels.shape(1) == input.shape(0));
-    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+    Assert(output.shape() == parameters.OutputShape(input.shape(), kernels.shape()));
 
-    int kernel_halfwidth = kernels.shape(3) / 2;
-    int kernel_halfheight = kernels.shape(2) / 2;
+    int kernel_height = kernels.shape(2), kernel_width = kernels.shape(3);
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
+    int stride = parameters.stride, dilation = parameters.dilation;
 
     output.Clear();
 
     // We perform input.shape(0) convolutions per output feature map.
     for (size_t feature_map = 0; feature_map < output.shape(0); feature_map++) {
         for (size_t input_channel = 0; input_channel < input.shape(0); input_channel++) {
-            for (size_t y = 0; y < input.shape(1); y++) {
-                for (size_t x = 0; x < input.shape(2); x++) {
+            for (size_t y = 0; y < output.shape(1); y++) {
+                for (size_t x = 0; x < output.shape(2); x++) {
                     float sum = 0.f;
-                    for (int ky = -kernel_halfheight; ky <= kernel_halfheight; ky++) {
-                        for (int kx = -kernel_halfwidth; kx <= kernel_halfwidth; kx++) {
-                            int sx = x + kx, sy = y + ky;
+                    for (int ky = 0; ky < kernel_height; ky++) {
+                        for (int kx = 0; kx < kernel_width; kx++) {
+                            int sx = x * stride - pad_x + kx * dilation, sy = y * stride - pad_y + ky * dilation;
                             if (sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1))) {
-                                sum += kernels(feature_map, input_channel, -ky + kernel_halfheight, -kx + kernel_halfwidth) * input(input_channel, sy, sx);
+                                sum += kernels(feature_map, input_channel, kernel_height - 1 - ky, kernel_width - 1 - kx) * input(input_channel, sy, sx);
                             }
                         }
                     }
@@ -269,36 +431,41 @@ CPUTensor& convolution(const CPUTensor& input, const CPUTensor& kernels, CPUTens
 }
 
 CPUTensor& cross_correlation(const CPUTensor& input, const CPUTensor& kernels, CPUTensor& output)
+{
+    return cross_correlation(input, kernels, ConvolutionParameters(), output);
+}
+
+CPUTensor& cross_correlation(const CPUTensor& input, const CPUTensor& kernels, const ConvolutionParameters& parameters, CPUTensor& output)
 {
     Assert(kernels.rank() == 4);
     Assert(input.rank() == 3 && output.rank() == 3);
     Assert(kernels.shape(2) % 2 == 1 && kernels.shape(3) % 2 == 1);
-    Assert(kernels.shape(0) == input.shape(0) && kernels.shape(1) == output.shape(0));
-    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+    Assert(input.shape() == parameters.OutputShape(output.shape(), kernels.shape()));
 
     // Note: Naming conventions here assume input shape (num_features, height, width)
     // and output shape (num_channels, height, width).
     // See TensorOps.h for an explanation why these are different than for convolution().
 
-    int kernel_halfwidth = kernels.shape(3) / 2;
-    int kernel_halfheight = kernels.shape(2) / 2;
+    int kernel_height = kernels.shape(2), kernel_width = kernels.shape(3);
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
+    int stride = parameters.stride, dilation = parameters.dilation;
 
     output.Clear();
 
+    // Every input element is distributed to the output elements that it was computed from during the convolution.
     for (size_t feature_map = 0; feature_map < input.shape(0); feature_map++) {
         for (size_t input_channel = 0; input_channel < output.shape(0); input_channel++) {
             for (size_t y = 0; y < input.shape(1); y++) {
                 for (size_t x = 0; x < input.shape(2); x++) {
-                    float sum = 0.f;
-                    for (int ky = -kernel_halfheight; ky <= kernel_halfheight; ky++) {
-                        for (int kx = -kernel_halfwidth; kx <= kernel_halfwidth; kx++) {
-                            int sx = x + kx, sy = y + ky;
-                            if (sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1))) {
-                                sum += kernels(feature_map, input_channel, ky + kernel_halfheight, kx + kernel_halfwidth) * input(feature_map, sy, sx);
+                    float value = input(feature_map, y, x);
+                    for (int ky = 0; ky < kernel_height; ky++) {
+                        for (int kx = 0; kx < kernel_width; kx++) {
+                            int sx = x * stride - pad_x + kx * dilation, sy = y * stride - pad_y + ky * dilation;
+                            if (sx >= 0 && sx < int(output.shape(2)) && sy >= 0 && sy < int(output.shape(1))) {
+                                output(input_channel, sy, sx) += kernels(feature_map, input_channel, kernel_height - 1 - ky, kernel_width - 1 - kx) * value;
                             }
                         }
                     }
-                    output(input_channel, y, x) += sum;
                 }
             }
         }
@@ -307,32 +474,100 @@ CPUTensor& cross_correlation(const CPUTensor& input, const CPUTensor& kernels, C
     return output;
 }
 
+void prepare_convolution(const CPUTensor& kernels)
+{
+    // Nothing to do here.
+}
+
 CPUTensor& convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, CPUTensor& output)
+{
+    return convolution_kernel_gradients(input, gradients, ConvolutionParameters(), output);
+}
+
+// Computes the kernel gradients into |output|, or adds them to |output| if |accumulate| is set.
+static CPUTensor& convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, const ConvolutionParameters& parameters,
+                                               bool accumulate, CPUTensor& output)
 {
     Assert(output.rank() == 4);
     Assert(input.rank() == 3 && gradients.rank() == 3);
     Assert(output.shape(2) % 2 == 1 && output.shape(3) % 2 == 1);
-    Assert(output.shape(0) == gradients.shape(0) && output.shape(1) == input.shape(0));
-    Assert(input.shape().ElementShape() == gradients.shape().ElementShape());
+    Assert(gradients.shape() == parameters.OutputShape(input.shape(), output.shape()));
+
+    int kernel_height = output.shape(2), kernel_width = output.shape(3);
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
+    int stride = parameters.stride, dilation = parameters.dilation;
+
+    // GEMM formulation: the input elements that each weight was applied to are gathered into one
+    // row per weight (im2col), then the gradient of a weight is the dot product of its row and the
+    // output gradients. This keeps the inner loop free of scattered writes.
+    size_t kernel_size = kernel_height * kernel_width;
+    size_t num_outputs = gradients.shape(1) * gradients.shape(2);
+    std::vector<float> columns(kernel_size * num_outputs);
+
+    for (size_t input_channel = 0; input_channel < input.shape(0); input_channel++) {
+        for (int ky = 0; ky < kernel_height; ky++) {
+            for (int kx = 0; kx < kernel_width; kx++) {
+                float* column = &columns[(ky * kernel_width + kx) * num_outputs];
+                for (size_t y = 0; y < gradients.shape(1); y++) {
+                    for (size_t x = 0; x < gradients.shape(2); x++) {
+                        int sx = x * stride - pad_x + kx * dilation, sy = y * stride - pad_y + ky * dilation;
+                        bool inside = sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1));
+                        *column++ = inside ? input(input_channel, sy, sx) : 0;
+                    }
+                }
+            }
+        }
 
-    int kernel_halfwidth = output.shape(3) / 2;
-    int kernel_halfheight = output.shape(2) / 2;
+        for (size_t feature_map = 0; feature_map < output.shape(0); feature_map++) {
+            const float* feature_map_gradients = gradients.begin() + feature_map * num_outputs;
+            for (size_t k = 0; k < kernel_size; k++) {
+                const float* column = &columns[k * num_outputs];
+                float gradient = 0;
+                for (size_t i = 0; i < num_outputs; i++)
+                    gradient += column[i] * feature_map_gradients[i];
+                // The kernel is mirrored during the convolution.
+                float& weight = output(feature_map, input_channel, (kernel_size - 1 - k) / kernel_width, (kernel_size - 1 - k) % kernel_width);
+                weight = accumulate ? weight + gradient : gradient;
+            }
+        }
+    }
 
-    output.Clear();
+    return output;
+}
 
-    for (size_t feature_map = 0; feature_map < output.shape(0); feature_map++) {
-        for (size_t input_channel = 0; input_channel < input.shape(0); input_channel++) {
-            for (size_t y = 0; y < input.shape(1); y++) {
-                for (size_t x = 0; x < input.shape(2); x++) {
-                    for (int ky = -kernel_halfheight; ky <= kernel_halfheight; ky++) {
-                        for (int kx = -kernel_halfwidth; kx <= kernel_halfwidth; kx++) {
-                            int sx = x + kx, sy = y + ky;
-                            if (sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1))) {
-                                output(feature_map, input_channel, -ky + kernel_halfheight, -kx + kernel_halfwidth) += input(input_channel, sy, sx) * gradients(feature_map, y, x);
-                            }
+CPUTensor& convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, const ConvolutionParameters& parameters, CPUTensor& output)
+{
+    return convolution_kernel_gradients(input, gradients, parameters, false, output);
+}
+
+CPUTensor& accumulate_convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, const ConvolutionParameters& parameters, CPUTensor& output)
+{
+    return convolution_kernel_gradients(input, gradients, parameters, true, output);
+}
+
+CPUTensor& depthwise_convolution(const CPUTensor& input, const CPUTensor& kernels, CPUTensor& output)
+{
+    Assert(kernels.rank() == 3);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(kernels.shape(1) % 2 == 1 && kernels.shape(2) % 2 == 1);
+    Assert(input.shape() == output.shape() && kernels.shape(0) == input.shape(0));
+
+    int kernel_height = kernels.shape(1), kernel_width = kernels.shape(2);
+    int pad_y = kernel_height / 2, pad_x = kernel_width / 2;
+
+    for (size_t channel = 0; channel < input.shape(0); channel++) {
+        for (size_t y = 0; y < output.shape(1); y++) {
+            for (size_t x = 0; x < output.shape(2); x++) {
+                float value = 0;
+                for (int ky = 0; ky < kernel_height; ky++) {
+                    for (int kx = 0; kx < kernel_width; kx++) {
+                        int sx = x - pad_x + kx, sy = y - pad_y + ky;
+                        if (sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1))) {
+                            value += kernels(channel, kernel_height - 1 - ky, kernel_width - 1 - kx) * input(channel, sy, sx);
                         }
                     }
                 }
+                output(channel, y, x) = value;
             }
         }
     }
@@ -340,6 +575,176 @@ CPUTensor& convolution_kernel_gradients(const CPUTensor& input, const CPUTensor&
     return output;
 }
 
+CPUTensor& depthwise_cross_correlation(const CPUTensor& input, const CPUTensor& kernels, CPUTensor& output)
+{
+    Assert(kernels.rank() == 3);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(kernels.shape(1) % 2 == 1 && kernels.shape(2) % 2 == 1);
+    Assert(input.shape() == output.shape() && kernels.shape(0) == input.shape(0));
+
+    int kernel_height = kernels.shape(1), kernel_width = kernels.shape(2);
+    int pad_y = kernel_height / 2, pad_x = kernel_width / 2;
+
+    for (size_t channel = 0; channel < input.shape(0); channel++) {
+        for (size_t y = 0; y < output.shape(1); y++) {
+            for (size_t x = 0; x < output.shape(2); x++) {
+                float value = 0;
+                for (int ky = 0; ky < kernel_height; ky++) {
+                    for (int kx = 0; kx < kernel_width; kx++) {
+                        int sx = x - pad_x + kx, sy = y - pad_y + ky;
+                        if (sx >= 0 && sx < int(input.shape(2)) && sy >= 0 && sy < int(input.shape(1))) {
+                            value += kernels(channel, ky, kx) * input(channel, sy, sx);
+                        }
+                    }
+                }
+                output(channel, y, x) = value;
+            }
+        }
+    }
+
+    return output;
+}
+
+// Computes the kernel gradients into |output|, or adds them to |output| if |accumulate| is set.
+static CPUTensor& depthwise_convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, bool accumulate, CPUTensor& output)
+{
+    Assert(output.rank() == 3);
+    Assert(input.rank() == 3 && gradients.rank() == 3);
+    Assert(output.shape(1) % 2 == 1 && output.shape(2) % 2 == 1);
+    Assert(input.shape() == gradients.shape() && output.shape(0) == input.shape(0));
+
+    int kernel_height = output.shape(1), kernel_width = output.shape(2);
+    int pad_y = kernel_height / 2, pad_x = kernel_width / 2;
+    int height = input.shape(1), width = input.shape(2);
+
+    // The gradient of every weight is a dot product of the channel's output gradients and the input shifted by the
+    // weight's offset, summed up in a register over the rows of the image. Only the output elements for which the
+    // shifted input lies inside the image are visited, so the inner loop has neither branches nor scattered writes.
+    for (size_t channel = 0; channel < input.shape(0); channel++) {
+        const float* in = input.begin() + channel * height * width;
+        const float* grad = gradients.begin() + channel * height * width;
+        for (int ky = 0; ky < kernel_height; ky++) {
+            for (int kx = 0; kx < kernel_width; kx++) {
+                int dy = ky - pad_y, dx = kx - pad_x;
+                int y_begin = std::max(0, -dy), y_end = std::min(height, height - dy);
+                int x_begin = std::max(0, -dx), x_end = std::min(width, width - dx);
+
+                float gradient = 0;
+                for (int y = y_begin; y < y_end; y++) {
+                    const float* in_row = in + (y + dy) * width + dx;
+                    const float* grad_row = grad + y * width;
+                    for (int x = x_begin; x < x_end; x++)
+                        gradient += in_row[x] * grad_row[x];
+                }
+
+                // The kernel is mirrored during the convolution.
+                float& weight = output(channel, kernel_height - 1 - ky, kernel_width - 1 - kx);
+                weight = accumulate ? weight + gradient : gradient;
+            }
+        }
+    }
+
+    return output;
+}
+
+CPUTensor& depthwise_convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, CPUTensor& output)
+{
+    return depthwise_convolution_kernel_gradients(input, gradients, false, output);
+}
+
+CPUTensor& accumulate_depthwise_convolution_kernel_gradients(const CPUTensor& input, const CPUTensor& gradients, CPUTensor& output)
+{
+    return depthwise_convolution_kernel_gradients(input, gradients, true, output);
+}
+
+void prepare_depthwise_convolution(const CPUTensor& kernels)
+{
+    // Nothing to do here.
+}
+
+CPUTensor& pointwise_convolution(const CPUTensor& input, const CPUTensor& weights, CPUTensor& output)
+{
+    Assert(weights.rank() == 2);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(weights.shape(0) == output.shape(0) && weights.shape(1) == input.shape(0));
+    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+    const float* in = input.begin();
+    float* out = output.begin();
+
+    output.Clear();
+
+    for (size_t feature_map = 0; feature_map < output.shape(0); feature_map++) {
+        for (size_t channel = 0; channel < input.shape(0); channel++) {
+            float weight = weights(feature_map, channel);
+            for (size_t i = 0; i < num_pixels; i++)
+                out[feature_map * num_pixels + i] += weight * in[channel * num_pixels + i];
+        }
+    }
+
+    return output;
+}
+
+CPUTensor& pointwise_cross_correlation(const CPUTensor& input, const CPUTensor& weights, CPUTensor& output)
+{
+    Assert(weights.rank() == 2);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(weights.shape(0) == input.shape(0) && weights.shape(1) == output.shape(0));
+    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+    const float* in = input.begin();
+    float* out = output.begin();
+
+    output.Clear();
+
+    for (size_t feature_map = 0; feature_map < input.shape(0); feature_map++) {
+        for (size_t channel = 0; channel < output.shape(0); channel++) {
+            float weight = weights(feature_map, channel);
+            for (size_t i = 0; i < num_pixels; i++)
+                out[channel * num_pixels + i] += weight * in[feature_map * num_pixels + i];
+        }
+    }
+
+    return output;
+}
+
+// Computes the weight gradients into |output|, or adds them to |output| if |accumulate| is set.
+static CPUTensor& pointwise_convolution_weight_gradients(const CPUTensor& input, const CPUTensor& gradients, bool accumulate, CPUTensor& output)
+{
+    Assert(output.rank() == 2);
+    Assert(input.rank() == 3 && gradients.rank() == 3);
+    Assert(output.shape(0) == gradients.shape(0) && output.shape(1) == input.shape(0));
+    Assert(input.shape().ElementShape() == gradients.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+    const float* in = input.begin();
+    const float* grad = gradients.begin();
+
+    for (size_t feature_map = 0; feature_map < output.shape(0); feature_map++) {
+        for (size_t channel = 0; channel < output.shape(1); channel++) {
+            float gradient = 0;
+            for (size_t i = 0; i < num_pixels; i++)
+                gradient += grad[feature_map * num_pixels + i] * in[channel * num_pixels + i];
+            float& weight = output(feature_map, channel);
+            weight = accumulate ? weight + gradient : gradient;
+        }
+    }
+
+    return output;
+}
+
+CPUTensor& pointwise_convolution_weight_gradients(const CPUTensor& input, const CPUTensor& gradients, CPUTensor& output)
+{
+    return pointwise_convolution_weight_gradients(input, gradients, false, output);
+}
+
+CPUTensor& accumulate_pointwise_convolution_weight_gradients(const CPUTensor& input, const CPUTensor& gradients, CPUTensor& output)
+{
+    return pointwise_convolution_weight_gradients(input, gradients, true, output);
+}
+
 
 static inline float sigmoid(float v) { return 1.0 / (1.0 + std::exp(-v)); }
 static inline float sigmoid_derivative(float v) { return sigmoid(v) * (1.0 - sigmoid(v)); }
@@ -351,5 +756,122 @@ static inline float relu_derivative(float v) { return v < 0 ? 0 : 1; }
 UNARY_OPERATION(relu, relu);
 UNARY_OPERATION(relu_derivative, relu_derivative);
 
+#ifdef __SSE2__
+// Computes exp() of four floats at once, as done by the Cephes library: exp(x) = 2^n * exp(r) with n = round(x / ln(2)),
+// where exp(r) for |r| <= ln(2) / 2 is approximated by a polynomial and 2^n is built directly from the exponent bits.
+static inline __m128 exp_ps(__m128 x)
+{
+    x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+    x = _mm_max_ps(x, _mm_set1_ps(-88.3762626647949f));
+
+    // n = floor(x / ln(2) + 0.5). SSE2 can only truncate, which rounds negative values up, so correct for that.
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+    __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), _mm_set1_ps(1.f)));
+
+    // r = x - n * ln(2), with ln(2) split into two constants to preserve precision.
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+
+    __m128 y = _mm_set1_ps(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.f));
+
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(0x7f)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(exponent));
+}
+
+static inline float horizontal_sum(__m128 v)
+{
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return f[0] + f[1] + f[2] + f[3];
+}
+
+static inline float horizontal_max(__m128 v)
+{
+    float f[4];
+    _mm_storeu_ps(f, v);
+    return std::max(std::max(f[0], f[1]), std::max(f[2], f[3]));
+}
+#endif
+
+// Computes softmax(input) as exp(x - lse), where lse = log(sum(exp(input))) is computed relative to the maximum of the
+// input so exp() can't overflow.
+//
+// Uses SSE where available. The loops process four elements at a time, followed by a scalar loop for the rest.
+CPUTensor& softmax(const CPUTensor& input, CPUTensor& output)
+{
+    Assert(input.rank() == 1 && input.shape() == output.shape());
+
+    const float* in = input.begin();
+    float* out = output.begin();
+    size_t size = input.size();
+
+    size_t i = 0;
+    float maximum = -INFINITY;
+#ifdef __SSE2__
+    __m128 maxima = _mm_set1_ps(-INFINITY);
+    for (; i + 4 <= size; i += 4)
+        maxima = _mm_max_ps(maxima, _mm_loadu_ps(in + i));
+    maximum = horizontal_max(maxima);
+#endif
+    for (; i < size; i++)
+        maximum = std::max(maximum, in[i]);
+
+    i = 0;
+    float sum = 0.f;
+#ifdef __SSE2__
+    __m128 sums = _mm_setzero_ps();
+    for (; i + 4 <= size; i += 4)
+        sums = _mm_add_ps(sums, exp_ps(_mm_sub_ps(_mm_loadu_ps(in + i), _mm_set1_ps(maximum))));
+    sum = horizontal_sum(sums);
+#endif
+    for (; i < size; i++)
+        sum += std::exp(in[i] - maximum);
+
+    float lse = maximum + std::log(sum);
+
+    i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= size; i += 4)
+        _mm_storeu_ps(out + i, exp_ps(_mm_sub_ps(_mm_loadu_ps(in + i), _mm_set1_ps(lse))));
+#endif
+    for (; i < size; i++)
+        out[i] = std::exp(in[i] - lse);
+
+    return output;
+}
+
+float softmax_cross_entropy(const CPUTensor& input, const CPUTensor& probabilities, const CPUTensor& label, CPUTensor& gradients)
+{
+    Assert(input.rank() == 1 && input.shape() == label.shape());
+    Assert(input.shape() == probabilities.shape() && input.shape() == gradients.shape());
+
+    const float* in = input.begin();
+    const float* p = probabilities.begin();
+    const float* l = label.begin();
+    float* g = gradients.begin();
+
+    size_t largest = 0;
+    float label_sum = 0.f, weighted_sum = 0.f;
+    for (size_t i = 0; i < input.size(); i++) {
+        if (in[i] > in[largest])
+            largest = i;
+        // For labels that sum up to one, the derivative of the loss wrt x is simply p - l.
+        g[i] = p[i] - l[i];
+        label_sum += l[i];
+        weighted_sum += l[i] * in[i];
+    }
+
+    // log(softmax(x)) = x - lse, so lse can be recovered from any element. The largest input has a probability of at
+    // least 1 / size, so its logarithm is always finite. The loss is then sum(label * (lse - input)).
+    float lse = in[largest] - std::log(p[largest]);
+    return lse * label_sum - weighted_sum;
+}
 
 }       // namespace nn
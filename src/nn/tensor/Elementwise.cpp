@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cmath>
+
+#include "nn/tensor/Elementwise.h"
+#include "common/Common.h"
+
+using namespace std;
+
+namespace nn {
+namespace elementwise {
+
+// Host versions of the functions in kernels/Elementwise.h.
+static inline float host_sigmoid(float v) { return 1.0 / (1.0 + std::exp(-v)); }
+static inline float host_sigmoid_derivative(float v) { return host_sigmoid(v) * (1.0 - host_sigmoid(v)); }
+static inline float host_relu(float v) { return std::max(0.f, v); }
+static inline float host_relu_derivative(float v) { return v < 0 ? 0 : 1; }
+
+Expression::Expression(Operation operation) : operation_(operation), argument_(0), scalar_(0) { }
+
+Expression::Expression(Operation operation, const Expression& operand) :
+    operation_(operation), argument_(0), scalar_(0), lhs_(make_shared<Expression>(operand))
+{
+    Assert(operation >= kExp);
+}
+
+Expression::Expression(Operation operation, const Expression& lhs, const Expression& rhs) :
+    operation_(operation), argument_(0), scalar_(0), lhs_(make_shared<Expression>(lhs)), rhs_(make_shared<Expression>(rhs))
+{
+    Assert(operation >= kAdd && operation <= kDiv);
+}
+
+Expression Expression::Argument(size_t index)
+{
+    Expression expression(kArgument);
+    expression.argument_ = index;
+    return expression;
+}
+
+Expression Expression::Scalar(float value)
+{
+    Expression expression(kScalar);
+    expression.scalar_ = value;
+    return expression;
+}
+
+size_t Expression::num_arguments() const
+{
+    switch (operation_) {
+        case kArgument:
+            return argument_ + 1;
+        case kScalar:
+            return 0;
+        default:
+            return max(lhs_->num_arguments(), rhs_ ? rhs_->num_arguments() : 0);
+    }
+}
+
+void Expression::CollectScalars(vector<float>* scalars) const
+{
+    if (operation_ == kScalar)
+        scalars->push_back(scalar_);
+    if (lhs_)
+        lhs_->CollectScalars(scalars);
+    if (rhs_)
+        rhs_->CollectScalars(scalars);
+}
+
+void Expression::AppendSignature(string* signature) const
+{
+    // One letter per operation in prefix order. Argument indices are terminated by a comma to keep them apart.
+    signature->push_back(static_cast<char>('A' + operation_));
+    if (operation_ == kArgument)
+        signature->append(to_string(argument_)).push_back(',');
+    if (lhs_)
+        lhs_->AppendSignature(signature);
+    if (rhs_)
+        rhs_->AppendSignature(signature);
+}
+
+string Expression::ToOpenCL() const
+{
+    size_t next_scalar = 0;
+    return ToOpenCL(&next_scalar);
+}
+
+string Expression::ToOpenCL(size_t* next_scalar) const
+{
+    // Operands are generated left to right, which matches the order of CollectScalars().
+    switch (operation_) {
+        case kArgument:
+            return "a" + to_string(argument_) + "[index]";
+        case kScalar:
+            return "s" + to_string((*next_scalar)++);
+        case kAdd:
+        case kSub:
+        case kMul:
+        case kDiv: {
+            static const char* const operators[] = { "+", "-", "*", "/" };
+            string lhs = lhs_->ToOpenCL(next_scalar);
+            string rhs = rhs_->ToOpenCL(next_scalar);
+            return "(" + lhs + " " + operators[operation_ - kAdd] + " " + rhs + ")";
+        }
+        case kExp:
+            return "exp(" + lhs_->ToOpenCL(next_scalar) + ")";
+        case kLog:
+            return "log(" + lhs_->ToOpenCL(next_scalar) + ")";
+        case kSigmoid:
+            return "sigmoid(" + lhs_->ToOpenCL(next_scalar) + ")";
+        case kSigmoidDerivative:
+            return "sigmoid_derivative(" + lhs_->ToOpenCL(next_scalar) + ")";
+        case kReLU:
+            return "relu(" + lhs_->ToOpenCL(next_scalar) + ")";
+        case kReLUDerivative:
+            return "relu_derivative(" + lhs_->ToOpenCL(next_scalar) + ")";
+    }
+
+    Check(false, "Unknown elementwise operation");
+    return "";
+}
+
+constexpr size_t Expression::kEvaluationBlockSize;
+
+const float* Expression::Evaluate(const float* const* arguments, size_t begin, size_t count, float* buffer) const
+{
+    Assert(count <= kEvaluationBlockSize);
+
+    if (operation_ == kArgument)
+        return arguments[argument_] + begin;
+
+    if (operation_ == kScalar) {
+        fill(buffer, buffer + count, scalar_);
+        return buffer;
+    }
+
+    // The left operand may be computed into |buffer| as well, the operations below work in place.
+    const float* x = lhs_->Evaluate(arguments, begin, count, buffer);
+
+    if (rhs_) {
+        float rhs_buffer[kEvaluationBlockSize];
+        const float* y = rhs_->Evaluate(arguments, begin, count, rhs_buffer);
+
+        switch (operation_) {
+            case kAdd:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = x[i] + y[i];
+                return buffer;
+            case kSub:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = x[i] - y[i];
+                return buffer;
+            case kMul:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = x[i] * y[i];
+                return buffer;
+            case kDiv:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = x[i] / y[i];
+                return buffer;
+            default:
+                break;
+        }
+    } else {
+        switch (operation_) {
+            case kExp:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = std::exp(x[i]);
+                return buffer;
+            case kLog:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = std::log(x[i]);
+                return buffer;
+            case kSigmoid:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = host_sigmoid(x[i]);
+                return buffer;
+            case kSigmoidDerivative:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = host_sigmoid_derivative(x[i]);
+                return buffer;
+            case kReLU:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = host_relu(x[i]);
+                return buffer;
+            case kReLUDerivative:
+                for (size_t i = 0; i < count; i++)
+                    buffer[i] = host_relu_derivative(x[i]);
+                return buffer;
+            default:
+                break;
+        }
+    }
+
+    Check(false, "Unknown elementwise operation");
+    return buffer;
+}
+
+Expression operator+(const Expression& lhs, const Expression& rhs) { return Expression(Expression::kAdd, lhs, rhs); }
+Expression operator-(const Expression& lhs, const Expression& rhs) { return Expression(Expression::kSub, lhs, rhs); }
+Expression operator*(const Expression& lhs, const Expression& rhs) { return Expression(Expression::kMul, lhs, rhs); }
+Expression operator/(const Expression& lhs, const Expression& rhs) { return Expression(Expression::kDiv, lhs, rhs); }
+
+Expression operator+(const Expression& lhs, float rhs) { return lhs + Expression::Scalar(rhs); }
+Expression operator-(const Expression& lhs, float rhs) { return lhs - Expression::Scalar(rhs); }
+Expression operator*(const Expression& lhs, float rhs) { return lhs * Expression::Scalar(rhs); }
+Expression operator/(const Expression& lhs, float rhs) { return lhs / Expression::Scalar(rhs); }
+
+Expression operator+(float lhs, const Expression& rhs) { return Expression::Scalar(lhs) + rhs; }
+Expression operator-(float lhs, const Expression& rhs) { return Expression::Scalar(lhs) - rhs; }
+Expression operator*(float lhs, const Expression& rhs) { return Expression::Scalar(lhs) * rhs; }
+Expression operator/(float lhs, const Expression& rhs) { return Expression::Scalar(lhs) / rhs; }
+
+Expression exp(const Expression& x) { return Expression(Expression::kExp, x); }
+Expression log(const Expression& x) { return Expression(Expression::kLog, x); }
+Expression sigmoid(const Expression& x) { return Expression(Expression::kSigmoid, x); }
+Expression sigmoid_derivative(const Expression& x) { return Expression(Expression::kSigmoidDerivative, x); }
+Expression relu(const Expression& x) { return Expression(Expression::kReLU, x); }
+Expression relu_derivative(const Expression& x) { return Expression(Expression::kReLUDerivative, x); }
+
+}       // namespace elementwise
+}       // namespace nn
@@ -0,0 +1,120 @@
+//
+// Fusable elementwise expressions.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __ELEMENTWISE_H__
+#define __ELEMENTWISE_H__
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nn {
+namespace elementwise {
+
+// A chain of elementwise operations on tensors and scalars, evaluated by fused() (see TensorOps.h) in a single pass over memory.
+//
+// Expressions are built from Argument() leaves and the operations below, which mirror the kernels in Arithmetic.cl and
+// Activations.cl. For example, the gradients of a ReLU activation are
+//
+//     fused(relu_derivative(Argument(0)) * Argument(1), { &input, &gradients }, output);
+//
+// On the GPU, every distinct expression is compiled into its own kernel on first use and found again by its signature
+// (see AppendSignature()). Scalars are kernel arguments, so expressions that only differ in their scalar values share
+// the same kernel.
+class Expression {
+  public:
+    enum Operation {
+        kArgument,
+        kScalar,
+        kAdd,
+        kSub,
+        kMul,
+        kDiv,
+        kExp,
+        kLog,
+        kSigmoid,
+        kSigmoidDerivative,
+        kReLU,
+        kReLUDerivative,
+    };
+
+    // Leaf expressions: the element of the tensor argument with the given index, or a constant.
+    static Expression Argument(size_t index);
+    static Expression Scalar(float value);
+
+    // Applies a unary or binary operation to the given expressions.
+    Expression(Operation operation, const Expression& operand);
+    Expression(Operation operation, const Expression& lhs, const Expression& rhs);
+
+    // Returns the number of tensor arguments that this expression requires, i.e. the largest argument index plus one.
+    size_t num_arguments() const;
+
+    // Appends the values of all scalars in this expression to |scalars|, in the order in which ToOpenCL() numbers them.
+    void CollectScalars(std::vector<float>* scalars) const;
+
+    // Appends a compact description of the structure of this expression to |signature|: its operations and argument
+    // indices, but not its scalar values. Expressions with the same signature compile to the same OpenCL code.
+    void AppendSignature(std::string* signature) const;
+
+    // Returns OpenCL code computing this expression for the element at |index|. Tensor arguments are named a0, a1, ...
+    // and scalars s0, s1, ... . The code uses the functions from kernels/Elementwise.h.
+    std::string ToOpenCL() const;
+
+    // Maximum number of elements that Evaluate() processes at once.
+    static constexpr size_t kEvaluationBlockSize = 256;
+
+    // Evaluates this expression on the host for the |count| <= kEvaluationBlockSize elements of the given arguments that
+    // start at |begin|. Every operation is applied to the whole block before the next one, so the expression tree is
+    // only walked once per block. Returns a pointer to the results, which is either into |buffer| (which must hold
+    // |count| floats) or, for a plain argument, into the argument itself.
+    const float* Evaluate(const float* const* arguments, size_t begin, size_t count, float* buffer) const;
+
+  private:
+    explicit Expression(Operation operation);
+
+    std::string ToOpenCL(size_t* next_scalar) const;
+
+    Operation operation_;
+
+    // Argument index of kArgument expressions.
+    size_t argument_;
+
+    // Value of kScalar expressions.
+    float scalar_;
+
+    // Operands of unary (lhs_ only) and binary operations. Expressions are immutable, so these can be shared.
+    std::shared_ptr<const Expression> lhs_, rhs_;
+};
+
+inline Expression Argument(size_t index) { return Expression::Argument(index); }
+
+Expression operator+(const Expression& lhs, const Expression& rhs);
+Expression operator-(const Expression& lhs, const Expression& rhs);
+Expression operator*(const Expression& lhs, const Expression& rhs);
+Expression operator/(const Expression& lhs, const Expression& rhs);
+
+Expression operator+(const Expression& lhs, float rhs);
+Expression operator-(const Expression& lhs, float rhs);
+Expression operator*(const Expression& lhs, float rhs);
+Expression operator/(const Expression& lhs, float rhs);
+
+Expression operator+(float lhs, const Expression& rhs);
+Expression operator-(float lhs, const Expression& rhs);
+Expression operator*(float lhs, const Expression& rhs);
+Expression operator/(float lhs, const Expression& rhs);
+
+Expression exp(const Expression& x);
+Expression log(const Expression& x);
+Expression sigmoid(const Expression& x);
+Expression sigmoid_derivative(const Expression& x);
+Expression relu(const Expression& x);
+Expression relu_derivative(const Expression& x);
+
+}       // namespace elementwise
+}       // namespace nn
+
+#endif
@@ -10,11 +10,17 @@ using namespace std;
 
 namespace nn {
 
-GPUTensor::GPUTensor() : BaseTensor({}) { }
+GPUTensor::GPUTensor() : BaseTensor({}), buffer_(nullptr) { }
 
 GPUTensor::GPUTensor(const Shape& shape) : BaseTensor(shape)
 {
-    buffer_ = GPUContext::device->AllocateBuffer(size() * sizeof(float)).release();
+    buffer_ = GPUContext::Current()->device()->AllocateBuffer(size() * sizeof(float)).release();
+    Check(buffer_, "Out of device memory");
+}
+
+GPUTensor::GPUTensor(const Shape& shape, cl_mem_flags flags) : BaseTensor(shape)
+{
+    buffer_ = GPUContext::Current()->device()->AllocateBuffer(size() * sizeof(float), flags).release();
     Check(buffer_, "Out of device memory");
 }
 
@@ -23,11 +29,9 @@ GPUTensor::GPUTensor(const GPUTensor& other) : BaseTensor(other.shape())
 #if COPYGUARD
     std::cout << "Notice: GPUTensor copy constructor called." << std::endl;
 #endif
-    // TODO add CopyInto() to ocl::Buffer that uses clEnqueueCopyBuffer.
-    buffer_ = GPUContext::device->AllocateBuffer(size() * sizeof(float)).release();
-    float* buf = other.buffer_->Read<float>();
-    buffer_->Write(buf);
-    delete [] buf;
+    buffer_ = GPUContext::Current()->device()->AllocateBuffer(size() * sizeof(float)).release();
+    Check(buffer_, "Out of device memory");
+    other.buffer_->CopyInto(buffer_);
 }
 
 GPUTensor& GPUTensor::operator=(const GPUTensor& other)
@@ -39,16 +43,13 @@ GPUTensor& GPUTensor::operator=(const GPUTensor& other)
 
     if (shape() != other.shape()) {
         delete buffer_;
-        buffer_ = GPUContext::device->AllocateBuffer(other.size() * sizeof(float)).release();
+        buffer_ = GPUContext::Current()->device()->AllocateBuffer(other.size() * sizeof(float)).release();
     }
 
     // Assign base class properties.
     BaseTensor::operator=(other);
 
-    // TODO Same as above, implement ocl::Buffer::CopyInto().
-    float* tmpbuf = other.buffer_->Read<float>();
-    buffer_->Write(tmpbuf);
-    delete [] tmpbuf;
+    other.buffer_->CopyInto(buffer_);
 
     return *this;
 }
@@ -64,9 +65,34 @@ void GPUTensor::Clear()
     buffer_->Clear();
 }
 
-CPUTensor GPUTensor::ToHost() const
+CPUTensor GPUTensor::ToHost(HostMemory memory) const
+{
+    return CPUTensor(*this, memory);
+}
+
+CPUTensor GPUTensor::MoveToHost()
 {
-    return CPUTensor(*this);
+    Check(!is_view(), "Cannot move tensor views.");
+
+    // On devices with unified memory the host can access the memory directly. The mapping
+    // keeps the underlying memory alive, so our buffer object can go away afterwards.
+    ocl::MappedBuffer* mapping = nullptr;
+    if (GPUContext::Current()->device()->has_unified_memory()) {
+        mapping = GPUContext::Current()->device()->MapBuffer(buffer_).release();
+        Check(mapping, "Failed to map tensor memory");
+    }
+
+    // Only a single named return value here, so the result is never copied.
+    CPUTensor result = mapping ? CPUTensor(shape(), mapping) : CPUTensor(*this, HostMemory::kPageable);
+    delete buffer_;
+    buffer_ = nullptr;
+    BaseTensor::operator=(GPUTensor());
+    return result;
+}
+
+GPUTensor::GPUTensor(const Shape& shape, ocl::Buffer* buffer) : BaseTensor(shape), buffer_(buffer)
+{
+    Assert(buffer->size() == size() * sizeof(float));
 }
 
 GPUTensor::GPUTensor(const GPUTensor& base, const Shape& new_shape) : BaseTensor(new_shape), buffer_(base.buffer_->NewView().release())
@@ -84,9 +110,16 @@ GPUTensor::GPUTensor(const GPUTensor& base, size_t index) : BaseTensor(base.shap
 
 GPUTensor::GPUTensor(const CPUTensor& tensor) : BaseTensor(tensor.shape())
 {
-    buffer_ = GPUContext::device->AllocateBuffer(size() * sizeof(float)).release();
+    buffer_ = GPUContext::Current()->device()->AllocateBuffer(size() * sizeof(float)).release();
     Check(buffer_, "Out of device memory");
-    buffer_->Write(tensor.buffer_);
+
+    // Pinned memory can be transferred via DMA directly, everything else needs to be staged first.
+    bool success;
+    if (tensor.is_pinned())
+        success = buffer_->Write(tensor.buffer_, size());
+    else
+        success = GPUContext::Current()->device()->Upload(buffer_, reinterpret_cast<uint8_t*>(tensor.buffer_), size() * sizeof(float), 0);
+    Check(success, "Failed to transfer tensor to the device");
 }
 
 ostream& operator<<(ostream& os, const GPUTensor& tensor)
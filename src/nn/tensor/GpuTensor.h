@@ -31,6 +31,10 @@ class GPUTensor : public BaseTensor<GPUTensor> {
     // Allocates a memory buffer but does not initialize its content.
     explicit GPUTensor(const Shape& shape);
 
+    // Allocates a memory buffer with the given memory flags, e.g. ocl::kScratchBuffer
+    // for temporaries that are never accessed by the host.
+    GPUTensor(const Shape& shape, cl_mem_flags flags);
+
     // Initialization constructor.
     // Initializes all values using the provided initializer.
     template <class Initializer>
@@ -40,9 +44,9 @@ class GPUTensor : public BaseTensor<GPUTensor> {
         for (size_t i = 0; i < size(); i++)
             buf[i] = initializer();
 
-        buffer_ = GPUContext::device->AllocateBuffer(size() * sizeof(float)).release();
+        buffer_ = GPUContext::Current()->device()->AllocateBuffer(size() * sizeof(float)).release();
         Check(buffer_, "Out of device memory");
-        buffer_->Write(buf);
+        GPUContext::Current()->device()->Upload(buffer_, reinterpret_cast<uint8_t*>(buf), size() * sizeof(float), 0);
         delete [] buf;
     }
 
@@ -61,7 +65,16 @@ class GPUTensor : public BaseTensor<GPUTensor> {
     void Clear();
 
     // Transfer the data of this tensor to a new tensor located on the host.
-    CPUTensor ToHost() const;
+    //
+    // Transfers into pinned memory are faster, but allocating pinned memory is more expensive.
+    CPUTensor ToHost(HostMemory memory = HostMemory::kPageable) const;
+
+    // Moves the data of this tensor to a new tensor located on the host, leaving this tensor empty.
+    //
+    // On devices with unified memory the returned tensor maps the memory of this tensor and no data is
+    // copied. The memory is handed back to the device once the returned tensor is moved with MoveToGPU().
+    // This tensor must not be a view, and any existing views onto it become invalid.
+    CPUTensor MoveToHost();
 
   private:
     // Tensor view constructors.
@@ -72,6 +85,9 @@ class GPUTensor : public BaseTensor<GPUTensor> {
     // Creates a GPU tensor with the data and shape of the provided CPU tensor.
     explicit GPUTensor(const CPUTensor& tensor);
 
+    // Creates a GPU tensor backed by the given buffer. Takes ownership of the buffer.
+    GPUTensor(const Shape& shape, ocl::Buffer* buffer);
+
     // Underlying (GPU) buffer. Pointer is owned by this instance if !dependent_.
     ocl::Buffer* buffer_;
 
@@ -1,29 +1,102 @@
 #include <cfloat>
 #include <memory>
 #include <cmath>
+#include <sstream>
 
 #include "nn/tensor/GpuTensor.h"
 #include "nn/tensor/CpuTensor.h"
 #include "nn/Gpu.h"
 
-#define INCLUDED_BY_HOST
-#include "kernels/KernelCommon.h"
-#undef INCLUDED_BY_HOST
+using namespace std;
+
+namespace nn {
+
+typedef ocl::Kernel::WorkSize WorkSize;
+
+// Largest work group size used by the reduction kernels. Supported by all devices we care about.
+constexpr size_t kMaxReductionWorkGroupSize = 256;
 
-// Some of the simple kernels can process multiple items per thread.
-constexpr size_t kItemsPerThread = ITEMS_PER_THREAD;
+// Size of the output tiles of the TransposedMatMul kernel. Must be in sync with kernels/LinearAlgebra.cl.
+constexpr size_t kMatMulTileSize = 16;
 
-// Number of threads to spawn if each thread processes |kItemsPerThread| items.
+// Number of threads to spawn for the simple kernels, which process multiple items per thread.
+// The number of items per thread is a compile time constant of the kernels, see KernelManager.
 inline size_t threadcount(size_t problem_size)
 {
-    return (problem_size + kItemsPerThread - 1) / kItemsPerThread;
+    size_t items_per_thread = GPUContext::Current()->kernel_manager().items_per_thread();
+    return (problem_size + items_per_thread - 1) / items_per_thread;
 }
 
-using namespace std;
+inline WorkSize ToWorkSize(const ocl::Tuner::Parameters& parameters)
+{
+    Assert(parameters.size() >= 1 && parameters.size() <= 3);
+    WorkSize result(parameters[0]);
+    for (size_t d = 1; d < parameters.size(); d++)
+        result.values[d] = parameters[d];
+    result.dimensions = parameters.size();
+    return result;
+}
 
-namespace nn {
+// Runs the given kernel with the arguments |args| followed by the buffer of |output|.
+//
+// The local work size is taken from the tuner (see ocl/Tuner.h). In tuning mode, unknown configurations are
+// benchmarked first. These runs write into a scratch tensor instead of |output|, so in-place operations stay correct.
+template <typename... Args>
+bool RunTuned(ocl::Kernel* kernel, WorkSize gws, GPUTensor& output, Args... args)
+{
+    WorkSize lws = ocl::Kernel::CalculateLocalWorkSize(gws);
 
-typedef ocl::Kernel::WorkSize WorkSize;
+    ocl::Tuner& tuner = GPUContext::Current()->tuner();
+    if (tuner.active()) {
+        string key = ocl::Tuner::Key(kernel->name(), gws);
+        ocl::Tuner::Parameters parameters;
+        if (!tuner.Lookup(key, &parameters) && tuner.enabled()) {
+            GPUTensor scratch(output.shape(), ocl::kScratchBuffer);
+            parameters = tuner.Tune(key, tuner.LocalWorkSizeCandidates(*kernel, gws), {}, [&](const ocl::Tuner::Parameters& candidate) {
+                return kernel->Run(gws, ToWorkSize(candidate), args..., scratch.gpu_buffer());
+            });
+        }
+        if (!parameters.empty())
+            lws = ToWorkSize(parameters);
+    }
+
+    return kernel->Run(gws, lws, args..., output.gpu_buffer());
+}
+
+// Same as above, for the kernel with the given ID.
+template <typename... Args>
+bool RunTuned(KernelIDs id, WorkSize gws, GPUTensor& output, Args... args)
+{
+    return RunTuned(GPUContext::Current()->kernel_manager().kernel(id), gws, output, args...);
+}
+
+// Elementwise operations on smaller tensors always use the scalar kernels. These are too small to be bandwidth bound.
+constexpr size_t kMinVectorizedElementwiseSize = 4096;
+
+// Returns the vector width to use for an elementwise operation on the given tensors, see KernelCommon.h.
+//
+// This is the configured width (see KernelManager) unless one of the tensors is too small or its buffer is a view that
+// isn't aligned to a whole vector, in which case a smaller width or the scalar kernels (width 1) are used.
+static size_t vector_width(std::initializer_list<const GPUTensor*> tensors)
+{
+    size_t width = GPUContext::Current()->kernel_manager().elementwise_vector_width();
+    for (const GPUTensor* tensor : tensors) {
+        if (tensor->size() < kMinVectorizedElementwiseSize)
+            return 1;
+        while (width > 1 && tensor->gpu_buffer()->offset() % (width * sizeof(float)) != 0)
+            width /= 2;
+    }
+
+    // There are no kernels for a vector width of 2.
+    return width >= 4 ? width : 1;
+}
+
+// Returns the elementwise kernel with the given ID for the given vector width.
+static ocl::Kernel* elementwise_kernel(KernelIDs id, size_t width)
+{
+    KernelManager& kernel_manager = GPUContext::Current()->kernel_manager();
+    return width == 1 ? kernel_manager.kernel(id) : kernel_manager.vector_kernel(id, width);
+}
 
 size_t argmax(const GPUTensor& input)
 {
@@ -41,33 +114,57 @@ float mse(const GPUTensor& x, const GPUTensor& y)
 {
     Assert(x.shape() == y.shape());
 
+    // Temporaries like this one are served from the device's buffer cache, so calling this
+    // once per sample does not cause an OpenCL allocation every time.
     GPUTensor errors(x.shape());
-    bool success = GPUContext::kernel_manager.kernel(kMSEKernel)->Run(
+    bool success = RunTuned(kMSEKernel,
             WorkSize(x.size()),
+            errors,
             x.size(),
             x.gpu_buffer(),
-            y.gpu_buffer(),
-            errors.gpu_buffer());
+            y.gpu_buffer());
     Assert(success);
 
     return sum(errors);
 }
 
-GPUTensor& matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor& output)
+// Returns the number of matrix elements that each thread processes during a (transposed) matrix-vector multiplication.
+//
+// This is a tradeoff between parallelism and the amount of work done during the reduction step, so it is tuned
+// per problem size if possible. |run| must perform the multiplication with the given value into a scratch tensor.
+template <typename Run>
+size_t gemv_elements_per_thread(const string& name, const GPUTensor& matrix, size_t reduction_size, Run run)
 {
-    Assert(matrix.rank() == 2 && vector.rank() == 1 && output.rank() == 1);
-    Assert(matrix.shape(0) == output.shape(0));
-    Assert(matrix.shape(1) == vector.shape(0));
+    // Default if no tuning results are available.
+    size_t fallback = min((size_t)64, matrix.shape(1));
 
-    // Each thread processes this many elements.
-    size_t num_elements_per_thread = min((size_t)64, matrix.shape(1));
+    ocl::Tuner& tuner = GPUContext::Current()->tuner();
+    if (!tuner.active())
+        return fallback;
+
+    string key = ocl::Tuner::Key(name, WorkSize(matrix.shape(ROW), matrix.shape(COL)));
+    ocl::Tuner::Parameters parameters;
+    if (tuner.Lookup(key, &parameters))
+        return parameters[0];
+    if (!tuner.enabled())
+        return fallback;
+
+    std::vector<ocl::Tuner::Parameters> candidates;
+    for (size_t n = 8; n <= 512 && n < 2 * reduction_size; n *= 2)
+        candidates.push_back({ n });
+
+    parameters = tuner.Tune(key, candidates, { fallback }, [&](const ocl::Tuner::Parameters& candidate) { return run(candidate[0]); });
+    return parameters[0];
+}
 
+static GPUTensor& matvecmul(const GPUTensor& matrix, const GPUTensor& vector, size_t num_elements_per_thread, GPUTensor& output)
+{
     // This many values will be produced for each row.
     size_t entries_per_row = (matrix.shape(COL) + num_elements_per_thread - 1) / num_elements_per_thread;
 
-    GPUTensor temp_out({matrix.shape(ROW), entries_per_row});
+    GPUTensor temp_out({matrix.shape(ROW), entries_per_row}, ocl::kScratchBuffer);
 
-    bool success = GPUContext::kernel_manager.kernel(kMatVecMulKernel)->Run(
+    bool success = GPUContext::Current()->kernel_manager().kernel(kMatVecMulKernel)->Run(
             WorkSize(entries_per_row, matrix.shape(ROW)),
             WorkSize(1, 256),               // Required by kernel
             matrix.shape(ROW),
@@ -79,7 +176,7 @@ GPUTensor& matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor
             temp_out.gpu_buffer());
     Assert(success);
 
-    success = GPUContext::kernel_manager.kernel(kMatVecMulReduceKernel)->Run(
+    success = GPUContext::Current()->kernel_manager().kernel(kMatVecMulReduceKernel)->Run(
             WorkSize(output.shape(0)),
             output.shape(0),
             entries_per_row,
@@ -90,21 +187,30 @@ GPUTensor& matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor
     return output;
 }
 
-GPUTensor& transposed_matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor& output)
+GPUTensor& matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor& output)
 {
     Assert(matrix.rank() == 2 && vector.rank() == 1 && output.rank() == 1);
-    Assert(matrix.shape(0) == vector.shape(0));
-    Assert(matrix.shape(1) == output.shape(0));
+    Assert(matrix.shape(0) == output.shape(0));
+    Assert(matrix.shape(1) == vector.shape(0));
 
     // Each thread processes this many elements.
-    size_t num_elements_per_thread = min((size_t)64, matrix.shape(1));
+    size_t num_elements_per_thread = gemv_elements_per_thread("MatVecMul", matrix, matrix.shape(COL), [&](size_t n) {
+        GPUTensor scratch(output.shape(), ocl::kScratchBuffer);
+        matvecmul(matrix, vector, n, scratch);
+        return true;
+    });
+
+    return matvecmul(matrix, vector, num_elements_per_thread, output);
+}
 
+static GPUTensor& transposed_matvecmul(const GPUTensor& matrix, const GPUTensor& vector, size_t num_elements_per_thread, GPUTensor& output)
+{
     // This many values will be produced for each row.
     size_t entries_per_row = (matrix.shape(ROW) + num_elements_per_thread - 1) / num_elements_per_thread;
 
-    GPUTensor temp_out({matrix.shape(COL), entries_per_row});
+    GPUTensor temp_out({matrix.shape(COL), entries_per_row}, ocl::kScratchBuffer);
 
-    bool success = GPUContext::kernel_manager.kernel(kTransposedMatVecMulKernel)->Run(
+    bool success = GPUContext::Current()->kernel_manager().kernel(kTransposedMatVecMulKernel)->Run(
             WorkSize(matrix.shape(COL), entries_per_row),
             WorkSize(256, 1),
             matrix.shape(ROW),
@@ -116,7 +222,7 @@ GPUTensor& transposed_matvecmul(const GPUTensor& matrix, const GPUTensor& vector
             temp_out.gpu_buffer());
     Assert(success);
 
-    success = GPUContext::kernel_manager.kernel(kMatVecMulReduceKernel)->Run(
+    success = GPUContext::Current()->kernel_manager().kernel(kMatVecMulReduceKernel)->Run(
             WorkSize(output.shape(0)),
             output.shape(0),
             entries_per_row,
@@ -127,6 +233,22 @@ GPUTensor& transposed_matvecmul(const GPUTensor& matrix, const GPUTensor& vector
     return output;
 }
 
+GPUTensor& transposed_matvecmul(const GPUTensor& matrix, const GPUTensor& vector, GPUTensor& output)
+{
+    Assert(matrix.rank() == 2 && vector.rank() == 1 && output.rank() == 1);
+    Assert(matrix.shape(0) == vector.shape(0));
+    Assert(matrix.shape(1) == output.shape(0));
+
+    // Each thread processes this many elements.
+    size_t num_elements_per_thread = gemv_elements_per_thread("TransposedMatVecMul", matrix, matrix.shape(ROW), [&](size_t n) {
+        GPUTensor scratch(output.shape(), ocl::kScratchBuffer);
+        transposed_matvecmul(matrix, vector, n, scratch);
+        return true;
+    });
+
+    return transposed_matvecmul(matrix, vector, num_elements_per_thread, output);
+}
+
 float vecmul(const GPUTensor& x, const GPUTensor& y)
 {
     Assert(x.rank() == 1);
@@ -138,18 +260,51 @@ float vecmul(const GPUTensor& x, const GPUTensor& y)
     return sum(tmp);
 }
 
-GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor& output)
+// Computes x * y^T into |output|, or adds it to |output| if |accumulate| is set.
+static GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, bool accumulate, GPUTensor& output)
 {
     Assert(x.rank() == 1 && y.rank() == 1 && output.rank() == 2);
     Assert(output.shape(0) == x.shape(0));
     Assert(output.shape(1) == y.shape(0));
 
-    bool success = GPUContext::kernel_manager.kernel(kTransposedVecMulKernel)->Run(
+    bool success = RunTuned(kTransposedVecMulKernel,
             WorkSize(output.shape(0), output.shape(1)),
+            output,
             output.shape(0),
             output.shape(1),
+            accumulate,
             x.gpu_buffer(),
-            y.gpu_buffer(),
+            y.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor& output)
+{
+    return transposed_vecmul(x, y, false, output);
+}
+
+GPUTensor& accumulate_transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor& output)
+{
+    return transposed_vecmul(x, y, true, output);
+}
+
+GPUTensor& accumulate_transposed_matmul(const GPUTensor& a, const GPUTensor& b, size_t num_rows, GPUTensor& output)
+{
+    Assert(a.rank() == 2 && b.rank() == 2 && output.rank() == 2);
+    Assert(num_rows <= a.shape(0) && num_rows <= b.shape(0));
+    Assert(output.shape(0) == a.shape(1) && output.shape(1) == b.shape(1));
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kTransposedMatMulKernel)->Run(
+            WorkSize(output.shape(1), output.shape(0)),
+            WorkSize(kMatMulTileSize, kMatMulTileSize),           // Kernel requires specific work group size
+            num_rows,
+            a.shape(1),
+            b.shape(1),
+            true,
+            a.gpu_buffer(),
+            b.gpu_buffer(),
             output.gpu_buffer());
     Assert(success);
 
@@ -160,11 +315,12 @@ GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor&
 {                                                                                                       \
     Assert(input.shape() == output.shape());                                                            \
                                                                                                         \
-    bool success = GPUContext::kernel_manager.kernel(kernel_name)->Run(                                 \
-            WorkSize(threadcount(input.size())),                                                        \
+    size_t width = vector_width({ &input, &output });                                                   \
+    bool success = RunTuned(elementwise_kernel(kernel_name, width),                                     \
+            WorkSize(threadcount(input.size() / width)),                                                \
+            output,                                                                                     \
             input.size(),                                                                               \
-            input.gpu_buffer(),                                                                         \
-            output.gpu_buffer());                                                                       \
+            input.gpu_buffer());                                                                        \
     Assert(success);                                                                                    \
                                                                                                         \
     return output;                                                                                      \
@@ -176,12 +332,13 @@ GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor&
     Assert(x.shape() == y.shape());                                                                     \
     Assert(y.shape() == output.shape());                                                                \
                                                                                                         \
-    bool success = GPUContext::kernel_manager.kernel(kernel_name)->Run(                                 \
-            WorkSize(threadcount(x.size())),                                                            \
+    size_t width = vector_width({ &x, &y, &output });                                                   \
+    bool success = RunTuned(elementwise_kernel(kernel_name, width),                                     \
+            WorkSize(threadcount(x.size() / width)),                                                    \
+            output,                                                                                     \
             x.size(),                                                                                   \
             x.gpu_buffer(),                                                                             \
-            y.gpu_buffer(),                                                                             \
-            output.gpu_buffer());                                                                       \
+            y.gpu_buffer());                                                                            \
     Assert(success);                                                                                    \
                                                                                                         \
     return output;                                                                                      \
@@ -192,12 +349,13 @@ GPUTensor& transposed_vecmul(const GPUTensor& x, const GPUTensor& y, GPUTensor&
 {                                                                                                       \
     Assert(x.shape() == output.shape());                                                                \
                                                                                                         \
-    bool success = GPUContext::kernel_manager.kernel(kernel_name)->Run(                                 \
-            WorkSize(threadcount(x.size())),                                                            \
+    size_t width = vector_width({ &x, &output });                                                       \
+    bool success = RunTuned(elementwise_kernel(kernel_name, width),                                     \
+            WorkSize(threadcount(x.size() / width)),                                                    \
+            output,                                                                                     \
             x.size(),                                                                                   \
             x.gpu_buffer(),                                                                             \
-            v,                                                                                          \
-            output.gpu_buffer());                                                                       \
+            v);                                                                                         \
     Assert(success);                                                                                    \
                                                                                                         \
     return output;                                                                                      \
@@ -208,13 +366,14 @@ GPUTensor& add(const GPUTensor& x, const GPUTensor& y, float v, GPUTensor& outpu
     Assert(x.shape() == y.shape());
     Assert(y.shape() == output.shape());
 
-    bool success = GPUContext::kernel_manager.kernel(kScaledAddKernel)->Run(
-            WorkSize(threadcount(x.size())),
+    size_t width = vector_width({ &x, &y, &output });
+    bool success = RunTuned(elementwise_kernel(kScaledAddKernel, width),
+            WorkSize(threadcount(x.size() / width)),
+            output,
             x.size(),
             x.gpu_buffer(),
             y.gpu_buffer(),
-            v,
-            output.gpu_buffer());
+            v);
     Assert(success);
 
     return output;
@@ -240,6 +399,202 @@ UNARY_OPERATION(sigmoid_derivative, kSigmoidDerivativeKernel);
 UNARY_OPERATION(relu, kReLUKernel);
 UNARY_OPERATION(relu_derivative, kReLUDerivativeKernel);
 
+// The optimizer updates modify the gradients and the optimizer state in place, so unlike most other kernels they
+// can't be run through RunTuned(): its benchmark runs would apply the update multiple times.
+GPUTensor& sgd_update(GPUTensor& parameters, GPUTensor& gradients, float gradient_scale, float learning_rate)
+{
+    Assert(parameters.shape() == gradients.shape());
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kSGDUpdateKernel)->Run(
+            WorkSize(threadcount(parameters.size())),
+            parameters.size(),
+            gradient_scale,
+            learning_rate,
+            gradients.gpu_buffer(),
+            parameters.gpu_buffer());
+    Assert(success);
+
+    return parameters;
+}
+
+GPUTensor& sgd_update(GPUTensor& parameters, GPUTensor& gradients, GPUTensor& velocity, float gradient_scale, float learning_rate, float momentum)
+{
+    Assert(parameters.shape() == gradients.shape() && parameters.shape() == velocity.shape());
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kMomentumUpdateKernel)->Run(
+            WorkSize(threadcount(parameters.size())),
+            parameters.size(),
+            gradient_scale,
+            learning_rate,
+            momentum,
+            gradients.gpu_buffer(),
+            velocity.gpu_buffer(),
+            parameters.gpu_buffer());
+    Assert(success);
+
+    return parameters;
+}
+
+GPUTensor& rmsprop_update(GPUTensor& parameters, GPUTensor& gradients, GPUTensor& mean_square, float gradient_scale, float learning_rate, float decay, float epsilon)
+{
+    Assert(parameters.shape() == gradients.shape() && parameters.shape() == mean_square.shape());
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kRMSPropUpdateKernel)->Run(
+            WorkSize(threadcount(parameters.size())),
+            parameters.size(),
+            gradient_scale,
+            learning_rate,
+            decay,
+            epsilon,
+            gradients.gpu_buffer(),
+            mean_square.gpu_buffer(),
+            parameters.gpu_buffer());
+    Assert(success);
+
+    return parameters;
+}
+
+GPUTensor& adam_update(GPUTensor& parameters, GPUTensor& gradients, GPUTensor& first_moment, GPUTensor& second_moment, float gradient_scale, float step_size,
+                       float beta1, float beta2, float epsilon)
+{
+    Assert(parameters.shape() == gradients.shape());
+    Assert(parameters.shape() == first_moment.shape() && parameters.shape() == second_moment.shape());
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kAdamUpdateKernel)->Run(
+            WorkSize(threadcount(parameters.size())),
+            parameters.size(),
+            gradient_scale,
+            step_size,
+            beta1,
+            beta2,
+            epsilon,
+            gradients.gpu_buffer(),
+            first_moment.gpu_buffer(),
+            second_moment.gpu_buffer(),
+            parameters.gpu_buffer());
+    Assert(success);
+
+    return parameters;
+}
+
+// Work group size of the softmax kernels, which process a whole vector in a single work group.
+static size_t softmax_work_group_size(size_t size)
+{
+    size_t work_group_size = 1;
+    while (work_group_size < size && work_group_size < kMaxReductionWorkGroupSize)
+        work_group_size *= 2;
+    return work_group_size;
+}
+
+GPUTensor& softmax(const GPUTensor& input, GPUTensor& output)
+{
+    Assert(input.rank() == 1 && input.shape() == output.shape());
+
+    size_t work_group_size = softmax_work_group_size(input.size());
+    bool success = GPUContext::Current()->kernel_manager().kernel(kSoftmaxKernel)->Run(
+            WorkSize(work_group_size),
+            WorkSize(work_group_size),
+            input.size(),
+            input.gpu_buffer(),
+            ocl::LocalMemory(work_group_size * sizeof(float)),
+            ocl::LocalMemory(work_group_size * sizeof(float)),
+            output.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+float softmax_cross_entropy(const GPUTensor& input, const GPUTensor& probabilities, const GPUTensor& label, GPUTensor& gradients)
+{
+    Assert(input.rank() == 1 && input.shape() == label.shape());
+    Assert(input.shape() == probabilities.shape() && input.shape() == gradients.shape());
+
+    GPUTensor loss({1});
+    size_t work_group_size = softmax_work_group_size(input.size());
+    bool success = GPUContext::Current()->kernel_manager().kernel(kSoftmaxCrossEntropyKernel)->Run(
+            WorkSize(work_group_size),
+            WorkSize(work_group_size),
+            input.size(),
+            input.gpu_buffer(),
+            probabilities.gpu_buffer(),
+            label.gpu_buffer(),
+            ocl::LocalMemory(work_group_size * sizeof(float)),
+            ocl::LocalMemory(work_group_size * sizeof(float)),
+            gradients.gpu_buffer(),
+            loss.gpu_buffer());
+    Assert(success);
+
+    return *loss.ToHost().begin();
+}
+
+// Returns the source of the kernel that evaluates the given expression, see fused(). The kernel works like the ones
+// generated by the UNARY_OPERATION and BINARY_OPERATION macros in KernelCommon.h.
+static string fused_kernel_source(const elementwise::Expression& expression, size_t num_arguments, size_t num_scalars)
+{
+    stringstream source;
+    source << "#include \"KernelCommon.h\"\n";
+    source << "#include \"Elementwise.h\"\n\n";
+
+    source << "kernel void Fused(uint size";
+    for (size_t i = 0; i < num_arguments; i++)
+        source << ", global const float* a" << i;
+    for (size_t i = 0; i < num_scalars; i++)
+        source << ", float s" << i;
+    source << ", global float* output)\n";
+
+    source << "{\n";
+    source << "    uint base = get_local_id(0) + (get_global_id(0) - get_local_id(0)) * ITEMS_PER_THREAD;\n";
+    source << "    for (uint i = 0; i < ITEMS_PER_THREAD; i++) {\n";
+    source << "        uint index = base + i * get_local_size(0);\n";
+    source << "        if (index < size)\n";
+    source << "            output[index] = " << expression.ToOpenCL() << ";\n";
+    source << "    }\n";
+    source << "}\n";
+
+    return source.str();
+}
+
+GPUTensor& fused(const elementwise::Expression& expression, const vector<const GPUTensor*>& arguments, GPUTensor& output)
+{
+    Assert(expression.num_arguments() <= arguments.size());
+
+    vector<float> scalars;
+    expression.CollectScalars(&scalars);
+
+    // The kernel only depends on the structure of the expression and the number of arguments. Its source is only
+    // generated if no kernel has been compiled for these yet.
+    string key = to_string(arguments.size()) + ':';
+    expression.AppendSignature(&key);
+    ocl::Kernel* kernel = GPUContext::Current()->kernel_manager().generated_kernel(key, [&]() {
+        return fused_kernel_source(expression, arguments.size(), scalars.size());
+    }, "Fused");
+
+    // The number of arguments depends on the expression, so they are bound one by one.
+    bool success = kernel->BindNextArgument(output.size());
+    for (const GPUTensor* argument : arguments) {
+        Assert(argument->shape() == output.shape());
+        success = success && kernel->BindNextArgument(argument->gpu_buffer());
+    }
+    for (float scalar : scalars)
+        success = success && kernel->BindNextArgument(scalar);
+    success = success && kernel->BindNextArgument(output.gpu_buffer());
+
+    success = success && kernel->Run(WorkSize(threadcount(output.size())));
+    Assert(success);
+
+    return output;
+}
+
+float fused_sum(const elementwise::Expression& expression, const vector<const GPUTensor*>& arguments)
+{
+    Assert(!arguments.empty());
+
+    GPUTensor values(arguments[0]->shape());
+    fused(expression, arguments, values);
+
+    return sum(values);
+}
+
 
 GPUTensor& maxpool(const GPUTensor& input, size_t pooling_width, size_t pooling_height, GPUTensor& output)
 {
@@ -249,8 +604,9 @@ GPUTensor& maxpool(const GPUTensor& input, size_t pooling_width, size_t pooling_
     Assert((input.shape(2) + pooling_width - 1) / pooling_width == output.shape(2));
 
     // One thread per element input the output tensor.
-    bool success = GPUContext::kernel_manager.kernel(kMaxPool2DKernel)->Run(
+    bool success = RunTuned(kMaxPool2DKernel,
             WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            output,
             output.shape(2),
             output.shape(1),
             output.shape(0),
@@ -258,8 +614,7 @@ GPUTensor& maxpool(const GPUTensor& input, size_t pooling_width, size_t pooling_
             input.shape(1),
             pooling_width,
             pooling_height,
-            input.gpu_buffer(),
-            output.gpu_buffer());
+            input.gpu_buffer());
     Assert(success);
 
     return output;
@@ -273,8 +628,9 @@ GPUTensor& maxpool_gradients(const GPUTensor& input, const GPUTensor& gradients,
     Assert((input.shape(2) + pooling_width - 1) / pooling_width == gradients.shape(2));
 
     output.Clear();
-    bool success = GPUContext::kernel_manager.kernel(kMaxPool2DGradientsKernel)->Run(
+    bool success = RunTuned(kMaxPool2DGradientsKernel,
             WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            output,
             gradients.shape(2),
             gradients.shape(1),
             gradients.shape(0),
@@ -283,88 +639,453 @@ GPUTensor& maxpool_gradients(const GPUTensor& input, const GPUTensor& gradients,
             pooling_width,
             pooling_height,
             input.gpu_buffer(),
-            gradients.gpu_buffer(),
-            output.gpu_buffer());
+            gradients.gpu_buffer());
     Assert(success);
 
     return output;
 }
 
+// Sums up chunks of |work_group_size| elements of every row of the 2D tensor |input| into |output|, one work group per
+// chunk. See the ReduceRows kernel.
+static void reduce_row_chunks(const GPUTensor& input, size_t work_group_size, bool accumulate, GPUTensor& output)
+{
+    size_t num_chunks = (input.shape(1) + work_group_size - 1) / work_group_size;
+    Assert(output.size() == input.shape(0) * num_chunks);
+
+    bool success = GPUContext::Current()->kernel_manager().kernel(kReduceRowsKernel)->Run(
+            WorkSize(num_chunks * work_group_size, input.shape(0)),
+            WorkSize(work_group_size, 1),
+            input.shape(1),
+            accumulate,
+            input.gpu_buffer(),
+            ocl::LocalMemory(work_group_size * sizeof(float)),
+            output.gpu_buffer());
+    Assert(success);
+}
+
+// Sums up every row of the 2D tensor |input| into the corresponding element of |output|, which may have any shape.
+// Every work group adds up a chunk of a row by a tree reduction. Rows longer than the maximum work group size are
+// reduced in several passes, each one writing a partial sum per chunk, so the whole reduction is a tree as well.
+static void reduce_rows(const GPUTensor& input, bool accumulate, GPUTensor& output)
+{
+    Assert(input.rank() == 2 && input.shape(0) == output.size());
+
+    // Rows shorter than the maximum work group size get a smaller work group.
+    size_t work_group_size = 1;
+    while (work_group_size < input.shape(1) && work_group_size < kMaxReductionWorkGroupSize)
+        work_group_size *= 2;
+
+    if (input.shape(1) <= work_group_size) {
+        reduce_row_chunks(input, work_group_size, accumulate, output);
+    } else {
+        size_t num_chunks = (input.shape(1) + work_group_size - 1) / work_group_size;
+        GPUTensor partial_sums({input.shape(0), num_chunks}, ocl::kScratchBuffer);
+        reduce_row_chunks(input, work_group_size, false, partial_sums);
+        reduce_rows(partial_sums, accumulate, output);
+    }
+}
+
 GPUTensor& convolution(const GPUTensor& input, const GPUTensor& kernels, GPUTensor& output)
+{
+    return convolution(input, kernels, ConvolutionParameters(), output);
+}
+
+GPUTensor& convolution(const GPUTensor& input, const GPUTensor& kernels, const ConvolutionParameters& parameters, GPUTensor& output)
 {
     Assert(kernels.rank() == 4);
     Assert(input.rank() == 3 && output.rank() == 3);
     Assert(kernels.shape(2) % 2 == 1 && kernels.shape(3) % 2 == 1);
-    Assert(kernels.shape(0) == output.shape(0) && kernels.shape(1) == input.shape(0));
-    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+    Assert(output.shape() == parameters.OutputShape(input.shape(), kernels.shape()));
     Assert(kernels.shape(2) < kMaxConvolutionKernelSize && kernels.shape(3) < kMaxConvolutionKernelSize);
 
-    for (size_t channel = 0; channel < input.shape(0); channel++) {
-        bool success = GPUContext::kernel_manager.convolution_kernel(kernels.shape(3), kernels.shape(2))->Run(
+    size_t kernel_height = kernels.shape(2), kernel_width = kernels.shape(3);
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
+
+    // Strided and dilated convolutions can't use the tiled kernels, see ConvolutionGeneral.cl.
+    if (!parameters.is_contiguous()) {
+        bool success = RunTuned(kConvolution2DGeneralKernel,
                 WorkSize(output.shape(2), output.shape(1), output.shape(0)),
-                WorkSize(16, 16, 1),           // Kernel requires specific work group size
+                output,
+                input.shape(2),
+                input.shape(1),
                 output.shape(2),
                 output.shape(1),
-                channel,
+                kernel_width,
+                kernel_height,
+                parameters.stride,
+                parameters.dilation,
+                pad_x,
+                pad_y,
+                input.shape(0),
+                output.shape(0),
+                input.gpu_buffer(),
+                kernels.gpu_buffer());
+        Assert(success);
+        return output;
+    }
+
+    KernelManager& kernel_manager = GPUContext::Current()->kernel_manager();
+    size_t feature_maps_per_thread = kernel_manager.convolution_feature_maps_per_thread();
+    size_t pixels_per_thread = kernel_manager.convolution_pixels_per_thread();
+
+    // The register blocked kernel reuses each loaded input value for several feature maps, but it can
+    // only be used if the number of feature maps is a multiple of the number of feature maps per thread.
+    if (output.shape(0) % feature_maps_per_thread == 0) {
+        bool success = kernel_manager.convolution_blocked_kernel(kernel_width, kernel_height)->Run(
+                WorkSize((output.shape(2) + pixels_per_thread - 1) / pixels_per_thread, output.shape(1), output.shape(0) / feature_maps_per_thread),
+                WorkSize(kConvolutionTileWidth / pixels_per_thread, kConvolutionTileHeight, 1),
+                input.shape(2),
+                input.shape(1),
+                output.shape(2),
+                output.shape(1),
+                pad_x,
+                pad_y,
                 input.shape(0),
                 input.gpu_buffer(),
                 kernels.gpu_buffer(),
                 output.gpu_buffer());
         Assert(success);
+        return output;
     }
 
+    // A single launch processes all input channels.
+    bool success = kernel_manager.convolution_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),           // Kernel requires specific work group size
+            input.shape(2),
+            input.shape(1),
+            output.shape(2),
+            output.shape(1),
+            pad_x,
+            pad_y,
+            input.shape(0),
+            input.gpu_buffer(),
+            kernels.gpu_buffer(),
+            output.gpu_buffer());
+    Assert(success);
+
     return output;
 }
 
 GPUTensor& cross_correlation(const GPUTensor& input, const GPUTensor& kernels, GPUTensor& output)
+{
+    return cross_correlation(input, kernels, ConvolutionParameters(), output);
+}
+
+GPUTensor& cross_correlation(const GPUTensor& input, const GPUTensor& kernels, const ConvolutionParameters& parameters, GPUTensor& output)
 {
     Assert(kernels.rank() == 4);
     Assert(input.rank() == 3 && output.rank() == 3);
     Assert(kernels.shape(2) % 2 == 1 && kernels.shape(3) % 2 == 1);
-    Assert(kernels.shape(0) == input.shape(0) && kernels.shape(1) == output.shape(0));
-    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+    Assert(input.shape() == parameters.OutputShape(output.shape(), kernels.shape()));
     Assert(kernels.shape(2) < kMaxConvolutionKernelSize && kernels.shape(3) < kMaxConvolutionKernelSize);
 
-    for (size_t channel = 0; channel < input.shape(0); channel++) {
-        bool success = GPUContext::kernel_manager.cross_correlation_kernel(kernels.shape(3), kernels.shape(2))->Run(
+    size_t kernel_height = kernels.shape(2), kernel_width = kernels.shape(3);
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
+
+    if (!parameters.is_contiguous()) {
+        // The general kernel takes the dimensions of the forward convolution, whose input is our output.
+        bool success = RunTuned(kCrossCorrelation2DGeneralKernel,
                 WorkSize(output.shape(2), output.shape(1), output.shape(0)),
-                WorkSize(16, 16, 1),
+                output,
                 output.shape(2),
                 output.shape(1),
-                channel,
+                input.shape(2),
+                input.shape(1),
+                kernel_width,
+                kernel_height,
+                parameters.stride,
+                parameters.dilation,
+                pad_x,
+                pad_y,
                 output.shape(0),
+                input.shape(0),
                 input.gpu_buffer(),
-                kernels.gpu_buffer(),
-                output.gpu_buffer());
+                kernels.gpu_buffer());
         Assert(success);
+        return output;
     }
 
+    // Pad the input such that the kernel covers every output element that an input element contributed to.
+    bool success = GPUContext::Current()->kernel_manager().cross_correlation_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),
+            input.shape(2),
+            input.shape(1),
+            output.shape(2),
+            output.shape(1),
+            static_cast<int>(kernel_width) - 1 - pad_x,
+            static_cast<int>(kernel_height) - 1 - pad_y,
+            input.shape(0),
+            output.shape(0),
+            input.gpu_buffer(),
+            kernels.gpu_buffer(),
+            output.gpu_buffer());
+    Assert(success);
+
     return output;
 }
 
+void prepare_convolution(const GPUTensor& kernels)
+{
+    Assert(kernels.rank() == 4);
+    GPUContext::Current()->kernel_manager().PrepareConvolutionKernels(kernels.shape(3), kernels.shape(2));
+}
+
 GPUTensor& convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, GPUTensor& kernels)
+{
+    return convolution_kernel_gradients(input, gradients, ConvolutionParameters(), kernels);
+}
+
+// Computes the kernel gradients into |kernels|, or adds them to |kernels| if |accumulate| is set.
+static GPUTensor& convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, const ConvolutionParameters& parameters,
+                                               bool accumulate, GPUTensor& kernels)
 {
     Assert(kernels.rank() == 4);
     Assert(input.rank() == 3 && gradients.rank() == 3);
     Assert(kernels.shape(2) % 2 == 1 && kernels.shape(3) % 2 == 1);
-    Assert(kernels.shape(0) == gradients.shape(0) && kernels.shape(1) == input.shape(0));
-    Assert(input.shape().ElementShape() == gradients.shape().ElementShape());
+    Assert(gradients.shape() == parameters.OutputShape(input.shape(), kernels.shape()));
     Assert(kernels.shape(2) < kMaxConvolutionKernelSize && kernels.shape(3) < kMaxConvolutionKernelSize);
 
-    size_t kernel_size = kernels.shape(2) * kernels.shape(3);
+    size_t kernel_height = kernels.shape(2), kernel_width = kernels.shape(3);
+    size_t kernel_size = kernel_width * kernel_height;
+    int pad_y = parameters.PaddingFor(kernel_height), pad_x = parameters.PaddingFor(kernel_width);
 
-    bool success = GPUContext::kernel_manager.convolution_gradient_kernel(kernels.shape(3), kernels.shape(2))->Run(
-            WorkSize(kernel_size, input.shape(0), gradients.shape(0)),
-            WorkSize(kernel_size, 1, 1),
+    if (!parameters.is_contiguous()) {
+        bool success = RunTuned(kConvolution2DGradientsGeneralKernel,
+                WorkSize(kernel_size, input.shape(0), gradients.shape(0)),
+                kernels,
+                input.shape(2),
+                input.shape(1),
+                gradients.shape(2),
+                gradients.shape(1),
+                kernel_width,
+                kernel_height,
+                parameters.stride,
+                parameters.dilation,
+                pad_x,
+                pad_y,
+                input.shape(0),
+                gradients.shape(0),
+                accumulate,
+                input.gpu_buffer(),
+                gradients.gpu_buffer());
+        Assert(success);
+        return kernels;
+    }
+
+    // Two passes: every work group computes the partial sums of one block of the output, then these are reduced.
+    size_t num_blocks = ((gradients.shape(2) + kConvolutionTileWidth - 1) / kConvolutionTileWidth) *
+                        ((gradients.shape(1) + kConvolutionTileHeight - 1) / kConvolutionTileHeight);
+    GPUTensor partial_sums({kernels.size(), num_blocks}, ocl::kScratchBuffer);
+
+    bool success = GPUContext::Current()->kernel_manager().convolution_gradient_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(gradients.shape(2), gradients.shape(1), gradients.shape(0) * input.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),           // Kernel requires specific work group size
             input.shape(2),
             input.shape(1),
+            gradients.shape(2),
+            gradients.shape(1),
+            pad_x,
+            pad_y,
             input.shape(0),
             input.gpu_buffer(),
             gradients.gpu_buffer(),
-            kernels.gpu_buffer());
+            partial_sums.gpu_buffer());
+    Assert(success);
+
+    reduce_rows(partial_sums, accumulate, kernels);
+
+    return kernels;
+}
+
+GPUTensor& convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, const ConvolutionParameters& parameters, GPUTensor& kernels)
+{
+    return convolution_kernel_gradients(input, gradients, parameters, false, kernels);
+}
+
+GPUTensor& accumulate_convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, const ConvolutionParameters& parameters, GPUTensor& kernels)
+{
+    return convolution_kernel_gradients(input, gradients, parameters, true, kernels);
+}
+
+GPUTensor& depthwise_convolution(const GPUTensor& input, const GPUTensor& kernels, GPUTensor& output)
+{
+    Assert(kernels.rank() == 3);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(kernels.shape(1) % 2 == 1 && kernels.shape(2) % 2 == 1);
+    Assert(input.shape() == output.shape() && kernels.shape(0) == input.shape(0));
+    Assert(kernels.shape(1) < kMaxConvolutionKernelSize && kernels.shape(2) < kMaxConvolutionKernelSize);
+
+    size_t kernel_height = kernels.shape(1), kernel_width = kernels.shape(2);
+
+    bool success = GPUContext::Current()->kernel_manager().depthwise_convolution_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),           // Kernel requires specific work group size
+            input.shape(2),
+            input.shape(1),
+            static_cast<int>(kernel_width / 2),
+            static_cast<int>(kernel_height / 2),
+            input.gpu_buffer(),
+            kernels.gpu_buffer(),
+            output.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+GPUTensor& depthwise_cross_correlation(const GPUTensor& input, const GPUTensor& kernels, GPUTensor& output)
+{
+    Assert(kernels.rank() == 3);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(kernels.shape(1) % 2 == 1 && kernels.shape(2) % 2 == 1);
+    Assert(input.shape() == output.shape() && kernels.shape(0) == input.shape(0));
+    Assert(kernels.shape(1) < kMaxConvolutionKernelSize && kernels.shape(2) < kMaxConvolutionKernelSize);
+
+    size_t kernel_height = kernels.shape(1), kernel_width = kernels.shape(2);
+
+    // For odd kernel sizes, the padding of the cross-correlation equals the padding of the convolution.
+    bool success = GPUContext::Current()->kernel_manager().depthwise_cross_correlation_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(output.shape(2), output.shape(1), output.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),
+            input.shape(2),
+            input.shape(1),
+            static_cast<int>(kernel_width / 2),
+            static_cast<int>(kernel_height / 2),
+            input.gpu_buffer(),
+            kernels.gpu_buffer(),
+            output.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+// Computes the kernel gradients into |kernels|, or adds them to |kernels| if |accumulate| is set.
+static GPUTensor& depthwise_convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, bool accumulate, GPUTensor& kernels)
+{
+    Assert(kernels.rank() == 3);
+    Assert(input.rank() == 3 && gradients.rank() == 3);
+    Assert(kernels.shape(1) % 2 == 1 && kernels.shape(2) % 2 == 1);
+    Assert(input.shape() == gradients.shape() && kernels.shape(0) == input.shape(0));
+    Assert(kernels.shape(1) < kMaxConvolutionKernelSize && kernels.shape(2) < kMaxConvolutionKernelSize);
+
+    size_t kernel_height = kernels.shape(1), kernel_width = kernels.shape(2);
+
+    // Same two passes as for the regular convolution.
+    size_t num_blocks = ((input.shape(2) + kConvolutionTileWidth - 1) / kConvolutionTileWidth) *
+                        ((input.shape(1) + kConvolutionTileHeight - 1) / kConvolutionTileHeight);
+    GPUTensor partial_sums({kernels.size(), num_blocks}, ocl::kScratchBuffer);
+
+    bool success = GPUContext::Current()->kernel_manager().depthwise_convolution_gradient_kernel(kernel_width, kernel_height)->Run(
+            WorkSize(input.shape(2), input.shape(1), input.shape(0)),
+            WorkSize(kConvolutionTileWidth, kConvolutionTileHeight, 1),           // Kernel requires specific work group size
+            input.shape(2),
+            input.shape(1),
+            static_cast<int>(kernel_width / 2),
+            static_cast<int>(kernel_height / 2),
+            input.gpu_buffer(),
+            gradients.gpu_buffer(),
+            partial_sums.gpu_buffer());
     Assert(success);
 
+    reduce_rows(partial_sums, accumulate, kernels);
+
     return kernels;
 }
 
+GPUTensor& depthwise_convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, GPUTensor& kernels)
+{
+    return depthwise_convolution_kernel_gradients(input, gradients, false, kernels);
+}
+
+GPUTensor& accumulate_depthwise_convolution_kernel_gradients(const GPUTensor& input, const GPUTensor& gradients, GPUTensor& kernels)
+{
+    return depthwise_convolution_kernel_gradients(input, gradients, true, kernels);
+}
+
+void prepare_depthwise_convolution(const GPUTensor& kernels)
+{
+    Assert(kernels.rank() == 3);
+    // The depthwise kernels are part of the convolution program for the same kernel size.
+    GPUContext::Current()->kernel_manager().PrepareConvolutionKernels(kernels.shape(2), kernels.shape(1));
+}
+
+GPUTensor& pointwise_convolution(const GPUTensor& input, const GPUTensor& weights, GPUTensor& output)
+{
+    Assert(weights.rank() == 2);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(weights.shape(0) == output.shape(0) && weights.shape(1) == input.shape(0));
+    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+
+    bool success = RunTuned(kPointwiseConvolutionKernel,
+            WorkSize(num_pixels, output.shape(0)),
+            output,
+            num_pixels,
+            input.shape(0),
+            output.shape(0),
+            input.gpu_buffer(),
+            weights.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+GPUTensor& pointwise_cross_correlation(const GPUTensor& input, const GPUTensor& weights, GPUTensor& output)
+{
+    Assert(weights.rank() == 2);
+    Assert(input.rank() == 3 && output.rank() == 3);
+    Assert(weights.shape(0) == input.shape(0) && weights.shape(1) == output.shape(0));
+    Assert(input.shape().ElementShape() == output.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+
+    bool success = RunTuned(kPointwiseCrossCorrelationKernel,
+            WorkSize(num_pixels, output.shape(0)),
+            output,
+            num_pixels,
+            output.shape(0),
+            input.shape(0),
+            input.gpu_buffer(),
+            weights.gpu_buffer());
+    Assert(success);
+
+    return output;
+}
+
+// Computes the weight gradients into |weights|, or adds them to |weights| if |accumulate| is set.
+static GPUTensor& pointwise_convolution_weight_gradients(const GPUTensor& input, const GPUTensor& gradients, bool accumulate, GPUTensor& weights)
+{
+    Assert(weights.rank() == 2);
+    Assert(input.rank() == 3 && gradients.rank() == 3);
+    Assert(weights.shape(0) == gradients.shape(0) && weights.shape(1) == input.shape(0));
+    Assert(input.shape().ElementShape() == gradients.shape().ElementShape());
+
+    size_t num_pixels = input.shape(1) * input.shape(2);
+
+    bool success = RunTuned(kPointwiseConvolutionGradientsKernel,
+            WorkSize(weights.shape(1), weights.shape(0)),
+            weights,
+            num_pixels,
+            input.shape(0),
+            gradients.shape(0),
+            accumulate,
+            input.gpu_buffer(),
+            gradients.gpu_buffer());
+    Assert(success);
+
+    return weights;
+}
+
+GPUTensor& pointwise_convolution_weight_gradients(const GPUTensor& input, const GPUTensor& gradients, GPUTensor& weights)
+{
+    return pointwise_convolution_weight_gradients(input, gradients, false, weights);
+}
+
+GPUTensor& accumulate_pointwise_convolution_weight_gradients(const GPUTensor& input, const GPUTensor& gradients, GPUTensor& weights)
+{
+    return pointwise_convolution_weight_gradients(input, gradients, true, weights);
+}
+
 }       // namespace nn
@@ -43,6 +43,14 @@ float vecmul(const Tensor& x, const Tensor& y);
 // Transposed vector-vector multiplication. Yields a matrix of shape (x.shape(0), y.shape(0)).
 Tensor& transposed_vecmul(const Tensor& x, const Tensor& y, Tensor& output);
 
+// Same as above, but adds the result to |output| (a rank-1 update, GER in BLAS terms). Used to accumulate weight gradients.
+Tensor& accumulate_transposed_vecmul(const Tensor& x, const Tensor& y, Tensor& output);
+
+// Matrix-matrix multiplication with the first matrix transposed, output += a^T * b, using only the first |num_rows| rows
+// of a and b. With the inputs and output gradients of a mini-batch stored row by row, this yields the sum of their
+// transposed vector-vector products, i.e. the weight gradients of the whole mini-batch.
+Tensor& accumulate_transposed_matmul(const Tensor& a, const Tensor& b, size_t num_rows, Tensor& output);
+
 
 //
 // Pooling
@@ -64,6 +72,10 @@ Tensor& maxpool_gradients(const Tensor& input, const Tensor& gradients, size_t p
 // The kernel tensor must be a 4D tensor: (num_features, num_channels, kernel_height, kernel_width).
 Tensor& convolution(const Tensor& input, const Tensor& kernels, Tensor& output);
 
+// Same as above, with the given stride, padding and dilation (see ConvolutionParameters.h).
+// The output shape must be parameters.OutputShape(input.shape(), kernels.shape()).
+Tensor& convolution(const Tensor& input, const Tensor& kernels, const ConvolutionParameters& parameters, Tensor& output);
+
 // 2D Cross-correlation, a convolution without mirroring the kernel.
 //
 // The input tensor is a tensor of shape (num_features, height, width), the output
@@ -75,9 +87,71 @@ Tensor& convolution(const Tensor& input, const Tensor& kernels, Tensor& output);
 // to a cross-correlation, thus the change in the first index of input and output tensor.
 Tensor& cross_correlation(const Tensor& input, const Tensor& kernels, Tensor& output);
 
+// Same as above for a convolution with the given parameters: computes the gradients wrt the input of
+// convolution(..., parameters, ...) from the gradients wrt its output. |input| has the shape of the
+// convolution's output, |output| the shape of the convolution's input.
+Tensor& cross_correlation(const Tensor& input, const Tensor& kernels, const ConvolutionParameters& parameters, Tensor& output);
+
 // Gradient calculation for the weights of a 4D convolution kernel: (num_features, num_channels, kernel_height, kernel_width).
 Tensor& convolution_kernel_gradients(const Tensor& input, const Tensor& gradients, Tensor& output);
 
+// Same as above for a convolution with the given parameters. |gradients| has the shape of the convolution's output.
+Tensor& convolution_kernel_gradients(const Tensor& input, const Tensor& gradients, const ConvolutionParameters& parameters, Tensor& output);
+
+// Same as above, but adds the gradients to |output|. Used to accumulate the kernel gradients of a mini-batch.
+Tensor& accumulate_convolution_kernel_gradients(const Tensor& input, const Tensor& gradients, const ConvolutionParameters& parameters, Tensor& output);
+
+// Starts preparing the above operations for the given 4D kernel tensor in the background,
+// e.g. by compiling the required device code. The kernel values are not used.
+void prepare_convolution(const Tensor& kernels);
+
+// Depthwise 2D convolution with zero padding at the borders: every channel of the input is convolved with its own kernel.
+//
+// Input and output are tensors of shape (num_channels, height, width).
+// The kernel tensor must be a 3D tensor: (num_channels, kernel_height, kernel_width).
+Tensor& depthwise_convolution(const Tensor& input, const Tensor& kernels, Tensor& output);
+
+// Computes the gradients wrt the input of depthwise_convolution() from the gradients wrt its output.
+Tensor& depthwise_cross_correlation(const Tensor& input, const Tensor& kernels, Tensor& output);
+
+// Gradient calculation for the weights of a 3D depthwise convolution kernel: (num_channels, kernel_height, kernel_width).
+Tensor& depthwise_convolution_kernel_gradients(const Tensor& input, const Tensor& gradients, Tensor& output);
+
+// Same as above, but adds the gradients to |output|.
+Tensor& accumulate_depthwise_convolution_kernel_gradients(const Tensor& input, const Tensor& gradients, Tensor& output);
+
+// Same as prepare_convolution() for the given 3D depthwise kernel tensor.
+void prepare_depthwise_convolution(const Tensor& kernels);
+
+// Pointwise (1x1) convolution: every output pixel is a linear combination of the channels of the input pixel.
+//
+// The input tensor is a tensor of shape (num_channels, height, width), the output
+// is a tensor of shape (num_features, height, width).
+// The weight tensor must be a 2D tensor: (num_features, num_channels).
+Tensor& pointwise_convolution(const Tensor& input, const Tensor& weights, Tensor& output);
+
+// Computes the gradients wrt the input of pointwise_convolution() from the gradients wrt its output.
+// As for cross_correlation(), the input is of shape (num_features, height, width) and the output of shape (num_channels, height, width).
+Tensor& pointwise_cross_correlation(const Tensor& input, const Tensor& weights, Tensor& output);
+
+// Gradient calculation for the weights of a pointwise convolution: (num_features, num_channels).
+Tensor& pointwise_convolution_weight_gradients(const Tensor& input, const Tensor& gradients, Tensor& output);
+
+// Same as above, but adds the gradients to |output|.
+Tensor& accumulate_pointwise_convolution_weight_gradients(const Tensor& input, const Tensor& gradients, Tensor& output);
+
+
+//
+// Fused elementwise operations
+//
+// output = expression, evaluated for every element. elementwise::Argument(i) refers to the elements of
+// arguments[i], which must all have the shape of the output. The output may be one of the arguments.
+// See Elementwise.h.
+Tensor& fused(const elementwise::Expression& expression, const std::vector<const Tensor*>& arguments, Tensor& output);
+
+// Returns the sum of the expression over all elements of the arguments.
+float fused_sum(const elementwise::Expression& expression, const std::vector<const Tensor*>& arguments);
+
 
 //
 // Elementwise operations
@@ -127,6 +201,38 @@ Tensor& relu(const Tensor& input, Tensor& output);
 // Derivative of the relu function
 Tensor& relu_derivative(const Tensor& input, Tensor& output);
 
+// Softmax function, output = exp(input) / sum(exp(input)). Computed in a numerically stable way, i.e. this does
+// not overflow for large inputs. |input| and |output| must be vectors.
+Tensor& softmax(const Tensor& input, Tensor& output);
+
+// Cross-entropy wrt |label| of a softmax, given its |input| and its output |probabilities| = softmax(input), e.g. from
+// the forward pass. Stores the gradients of the loss wrt |input| in |gradients| and returns the loss
+// -sum(label * log(softmax(input))). The softmax isn't computed again, and the loss is numerically stable even
+// if some of the probabilities are rounded to zero.
+float softmax_cross_entropy(const Tensor& input, const Tensor& probabilities, const Tensor& label, Tensor& gradients);
+
+
+//
+// Optimizer updates, see nn/optimizers/
+//
+// Each of these performs one optimization step for a parameter tensor in a single pass: the gradients are scaled by
+// |gradient_scale| (usually 1 / batch_size), the optimizer state and the parameters are updated and the gradients
+// are reset to zero.
+//
+// parameters -= learning_rate * g
+Tensor& sgd_update(Tensor& parameters, Tensor& gradients, float gradient_scale, float learning_rate);
+
+// velocity = momentum * velocity - learning_rate * g, parameters += velocity
+Tensor& sgd_update(Tensor& parameters, Tensor& gradients, Tensor& velocity, float gradient_scale, float learning_rate, float momentum);
+
+// mean_square = decay * mean_square + (1 - decay) * g^2, parameters -= learning_rate * g / (sqrt(mean_square) + epsilon)
+Tensor& rmsprop_update(Tensor& parameters, Tensor& gradients, Tensor& mean_square, float gradient_scale, float learning_rate, float decay, float epsilon);
+
+// first_moment = beta1 * first_moment + (1 - beta1) * g, second_moment = beta2 * second_moment + (1 - beta2) * g^2,
+// parameters -= step_size * first_moment / (sqrt(second_moment) + epsilon)
+Tensor& adam_update(Tensor& parameters, Tensor& gradients, Tensor& first_moment, Tensor& second_moment, float gradient_scale, float step_size,
+                    float beta1, float beta2, float epsilon);
+
 
 //
 // Miscellaneous operations
@@ -1,19 +1,43 @@
 #include "Buffer.h"
+#include "BufferPool.h"
+#include "CommandGraph.h"
 
 using namespace std;
 
 namespace ocl {
 
-CLBuffer::CLBuffer(cl_command_queue command_queue, cl_mem buffer, size_t size) : Buffer(size), command_queue_(command_queue), buffer_(buffer)
+uint8_t* ZeroChunk()
+{
+    static uint8_t zeroes[kClearChunkSize];
+    return zeroes;
+}
+
+CLBuffer::CLBuffer(cl_command_queue command_queue, cl_mem buffer, size_t size, Profiler* profiler) :
+    Buffer(size),
+    command_queue_(command_queue),
+    profiler_(profiler),
+    event_(nullptr),
+    buffer_(buffer)
+{
+    CL_Check(clRetainCommandQueue(command_queue_));
+}
+
+CLBuffer::CLBuffer(cl_command_queue command_queue, shared_ptr<PooledBuffer> pooled_buffer, size_t size, Profiler* profiler) :
+    Buffer(size),
+    command_queue_(command_queue),
+    profiler_(profiler),
+    event_(nullptr),
+    buffer_(pooled_buffer->buffer()),
+    pooled_buffer_(pooled_buffer)
 {
     CL_Check(clRetainCommandQueue(command_queue_));
 }
 
 CLBuffer::~CLBuffer()
 {
-    if (buffer_) {
+    // Pooled buffers go back to the pool once the last view onto them is gone as well.
+    if (buffer_ && !pooled_buffer_)
         clReleaseMemObject(buffer_);
-    }
     if (command_queue_) {
         clReleaseCommandQueue(command_queue_);
     }
@@ -22,14 +46,16 @@ CLBuffer::~CLBuffer()
 bool CLBuffer::Read(uint8_t* buffer, size_t nbytes, std::size_t offset, bool blocking)
 {
     Assert(offset + nbytes <= size());
-    CL_ENSURE_SUCCESS(clEnqueueReadBuffer(command_queue_, buffer_, blocking, offset, nbytes, buffer, 0, nullptr, nullptr), "Error reading data from device", false);
+    CL_ENSURE_SUCCESS(clEnqueueReadBuffer(command_queue_, buffer_, blocking, offset, nbytes, buffer, 0, nullptr, ProfilingEvent()), "Error reading data from device", false);
+    RecordEvent(kDeviceToHost);
     return true;
 }
 
 bool CLBuffer::Write(uint8_t* buffer, size_t nbytes, std::size_t offset, bool blocking)
 {
     Assert(offset + nbytes <= size());
-    CL_ENSURE_SUCCESS(clEnqueueWriteBuffer(command_queue_, buffer_, blocking, offset, nbytes, buffer, 0, nullptr, nullptr), "Error writing data to device", false);
+    CL_ENSURE_SUCCESS(clEnqueueWriteBuffer(command_queue_, buffer_, blocking, offset, nbytes, buffer, 0, nullptr, ProfilingEvent()), "Error writing data to device", false);
+    RecordEvent(kHostToDevice);
     return true;
 }
 
@@ -40,16 +66,45 @@ void CLBuffer::Clear(size_t offset, size_t length)
     //uint8_t zero = 0;
     //CL_ENSURE_SUCCESS(clEnqueueFillBuffer(command_queue_, buffer_, &zero, 1, offset, length, 0, nullptr, nullptr), "Error clearing buffer", );
 
-    static uint8_t zeroes[1024*1024];
+    if (CommandGraph* graph = CommandGraph::Capturing(command_queue_))
+        graph->AddClear(buffer_, offset, length);
+
     size_t i = 0;
     while (length) {
-        size_t to_write = std::min(length, (size_t)1024*1024);
-        Write(zeroes, to_write, offset + i, false);
+        size_t to_write = std::min(length, kClearChunkSize);
+        Write(ZeroChunk(), to_write, offset + i, false);
         length -= to_write;
         i += to_write;
     }
 }
 
+bool CLBuffer::Copy(Buffer* destination, size_t nbytes, std::size_t offset, std::size_t dest_offset)
+{
+    Assert(offset + nbytes <= size());
+    Assert(dest_offset + nbytes <= destination->size());
+    CL_ENSURE_SUCCESS(clEnqueueCopyBuffer(command_queue_, buffer_, destination->cl_buffer(), offset, dest_offset, nbytes, 0, nullptr, ProfilingEvent()), "Error copying buffer on device", false);
+    RecordEvent(kDeviceToDevice);
+
+    if (CommandGraph* graph = CommandGraph::Capturing(command_queue_))
+        graph->AddCopy(buffer_, destination->cl_buffer(), nbytes, offset, dest_offset);
+    return true;
+}
+
+void CLBuffer::DetachFromPool()
+{
+    if (pooled_buffer_)
+        pooled_buffer_->Detach();
+}
+
+void CLBuffer::RecordEvent(const char* name)
+{
+    if (profiler_) {
+        profiler_->Record(name, event_);
+        clReleaseEvent(event_);
+        event_ = nullptr;
+    }
+}
+
 unique_ptr<Buffer> CLBuffer::NewView(size_t offset, size_t size)
 {
     Assert(offset + size <= this->size());
@@ -59,14 +114,21 @@ unique_ptr<Buffer> CLBuffer::NewView(size_t offset, size_t size)
     cl_mem sub_buffer =clCreateSubBuffer(buffer_, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &retval);
     CL_ENSURE_SUCCESS(retval, "Failed to create sub-buffer", nullptr);
 
-    return unique_ptr<Buffer>(new CLBufferView(command_queue_, sub_buffer, buffer_, size, offset));
+    return unique_ptr<Buffer>(new CLBufferView(command_queue_, sub_buffer, buffer_, pooled_buffer_, size, offset, profiler_));
 }
 
-CLBufferView::CLBufferView(cl_command_queue command_queue, cl_mem buffer, cl_mem base_buffer, size_t size, size_t offset) :
-    CLBuffer(command_queue, buffer, size),
+CLBufferView::CLBufferView(cl_command_queue command_queue, cl_mem buffer, cl_mem base_buffer, shared_ptr<PooledBuffer> pooled_base, size_t size, size_t offset, Profiler* profiler) :
+    CLBuffer(command_queue, buffer, size, profiler),
     base_(base_buffer),
+    pooled_base_(pooled_base),
     offset_(offset) { }
 
+void CLBufferView::DetachFromPool()
+{
+    if (pooled_base_)
+        pooled_base_->Detach();
+}
+
 unique_ptr<Buffer> CLBufferView::NewView(size_t offset, size_t size)
 {
     Assert(offset + size <= this->size());
@@ -76,7 +138,7 @@ unique_ptr<Buffer> CLBufferView::NewView(size_t offset, size_t size)
     cl_mem sub_buffer =clCreateSubBuffer(base_, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &retval);
     CL_ENSURE_SUCCESS(retval, "Failed to create sub-buffer", nullptr);
 
-    return unique_ptr<Buffer>(new CLBufferView(command_queue_, sub_buffer, base_, size, offset));
+    return unique_ptr<Buffer>(new CLBufferView(command_queue_, sub_buffer, base_, pooled_base_, size, offset + offset_, profiler_));
 }
 
 }       // namespace ocl
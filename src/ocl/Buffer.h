@@ -9,11 +9,20 @@
 
 #include <memory>
 
+#include "Profiler.h"
 #include "Utils.h"
 
 namespace ocl {
 
 class BufferView;
+class PooledBuffer;
+
+// Buffers are cleared by writing chunks of zeroes from host memory, see CLBuffer::Clear().
+constexpr size_t kClearChunkSize = 1024 * 1024;
+
+// Returns kClearChunkSize bytes of zeroes. The memory stays valid for the lifetime of the process, so it can be the
+// source of non-blocking writes.
+uint8_t* ZeroChunk();
 
 // Abstract class to represent an OpenCL buffer.
 class Buffer {
@@ -31,6 +40,11 @@ class Buffer {
     // Clears all bytes in the range [offset, offset + length).
     virtual void Clear(size_t offset, size_t length) = 0;
 
+    // Copies |nbytes| bytes starting at |offset| into the destination buffer at |dest_offset|.
+    //
+    // The copy is performed on the device, the data never travels through host memory.
+    virtual bool Copy(Buffer* destination, size_t nbytes, std::size_t offset, std::size_t dest_offset) = 0;
+
     // Creates a new view onto this buffer. A view shares the same underlying
     // memory with the original buffer.
     virtual std::unique_ptr<Buffer> NewView(size_t offset, size_t size) = 0;
@@ -41,9 +55,15 @@ class Buffer {
     // Clears the whole buffer.
     void Clear() { Clear(0, size_); }
 
+    // Copies the content of this buffer into the destination buffer, which must be at least as large as this buffer.
+    bool CopyInto(Buffer* destination) { return Copy(destination, size_, 0, 0); }
+
     // Returns the size of this buffer in bytes.
     size_t size() const { return size_; }
 
+    // Returns the offset (in bytes) of this buffer into the underlying device allocation. Non-zero only for views.
+    virtual size_t offset() const { return 0; }
+
     // Reads the specified number of elements from this device buffer into a newly allocated host buffer.
     //
     // Returns nullptr upon failure.
@@ -94,11 +114,18 @@ class Buffer {
     // Returns the OpenCL handle to the underlying buffer.
     virtual cl_mem cl_buffer() const = 0;
 
+    // Makes sure the underlying memory isn't handed out by a buffer pool again. Called when the buffer is mapped.
+    virtual void DetachFromPool() { }
+
     // Size of this buffer in bytes.
     size_t size_;
 
     // class Kernel is a friend class so it can access the OpenCL buffer handle.
     friend class Kernel;
+    // class Device is a friend class so it can perform staged transfers on the OpenCL buffer handle.
+    friend class Device;
+    // class CLBuffer is a friend class so it can obtain the handle of the destination buffer in Copy().
+    friend class CLBuffer;
     // class BufferView is a friend class so it can call cl_buffer() on the underlying buffer.
     friend class BufferView;
 };
@@ -107,7 +134,12 @@ class Buffer {
 // Standard Buffer implementation based on OpenCL buffers.
 class CLBuffer : public Buffer {
   public:
-    CLBuffer(cl_command_queue command_queue, cl_mem buffer, size_t size);
+    // If |profiler| is not null, all transfers to and from the buffer are recorded by it.
+    CLBuffer(cl_command_queue command_queue, cl_mem buffer, size_t size, Profiler* profiler);
+
+    // Creates a buffer that was obtained from a pool. Once this instance and all views onto it
+    // have been destroyed, the OpenCL buffer will be handed back to the pool instead of being released.
+    CLBuffer(cl_command_queue command_queue, std::shared_ptr<PooledBuffer> pooled_buffer, size_t size, Profiler* profiler);
 
     virtual ~CLBuffer();
 
@@ -117,6 +149,8 @@ class CLBuffer : public Buffer {
 
     virtual void Clear(size_t offset, size_t length) override;
 
+    virtual bool Copy(Buffer* destination, size_t nbytes, std::size_t offset, std::size_t dest_offset) override;
+
     virtual std::unique_ptr<Buffer> NewView(size_t offset, size_t size) override;
 
   protected:
@@ -124,12 +158,28 @@ class CLBuffer : public Buffer {
     // Will be retained (to increase its refcount) upon construction and released upon destruction.
     cl_command_queue    command_queue_;
 
+    // Profiler for transfers, may be null. Not owned by this instance.
+    Profiler* profiler_;
+
+    // Returns a pointer to an event for the next command if profiling is enabled, else nullptr.
+    cl_event* ProfilingEvent() { return profiler_ ? &event_ : nullptr; }
+
+    // Records the command started with ProfilingEvent() under the given name.
+    void RecordEvent(const char* name);
+
   private:
+    // Event of the last profiled command.
+    cl_event event_;
+
     virtual cl_mem cl_buffer() const override { return buffer_; }
 
+    virtual void DetachFromPool() override;
+
     // Handle to the underlying OpenCL buffer.
     cl_mem buffer_;
 
+    // Pooled buffer that buffer_ belongs to, nullptr if the buffer is owned by this instance.
+    std::shared_ptr<PooledBuffer> pooled_buffer_;
 
     DISALLOW_COPY_AND_ASSIGN(CLBuffer);
 };
@@ -140,15 +190,23 @@ class CLBuffer : public Buffer {
 //
 class CLBufferView : public CLBuffer {
   public:
-    CLBufferView(cl_command_queue command_queue, cl_mem buffer, cl_mem base_buffer, size_t size, size_t offset);
+    // |pooled_base| is the pooled buffer that |base_buffer| belongs to, if any. It is kept alive by the view.
+    CLBufferView(cl_command_queue command_queue, cl_mem buffer, cl_mem base_buffer, std::shared_ptr<PooledBuffer> pooled_base, size_t size, size_t offset, Profiler* profiler);
 
     virtual std::unique_ptr<Buffer> NewView(size_t offset, size_t size) override;
 
+    virtual size_t offset() const override { return offset_; }
+
   private:
+    virtual void DetachFromPool() override;
+
     // Handle to the original buffer.
     // We need to keep this as clCreateSubBuffer cannot take a sub-buffer as first argument.
     cl_mem base_;
 
+    // Pooled buffer that base_ belongs to, nullptr if the base buffer isn't pooled.
+    std::shared_ptr<PooledBuffer> pooled_base_;
+
     // Offset (in bytes) into the base buffer of this view.
     size_t offset_;
 
@@ -0,0 +1,103 @@
+#include <algorithm>
+
+#include "BufferPool.h"
+
+using namespace std;
+
+namespace ocl {
+
+constexpr size_t BufferPool::kLargeBucketThreshold;
+constexpr size_t BufferPool::kLargeBucketGranularity;
+constexpr size_t BufferPool::kMinBucketSize;
+
+BufferPool::BufferPool(cl_context context) : context_(context), caching_enabled_(true) { }
+
+BufferPool::~BufferPool()
+{
+    WARN_IF(statistics_.live_bytes != 0, "Destroying buffer pool while " << statistics_.live_bytes << " bytes are still in use");
+    ReleaseCachedBuffers();
+}
+
+size_t BufferPool::BucketSize(size_t size)
+{
+    if (size > kLargeBucketThreshold)
+        return (size + kLargeBucketGranularity - 1) / kLargeBucketGranularity * kLargeBucketGranularity;
+
+    size_t bucket = kMinBucketSize;
+    while (bucket < size)
+        bucket *= 2;
+    return bucket;
+}
+
+cl_mem BufferPool::Allocate(size_t size, cl_mem_flags flags, size_t* capacity)
+{
+    size_t bucket = BucketSize(size);
+    statistics_.allocations++;
+
+    cl_mem buffer = nullptr;
+    auto& cached = cache_[make_pair(flags, bucket)];
+    if (!cached.empty()) {
+        buffer = cached.back();
+        cached.pop_back();
+        statistics_.cache_hits++;
+        statistics_.cached_bytes -= bucket;
+    } else {
+        cl_int clError;
+        buffer = clCreateBuffer(context_, flags, bucket, NULL, &clError);
+        if (clError == CL_MEM_OBJECT_ALLOCATION_FAILURE || clError == CL_OUT_OF_RESOURCES) {
+            // Give the memory held by the cache back to the device and try again.
+            ReleaseCachedBuffers();
+            buffer = clCreateBuffer(context_, flags, bucket, NULL, &clError);
+        }
+        CL_ENSURE_SUCCESS(clError, "Failed to allocate buffer", nullptr);
+    }
+
+    statistics_.live_bytes += bucket;
+    statistics_.peak_bytes = max(statistics_.peak_bytes, statistics_.live_bytes);
+
+    *capacity = bucket;
+    return buffer;
+}
+
+void BufferPool::Recycle(cl_mem buffer, size_t capacity, cl_mem_flags flags)
+{
+    if (!caching_enabled_) {
+        Release(buffer, capacity);
+        return;
+    }
+
+    Assert(capacity == BucketSize(capacity));
+    Assert(statistics_.live_bytes >= capacity);
+
+    statistics_.live_bytes -= capacity;
+    cache_[make_pair(flags, capacity)].push_back(buffer);
+    statistics_.cached_bytes += capacity;
+}
+
+void BufferPool::Release(cl_mem buffer, size_t capacity)
+{
+    Assert(statistics_.live_bytes >= capacity);
+
+    statistics_.live_bytes -= capacity;
+    clReleaseMemObject(buffer);
+}
+
+void BufferPool::ReleaseCachedBuffers()
+{
+    for (auto& entry : cache_) {
+        for (cl_mem buffer : entry.second)
+            clReleaseMemObject(buffer);
+    }
+    cache_.clear();
+    statistics_.cached_bytes = 0;
+}
+
+PooledBuffer::~PooledBuffer()
+{
+    if (detached_)
+        pool_->Release(buffer_, capacity_);
+    else
+        pool_->Recycle(buffer_, capacity_, flags_);
+}
+
+}       // namespace ocl
@@ -0,0 +1,132 @@
+//
+// Caching allocator for OpenCL buffers.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Utils.h"
+
+namespace ocl {
+
+// Memory flags for buffers that kernels only ever read from, e.g. weights during inference.
+constexpr cl_mem_flags kReadOnlyBuffer = CL_MEM_READ_ONLY;
+
+// Memory flags for device-only temporaries that the host never reads or writes.
+// Such buffers cannot be cleared or transferred from the host.
+constexpr cl_mem_flags kScratchBuffer = CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS;
+
+// Statistics about the buffers allocated through a BufferPool. All sizes are in bytes.
+struct MemoryStatistics {
+    // Number of allocation requests and how many of these were served from the cache.
+    size_t allocations = 0;
+    size_t cache_hits = 0;
+
+    // Memory held by buffers that are currently in use, and the maximum of that value so far.
+    size_t live_bytes = 0;
+    size_t peak_bytes = 0;
+
+    // Memory held by released buffers that are kept around for reuse.
+    size_t cached_bytes = 0;
+};
+
+// Size-bucketed cache of OpenCL buffers.
+//
+// Allocating device memory is expensive, yet many operations need temporary buffers of the same size
+// on every call. Instead of releasing buffers, the pool keeps them around and hands them out again for
+// later requests with the same memory flags and size bucket.
+// Requested sizes are rounded up to a power of two (or a multiple of kLargeBucketGranularity for large buffers).
+class BufferPool {
+  public:
+    BufferPool(cl_context context);
+
+    // Releases all cached buffers. All buffers handed out by this pool must have been recycled by now.
+    ~BufferPool();
+
+    // Returns a buffer of at least |size| bytes with the given flags, either from the cache or newly allocated.
+    // The actual size of the buffer is stored in |capacity| and must be passed to Recycle() later on.
+    //
+    // Returns nullptr upon failure.
+    cl_mem Allocate(size_t size, cl_mem_flags flags, size_t* capacity);
+
+    // Returns a buffer previously obtained from Allocate() to the cache. Its content is not preserved.
+    //
+    // The buffer may still be used by enqueued commands. That's fine since all commands using it later on are
+    // enqueued on the same in-order command queue and thus only start once the earlier ones have finished.
+    void Recycle(cl_mem buffer, size_t capacity, cl_mem_flags flags);
+
+    // Gives up a buffer previously obtained from Allocate() without caching it, e.g. because it is still mapped.
+    void Release(cl_mem buffer, size_t capacity);
+
+    // Releases all cached buffers, e.g. to make room for a large allocation.
+    void ReleaseCachedBuffers();
+
+    // If disabled, recycled buffers are released instead of being cached. This is required while a CommandGraph is
+    // capturing: it keeps the buffers used by the recorded commands alive, so they must not be handed out again.
+    void set_caching_enabled(bool enabled) { caching_enabled_ = enabled; }
+
+    // Returns the allocation statistics of this pool.
+    const MemoryStatistics& statistics() const { return statistics_; }
+
+  private:
+    // Buffers larger than this are rounded up to a multiple of kLargeBucketGranularity instead of a power of two.
+    static constexpr size_t kLargeBucketThreshold = 1024 * 1024;
+    static constexpr size_t kLargeBucketGranularity = 1024 * 1024;
+    static constexpr size_t kMinBucketSize = 256;
+
+    // Returns the size of the bucket that a request of |size| bytes is served from.
+    static size_t BucketSize(size_t size);
+
+    // OpenCL context in which the buffers are allocated. Not owned by this instance.
+    cl_context context_;
+
+    // Released buffers, indexed by their memory flags and bucket size.
+    std::map<std::pair<cl_mem_flags, size_t>, std::vector<cl_mem>> cache_;
+
+    bool caching_enabled_;
+
+    MemoryStatistics statistics_;
+
+    DISALLOW_COPY_AND_ASSIGN(BufferPool);
+};
+
+// A buffer obtained from a BufferPool, shared by the CLBuffer it was allocated for and all views onto it.
+//
+// The buffer goes back to the pool once the last of them is destroyed. Buffers that have been mapped into host
+// memory are detached from the pool instead, since the mapping keeps using the memory after that.
+class PooledBuffer {
+  public:
+    PooledBuffer(BufferPool* pool, cl_mem buffer, size_t capacity, cl_mem_flags flags) :
+        pool_(pool), buffer_(buffer), capacity_(capacity), flags_(flags), detached_(false) { }
+
+    ~PooledBuffer();
+
+    cl_mem buffer() const { return buffer_; }
+
+    // Makes sure the buffer is never handed out again.
+    void Detach() { detached_ = true; }
+
+  private:
+    // The pool must outlive this instance.
+    BufferPool* pool_;
+
+    cl_mem buffer_;
+
+    // Actual size and memory flags of the OpenCL buffer.
+    size_t capacity_;
+    cl_mem_flags flags_;
+
+    bool detached_;
+
+    DISALLOW_COPY_AND_ASSIGN(PooledBuffer);
+};
+
+}       // namespace ocl
+
+#endif
@@ -0,0 +1,157 @@
+#include <algorithm>
+
+#include "Buffer.h"
+#include "CommandGraph.h"
+
+using namespace std;
+
+namespace ocl {
+
+atomic<CommandGraph*> CommandGraph::capturing_(nullptr);
+
+CommandGraph::CommandGraph(cl_command_queue command_queue, Profiler* profiler) : command_queue_(command_queue), profiler_(profiler)
+{
+    CL_Check(clRetainCommandQueue(command_queue_));
+}
+
+CommandGraph::~CommandGraph()
+{
+    Assert(capturing_ != this);
+
+    for (Command& command : commands_) {
+        if (command.type == Command::kKernel)
+            clReleaseKernel(command.kernel);
+    }
+    for (cl_mem memory_object : memory_objects_)
+        clReleaseMemObject(memory_object);
+
+    clReleaseCommandQueue(command_queue_);
+}
+
+void CommandGraph::StartCapture()
+{
+    CommandGraph* expected = nullptr;
+    Check(capturing_.compare_exchange_strong(expected, this), "Another command graph is already capturing");
+}
+
+void CommandGraph::StopCapture()
+{
+    Assert(capturing_ == this);
+    capturing_ = nullptr;
+}
+
+void CommandGraph::Retain(cl_mem memory_object)
+{
+    if (memory_objects_.insert(memory_object).second)
+        CL_Check(clRetainMemObject(memory_object));
+}
+
+bool CommandGraph::AddKernel(cl_kernel kernel, const string& name, const vector<Argument>& arguments, cl_uint dimensions, const size_t* gws, const size_t* lws)
+{
+    Assert(dimensions <= 3);
+
+    // The original kernel object is shared with all other users of the kernel, which rebind its arguments on every launch.
+    // Create a private one from the same program instead, so the arguments only have to be bound once.
+    cl_program program;
+    CL_ENSURE_SUCCESS(clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, nullptr), "Failed to query kernel program", false);
+
+    cl_int clErr;
+    Command command;
+    command.type = Command::kKernel;
+    command.kernel = clCreateKernel(program, name.c_str(), &clErr);
+    CL_ENSURE_SUCCESS(clErr, "Failed to create kernel '" << name << "'", false);
+    command.name = name;
+    command.dimensions = dimensions;
+    copy(gws, gws + dimensions, command.gws);
+    copy(lws, lws + dimensions, command.lws);
+
+    for (cl_uint i = 0; i < arguments.size(); i++) {
+        const Argument& argument = arguments[i];
+        clErr = clSetKernelArg(command.kernel, i, argument.size, argument.value.empty() ? nullptr : argument.value.data());
+        if (clErr != CL_SUCCESS) {
+            clReleaseKernel(command.kernel);
+            CL_ENSURE_SUCCESS(clErr, "Failed to bind argument for kernel '" << name << "'", false);
+        }
+        if (argument.memory_object)
+            Retain(argument.memory_object);
+    }
+
+    commands_.push_back(command);
+    return true;
+}
+
+bool CommandGraph::AddCopy(cl_mem source, cl_mem destination, size_t nbytes, size_t offset, size_t dest_offset)
+{
+    Command command;
+    command.type = Command::kCopy;
+    command.source = source;
+    command.destination = destination;
+    command.nbytes = nbytes;
+    command.offset = offset;
+    command.dest_offset = dest_offset;
+
+    Retain(source);
+    Retain(destination);
+    commands_.push_back(command);
+    return true;
+}
+
+bool CommandGraph::AddClear(cl_mem buffer, size_t offset, size_t length)
+{
+    Command command;
+    command.type = Command::kClear;
+    command.destination = buffer;
+    command.nbytes = length;
+    command.offset = offset;
+
+    Retain(buffer);
+    commands_.push_back(command);
+    return true;
+}
+
+bool CommandGraph::Replay()
+{
+    Assert(capturing_ != this);
+
+    cl_event event;
+    cl_event* event_ptr = profiler_ ? &event : nullptr;
+
+    for (const Command& command : commands_) {
+        switch (command.type) {
+            case Command::kKernel:
+                CL_ENSURE_SUCCESS(clEnqueueNDRangeKernel(command_queue_, command.kernel, command.dimensions, nullptr, command.gws, command.lws, 0, nullptr, event_ptr),
+                                  "Error executing kernel '" << command.name << "'", false);
+                if (profiler_) {
+                    profiler_->Record(command.name, event);
+                    clReleaseEvent(event);
+                }
+                break;
+
+            case Command::kCopy:
+                CL_ENSURE_SUCCESS(clEnqueueCopyBuffer(command_queue_, command.source, command.destination, command.offset, command.dest_offset, command.nbytes, 0, nullptr, event_ptr),
+                                  "Error copying buffer on device", false);
+                if (profiler_) {
+                    profiler_->Record(kDeviceToDevice, event);
+                    clReleaseEvent(event);
+                }
+                break;
+
+            case Command::kClear:
+                // Same as CLBuffer::Clear(). The zero chunk is static, so the writes don't need to block.
+                for (size_t done = 0; done < command.nbytes; done += kClearChunkSize) {
+                    size_t chunk_size = min(command.nbytes - done, kClearChunkSize);
+                    CL_ENSURE_SUCCESS(clEnqueueWriteBuffer(command_queue_, command.destination, CL_FALSE, command.offset + done, chunk_size, ZeroChunk(), 0, nullptr, event_ptr),
+                                      "Error clearing buffer", false);
+                    if (profiler_) {
+                        profiler_->Record(kHostToDevice, event);
+                        clReleaseEvent(event);
+                    }
+                }
+                break;
+        }
+    }
+
+    return true;
+}
+
+}       // namespace ocl
@@ -0,0 +1,112 @@
+//
+// Recorded sequences of device commands.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __COMMAND_GRAPH_H__
+#define __COMMAND_GRAPH_H__
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "Profiler.h"
+
+namespace ocl {
+
+// A sequence of kernel launches, device side copies and buffer clears that was recorded once and can be
+// enqueued again with minimal host overhead, similar to CUDA graphs.
+//
+// While a graph is capturing (see Device::BeginCapture()), all commands enqueued on its command queue are
+// executed as usual and additionally appended to the graph. Every recorded kernel launch gets its own
+// OpenCL kernel object with all arguments bound upfront, so Replay() only has to enqueue the commands.
+//
+// Transfers between host and device memory are not recorded. The buffers used by the recorded commands are
+// retained by the graph, but their contents are not: replaying the graph operates on the current contents
+// of the same buffers, while scalar arguments keep the values they had during the capture.
+class CommandGraph {
+  public:
+    // A kernel argument bound while capturing. |value| is empty for local memory arguments.
+    struct Argument {
+        size_t size;
+        std::vector<uint8_t> value;
+
+        // The buffer that this argument refers to, if any.
+        cl_mem memory_object;
+    };
+
+    // If |profiler| is not null, all replayed commands are recorded by it.
+    CommandGraph(cl_command_queue command_queue, Profiler* profiler);
+
+    ~CommandGraph();
+
+    // Returns the graph that is currently capturing the commands enqueued on the given queue, or nullptr.
+    static CommandGraph* Capturing(cl_command_queue command_queue)
+    {
+        CommandGraph* graph = capturing_.load(std::memory_order_relaxed);
+        return graph && graph->command_queue_ == command_queue ? graph : nullptr;
+    }
+
+    // Starts and stops capturing commands. Only one graph can capture commands at any time.
+    void StartCapture();
+    void StopCapture();
+
+    // Appends a kernel launch with the given (final) global and local work size to this graph.
+    bool AddKernel(cl_kernel kernel, const std::string& name, const std::vector<Argument>& arguments, cl_uint dimensions, const size_t* gws, const size_t* lws);
+
+    // Appends a copy between two device buffers to this graph.
+    bool AddCopy(cl_mem source, cl_mem destination, size_t nbytes, size_t offset, size_t dest_offset);
+
+    // Appends the clearing of the range [offset, offset + length) of the given buffer to this graph.
+    bool AddClear(cl_mem buffer, size_t offset, size_t length);
+
+    // Enqueues all recorded commands in order. Does not wait for them to finish.
+    bool Replay();
+
+    // Returns the number of recorded commands.
+    size_t num_commands() const { return commands_.size(); }
+
+  private:
+    struct Command {
+        enum Type { kKernel, kCopy, kClear };
+
+        Type type;
+
+        // Kernel launches.
+        cl_kernel kernel;
+        std::string name;
+        cl_uint dimensions;
+        size_t gws[3], lws[3];
+
+        // Copies and clears. |destination| is the buffer to clear.
+        cl_mem source, destination;
+        size_t nbytes, offset, dest_offset;
+    };
+
+    // Keeps the given buffer alive for as long as this graph exists.
+    void Retain(cl_mem memory_object);
+
+    // The graph that is currently capturing commands, if any.
+    static std::atomic<CommandGraph*> capturing_;
+
+    // Handle to the OpenCL command queue that the commands are recorded from and replayed to.
+    // Will be retained (to increase its refcount) upon construction and released upon destruction.
+    cl_command_queue command_queue_;
+
+    // Profiler for replayed commands, may be null. Not owned by this instance.
+    Profiler* profiler_;
+
+    std::vector<Command> commands_;
+
+    // Buffers referenced by the recorded commands, retained by this instance.
+    std::set<cl_mem> memory_objects_;
+
+    DISALLOW_COPY_AND_ASSIGN(CommandGraph);
+};
+
+}   // namespace ocl
+
+#endif
@@ -1,6 +1,8 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
 
 #include "Device.h"
 #include "Utils.h"
@@ -9,8 +11,46 @@ using namespace std;
 
 namespace ocl {
 
+void* AllocateHostMemory(size_t size)
+{
+    // Round up the size so that the whole allocation can be mapped to the device.
+    size = (size + kHostMemoryGranularity - 1) / kHostMemoryGranularity * kHostMemoryGranularity;
+
+    void* data;
+    if (posix_memalign(&data, kHostMemoryAlignment, size) != 0)
+        return nullptr;
+    return data;
+}
+
+void FreeHostMemory(void* data)
+{
+    free(data);
+}
+
+// Called by the OpenCL runtime once a buffer created by WrapHostMemory() is destroyed.
+static void CL_CALLBACK FreeWrappedHostMemory(cl_mem buffer, void* data)
+{
+    FreeHostMemory(data);
+}
+
+Device::Device(cl_device_id device_id) : device_(device_id), context_(nullptr), command_queue_(nullptr), has_unified_memory_(false)
+{
+    for (size_t i = 0; i < kNumStagingBuffers; i++)
+        staging_events_[i] = nullptr;
+}
+
 Device::~Device()
 {
+    for (size_t i = 0; i < kNumStagingBuffers; i++) {
+        if (staging_events_[i]) {
+            clReleaseEvent(staging_events_[i]);
+        }
+        staging_buffers_[i].reset();
+    }
+    if (capture_)
+        capture_->StopCapture();
+    capture_.reset();
+    buffer_pool_.reset();
     if (command_queue_) {
         clReleaseCommandQueue(command_queue_);
     }
@@ -52,6 +92,7 @@ void Device::PrintDeviceInfo()
     PRINT_INFO_INT("Address bits", intval, "", clGetDeviceInfo(device_, CL_DEVICE_ADDRESS_BITS, sizeof(cl_ulong), &intval, &content_size));
     PRINT_INFO_INT("Compute Units", intval, "", clGetDeviceInfo(device_, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_ulong), &intval, &content_size));
     PRINT_INFO_INT("Clock Frequency", intval, " MHz", clGetDeviceInfo(device_, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_ulong), &intval, &content_size));
+    cout << "Unified memory: " << (has_unified_memory_ ? "yes" : "no") << endl;
 
     cout << endl << "******************************" << endl << endl;
 }
@@ -59,19 +100,44 @@ void Device::PrintDeviceInfo()
 #undef PRINT_INFO_STR
 #undef PRINT_INFO_INT
 
-bool Device::Init()
+bool Device::Init(bool enable_profiling)
 {
     cl_int clError;
 
     context_ = clCreateContext(NULL, 1, &device_, NULL, NULL, &clError);
     CL_ENSURE_SUCCESS(clError, "Failed to create OpenCL context.", false);
 
-    command_queue_ = clCreateCommandQueue(context_, device_, 0, &clError);
+    command_queue_ = clCreateCommandQueue(context_, device_, enable_profiling ? CL_QUEUE_PROFILING_ENABLE : 0, &clError);
     CL_ENSURE_SUCCESS(clError, "Failed to create the command queue in the context", false);
 
+    if (enable_profiling)
+        profiler_.reset(new Profiler);
+
+    cl_bool unified_memory;
+    CL_ENSURE_SUCCESS(clGetDeviceInfo(device_, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified_memory), &unified_memory, nullptr), "Failed to query device memory model", false);
+    has_unified_memory_ = unified_memory == CL_TRUE;
+
+    buffer_pool_.reset(new BufferPool(context_));
+
     return true;
 }
 
+void Device::BeginCapture()
+{
+    Check(!capture_, "Already capturing commands");
+    capture_.reset(new CommandGraph(command_queue_, profiler_.get()));
+    capture_->StartCapture();
+    buffer_pool_->set_caching_enabled(false);
+}
+
+unique_ptr<CommandGraph> Device::EndCapture()
+{
+    Check(capture_, "Not capturing commands");
+    capture_->StopCapture();
+    buffer_pool_->set_caching_enabled(true);
+    return move(capture_);
+}
+
 void Device::AwaitJobCompletion()
 {
     CL_Check(clFinish(command_queue_));
@@ -84,19 +150,192 @@ size_t Device::MaxWorkGroupSize()
     return size;
 }
 
+size_t Device::MaxWorkItemSize(unsigned int dimension)
+{
+    Assert(dimension < 3);
+    size_t sizes[3];
+    CL_Check(clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(sizes), sizes, nullptr));
+    return sizes[dimension];
+}
+
 unique_ptr<Buffer> Device::AllocateBuffer(size_t size, cl_mem_flags flags)
+{
+    size_t capacity;
+    cl_mem buffer = buffer_pool_->Allocate(size, flags, &capacity);
+    FAIL_IF(!buffer, "Failed to allocate buffer", nullptr);
+
+    shared_ptr<PooledBuffer> pooled_buffer = make_shared<PooledBuffer>(buffer_pool_.get(), buffer, capacity, flags);
+    return unique_ptr<Buffer>(new CLBuffer(command_queue_, pooled_buffer, size, profiler_.get()));
+}
+
+unique_ptr<MappedBuffer> Device::AllocatePinnedMemory(size_t size)
+{
+    cl_int clError;
+    cl_mem buffer = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &clError);
+    CL_ENSURE_SUCCESS(clError, "Failed to allocate pinned host memory", nullptr);
+
+    void* data = clEnqueueMapBuffer(command_queue_, buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, nullptr, nullptr, &clError);
+    if (clError != CL_SUCCESS) {
+        clReleaseMemObject(buffer);
+        CL_ENSURE_SUCCESS(clError, "Failed to map pinned host memory", nullptr);
+    }
+
+    return unique_ptr<MappedBuffer>(new MappedBuffer(command_queue_, buffer, data, size));
+}
+
+unique_ptr<Buffer> Device::WrapHostMemory(void* data, size_t size)
 {
     cl_int clError;
-    cl_mem buffer = clCreateBuffer(context_, flags, size, NULL, &clError);
-    CL_ENSURE_SUCCESS(clError, "Failed to allocate buffer", nullptr);
+    cl_mem buffer = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, data, &clError);
+    CL_ENSURE_SUCCESS(clError, "Failed to create buffer from host memory", nullptr);
 
-    return unique_ptr<Buffer>(new CLBuffer(command_queue_, buffer, size));
+    clError = clSetMemObjectDestructorCallback(buffer, FreeWrappedHostMemory, data);
+    if (clError != CL_SUCCESS) {
+        clReleaseMemObject(buffer);
+        CL_ENSURE_SUCCESS(clError, "Failed to register destructor callback", nullptr);
+    }
+
+    return unique_ptr<Buffer>(new CLBuffer(command_queue_, buffer, size, profiler_.get()));
+}
+
+unique_ptr<MappedBuffer> Device::MapBuffer(Buffer* buffer)
+{
+    cl_mem handle = buffer->cl_buffer();
+
+    cl_int clError;
+    void* data = clEnqueueMapBuffer(command_queue_, handle, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, buffer->size(), 0, nullptr, nullptr, &clError);
+    CL_ENSURE_SUCCESS(clError, "Failed to map buffer", nullptr);
+
+    // The mapping holds its own reference to the buffer and may outlive it, so its memory must not be reused.
+    CL_Check(clRetainMemObject(handle));
+    buffer->DetachFromPool();
+    return unique_ptr<MappedBuffer>(new MappedBuffer(command_queue_, handle, data, buffer->size()));
+}
+
+unique_ptr<Buffer> Device::UnmapBuffer(unique_ptr<MappedBuffer> mapping)
+{
+    size_t size = mapping->size();
+    cl_mem handle = mapping->Release();
+    return unique_ptr<Buffer>(new CLBuffer(command_queue_, handle, size, profiler_.get()));
+}
+
+bool Device::AllocateStagingBuffers()
+{
+    for (size_t i = 0; i < kNumStagingBuffers; i++) {
+        if (!staging_buffers_[i])
+            staging_buffers_[i] = AllocatePinnedMemory(kStagingBufferSize);
+        if (!staging_buffers_[i])
+            return false;
+    }
+    return true;
+}
+
+bool Device::AwaitStagingBuffer(size_t index)
+{
+    Assert(index < kNumStagingBuffers);
+    if (!staging_events_[index])
+        return true;
+
+    cl_int clError = clWaitForEvents(1, &staging_events_[index]);
+    clReleaseEvent(staging_events_[index]);
+    staging_events_[index] = nullptr;
+    CL_ENSURE_SUCCESS(clError, "Staged transfer failed", false);
+    return true;
+}
+
+bool Device::Upload(Buffer* buffer, const uint8_t* data, size_t nbytes, size_t offset)
+{
+    Assert(offset + nbytes <= buffer->size());
+
+    // Let the driver deal with small transfers or if there is no pinned memory available.
+    if (nbytes < kMinStagedTransferSize || !AllocateStagingBuffers())
+        return buffer->Write(const_cast<uint8_t*>(data), nbytes, offset, true);
+
+    size_t slot = 0;
+    for (size_t done = 0; done < nbytes; done += kStagingBufferSize) {
+        size_t chunk_size = min(kStagingBufferSize, nbytes - done);
+        uint8_t* staging = staging_buffers_[slot]->data();
+
+        // Wait until the previous transfer out of this staging buffer has completed, then refill it.
+        // The copy overlaps with the transfer of the previous chunk from the other staging buffer.
+        FAIL_IF(!AwaitStagingBuffer(slot), "Upload failed", false);
+        memcpy(staging, data + done, chunk_size);
+
+        CL_ENSURE_SUCCESS(clEnqueueWriteBuffer(command_queue_, buffer->cl_buffer(), CL_FALSE, offset + done, chunk_size, staging, 0, nullptr, &staging_events_[slot]), "Error writing data to device", false);
+        if (profiler_)
+            profiler_->Record(kHostToDevice, staging_events_[slot]);
+
+        slot = (slot + 1) % kNumStagingBuffers;
+    }
+
+    for (size_t i = 0; i < kNumStagingBuffers; i++)
+        FAIL_IF(!AwaitStagingBuffer(i), "Upload failed", false);
+
+    return true;
+}
+
+bool Device::Download(Buffer* buffer, uint8_t* data, size_t nbytes, size_t offset)
+{
+    Assert(offset + nbytes <= buffer->size());
+
+    // Let the driver deal with small transfers or if there is no pinned memory available.
+    if (nbytes < kMinStagedTransferSize || !AllocateStagingBuffers())
+        return buffer->Read(data, nbytes, offset, true);
+
+    // Destination and size of the chunk that is currently being transferred into each staging buffer.
+    uint8_t* pending_destination[kNumStagingBuffers] = { nullptr };
+    size_t pending_size[kNumStagingBuffers] = { 0 };
+
+    size_t slot = 0;
+    for (size_t done = 0; done < nbytes; done += kStagingBufferSize) {
+        size_t chunk_size = min(kStagingBufferSize, nbytes - done);
+        uint8_t* staging = staging_buffers_[slot]->data();
+
+        // Copy out the chunk that was previously transferred into this staging buffer.
+        // The copy overlaps with the transfer of the next chunk into the other staging buffer.
+        FAIL_IF(!AwaitStagingBuffer(slot), "Download failed", false);
+        if (pending_destination[slot])
+            memcpy(pending_destination[slot], staging, pending_size[slot]);
+
+        CL_ENSURE_SUCCESS(clEnqueueReadBuffer(command_queue_, buffer->cl_buffer(), CL_FALSE, offset + done, chunk_size, staging, 0, nullptr, &staging_events_[slot]), "Error reading data from device", false);
+        if (profiler_)
+            profiler_->Record(kDeviceToHost, staging_events_[slot]);
+        pending_destination[slot] = data + done;
+        pending_size[slot] = chunk_size;
+
+        slot = (slot + 1) % kNumStagingBuffers;
+    }
+
+    // Copy out the remaining chunks.
+    for (size_t i = 0; i < kNumStagingBuffers; i++) {
+        FAIL_IF(!AwaitStagingBuffer(i), "Download failed", false);
+        if (pending_destination[i])
+            memcpy(pending_destination[i], staging_buffers_[i]->data(), pending_size[i]);
+    }
+
+    return true;
+}
+
+bool Device::EnableProgramCache(const string& directory)
+{
+    Assert(device_);
+    unique_ptr<ProgramCache> cache(new ProgramCache(device_, directory));
+    if (!cache->Init())
+        return false;
+    program_cache_ = move(cache);
+    return true;
 }
 
 unique_ptr<Program> Device::CreateProgram(const string& source_code, const string& compiler_args)
 {
     cl_program prog = nullptr;
 
+    if (program_cache_) {
+        prog = program_cache_->Load(context_, source_code, compiler_args);
+        if (prog)
+            return unique_ptr<Program>(new Program(command_queue_, prog, device_, profiler_.get()));
+    }
+
     const char* src = source_code.c_str();
     size_t length = source_code.size();
 
@@ -112,7 +351,11 @@ unique_ptr<Program> Device::CreateProgram(const string& source_code, const strin
         return nullptr;
     }
 
-    return unique_ptr<Program>(new Program(command_queue_, prog, device_));
+    if (program_cache_) {
+        WARN_IF(!program_cache_->Store(prog, source_code, compiler_args), "Failed to store program binary in the cache");
+    }
+
+    return unique_ptr<Program>(new Program(command_queue_, prog, device_, profiler_.get()));
 }
 
 unique_ptr<Program> Device::CreateProgramFromFile(const string& path, const string& compiler_args)
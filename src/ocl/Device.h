@@ -11,19 +11,50 @@
 
 #include "Utils.h"
 #include "Buffer.h"
+#include "BufferPool.h"
+#include "CommandGraph.h"
+#include "MappedBuffer.h"
 #include "Program.h"
+#include "Profiler.h"
+#include "ProgramCache.h"
 
 namespace ocl {
 
+// Number and size of the pinned host buffers used to stage transfers from and to pageable host memory.
+constexpr size_t kNumStagingBuffers = 2;
+constexpr size_t kStagingBufferSize = 4 * 1024 * 1024;
+
+// Transfers smaller than this are handed to the driver directly, staging them isn't worth the overhead.
+constexpr size_t kMinStagedTransferSize = 64 * 1024;
+
+// Alignment and size granularity of host allocations that can back a device buffer without copying (CL_MEM_USE_HOST_PTR).
+constexpr size_t kHostMemoryAlignment = 4096;
+constexpr size_t kHostMemoryGranularity = 64;
+
+// Pageable host allocations smaller than this aren't worth handing over to the device: page aligning them wastes
+// memory and copying them costs about as much. They use ordinary allocations instead of AllocateHostMemory().
+constexpr size_t kMinHostHandOffSize = 64 * 1024;
+
+// Allocates host memory that can later be handed to Device::WrapHostMemory(). Returns nullptr on failure.
+void* AllocateHostMemory(size_t size);
+
+// Frees memory previously allocated with AllocateHostMemory().
+void FreeHostMemory(void* data);
+
 class Device {
   public:
-    Device(cl_device_id device_id) : device_(device_id) { }
+    Device(cl_device_id device_id);
     ~Device();
 
     // Initializes this device.
     //
+    // If |enable_profiling| is true, all kernel executions and transfers are profiled, see profiler().
     // Returns false on error.
-    bool Init();
+    bool Init(bool enable_profiling);
+    bool Init() { return Init(false); }
+
+    // Returns the profiler of this device, or nullptr if profiling is not enabled.
+    Profiler* profiler() { return profiler_.get(); }
 
     // Prints device information to stdout.
     void PrintDeviceInfo();
@@ -31,20 +62,94 @@ class Device {
     // Waits for all currently queued actions for this device to be completed.
     void AwaitJobCompletion();
 
+    // Returns the handle of the underlying OpenCL device.
+    cl_device_id id() const { return device_; }
+
     // Returns a handle to the command queue for this device.
     cl_command_queue command_queue() { return command_queue_; }
 
     // Returns the maximum number of threads per work group for this device.
     size_t MaxWorkGroupSize();
 
+    // Returns the maximum number of threads in the given dimension of a work group.
+    size_t MaxWorkItemSize(unsigned int dimension);
+
+    // Returns a string identifying this device and its driver.
+    std::string Description() const { return util::DeviceDescription(device_); }
+
+    // Returns true if the device and the host share the same physical memory, as is the case for
+    // CPU devices and most integrated GPUs. On such devices buffers can be shared with the host
+    // without copying, see WrapHostMemory() and MapBuffer(). Valid after Init() has been called.
+    bool has_unified_memory() const { return has_unified_memory_; }
+
     // Allocates a new buffer on this device.
+    //
+    // Buffers are served from a cache of previously released buffers of the same size bucket and flags
+    // whenever possible (see BufferPool.h). The flags can be used to hint at how the buffer will be used,
+    // e.g. kReadOnlyBuffer for weights during inference or kScratchBuffer for device-only temporaries.
+    // Buffers must not outlive the device.
     std::unique_ptr<Buffer> AllocateBuffer(size_t size, cl_mem_flags flags);
     std::unique_ptr<Buffer> AllocateBuffer(size_t size) { return AllocateBuffer(size, CL_MEM_READ_WRITE); }
 
     // Allocates a new buffer and zero initializes it.
     std::unique_ptr<Buffer> AllocateZeroFilledBuffer(size_t size) { auto buf = AllocateBuffer(size, CL_MEM_READ_WRITE); buf->Clear(); return buf; }
 
+    // Allocates pinned (page-locked) host memory.
+    //
+    // Transfers from and to pinned memory are performed via DMA and are usually a lot faster than
+    // transfers from and to pageable memory (e.g. memory obtained through new[]).
+    std::unique_ptr<MappedBuffer> AllocatePinnedMemory(size_t size);
+
+    // Creates a device buffer that uses the given host memory as storage (CL_MEM_USE_HOST_PTR).
+    //
+    // Takes ownership of |data|, which must have been allocated through AllocateHostMemory(). The memory
+    // is freed once the buffer and all views onto it have been released.
+    // This only avoids copies on devices with unified memory, on other devices the driver will mirror the memory.
+    std::unique_ptr<Buffer> WrapHostMemory(void* data, size_t size);
+
+    // Maps the given buffer into host memory. The mapping keeps the underlying buffer alive.
+    //
+    // On devices with unified memory this doesn't copy any data. The buffer must not be used
+    // by the device while it is mapped.
+    std::unique_ptr<MappedBuffer> MapBuffer(Buffer* buffer);
+
+    // Returns allocation statistics (cache hits, live and peak memory usage) for the buffers allocated through AllocateBuffer().
+    const MemoryStatistics& memory_statistics() const { return buffer_pool_->statistics(); }
+
+    // Releases all cached buffers back to the OpenCL runtime.
+    void ReleaseCachedBuffers() { buffer_pool_->ReleaseCachedBuffers(); }
+
+    // Starts recording the kernel launches, device side copies and clears enqueued on this device into a CommandGraph.
+    //
+    // The commands are still executed as usual. Buffers that are released while capturing are not recycled by the buffer
+    // pool, as the graph may refer to them. Only one device can capture commands at any time.
+    void BeginCapture();
+
+    // Stops capturing and returns the recorded commands. The graph must not outlive this device.
+    std::unique_ptr<CommandGraph> EndCapture();
+
+    // Unmaps the given mapping and returns a device buffer referring to the same memory.
+    std::unique_ptr<Buffer> UnmapBuffer(std::unique_ptr<MappedBuffer> mapping);
+
+    // Transfers |nbytes| bytes from pageable host memory into the given device buffer, starting at |offset|.
+    //
+    // Large transfers are split into chunks that are copied into the pinned staging buffers of this device
+    // and transferred from there, so that copying the next chunk overlaps with the transfer of the previous one.
+    // Blocks until the data has been transferred.
+    bool Upload(Buffer* buffer, const uint8_t* data, size_t nbytes, size_t offset);
+
+    // Transfers |nbytes| bytes starting at |offset| from the given device buffer into pageable host memory.
+    //
+    // Like Upload(), this goes through the pinned staging buffers. Blocks until the data is available.
+    bool Download(Buffer* buffer, uint8_t* data, size_t nbytes, size_t offset);
+
+    // Stores the binaries of programs created on this device in the given directory and loads them
+    // from there instead of compiling the source code in later sessions. See ProgramCache.h.
+    bool EnableProgramCache(const std::string& directory);
+
     // Creates a program on this device from the given source code.
+    //
+    // If the program cache is enabled, a previously compiled binary for the same source and compile options will be used if available.
     std::unique_ptr<Program> CreateProgram(const std::string& source, const std::string& compile_options);
     std::unique_ptr<Program> CreateProgram(const std::string& source) { return CreateProgram(source, ""); }
 
@@ -62,6 +167,34 @@ class Device {
     // OpenCL command queue for this device. Valid after Init() has been called.
     cl_command_queue command_queue_;
 
+    // Whether the device shares its memory with the host. Valid after Init() has been called.
+    bool has_unified_memory_;
+
+    // Cache for buffers allocated through AllocateBuffer(). Valid after Init() has been called.
+    std::unique_ptr<BufferPool> buffer_pool_;
+
+    // Profiler for all commands on this device, nullptr unless enabled in Init().
+    // Must outlive all buffers, programs and kernels of this device.
+    std::unique_ptr<Profiler> profiler_;
+
+    // Graph that commands are currently recorded into, nullptr unless between BeginCapture() and EndCapture().
+    std::unique_ptr<CommandGraph> capture_;
+
+    // Cache for compiled programs, nullptr unless enabled through EnableProgramCache().
+    std::unique_ptr<ProgramCache> program_cache_;
+
+    // Pinned host buffers used to stage transfers. Allocated on first use.
+    std::unique_ptr<MappedBuffer> staging_buffers_[kNumStagingBuffers];
+
+    // Events of the last transfer from or to each staging buffer, nullptr if no transfer is in flight.
+    cl_event staging_events_[kNumStagingBuffers];
+
+    // Allocates the staging buffers if necessary. Returns false if not enough pinned memory is available.
+    bool AllocateStagingBuffers();
+
+    // Waits until the last transfer involving the given staging buffer has completed.
+    bool AwaitStagingBuffer(size_t index);
+
 
     void PrintBuildLog(cl_program prog);
 
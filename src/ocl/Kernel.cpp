@@ -1,8 +1,17 @@
 #include "Kernel.h"
 
+using namespace std;
+
 namespace ocl {
 
-Kernel::Kernel(cl_command_queue command_queue, cl_kernel kernel, cl_device_id device) : kernel_(kernel), device_(device), cur_index_(0), command_queue_(command_queue) {
+Kernel::Kernel(cl_command_queue command_queue, cl_kernel kernel, cl_device_id device, const std::string& name, Profiler* profiler) :
+    kernel_(kernel),
+    device_(device),
+    name_(name),
+    profiler_(profiler),
+    cur_index_(0),
+    command_queue_(command_queue)
+{
     CL_Check(clRetainCommandQueue(command_queue_));
 }
 
@@ -23,6 +32,26 @@ size_t Kernel::PreferredWorkSizeMultiple() const
     return size;
 }
 
+size_t Kernel::MaxWorkGroupSize() const
+{
+    size_t size;
+    CL_Check(clGetKernelWorkGroupInfo(kernel_, device_, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size), &size, nullptr));
+    return size;
+}
+
+bool Kernel::SetNextArgument(size_t size, const void* value, cl_mem memory_object)
+{
+    cl_int clErr = clSetKernelArg(kernel_, cur_index_, size, value);
+    CL_ENSURE_SUCCESS(clErr, "Failed to bind argument for kernel", false);
+    cur_index_++;
+
+    if (CommandGraph::Capturing(command_queue_)) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        captured_arguments_.push_back({ size, value ? vector<uint8_t>(bytes, bytes + size) : vector<uint8_t>(), memory_object });
+    }
+    return true;
+}
+
 // We scale down size_t to uint32_t for OpenCL kernels..
 template<>
 bool Kernel::BindNextArgument<size_t>(size_t size)
@@ -30,34 +59,34 @@ bool Kernel::BindNextArgument<size_t>(size_t size)
     Assert(size <= 0xffffffff);
 
     uint32_t cl_size = size;
-    cl_int clErr = clSetKernelArg(kernel_, cur_index_, sizeof(cl_uint), (void *)&cl_size);
-    CL_ENSURE_SUCCESS(clErr, "Failed to bind argument for kernel", false);
-    cur_index_++;
-    return true;
+    return SetNextArgument(sizeof(cl_uint), &cl_size, nullptr);
+}
+
+// bool kernel arguments are not allowed in OpenCL, so flags are passed as uint.
+template<>
+bool Kernel::BindNextArgument<bool>(bool flag)
+{
+    cl_uint cl_flag = flag ? 1 : 0;
+    return SetNextArgument(sizeof(cl_uint), &cl_flag, nullptr);
 }
 
 template<>
 bool Kernel::BindNextArgument<Buffer*>(Buffer* buffer)
 {
     cl_mem cl_buffer = buffer->cl_buffer();
-    cl_int clErr = clSetKernelArg(kernel_, cur_index_, sizeof(cl_mem), (void *)&cl_buffer);
-    CL_ENSURE_SUCCESS(clErr, "Failed to bind buffer argument for kernel", false);
-    cur_index_++;
-    return true;
+    return SetNextArgument(sizeof(cl_mem), &cl_buffer, cl_buffer);
 }
 
 template<>
 bool Kernel::BindNextArgument<LocalMemory>(LocalMemory local_buffer)
 {
-    cl_int clErr = clSetKernelArg(kernel_, cur_index_, local_buffer.size, NULL);
-    CL_ENSURE_SUCCESS(clErr, "Failed to bind argument for kernel", false);
-    cur_index_++;
-    return true;
+    return SetNextArgument(local_buffer.size, nullptr, nullptr);
 }
 
 Kernel::WorkSize Kernel::CalculateLocalWorkSize(WorkSize gws)
 {
-    // TODO this needs some more love
+    // 256 work items per group work well on the devices we run on. Kernels for which this matters
+    // more are tuned per device instead, see Tuner.
     WorkSize lws(0);
     if (gws.dimensions == 1)
         lws = WorkSize(256);
@@ -65,6 +94,12 @@ Kernel::WorkSize Kernel::CalculateLocalWorkSize(WorkSize gws)
         lws = WorkSize(32, 8);
     else if (gws.dimensions == 3)
         lws = WorkSize(16, 4, 4);
+
+    // Don't pad small dimensions to a much larger work group, the additional work items would only idle.
+    for (uint8_t d = 0; d < lws.dimensions; d++) {
+        while (lws.values[d] > 1 && lws.values[d] / 2 >= gws.values[d])
+            lws.values[d] /= 2;
+    }
     return lws;
 }
 
@@ -77,9 +112,21 @@ bool Kernel::Run(WorkSize gws, WorkSize lws)
 {
     Assert(gws.dimensions == lws.dimensions);
     gws = PrepareFinalWorkSize(gws, lws);
-    cl_int clErr = clEnqueueNDRangeKernel(command_queue_, kernel_, gws.dimensions, nullptr, gws.values, lws.values, 0, nullptr, nullptr);
-    CL_ENSURE_SUCCESS(clErr, "Error executing kernel", false);
+    cl_event event;
+    cl_int clErr = clEnqueueNDRangeKernel(command_queue_, kernel_, gws.dimensions, nullptr, gws.values, lws.values, 0, nullptr, profiler_ ? &event : nullptr);
     cur_index_ = 0;
+    vector<CommandGraph::Argument> arguments;
+    arguments.swap(captured_arguments_);
+    CL_ENSURE_SUCCESS(clErr, "Error executing kernel '" << name_ << "'", false);
+
+    if (CommandGraph* graph = CommandGraph::Capturing(command_queue_)) {
+        FAIL_IF(!graph->AddKernel(kernel_, name_, arguments, gws.dimensions, gws.values, lws.values), "Failed to capture kernel '" << name_ << "'", false);
+    }
+
+    if (profiler_) {
+        profiler_->Record(name_, event);
+        clReleaseEvent(event);
+    }
     return true;
 }
 
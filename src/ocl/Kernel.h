@@ -6,9 +6,12 @@
 #define __KERNEL_H__
 
 #include <memory>
+#include <string>
 
 #include "Utils.h"
 #include "Buffer.h"
+#include "CommandGraph.h"
+#include "Profiler.h"
 
 namespace ocl {
 
@@ -22,7 +25,8 @@ struct LocalMemory {
 
 class Kernel {
   public:
-    Kernel(cl_command_queue command_queue, cl_kernel kernel, cl_device_id device);
+    // If |profiler| is not null, every execution of the kernel is recorded by it.
+    Kernel(cl_command_queue command_queue, cl_kernel kernel, cl_device_id device, const std::string& name, Profiler* profiler);
 
     ~Kernel();
 
@@ -44,19 +48,22 @@ class Kernel {
         size_t values[3];
     };
 
+    // Returns the name of this kernel.
+    const std::string& name() const { return name_; }
+
     // Returns the preferred work group size multiple for this kernel.
     size_t PreferredWorkSizeMultiple() const;
 
+    // Returns the maximum work group size that this kernel can be executed with on its device.
+    size_t MaxWorkGroupSize() const;
+
     // Bind the next kernel argument.
     //
     // This is supported for all primitive data types, as well as Buffer pointers and LocalMemory instances.
     template <typename T>
     bool BindNextArgument(T value)
     {
-        cl_int clErr = clSetKernelArg(kernel_, cur_index_, sizeof(T), (void *)&value);
-        CL_ENSURE_SUCCESS(clErr, "Failed to bind argument for kernel", false);
-        cur_index_++;
-        return true;
+        return SetNextArgument(sizeof(T), &value, nullptr);
     }
 
     // Calculate a decent local work size for the provided global work size and the current device.
@@ -102,15 +109,28 @@ class Kernel {
     // Ensure that the global work size is XXX
     WorkSize PrepareFinalWorkSize(WorkSize gws, WorkSize lws);
 
+    // Binds |size| bytes at |value| (nullptr for local memory) to the next argument. |memory_object|
+    // is the buffer that the argument refers to, if any. Used by all BindNextArgument() variants.
+    bool SetNextArgument(size_t size, const void* value, cl_mem memory_object);
+
     // Handle to the underlying OpenCL kernel.
     cl_kernel kernel_;
 
     // Handle to the device that this kernel will execute on.
     cl_device_id device_;
 
+    // Name of the kernel function.
+    std::string name_;
+
+    // Profiler for kernel executions, may be null. Not owned by this instance.
+    Profiler* profiler_;
+
     // Index of the next argument to be bound.
     size_t cur_index_;
 
+    // Arguments bound for the next launch, only collected while a CommandGraph is capturing our command queue.
+    std::vector<CommandGraph::Argument> captured_arguments_;
+
     // Handle to the OpenCL command queue to communicate with the device.
     // Will be retained (to increase its refcount) upon construction and released upon destruction.
     cl_command_queue command_queue_;
@@ -0,0 +1,40 @@
+#include "MappedBuffer.h"
+
+namespace ocl {
+
+MappedBuffer::MappedBuffer(cl_command_queue command_queue, cl_mem buffer, void* data, size_t size) :
+    command_queue_(command_queue),
+    buffer_(buffer),
+    data_(static_cast<uint8_t*>(data)),
+    size_(size)
+{
+    CL_Check(clRetainCommandQueue(command_queue_));
+}
+
+MappedBuffer::~MappedBuffer()
+{
+    if (buffer_) {
+        if (data_) {
+            clEnqueueUnmapMemObject(command_queue_, buffer_, data_, 0, nullptr, nullptr);
+            clFinish(command_queue_);
+        }
+        clReleaseMemObject(buffer_);
+    }
+    if (command_queue_) {
+        clReleaseCommandQueue(command_queue_);
+    }
+}
+
+cl_mem MappedBuffer::Release()
+{
+    cl_mem buffer = buffer_;
+    if (buffer_ && data_) {
+        CL_Check(clEnqueueUnmapMemObject(command_queue_, buffer_, data_, 0, nullptr, nullptr));
+    }
+    buffer_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+    return buffer;
+}
+
+}       // namespace ocl
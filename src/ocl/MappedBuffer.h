@@ -0,0 +1,57 @@
+//
+// Host-accessible mapping of an OpenCL buffer.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __MAPPED_BUFFER_H__
+#define __MAPPED_BUFFER_H__
+
+#include "Utils.h"
+
+namespace ocl {
+
+// An OpenCL buffer that is mapped into the address space of the host.
+//
+// The buffer stays mapped for the lifetime of this object and is unmapped and released upon destruction.
+// If the buffer was allocated with CL_MEM_ALLOC_HOST_PTR (see Device::AllocatePinnedMemory), the mapped
+// memory will be pinned (page-locked) host memory which the device can access via DMA. Such memory can
+// directly be used as source or destination of a transfer without requiring the driver to stage it first.
+class MappedBuffer {
+  public:
+    // Takes ownership of the buffer handle. |data| must be the pointer returned by clEnqueueMapBuffer.
+    MappedBuffer(cl_command_queue command_queue, cl_mem buffer, void* data, size_t size);
+
+    ~MappedBuffer();
+
+    // Returns a pointer to the mapped memory.
+    uint8_t* data() const { return data_; }
+
+    // Returns the size of the mapped memory in bytes.
+    size_t size() const { return size_; }
+
+    // Unmaps the buffer and returns the underlying buffer handle. The caller takes ownership of the handle.
+    //
+    // Afterwards, this object no longer refers to any memory.
+    cl_mem Release();
+
+  private:
+    // Handle to the OpenCL command queue to communicate with the device.
+    // Will be retained (to increase its refcount) upon construction and released upon destruction.
+    cl_command_queue command_queue_;
+
+    // Handle to the underlying OpenCL buffer.
+    cl_mem buffer_;
+
+    // Start of the mapped memory region.
+    uint8_t* data_;
+
+    // Size of the mapped memory region in bytes.
+    size_t size_;
+
+    DISALLOW_COPY_AND_ASSIGN(MappedBuffer);
+};
+
+}       // namespace ocl
+
+#endif
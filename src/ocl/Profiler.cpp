@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "Profiler.h"
+
+using namespace std;
+
+namespace ocl {
+
+const char* const kHostToDevice = "Host to device";
+const char* const kDeviceToHost = "Device to host";
+const char* const kDeviceToDevice = "Device to device";
+
+constexpr size_t Profiler::kBucketsPerDecade;
+constexpr size_t Profiler::kNumBuckets;
+constexpr size_t Profiler::kMaxPendingEvents;
+
+void Profiler::Histogram::Add(cl_ulong ns)
+{
+    total_ns += ns;
+    size_t bucket = ns == 0 ? 0 : (size_t)(log10((double)ns) * kBucketsPerDecade);
+    buckets[min(bucket, kNumBuckets - 1)]++;
+}
+
+Profiler::Timing Profiler::Histogram::Summarize(size_t count) const
+{
+    Timing timing;
+    timing.total = total_ns / 1e6;
+    timing.mean = count ? timing.total / count : 0;
+
+    // Upper bound of the bucket containing the 99th percentile.
+    size_t seen = 0, bucket = 0;
+    for (; bucket < kNumBuckets; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= ceil(0.99 * count))
+            break;
+    }
+    timing.p99 = count ? pow(10, (double)(bucket + 1) / kBucketsPerDecade) / 1e6 : 0;
+
+    return timing;
+}
+
+Profiler::~Profiler()
+{
+    for (auto& command : pending_)
+        clReleaseEvent(command.second);
+}
+
+void Profiler::Record(const string& name, cl_event event)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    CL_Check(clRetainEvent(event));
+    pending_.emplace_back(name, event);
+
+    if (pending_.size() > kMaxPendingEvents)
+        Resolve(false);
+    // If the device is lagging far behind, block rather than accumulating events.
+    if (pending_.size() > 2 * kMaxPendingEvents)
+        Resolve(true);
+}
+
+void Profiler::Resolve(bool wait)
+{
+    while (!pending_.empty()) {
+        cl_event event = pending_.front().second;
+
+        if (wait) {
+            CL_Check(clWaitForEvents(1, &event));
+        } else {
+            cl_int status;
+            CL_Check(clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr));
+            // Commands complete in submission order on our in-order queues.
+            if (status != CL_COMPLETE)
+                return;
+        }
+
+        cl_ulong queued, start, end;
+        CL_Check(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr));
+        CL_Check(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr));
+        CL_Check(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr));
+
+        Statistics& statistics = statistics_[pending_.front().first];
+        statistics.count++;
+        statistics.wait.Add(start > queued ? start - queued : 0);
+        statistics.execution.Add(end > start ? end - start : 0);
+
+        clReleaseEvent(event);
+        pending_.pop_front();
+    }
+}
+
+vector<Profiler::Entry> Profiler::Report()
+{
+    lock_guard<mutex> lock(mutex_);
+    Resolve(true);
+
+    vector<Entry> report;
+    for (const auto& statistics : statistics_) {
+        Entry entry;
+        entry.name = statistics.first;
+        entry.count = statistics.second.count;
+        entry.wait = statistics.second.wait.Summarize(entry.count);
+        entry.execution = statistics.second.execution.Summarize(entry.count);
+        report.push_back(entry);
+    }
+
+    sort(report.begin(), report.end(), [](const Entry& a, const Entry& b) { return a.execution.total > b.execution.total; });
+    return report;
+}
+
+void Profiler::Print(ostream& out)
+{
+    vector<Entry> report = Report();
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-28s %10s | %12s %10s %10s | %12s %10s %10s\n", "Command", "Count", "Run total", "mean", "p99", "Wait total", "mean", "p99");
+    out << line;
+    for (const Entry& entry : report) {
+        snprintf(line, sizeof(line), "%-28s %10zu | %10.2fms %8.4fms %8.4fms | %10.2fms %8.4fms %8.4fms\n", entry.name.c_str(), entry.count,
+                 entry.execution.total, entry.execution.mean, entry.execution.p99, entry.wait.total, entry.wait.mean, entry.wait.p99);
+        out << line;
+    }
+}
+
+void Profiler::Reset()
+{
+    lock_guard<mutex> lock(mutex_);
+    Resolve(true);
+    statistics_.clear();
+}
+
+}       // namespace ocl
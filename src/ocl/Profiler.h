@@ -0,0 +1,106 @@
+//
+// Profiling of device commands.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+namespace ocl {
+
+// Names under which buffer transfers are recorded.
+extern const char* const kHostToDevice;
+extern const char* const kDeviceToHost;
+extern const char* const kDeviceToDevice;
+
+// Collects the timestamps of profiled commands (kernel launches, transfers) and aggregates them by name.
+//
+// Requires a command queue created with CL_QUEUE_PROFILING_ENABLE, see Device::Init().
+class Profiler {
+  public:
+    // Aggregated durations in milliseconds.
+    struct Timing {
+        double total;
+        double mean;
+        double p99;
+    };
+
+    struct Entry {
+        std::string name;
+        size_t count;
+
+        // Time between enqueueing the command and the start of its execution.
+        Timing wait;
+
+        // Time between the start and the end of the execution.
+        Timing execution;
+    };
+
+    Profiler() { }
+
+    ~Profiler();
+
+    // Records the given command. The event is retained by the profiler, so the caller may release it afterwards.
+    void Record(const std::string& name, cl_event event);
+
+    // Waits for all recorded commands to finish and returns their statistics, ordered by total execution time.
+    std::vector<Entry> Report();
+
+    // Prints a report as returned by Report() in a human readable form.
+    void Print(std::ostream& out);
+
+    // Discards all statistics collected so far.
+    void Reset();
+
+  private:
+    // Durations are collected in logarithmic buckets so that memory use stays constant.
+    static constexpr size_t kBucketsPerDecade = 20;
+    static constexpr size_t kNumBuckets = 11 * kBucketsPerDecade;       // 1ns to 100s
+
+    // Maximum number of unresolved events kept around.
+    static constexpr size_t kMaxPendingEvents = 4096;
+
+    struct Histogram {
+        Histogram() : total_ns(0), buckets(kNumBuckets, 0) { }
+
+        void Add(cl_ulong ns);
+        Timing Summarize(size_t count) const;
+
+        double total_ns;
+        std::vector<size_t> buckets;
+    };
+
+    struct Statistics {
+        Statistics() : count(0) { }
+
+        size_t count;
+        Histogram wait;
+        Histogram execution;
+    };
+
+    // Moves finished events from pending_ into statistics_. If |wait| is true, waits for all pending events first.
+    void Resolve(bool wait);
+
+    std::mutex mutex_;
+
+    // Commands that may not have finished yet, in submission order.
+    std::deque<std::pair<std::string, cl_event>> pending_;
+
+    std::map<std::string, Statistics> statistics_;
+
+    DISALLOW_COPY_AND_ASSIGN(Profiler);
+};
+
+}   // namespace ocl
+
+#endif
@@ -2,7 +2,7 @@
 
 namespace ocl {
 
-Program::Program(cl_command_queue command_queue, cl_program program, cl_device_id device) : program_(program), device_(device), command_queue_(command_queue) {
+Program::Program(cl_command_queue command_queue, cl_program program, cl_device_id device, Profiler* profiler) : program_(program), device_(device), profiler_(profiler), command_queue_(command_queue) {
     CL_Check(clRetainCommandQueue(command_queue_));
 }
 
@@ -21,7 +21,7 @@ std::unique_ptr<Kernel> Program::CreateKernel(std::string name) {
     cl_kernel kernel = clCreateKernel(program_, name.c_str(), &clError);
     CL_ENSURE_SUCCESS(clError, "Failed to create kernel '" << name << "'", nullptr);
 
-    return std::unique_ptr<Kernel>(new Kernel(command_queue_, kernel, device_));
+    return std::unique_ptr<Kernel>(new Kernel(command_queue_, kernel, device_, name, profiler_));
 }
 
 }       // namespace ocl
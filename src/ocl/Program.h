@@ -9,12 +9,14 @@
 
 #include "Utils.h"
 #include "Kernel.h"
+#include "Profiler.h"
 
 namespace ocl {
 
 class Program {
   public:
-    Program(cl_command_queue command_queue, cl_program program, cl_device_id device);
+    // If |profiler| is not null, kernels created from this program are profiled.
+    Program(cl_command_queue command_queue, cl_program program, cl_device_id device, Profiler* profiler);
 
     ~Program();
 
@@ -30,6 +32,9 @@ class Program {
     // Handle to the device that this program was compiled for.
     cl_device_id device_;
 
+    // Profiler passed on to all kernels, may be null. Not owned by this instance.
+    Profiler* profiler_;
+
     // Handle to the OpenCL command queue to communicate with the device.
     // Will be retained (to increase its refcount) upon construction and released upon destruction.
     cl_command_queue command_queue_;
@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "ProgramBuilder.h"
+#include "Device.h"
+
+using namespace std;
+
+namespace ocl {
+
+struct PendingProgram {
+    enum State { kQueued, kBuilding, kFinished };
+
+    PendingProgram(const string& path, const string& compile_options) : path(path), compile_options(compile_options), state(kQueued) { }
+
+    string path;
+    string compile_options;
+
+    State state;
+    unique_ptr<Program> program;
+};
+
+ProgramBuilder::ProgramBuilder(Device* device, size_t num_threads) : device_(device), shutdown_(false)
+{
+    for (size_t i = 0; i < num_threads; i++)
+        workers_.emplace_back(&ProgramBuilder::Work, this);
+}
+
+ProgramBuilder::~ProgramBuilder()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        shutdown_ = true;
+        queue_.clear();
+    }
+    work_available_.notify_all();
+
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+shared_ptr<PendingProgram> ProgramBuilder::BuildFromFile(const string& path, const string& compile_options)
+{
+    shared_ptr<PendingProgram> pending = make_shared<PendingProgram>(path, compile_options);
+    {
+        lock_guard<mutex> lock(mutex_);
+        queue_.push_back(pending);
+    }
+    work_available_.notify_one();
+    return pending;
+}
+
+unique_ptr<Program> ProgramBuilder::Await(const shared_ptr<PendingProgram>& pending)
+{
+    unique_lock<mutex> lock(mutex_);
+
+    if (pending->state == PendingProgram::kQueued) {
+        // Don't wait for a worker to become available, just do it ourselves.
+        queue_.erase(find(queue_.begin(), queue_.end(), pending));
+        pending->state = PendingProgram::kBuilding;
+        lock.unlock();
+        Build(pending.get());
+        lock.lock();
+    }
+
+    build_finished_.wait(lock, [&]() { return pending->state == PendingProgram::kFinished; });
+    return move(pending->program);
+}
+
+void ProgramBuilder::Work()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        work_available_.wait(lock, [&]() { return shutdown_ || !queue_.empty(); });
+        if (shutdown_)
+            return;
+
+        shared_ptr<PendingProgram> pending = queue_.front();
+        queue_.pop_front();
+        pending->state = PendingProgram::kBuilding;
+
+        lock.unlock();
+        Build(pending.get());
+        lock.lock();
+    }
+}
+
+void ProgramBuilder::Build(PendingProgram* pending)
+{
+    // The OpenCL API is thread safe (except for clSetKernelArg), so multiple programs can be built at the same time.
+    unique_ptr<Program> program = device_->CreateProgramFromFile(pending->path, pending->compile_options);
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        pending->program = move(program);
+        pending->state = PendingProgram::kFinished;
+    }
+    build_finished_.notify_all();
+}
+
+}       // namespace ocl
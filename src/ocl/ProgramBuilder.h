@@ -0,0 +1,78 @@
+//
+// Background compilation of OpenCL programs.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __PROGRAM_BUILDER_H__
+#define __PROGRAM_BUILDER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Program.h"
+#include "Utils.h"
+
+namespace ocl {
+
+class Device;
+
+// A program that has been scheduled for compilation. Opaque to users of the ProgramBuilder.
+struct PendingProgram;
+
+// Compiles programs on a set of worker threads.
+//
+// Compiling an OpenCL program can take several hundred milliseconds, most of which is spent
+// inside the driver. The builder allows these compilations to run concurrently with each other
+// and with the rest of the application.
+class ProgramBuilder {
+  public:
+    // Creates a builder that compiles programs for the given device using |num_threads| worker threads.
+    // The device must outlive the builder.
+    ProgramBuilder(Device* device, size_t num_threads);
+
+    // Waits for running compilations to finish. Compilations that have not started yet are dropped.
+    ~ProgramBuilder();
+
+    // Schedules the compilation of the program in the given file and returns immediately.
+    std::shared_ptr<PendingProgram> BuildFromFile(const std::string& path, const std::string& compile_options);
+
+    // Waits until the given program has been compiled and returns it, or nullptr if compilation failed.
+    // If no worker has picked up the program yet, it is compiled on the calling thread.
+    //
+    // Can only be called once per pending program.
+    std::unique_ptr<Program> Await(const std::shared_ptr<PendingProgram>& pending);
+
+  private:
+    // Main loop of the worker threads.
+    void Work();
+
+    // Compiles the given program and wakes up all threads waiting for it.
+    void Build(PendingProgram* pending);
+
+    // Device that the programs are compiled for. Not owned by this instance.
+    Device* device_;
+
+    std::vector<std::thread> workers_;
+
+    // Protects all members below as well as the state of all pending programs.
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable build_finished_;
+
+    // Programs waiting for a worker.
+    std::deque<std::shared_ptr<PendingProgram>> queue_;
+
+    bool shutdown_;
+
+    DISALLOW_COPY_AND_ASSIGN(ProgramBuilder);
+};
+
+}   // namespace ocl
+
+#endif
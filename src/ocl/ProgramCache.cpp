@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "ProgramCache.h"
+
+using namespace std;
+
+namespace ocl {
+
+// Identifies cache files and their format version.
+static const char kCacheFileMagic[8] = { 'D', 'L', 'C', 'L', 'B', 'I', 'N', '1' };
+
+static bool ReadFile(const string& path, string* content)
+{
+    ifstream file(path.c_str(), ios::binary);
+    if (!file.is_open())
+        return false;
+    stringstream stream;
+    stream << file.rdbuf();
+    *content = stream.str();
+    return true;
+}
+
+// Appends the content of all headers (transitively) included by |source| from one of the given directories to |result|.
+static void AppendIncludedHeaders(const string& source, const vector<string>& include_directories, set<string>* visited, string* result)
+{
+    istringstream lines(source);
+    string line;
+    while (getline(lines, line)) {
+        size_t pos = line.find_first_not_of(" \t");
+        if (pos == string::npos || line.compare(pos, 8, "#include") != 0)
+            continue;
+        size_t start = line.find('"', pos);
+        size_t end = start == string::npos ? string::npos : line.find('"', start + 1);
+        if (end == string::npos)
+            continue;
+
+        string name = line.substr(start + 1, end - start - 1);
+        for (const auto& directory : include_directories) {
+            string path = directory + "/" + name, header;
+            if (ReadFile(path, &header)) {
+                if (visited->insert(path).second) {
+                    *result += header;
+                    AppendIncludedHeaders(header, include_directories, visited, result);
+                }
+                break;
+            }
+        }
+    }
+}
+
+ProgramCache::ProgramCache(cl_device_id device, const string& directory) : device_(device), directory_(directory)
+{
+    if (directory_.empty() || directory_.back() != '/')
+        directory_ += '/';
+}
+
+bool ProgramCache::Init()
+{
+    FAIL_IF(!util::MakeDirectories(directory_.substr(0, directory_.size() - 1)), "Failed to create program cache directory '" << directory_ << "'", false);
+
+    device_description_ = util::DeviceDescription(device_);
+    FAIL_IF(device_description_.empty(), "Failed to query device information", false);
+
+    return true;
+}
+
+string ProgramCache::DefaultDirectory()
+{
+    const char* directory = getenv("DEEPLEARN_KERNEL_CACHE");
+    if (directory)
+        return directory;
+
+    const char* home = getenv("HOME");
+    return string(home ? home : "/tmp") + "/.cache/deeplearn/kernels/";
+}
+
+string ProgramCache::Key(const string& source, const string& compile_options)
+{
+    // Headers can change without the including source changing, so they are part of the key as well.
+    vector<string> include_directories;
+    istringstream options(compile_options);
+    string option;
+    while (options >> option) {
+        if (option == "-I" && options >> option)
+            include_directories.push_back(option);
+        else if (option.compare(0, 2, "-I") == 0)
+            include_directories.push_back(option.substr(2));
+    }
+
+    string full_source = source;
+    set<string> visited;
+    AppendIncludedHeaders(source, include_directories, &visited, &full_source);
+
+    return device_description_ + compile_options + "\n" + util::HexString(util::Hash(full_source)) + "\n";
+}
+
+string ProgramCache::PathForKey(const string& key)
+{
+    return directory_ + util::HexString(util::Hash(key)) + ".bin";
+}
+
+cl_program ProgramCache::Load(cl_context context, const string& source, const string& compile_options)
+{
+    string key = Key(source, compile_options);
+    string path = PathForKey(key);
+
+    string content;
+    if (!ReadFile(path, &content))
+        return nullptr;
+
+    // Layout: magic, key length, key, binary.
+    size_t header_size = sizeof(kCacheFileMagic) + sizeof(uint64_t);
+    uint64_t key_length = 0;
+    if (content.size() >= header_size)
+        content.copy(reinterpret_cast<char*>(&key_length), sizeof(key_length), sizeof(kCacheFileMagic));
+    if (content.size() < header_size + key_length ||
+        content.compare(0, sizeof(kCacheFileMagic), kCacheFileMagic, sizeof(kCacheFileMagic)) != 0 ||
+        content.compare(header_size, key_length, key) != 0) {
+        // Stale or corrupted entry, e.g. after a hash collision.
+        remove(path.c_str());
+        return nullptr;
+    }
+
+    const unsigned char* binary = reinterpret_cast<const unsigned char*>(content.data()) + header_size + key_length;
+    size_t binary_size = content.size() - header_size - key_length;
+
+    cl_int clError, binary_status;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device_, &binary_size, &binary, &binary_status, &clError);
+    if (clError == CL_SUCCESS && binary_status == CL_SUCCESS)
+        clError = clBuildProgram(program, 1, &device_, compile_options.c_str(), NULL, NULL);
+    else if (clError == CL_SUCCESS)
+        clError = binary_status;
+
+    if (clError != CL_SUCCESS) {
+        // The driver no longer accepts this binary.
+        if (program)
+            clReleaseProgram(program);
+        remove(path.c_str());
+        return nullptr;
+    }
+
+    return program;
+}
+
+bool ProgramCache::Store(cl_program program, const string& source, const string& compile_options)
+{
+    size_t binary_size;
+    CL_ENSURE_SUCCESS(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL), "Failed to query program binary size", false);
+    FAIL_IF(binary_size == 0, "Program binary is not available", false);
+
+    vector<unsigned char> binary(binary_size);
+    unsigned char* binary_ptr = &binary[0];
+    CL_ENSURE_SUCCESS(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary_ptr, NULL), "Failed to retrieve program binary", false);
+
+    string key = Key(source, compile_options);
+    string path = PathForKey(key);
+    uint64_t key_length = key.size();
+
+    // Write to a temporary file first so that concurrent sessions never see partially written entries.
+    string tmp_path = util::TemporaryPath(path);
+    {
+        ofstream file(tmp_path.c_str(), ios::binary | ios::trunc);
+        FAIL_IF(!file.is_open(), "Failed to create '" << tmp_path << "'", false);
+        file.write(kCacheFileMagic, sizeof(kCacheFileMagic));
+        file.write(reinterpret_cast<const char*>(&key_length), sizeof(key_length));
+        file.write(key.data(), key.size());
+        file.write(reinterpret_cast<const char*>(&binary[0]), binary.size());
+        FAIL_IF(!file.good(), "Failed to write '" << tmp_path << "'", false);
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}       // namespace ocl
@@ -0,0 +1,61 @@
+//
+// On-disk cache of compiled OpenCL programs.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __PROGRAM_CACHE_H__
+#define __PROGRAM_CACHE_H__
+
+#include <string>
+
+#include "Utils.h"
+
+namespace ocl {
+
+// Stores the binaries of compiled programs (CL_PROGRAM_BINARIES) in a directory so that
+// later sessions can skip the compilation step.
+//
+// Each entry is keyed by the device, its driver version, the program source (including all
+// headers it includes from one of the -I directories) and the compile options. The full key is
+// stored alongside the binary, entries that do not match it are discarded.
+class ProgramCache {
+  public:
+    ProgramCache(cl_device_id device, const std::string& directory);
+
+    // Creates the cache directory if necessary. Returns false if the cache cannot be used.
+    bool Init();
+
+    // Loads and builds the cached program for the given source and compile options.
+    //
+    // Returns nullptr if no (valid) binary is available.
+    cl_program Load(cl_context context, const std::string& source, const std::string& compile_options);
+
+    // Stores the binary of the given (built) program in the cache.
+    bool Store(cl_program program, const std::string& source, const std::string& compile_options);
+
+    // Returns the default cache directory, $DEEPLEARN_KERNEL_CACHE if set, else ~/.cache/deeplearn/kernels/.
+    static std::string DefaultDirectory();
+
+  private:
+    // Returns the full key describing the given program on this device.
+    std::string Key(const std::string& source, const std::string& compile_options);
+
+    // Returns the path of the cache file for the given key.
+    std::string PathForKey(const std::string& key);
+
+    // Handle to the device that the programs are compiled for. Not owned by this instance.
+    cl_device_id device_;
+
+    // Directory containing the cached binaries, with trailing slash.
+    std::string directory_;
+
+    // Name, vendor and driver version of the device. Valid after Init() has been called.
+    std::string device_description_;
+
+    DISALLOW_COPY_AND_ASSIGN(ProgramCache);
+};
+
+}   // namespace ocl
+
+#endif
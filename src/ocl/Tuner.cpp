@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "Tuner.h"
+
+using namespace std;
+
+namespace ocl {
+
+constexpr size_t Tuner::kBenchmarkRepetitions;
+
+// Returns the smallest power of two that is greater or equal to |value|.
+static size_t NextPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+    while (result < value)
+        result *= 2;
+    return result;
+}
+
+bool Tuner::Init(Device* device, const string& path)
+{
+    device_ = device;
+    path_ = path;
+    for (unsigned int d = 0; d < 3; d++)
+        max_work_item_sizes_[d] = device_->MaxWorkItemSize(d);
+
+    ifstream file(path_.c_str());
+    if (!file.is_open())
+        return true;            // Nothing tuned yet.
+
+    // Format: one entry per line, "key value1 value2 ...". Lines starting with '#' are comments.
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        istringstream entry(line);
+        string key;
+        Parameters parameters;
+        size_t value;
+        entry >> key;
+        while (entry >> value)
+            parameters.push_back(value);
+        FAIL_IF(key.empty() || parameters.empty() || !entry.eof(), "Malformed tuning file '" << path_ << "'", false);
+
+        results_[key] = parameters;
+    }
+
+    return true;
+}
+
+bool Tuner::Lookup(const string& key, Parameters* parameters) const
+{
+    auto it = results_.find(key);
+    if (it == results_.end())
+        return false;
+    *parameters = it->second;
+    return true;
+}
+
+void Tuner::Store(const string& key, const Parameters& parameters)
+{
+    results_[key] = parameters;
+    WARN_IF(!Save(), "Failed to write tuning file '" << path_ << "'");
+}
+
+bool Tuner::Save() const
+{
+    size_t separator = path_.rfind('/');
+    if (separator != string::npos && separator > 0)
+        util::MakeDirectories(path_.substr(0, separator));
+
+    string tmp_path = util::TemporaryPath(path_);
+    {
+        ofstream file(tmp_path.c_str(), ios::trunc);
+        if (!file.is_open())
+            return false;
+
+        istringstream description(device_->Description());
+        string line;
+        while (getline(description, line))
+            file << "# " << line << endl;
+
+        for (const auto& result : results_) {
+            file << result.first;
+            for (size_t value : result.second)
+                file << " " << value;
+            file << endl;
+        }
+
+        if (!file.good())
+            return false;
+    }
+
+    return rename(tmp_path.c_str(), path_.c_str()) == 0;
+}
+
+vector<Tuner::Parameters> Tuner::LocalWorkSizeCandidates(const Kernel& kernel, Kernel::WorkSize gws) const
+{
+    size_t max_size = kernel.MaxWorkGroupSize();
+    size_t multiple = min(max<size_t>(kernel.PreferredWorkSizeMultiple(), 1), max_size);
+
+    // Limits per dimension. There is no point in using work groups that are much larger than the problem itself.
+    size_t limits[3] = { 1, 1, 1 };
+    for (unsigned int d = 0; d < gws.dimensions; d++)
+        limits[d] = min(max_work_item_sizes_[d], max(NextPowerOfTwo(gws.values[d]), multiple));
+
+    vector<Parameters> candidates;
+    for (size_t z = 1; z <= limits[2]; z *= 2) {
+        for (size_t y = 1; y <= limits[1]; y *= 2) {
+            for (size_t x = 1; x <= limits[0]; x *= 2) {
+                size_t size = x * y * z;
+                if (size > max_size || size % multiple != 0)
+                    continue;
+
+                Parameters candidate = { x, y, z };
+                candidate.resize(gws.dimensions);
+                candidates.push_back(candidate);
+            }
+        }
+    }
+
+    return candidates;
+}
+
+string Tuner::Key(const string& name, Kernel::WorkSize problem_size)
+{
+    stringstream key;
+    key << name << "/";
+    for (unsigned int d = 0; d < problem_size.dimensions; d++)
+        key << (d > 0 ? "x" : "") << NextPowerOfTwo(problem_size.values[d]);
+    return key.str();
+}
+
+string Tuner::DefaultPath(Device* device)
+{
+    const char* directory = getenv("DEEPLEARN_TUNING_DIR");
+    string path;
+    if (directory) {
+        path = directory;
+    } else {
+        const char* home = getenv("HOME");
+        path = string(home ? home : "/tmp") + "/.cache/deeplearn";
+    }
+
+    return path + "/tuning-" + util::HexString(util::Hash(device->Description())) + ".txt";
+}
+
+}       // namespace ocl
@@ -0,0 +1,126 @@
+//
+// Autotuning of kernel launch parameters.
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __TUNER_H__
+#define __TUNER_H__
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Device.h"
+#include "Kernel.h"
+#include "Utils.h"
+
+namespace ocl {
+
+// Finds and remembers the fastest launch parameters (local work sizes, items per thread, ...) for kernels on a device.
+//
+// Parameters are stored per key, where a key usually identifies a kernel together with a bucket of problem sizes.
+// Results are written to a tuning file, so later sessions on the same device can use them without benchmarking.
+class Tuner {
+  public:
+    typedef std::vector<size_t> Parameters;
+
+    Tuner() : device_(nullptr), enabled_(false) { }
+
+    // Uses the given tuning file for the given device. Results from earlier sessions are loaded from it.
+    bool Init(Device* device, const std::string& path);
+
+    // If enabled, parameters that are not in the tuning file yet are determined by benchmarking all candidates.
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    // Whether Lookup() can possibly succeed. Allows callers to skip building keys on the fast path.
+    bool active() const { return enabled_ || !results_.empty(); }
+
+    // Retrieves the tuned parameters for the given key. Returns false if the key hasn't been tuned yet.
+    bool Lookup(const std::string& key, Parameters* parameters) const;
+
+    // Returns the tuned parameters for the given key.
+    //
+    // If the key is unknown and tuning is enabled, |benchmark| is called with every candidate. It must
+    // enqueue the work to measure and return false if the candidate cannot be used. The fastest candidate
+    // is then stored and returned. Otherwise, |fallback| is returned.
+    //
+    // The benchmark must not modify any data that is still needed, as it runs multiple times.
+    template <typename Benchmark>
+    Parameters Tune(const std::string& key, const std::vector<Parameters>& candidates, const Parameters& fallback, Benchmark benchmark)
+    {
+        Parameters result;
+        if (Lookup(key, &result))
+            return result;
+        if (!enabled_ || candidates.empty())
+            return fallback;
+
+        double best_time = -1;
+        result = fallback;
+        for (const Parameters& candidate : candidates) {
+            // The first run includes one-time costs (e.g. allocations), so don't measure it.
+            if (!benchmark(candidate))
+                continue;
+            device_->AwaitJobCompletion();
+
+            auto begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < kBenchmarkRepetitions; i++)
+                benchmark(candidate);
+            device_->AwaitJobCompletion();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+            if (best_time < 0 || elapsed.count() < best_time) {
+                best_time = elapsed.count();
+                result = candidate;
+            }
+        }
+
+        if (best_time >= 0)
+            Store(key, result);
+        return result;
+    }
+
+    // Stores parameters for the given key and updates the tuning file.
+    void Store(const std::string& key, const Parameters& parameters);
+
+    // Returns all candidate local work sizes for running |kernel| with the given global work size.
+    //
+    // The candidates respect the maximum work group size of the kernel and device and are multiples of
+    // the preferred work group size multiple of the kernel whenever possible.
+    std::vector<Parameters> LocalWorkSizeCandidates(const Kernel& kernel, Kernel::WorkSize gws) const;
+
+    // Returns the key for |name| and the given problem size. Problem sizes are bucketed
+    // (rounded up to the next power of two) so that similar sizes share their parameters.
+    static std::string Key(const std::string& name, Kernel::WorkSize problem_size);
+
+    // Returns the default tuning file for the given device, in $DEEPLEARN_TUNING_DIR if set, else ~/.cache/deeplearn/.
+    static std::string DefaultPath(Device* device);
+
+  private:
+    // Number of timed runs per candidate.
+    static constexpr size_t kBenchmarkRepetitions = 10;
+
+    // Writes all results to the tuning file.
+    bool Save() const;
+
+    // Device that the kernels are tuned for. Not owned by this instance.
+    Device* device_;
+
+    // Path to the tuning file.
+    std::string path_;
+
+    bool enabled_;
+
+    std::map<std::string, Parameters> results_;
+
+    // Maximum number of work items per dimension of a work group on the device.
+    size_t max_work_item_sizes_[3];
+
+    DISALLOW_COPY_AND_ASSIGN(Tuner);
+};
+
+}   // namespace ocl
+
+#endif
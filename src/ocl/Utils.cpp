@@ -1,8 +1,62 @@
+#include <atomic>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "Utils.h"
 
 namespace ocl {
 namespace util {
 
+std::string DeviceDescription(cl_device_id device)
+{
+    const cl_device_info properties[] = { CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION, CL_DRIVER_VERSION };
+    const size_t buffer_size = 1024;
+    char buffer[buffer_size];
+
+    std::string description;
+    for (cl_device_info property : properties) {
+        if (clGetDeviceInfo(device, property, buffer_size, buffer, NULL) != CL_SUCCESS)
+            return "";
+        description += buffer;
+        description += "\n";
+    }
+    return description;
+}
+
+bool MakeDirectories(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    mkdir(path.c_str(), 0755);
+
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+std::string TemporaryPath(const std::string& path)
+{
+    static std::atomic<unsigned long> counter(0);
+    return path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+uint64_t Hash(const std::string& data)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string HexString(uint64_t value)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+    return buf;
+}
+
 #define CL_ERROR(x) case (x): return #x;
 
 const char* GetCLErrorString(cl_int CLErrorCode)
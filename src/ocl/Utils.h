@@ -6,6 +6,7 @@
 #define __UTILS_H__
 
 #include <iostream>
+#include <string>
 
 #include "../common/Common.h"
 
@@ -23,6 +24,20 @@ namespace util {
 
 	const char* GetCLErrorString(cl_int CLErrorCode);
 
+    // Returns a string identifying the device and its driver: name, vendor, OpenCL version and driver version.
+    std::string DeviceDescription(cl_device_id device);
+
+    // Creates the given directory and all its parents. Returns true if the directory exists afterwards.
+    bool MakeDirectories(const std::string& path);
+
+    // Returns a path next to |path| that is unique to this call, for writing a file that then replaces |path|.
+    // Unique across processes and across threads of this process.
+    std::string TemporaryPath(const std::string& path);
+
+    // 64-bit FNV-1a hash of the given data and its hexadecimal representation.
+    uint64_t Hash(const std::string& data);
+    std::string HexString(uint64_t value);
+
 }       // namespace util
 }       // namespace ocl
 
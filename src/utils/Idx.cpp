@@ -0,0 +1,153 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/Idx.h"
+
+using namespace std;
+using namespace nn;
+
+namespace utils {
+
+// Reads a big endian integer of N bytes.
+template <size_t N>
+static inline uint64_t ReadBigEndian(const uint8_t* bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < N; i++)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+// Converts |count| big endian elements of type T, stored in an unsigned integer of the same size, to floats.
+template <typename T, typename Bits>
+static void Convert(const uint8_t* bytes, size_t count, float scale, float* output)
+{
+    static_assert(sizeof(T) == sizeof(Bits), "Type mismatch");
+    for (size_t i = 0; i < count; i++) {
+        Bits bits = ReadBigEndian<sizeof(T)>(bytes + i * sizeof(T));
+        T value;
+        memcpy(&value, &bits, sizeof(T));
+        output[i] = value * scale;
+    }
+}
+
+unique_ptr<IdxFile> IdxFile::Open(const string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    FAIL_IF(fd < 0, "Failed to open file '" << path << "'.", nullptr);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 4) {
+        close(fd);
+        FAIL_IF(true, "Invalid IDX file '" << path << "'.", nullptr);
+    }
+    size_t size = st.st_size;
+
+    // The mapping stays valid after the file has been closed.
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    FAIL_IF(mapping == MAP_FAILED, "Failed to map file '" << path << "'.", nullptr);
+
+    // Header: two zero bytes, the data type, the rank, then the size of every dimension as 32 bit big endian integer.
+    const uint8_t* bytes = static_cast<const uint8_t*>(mapping);
+    DataType type = static_cast<DataType>(bytes[2]);
+    size_t rank = bytes[3];
+
+    size_t element_size = 0;
+    switch (type) {
+        case kUInt8:
+        case kInt8:
+            element_size = 1;
+            break;
+        case kInt16:
+            element_size = 2;
+            break;
+        case kInt32:
+        case kFloat32:
+            element_size = 4;
+            break;
+        case kFloat64:
+            element_size = 8;
+            break;
+    }
+
+    size_t header_size = 4 + 4 * rank;
+    bool valid = bytes[0] == 0 && bytes[1] == 0 && element_size != 0 && rank > 0 && size >= header_size;
+
+    vector<size_t> dimensions;
+    size_t num_elements = 1;
+    for (size_t i = 0; valid && i < rank; i++) {
+        dimensions.push_back(ReadBigEndian<4>(bytes + 4 + 4 * i));
+        num_elements *= dimensions.back();
+    }
+    valid = valid && num_elements > 0 && size == header_size + num_elements * element_size;
+
+    if (!valid) {
+        munmap(mapping, size);
+        FAIL_IF(true, "Invalid or corrupted IDX file '" << path << "'.", nullptr);
+    }
+
+    // Samples are usually accessed in random order.
+    madvise(mapping, size, MADV_RANDOM);
+
+    return unique_ptr<IdxFile>(new IdxFile(mapping, size, type, element_size, dimensions, header_size));
+}
+
+IdxFile::IdxFile(void* mapping, size_t mapping_size, DataType type, size_t element_size, const vector<size_t>& dimensions, size_t header_size) :
+    mapping_(mapping),
+    mapping_size_(mapping_size),
+    type_(type),
+    element_size_(element_size),
+    dimensions_(dimensions),
+    sample_size_(1),
+    data_(static_cast<const uint8_t*>(mapping) + header_size),
+    scale_(1.f)
+{
+    for (size_t i = 1; i < dimensions.size(); i++)
+        sample_size_ *= dimensions[i];
+}
+
+IdxFile::~IdxFile()
+{
+    munmap(mapping_, mapping_size_);
+}
+
+Shape IdxFile::sample_shape() const
+{
+    if (dimensions_.size() == 1)
+        return Shape({1});
+    return Shape(vector<size_t>(dimensions_.begin() + 1, dimensions_.end()));
+}
+
+void IdxFile::Load(size_t index, float* output) const
+{
+    const uint8_t* bytes = sample(index);
+
+    switch (type_) {
+        case kUInt8:
+            for (size_t i = 0; i < sample_size_; i++)
+                output[i] = bytes[i] * scale_;
+            break;
+        case kInt8:
+            for (size_t i = 0; i < sample_size_; i++)
+                output[i] = static_cast<int8_t>(bytes[i]) * scale_;
+            break;
+        case kInt16:
+            Convert<int16_t, uint16_t>(bytes, sample_size_, scale_, output);
+            break;
+        case kInt32:
+            Convert<int32_t, uint32_t>(bytes, sample_size_, scale_, output);
+            break;
+        case kFloat32:
+            Convert<float, uint32_t>(bytes, sample_size_, scale_, output);
+            break;
+        case kFloat64:
+            Convert<double, uint64_t>(bytes, sample_size_, scale_, output);
+            break;
+    }
+}
+
+}       // namespace utils
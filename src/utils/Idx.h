@@ -0,0 +1,91 @@
+//
+// Reader for the IDX file format
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __IDX_H__
+#define __IDX_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nn/Dataset.h"
+
+namespace utils {
+
+// An IDX file (as used for the MNIST dataset), mapped into memory.
+//
+// An IDX file stores a big endian array of arbitrary rank. Its first dimension is treated as the sample dimension.
+// The file is never copied or converted as a whole: samples can be accessed in place through sample(), and are
+// only converted to floats when requested through Load(), typically on the worker threads of a nn::DataLoader.
+class IdxFile : public nn::Dataset {
+  public:
+    // Element types, as encoded in the magic number of the file.
+    enum DataType {
+        kUInt8   = 0x08,
+        kInt8    = 0x09,
+        kInt16   = 0x0B,
+        kInt32   = 0x0C,
+        kFloat32 = 0x0D,
+        kFloat64 = 0x0E,
+    };
+
+    // Maps the file at the given path into memory and validates its header. Returns nullptr on failure.
+    static std::unique_ptr<IdxFile> Open(const std::string& path);
+
+    virtual ~IdxFile();
+
+    DataType type() const { return type_; }
+
+    // Returns the size of the array in every dimension. The first dimension is the number of samples.
+    const std::vector<size_t>& dimensions() const { return dimensions_; }
+
+    // Returns the size of a single element in bytes.
+    size_t element_size() const { return element_size_; }
+
+    // Returns the number of elements per sample.
+    size_t sample_size() const { return sample_size_; }
+
+    // Returns the raw bytes of the sample with the given index, pointing directly into the mapped file.
+    // For multi-byte types, the elements are stored in big endian byte order.
+    const uint8_t* sample(size_t index) const
+    {
+        Assert(index < num_samples());
+        return data_ + index * sample_size_ * element_size_;
+    }
+
+    // Sets the factor that elements are multiplied with by Load(), e.g. 1/255 to map 8 bit pixels to [0, 1].
+    void set_scale(float scale) { scale_ = scale; }
+
+    virtual size_t num_samples() const override { return dimensions_[0]; }
+
+    // Samples of one-dimensional files consist of a single element.
+    virtual nn::Shape sample_shape() const override;
+
+    virtual void Load(size_t index, float* output) const override;
+
+  private:
+    IdxFile(void* mapping, size_t mapping_size, DataType type, size_t element_size, const std::vector<size_t>& dimensions, size_t header_size);
+
+    // The whole file, as returned by mmap.
+    void* mapping_;
+    size_t mapping_size_;
+
+    DataType type_;
+    size_t element_size_;
+    std::vector<size_t> dimensions_;
+    size_t sample_size_;
+
+    // Start of the array data inside the mapping.
+    const uint8_t* data_;
+
+    float scale_;
+
+    DISALLOW_COPY_AND_ASSIGN(IdxFile);
+};
+
+}       // namespace utils
+
+#endif
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils/InferenceServer.h"
+
+using namespace std;
+using namespace nn;
+
+namespace utils {
+
+// How often the accept loop checks whether the server has been stopped.
+static const int kPollIntervalMs = 100;
+
+// Reads exactly |nbytes| bytes. Returns false if the connection was closed or an error occurred.
+static bool ReadFully(int fd, void* buffer, size_t nbytes)
+{
+    uint8_t* current = static_cast<uint8_t*>(buffer);
+    while (nbytes > 0) {
+        ssize_t n = read(fd, current, nbytes);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        current += n;
+        nbytes -= n;
+    }
+    return true;
+}
+
+// Writes exactly |nbytes| bytes. Doesn't raise SIGPIPE if the peer has gone away.
+static bool WriteFully(int fd, const void* buffer, size_t nbytes)
+{
+    const uint8_t* current = static_cast<const uint8_t*>(buffer);
+    while (nbytes > 0) {
+        ssize_t n = send(fd, current, nbytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        current += n;
+        nbytes -= n;
+    }
+    return true;
+}
+
+// Fills in a socket address for the given path. Returns false if the path is too long.
+static bool MakeAddress(const string& path, sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    FAIL_IF(path.size() >= sizeof(address->sun_path), "Socket path '" << path << "' is too long.", false);
+    strncpy(address->sun_path, path.c_str(), sizeof(address->sun_path) - 1);
+    return true;
+}
+
+ServerStatistics::ServerStatistics(size_t max_batch_size) :
+    start_(chrono::steady_clock::now()),
+    num_requests_(0),
+    num_batches_(0),
+    total_latency_ms_(0),
+    max_latency_ms_(0),
+    next_latency_(0),
+    batch_sizes_(max_batch_size + 1, 0) { }
+
+void ServerStatistics::RecordBatch(const vector<double>& latencies_ms)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    Assert(latencies_ms.size() < batch_sizes_.size());
+    num_batches_++;
+    batch_sizes_[latencies_ms.size()]++;
+
+    for (double latency : latencies_ms) {
+        num_requests_++;
+        total_latency_ms_ += latency;
+        max_latency_ms_ = max(max_latency_ms_, latency);
+
+        if (recent_latencies_ms_.size() < kLatencyWindow) {
+            recent_latencies_ms_.push_back(latency);
+        } else {
+            recent_latencies_ms_[next_latency_] = latency;
+            next_latency_ = (next_latency_ + 1) % kLatencyWindow;
+        }
+    }
+}
+
+size_t ServerStatistics::num_requests() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return num_requests_;
+}
+
+size_t ServerStatistics::num_batches() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return num_batches_;
+}
+
+string ServerStatistics::ToString() const
+{
+    lock_guard<mutex> lock(mutex_);
+
+    chrono::duration<double> uptime = chrono::steady_clock::now() - start_;
+    stringstream stream;
+    stream << fixed << setprecision(2);
+    stream << "requests: " << num_requests_ << "  batches: " << num_batches_
+           << "  throughput: " << num_requests_ / uptime.count() << " requests/s" << endl;
+
+    if (num_requests_ == 0)
+        return stream.str();
+
+    vector<double> sorted(recent_latencies_ms_);
+    sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) { return sorted[min(sorted.size() - 1, size_t(p * sorted.size()))]; };
+
+    stream << "latency (ms):  mean " << total_latency_ms_ / num_requests_
+           << "  p50 " << percentile(0.5) << "  p90 " << percentile(0.9) << "  p99 " << percentile(0.99)
+           << "  max " << max_latency_ms_ << endl;
+
+    stream << "batch size:    mean " << (double)num_requests_ / num_batches_ << "  histogram";
+    for (size_t size = 1; size < batch_sizes_.size(); size++) {
+        if (batch_sizes_[size] > 0)
+            stream << "  " << size << ": " << batch_sizes_[size];
+    }
+    stream << endl;
+
+    return stream.str();
+}
+
+InferenceServer::InferenceServer(const Shape& input_shape, const Shape& output_shape, BatchFunction evaluate, size_t max_batch_size, chrono::microseconds max_wait) :
+    input_shape_(input_shape),
+    output_shape_(output_shape),
+    input_size_(input_shape.TotalElementCount()),
+    output_size_(output_shape.TotalElementCount()),
+    evaluate_(evaluate),
+    max_batch_size_(max_batch_size),
+    max_wait_(max_wait),
+    listen_fd_(-1),
+    stop_(false),
+    stopping_(false),
+    statistics_(max_batch_size)
+{
+    Assert(max_batch_size > 0);
+}
+
+InferenceServer::~InferenceServer()
+{
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool InferenceServer::Listen(const string& path)
+{
+    sockaddr_un address;
+    if (!MakeAddress(path, &address))
+        return false;
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    FAIL_IF(listen_fd_ < 0, "Failed to create socket: " << strerror(errno), false);
+
+    // A stale socket from a previous run would make bind() fail.
+    unlink(path.c_str());
+    path_ = path;
+
+    FAIL_IF(bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0, "Failed to bind to '" << path << "': " << strerror(errno), false);
+    FAIL_IF(listen(listen_fd_, SOMAXCONN) != 0, "Failed to listen on '" << path << "': " << strerror(errno), false);
+
+    return true;
+}
+
+void InferenceServer::Run()
+{
+    Assert(listen_fd_ >= 0);
+
+    batcher_ = thread(&InferenceServer::ProcessBatches, this);
+
+    while (!stop_) {
+        pollfd listener = { listen_fd_, POLLIN, 0 };
+        if (poll(&listener, 1, kPollIntervalMs) <= 0)
+            continue;
+
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        WARN_IF(fd < 0 && errno != EINTR, "Failed to accept connection: " << strerror(errno));
+        if (fd < 0)
+            continue;
+
+        ReapConnections(false);
+
+        Connection* connection = new Connection();
+        connection->fd = fd;
+        connection->finished = false;
+        connections_.emplace_back(connection);
+        connection->thread = thread(&InferenceServer::ServeConnection, this, connection);
+    }
+
+    // Stop accepting requests. Requests that are already queued are still answered.
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queue_changed_.notify_all();
+
+    ReapConnections(true);
+    batcher_.join();
+}
+
+void InferenceServer::ReapConnections(bool all)
+{
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        Connection* connection = it->get();
+        if (all)
+            shutdown(connection->fd, SHUT_RDWR);
+
+        if (all || connection->finished) {
+            connection->thread.join();
+            close(connection->fd);
+            it = connections_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void InferenceServer::ServeConnection(Connection* connection)
+{
+    int fd = connection->fd;
+    vector<float> input(input_size_), output(output_size_);
+
+    uint32_t command;
+    while (ReadFully(fd, &command, sizeof(command))) {
+        bool success = false;
+
+        if (command == kDescribe) {
+            uint32_t sizes[] = { uint32_t(input_size_), uint32_t(output_size_) };
+            success = WriteFully(fd, sizes, sizeof(sizes));
+        } else if (command == kEvaluate) {
+            if (!ReadFully(fd, input.data(), input_size_ * sizeof(float)))
+                break;
+
+            Request request = { input.data(), output.data(), chrono::steady_clock::now(), false };
+            {
+                unique_lock<mutex> lock(mutex_);
+                if (stopping_)
+                    break;
+                queue_.push_back(&request);
+                queue_changed_.notify_one();
+                batch_done_.wait(lock, [&request]() { return request.done; });
+            }
+
+            success = WriteFully(fd, output.data(), output_size_ * sizeof(float));
+        } else if (command == kStatistics) {
+            string text = statistics_.ToString();
+            uint32_t length = text.size();
+            success = WriteFully(fd, &length, sizeof(length)) && WriteFully(fd, text.data(), length);
+        } else {
+            WARN_IF(true, "Unknown command " << command << ", closing connection.");
+        }
+
+        if (!success)
+            break;
+    }
+
+    connection->finished = true;
+}
+
+void InferenceServer::ProcessBatches()
+{
+    vector<size_t> input_dimensions = { 0 }, output_dimensions = { 0 };
+    for (size_t i = 0; i < input_shape_.rank(); i++)
+        input_dimensions.push_back(input_shape_[i]);
+    for (size_t i = 0; i < output_shape_.rank(); i++)
+        output_dimensions.push_back(output_shape_[i]);
+
+    vector<Request*> batch;
+    vector<double> latencies;
+
+    while (true) {
+        {
+            unique_lock<mutex> lock(mutex_);
+            queue_changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+
+            // Wait for more requests until the batch is full or the oldest request has waited long enough.
+            chrono::steady_clock::time_point deadline = queue_.front()->arrival + max_wait_;
+            queue_changed_.wait_until(lock, deadline, [this]() { return stopping_ || queue_.size() >= max_batch_size_; });
+
+            size_t batch_size = min(queue_.size(), max_batch_size_);
+            batch.assign(queue_.begin(), queue_.begin() + batch_size);
+            queue_.erase(queue_.begin(), queue_.begin() + batch_size);
+        }
+
+        input_dimensions[0] = output_dimensions[0] = batch.size();
+        Shape input_batch_shape(input_dimensions), output_batch_shape(output_dimensions);
+
+        CPUTensor inputs(input_batch_shape);
+        for (size_t i = 0; i < batch.size(); i++)
+            copy(batch[i]->input, batch[i]->input + input_size_, inputs.begin() + i * input_size_);
+
+        CPUTensor outputs = evaluate_(inputs);
+        Check(outputs.shape() == output_batch_shape, "Batch function returned a tensor of shape " << outputs.shape().ToString());
+
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        latencies.clear();
+        for (size_t i = 0; i < batch.size(); i++) {
+            copy(outputs.begin() + i * output_size_, outputs.begin() + (i + 1) * output_size_, batch[i]->output);
+            latencies.push_back(chrono::duration<double, milli>(now - batch[i]->arrival).count());
+        }
+        statistics_.RecordBatch(latencies);
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            for (Request* request : batch)
+                request->done = true;
+        }
+        batch_done_.notify_all();
+    }
+}
+
+unique_ptr<InferenceClient> InferenceClient::Connect(const string& path)
+{
+    sockaddr_un address;
+    if (!MakeAddress(path, &address))
+        return nullptr;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    FAIL_IF(fd < 0, "Failed to create socket: " << strerror(errno), nullptr);
+
+    unique_ptr<InferenceClient> client(new InferenceClient(fd));
+    FAIL_IF(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0, "Failed to connect to '" << path << "': " << strerror(errno), nullptr);
+
+    uint32_t command = InferenceServer::kDescribe, sizes[2];
+    FAIL_IF(!WriteFully(fd, &command, sizeof(command)) || !ReadFully(fd, sizes, sizeof(sizes)), "Failed to query the server.", nullptr);
+    client->input_size_ = sizes[0];
+    client->output_size_ = sizes[1];
+
+    return client;
+}
+
+InferenceClient::InferenceClient(int fd) : fd_(fd), input_size_(0), output_size_(0) { }
+
+InferenceClient::~InferenceClient()
+{
+    close(fd_);
+}
+
+bool InferenceClient::Evaluate(const float* input, float* output)
+{
+    uint32_t command = InferenceServer::kEvaluate;
+    return WriteFully(fd_, &command, sizeof(command)) &&
+           WriteFully(fd_, input, input_size_ * sizeof(float)) &&
+           ReadFully(fd_, output, output_size_ * sizeof(float));
+}
+
+bool InferenceClient::Statistics(string* text)
+{
+    uint32_t command = InferenceServer::kStatistics, length;
+    if (!WriteFully(fd_, &command, sizeof(command)) || !ReadFully(fd_, &length, sizeof(length)))
+        return false;
+
+    text->resize(length);
+    return length == 0 || ReadFully(fd_, &text->at(0), length);
+}
+
+}       // namespace utils
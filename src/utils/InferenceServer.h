@@ -0,0 +1,205 @@
+//
+// Inference server with dynamic batching
+//
+// Copyright (c) 2016 Samuel Groß
+//
+
+#ifndef __INFERENCE_SERVER_H__
+#define __INFERENCE_SERVER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nn/Tensor.h"
+#include "common/Common.h"
+
+namespace utils {
+
+//
+// Protocol
+//
+// Clients connect to a Unix domain stream socket and send any number of requests over the same connection.
+// Every request starts with a 32 bit command, all values are in host byte order:
+//
+//      kDescribe       Reply: the number of input and output elements per sample, as two 32 bit integers.
+//      kEvaluate       Followed by the input elements as floats. Reply: the output elements as floats.
+//      kStatistics     Reply: the length of the statistics text as 32 bit integer, followed by the text.
+//
+// A connection has at most one request in flight. Clients that want to issue requests concurrently open
+// multiple connections; their requests are then batched together by the server.
+//
+
+// Latency, batch size and throughput statistics of an InferenceServer. Thread safe.
+class ServerStatistics {
+  public:
+    explicit ServerStatistics(size_t max_batch_size);
+
+    // Records a batch with the given latencies (from the arrival of a request until its result was available).
+    void RecordBatch(const std::vector<double>& latencies_ms);
+
+    size_t num_requests() const;
+    size_t num_batches() const;
+
+    // Returns a human readable summary.
+    std::string ToString() const;
+
+  private:
+    // Percentiles are computed over this many of the most recent requests.
+    static const size_t kLatencyWindow = 10000;
+
+    mutable std::mutex mutex_;
+
+    std::chrono::steady_clock::time_point start_;
+
+    size_t num_requests_;
+    size_t num_batches_;
+
+    double total_latency_ms_;
+    double max_latency_ms_;
+
+    // The latencies of the last kLatencyWindow requests, used as ring buffer once full.
+    std::vector<double> recent_latencies_ms_;
+    size_t next_latency_;
+
+    // Number of batches of every size, indexed by the batch size.
+    std::vector<size_t> batch_sizes_;
+
+    DISALLOW_COPY_AND_ASSIGN(ServerStatistics);
+};
+
+// Serves a model over a Unix domain socket, see the protocol above.
+//
+// Requests arriving on all connections are queued and coalesced into batches: a batch is started as soon as
+// max_batch_size requests are waiting, or once the oldest waiting request has waited for max_wait. This trades
+// a bounded amount of latency for much higher throughput, since evaluating a batch costs little more than
+// evaluating a single sample (e.g. a single transfer to and from the GPU, see Network::EvaluateBatch()).
+class InferenceServer {
+  public:
+    // Commands of the protocol described above.
+    enum Command : uint32_t {
+        kDescribe   = 1,
+        kEvaluate   = 2,
+        kStatistics = 3,
+    };
+
+    // Evaluates a batch. Receives a tensor of shape (batch_size, input shape) and returns a tensor of
+    // shape (batch_size, output shape). Always called from the same thread.
+    typedef std::function<nn::CPUTensor(const nn::CPUTensor&)> BatchFunction;
+
+    InferenceServer(const nn::Shape& input_shape, const nn::Shape& output_shape, BatchFunction evaluate, size_t max_batch_size, std::chrono::microseconds max_wait);
+
+    ~InferenceServer();
+
+    // Creates the socket at the given path, replacing any existing file, and starts listening on it.
+    bool Listen(const std::string& path);
+
+    // Accepts connections and serves requests until Stop() is called. Answers all queued requests before returning.
+    void Run();
+
+    // Makes Run() return. Can be called from other threads and from signal handlers.
+    void Stop() { stop_ = true; }
+
+    const ServerStatistics& statistics() const { return statistics_; }
+
+  private:
+    // A request waiting for its result. Owned by the connection thread, which blocks until |done| is set.
+    struct Request {
+        const float* input;
+        float* output;
+        std::chrono::steady_clock::time_point arrival;
+        bool done;
+    };
+
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> finished;
+    };
+
+    // Reads requests from a connection and writes the replies. Runs on a thread per connection.
+    void ServeConnection(Connection* connection);
+
+    // Forms batches from the queued requests and evaluates them. Runs on the batching thread.
+    void ProcessBatches();
+
+    // Joins the threads of closed connections. If |all| is set, shuts down and joins all connections.
+    void ReapConnections(bool all);
+
+    nn::Shape input_shape_;
+    nn::Shape output_shape_;
+    size_t input_size_, output_size_;
+
+    BatchFunction evaluate_;
+
+    size_t max_batch_size_;
+    std::chrono::microseconds max_wait_;
+
+    // Path and file descriptor of the listening socket.
+    std::string path_;
+    int listen_fd_;
+
+    std::atomic<bool> stop_;
+
+    std::vector<std::unique_ptr<Connection>> connections_;
+
+    // Protects queue_, the done flags of the requests and stopping_.
+    std::mutex mutex_;
+
+    // Signalled when a request is queued or the server stops.
+    std::condition_variable queue_changed_;
+
+    // Signalled when a batch has been evaluated.
+    std::condition_variable batch_done_;
+
+    std::deque<Request*> queue_;
+
+    // Set once no more requests are accepted. The batching thread exits once the queue is empty.
+    bool stopping_;
+
+    std::thread batcher_;
+
+    ServerStatistics statistics_;
+
+    DISALLOW_COPY_AND_ASSIGN(InferenceServer);
+};
+
+// A connection to an InferenceServer.
+class InferenceClient {
+  public:
+    // Connects to the server at the given socket path. Returns nullptr on failure.
+    static std::unique_ptr<InferenceClient> Connect(const std::string& path);
+
+    ~InferenceClient();
+
+    // Returns the number of input and output elements per sample, as reported by the server.
+    size_t input_size() const { return input_size_; }
+    size_t output_size() const { return output_size_; }
+
+    // Evaluates a single sample. |input| must hold input_size() elements, |output| receives output_size() elements.
+    bool Evaluate(const float* input, float* output);
+
+    // Retrieves the statistics of the server.
+    bool Statistics(std::string* text);
+
+  private:
+    explicit InferenceClient(int fd);
+
+    int fd_;
+
+    size_t input_size_, output_size_;
+
+    DISALLOW_COPY_AND_ASSIGN(InferenceClient);
+};
+
+}       // namespace utils
+
+#endif
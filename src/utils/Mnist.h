@@ -7,10 +7,27 @@
 #ifndef __MNIST_H__
 #define __MNIST_H__
 
+#include <memory>
+#include <string>
+
+#include "nn/Dataset.h"
 #include "nn/Tensor.h"
+#include "utils/Idx.h"
 
 namespace utils {
 
+// One MNIST dataset (training or test set), mapped into memory. Samples are only converted to floats when they
+// are loaded, e.g. by a nn::DataLoader. |images| has samples of shape [28, 28] with pixels scaled to [0, 1],
+// |labels| has "one-hot" vectors of size 10 (see LoadMNIST()) and refers to |label_indices|.
+struct MNISTDataset {
+    std::unique_ptr<IdxFile> images;
+    std::unique_ptr<IdxFile> label_indices;
+    std::unique_ptr<nn::OneHotDataset> labels;
+};
+
+// Maps the MNIST training set (if |training| is true) or test set from the provided directory into memory.
+bool OpenMNIST(const std::string& mnist_dir, bool training, MNISTDataset* dataset);
+
 // Load the MNIST training set from the provided directory.
 //
 // Labels are converted to "one-hot" vectors of size 10, with all entries 0 except for the correct entry which will be set to 1.
@@ -1,4 +1,5 @@
 #include <libgen.h>
+#include <cstdlib>
 #include <vector>
 
 #include "utils/OpenCL.h"
@@ -7,7 +8,11 @@
 
 using namespace std;
 
-static cl_device_id ChooseDevice()
+// Returns |count| devices to use. If there are fewer devices than requested, the last device is split into sub-devices.
+//
+// GPUs are used unless $DEEPLEARN_DEVICE_TYPE is "cpu". Splitting a CPU device (e.g. with PoCL) allows testing
+// multi-device training on machines without multiple GPUs.
+static vector<cl_device_id> ChooseDevices(size_t count)
 {
 
     // 1. get all platform IDs
@@ -16,42 +21,103 @@ static cl_device_id ChooseDevice()
     platforms.resize(c_MaxPlatforms);
 
     cl_uint num_platforms;
-    CL_ENSURE_SUCCESS(clGetPlatformIDs(c_MaxPlatforms, &platforms[0], &num_platforms), "Failed to get CL platform ID", nullptr);
+    CL_ENSURE_SUCCESS(clGetPlatformIDs(c_MaxPlatforms, &platforms[0], &num_platforms), "Failed to get CL platform ID", {});
     platforms.resize(num_platforms);
 
-    // 2. find all available GPU devices
+    // 2. find all available devices of the selected type
     vector<cl_device_id> devices;
     const int max_devices = 16;
     devices.resize(max_devices);
     int total_device_count = 0;
 
-    cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+    const char* type = getenv("DEEPLEARN_DEVICE_TYPE");
+    cl_device_type deviceType = type && string(type) == "cpu" ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_GPU;
 
     for (size_t i = 0; i < platforms.size(); i++) {
         cl_uint num_devices_on_platform;
-        clGetDeviceIDs(platforms[i], deviceType, max_devices - total_device_count, &devices[total_device_count], &num_devices_on_platform);
+        if (clGetDeviceIDs(platforms[i], deviceType, max_devices - total_device_count, &devices[total_device_count], &num_devices_on_platform) != CL_SUCCESS)
+            continue;
         total_device_count += num_devices_on_platform;
     }
 
-    FAIL_IF(total_device_count == 0, "No device of the selected type with OpenCL support was found.", nullptr);
+    FAIL_IF(total_device_count == 0, "No device of the selected type with OpenCL support was found.", {});
+    devices.resize(total_device_count);
 
-    // Choosing the last available device, first might be integrated graphics.
-    return devices[total_device_count - 1];
+    // Choosing the last available devices, first might be integrated graphics.
+    if (devices.size() >= count)
+        return vector<cl_device_id>(devices.end() - count, devices.end());
+
+    // 3. not enough devices, partition the last one into |count| sub-devices of equal size
+    cl_device_id parent = devices.back();
+    cl_uint compute_units, max_sub_devices;
+    CL_ENSURE_SUCCESS(clGetDeviceInfo(parent, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL), "Failed to query device information", {});
+    CL_ENSURE_SUCCESS(clGetDeviceInfo(parent, CL_DEVICE_PARTITION_MAX_SUB_DEVICES, sizeof(max_sub_devices), &max_sub_devices, NULL), "Failed to query device information", {});
+    FAIL_IF(max_sub_devices < count || compute_units < count, "Only " << devices.size() << " devices available and the last one can't be split into " << count << " sub-devices", {});
+
+    cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)(compute_units / count), 0 };
+    vector<cl_device_id> sub_devices(compute_units);
+    cl_uint num_sub_devices;
+    CL_ENSURE_SUCCESS(clCreateSubDevices(parent, properties, sub_devices.size(), &sub_devices[0], &num_sub_devices), "Failed to create sub-devices", {});
+
+    // Partitioning might yield a few more sub-devices than needed, these are simply left unused.
+    Assert(num_sub_devices >= count);
+    sub_devices.resize(count);
+    return sub_devices;
 }
 
-bool InitOpenCL()
+// Returns the directory containing the OpenCL kernels.
+static string KernelDirectory()
 {
-    cl_device_id device_id;
+    char filepath[] = __FILE__;                 // must be writable, dirname() takes a "char*", not "const char*"
+    string src_directory(dirname(filepath));
+    return src_directory + "/../kernels/";
+}
 
-    device_id = ChooseDevice();
-    Check(device_id, "No available OpenCL devices");
+nn::GPUContext* CreateGPUContext(cl_device_id device_id)
+{
     ocl::Device* device = new ocl::Device(device_id);
+    nn::GPUContext* context = new nn::GPUContext(device);
 
-    Check(device->Init(), "OpenCL device could not be initialized");
+    // Profiling adds some overhead to every command, so it is only enabled on request.
+    Check(device->Init(getenv("DEEPLEARN_PROFILE") != nullptr), "OpenCL device could not be initialized");
 
     device->PrintDeviceInfo();
 
-    char filepath[] = __FILE__;                 // must be writable, dirname() takes a "char*", not "const char*"
-    string src_directory(dirname(filepath));
-    return nn::GPUContext::Init(device, src_directory + "/../kernels/");
+    // Compiling all kernels takes a while, so reuse the binaries from previous sessions.
+    WARN_IF(!device->EnableProgramCache(ocl::ProgramCache::DefaultDirectory()), "Program cache is not available, compiling all kernels from source");
+
+    // Benchmark kernel launch parameters that haven't been tuned for this device yet.
+    const char* autotune = getenv("DEEPLEARN_AUTOTUNE");
+    context->tuner().set_enabled(autotune && string(autotune) != "0");
+
+    if (!context->Init(KernelDirectory())) {
+        delete context;
+        return nullptr;
+    }
+
+    return context;
+}
+
+bool InitOpenCL()
+{
+    vector<nn::GPUContext*> contexts;
+    return InitOpenCL(1, &contexts);
+}
+
+bool InitOpenCL(size_t num_devices, vector<nn::GPUContext*>* contexts)
+{
+    Assert(num_devices > 0);
+
+    vector<cl_device_id> device_ids = ChooseDevices(num_devices);
+    Check(!device_ids.empty(), "No available OpenCL devices");
+
+    for (cl_device_id device_id : device_ids) {
+        nn::GPUContext* context = CreateGPUContext(device_id);
+        if (!context)
+            return false;
+        contexts->push_back(context);
+    }
+
+    nn::GPUContext::SetDefault(contexts->front());
+    return true;
 }
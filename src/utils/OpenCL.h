@@ -7,7 +7,22 @@
 #ifndef __OPENCL_H__
 #define __OPENCL_H__
 
+#include <vector>
+
+#include "nn/Gpu.h"
+
 // Chooses an available OpenCL device, initializes it and sets it as default device for the nn library.
 bool InitOpenCL();
 
+// Chooses and initializes |num_devices| OpenCL devices, e.g. for data-parallel training (see nn/DataParallel.h).
+//
+// One context per device is appended to |contexts|, the first one becomes the default context. If fewer devices
+// are available, the last device is split into sub-devices. The contexts live until the end of the process.
+bool InitOpenCL(size_t num_devices, std::vector<nn::GPUContext*>* contexts);
+
+// Creates and initializes a new context for the given device. Returns nullptr on failure.
+//
+// Every context has its own OpenCL context and command queue, even if there already is one for the same device.
+nn::GPUContext* CreateGPUContext(cl_device_id device_id);
+
 #endif